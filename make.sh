@@ -110,6 +110,16 @@ if [ $have_pthread -eq 0 ] && [ "$uname" != "Darwin" ]; then
    fi
 fi
 
+# the optional codecs for the replication compression
+if [ -f /usr/include/lz4.h ] || [ -f /usr/local/include/lz4.h ]; then
+  CFLAGS="$CFLAGS -DFS_WITH_LZ4"
+  LIBS="$LIBS -llz4"
+fi
+if [ -f /usr/include/zstd.h ] || [ -f /usr/local/include/zstd.h ]; then
+  CFLAGS="$CFLAGS -DFS_WITH_ZSTD"
+  LIBS="$LIBS -lzstd"
+fi
+
 sed_replace()
 {
     sed_cmd=$1
@@ -137,6 +147,11 @@ cd src/server
 replace_makefile
 make $1 $2
 
+cd tests || exit
+replace_makefile
+make $1 $2
+cd ..
+
 cd ../client
 replace_makefile
 make $1 $2
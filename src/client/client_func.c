@@ -6,8 +6,106 @@
 #include "fs_cluster_cfg.h"
 #include "client_global.h"
 #include "simple_connection_manager.h"
+#include "pooled_connection_manager.h"
+#include "replica_selector.h"
+#include "hedged_read.h"
+#include "topology_subscriber.h"
 #include "client_func.h"
 
+static void load_connection_pool_config(IniContext *iniContext)
+{
+    FSPooledConnectionConfig *config;
+
+    config = &g_fs_client_vars.connection_pool;
+    config->enabled = iniGetBoolValue(NULL, "use_connection_pool",
+            iniContext, true);
+    config->max_count_per_server = iniGetIntValue(NULL,
+            "connection_pool_max_count_per_server", iniContext, 0);
+    if (config->max_count_per_server < 0) {
+        config->max_count_per_server = 0;
+    }
+
+    config->max_idle_time = iniGetIntValue(NULL,
+            "connection_pool_max_idle_time", iniContext,
+            FS_CLIENT_DEFAULT_POOL_MAX_IDLE_TIME);
+    if (config->max_idle_time <= 0) {
+        config->max_idle_time = FS_CLIENT_DEFAULT_POOL_MAX_IDLE_TIME;
+    }
+
+    config->prewarm_count = iniGetIntValue(NULL,
+            "connection_pool_prewarm_count", iniContext,
+            FS_CLIENT_DEFAULT_POOL_PREWARM_COUNT);
+    if (config->prewarm_count < 0) {
+        config->prewarm_count = 0;
+    } else if (config->max_count_per_server > 0 && config->
+            prewarm_count > config->max_count_per_server)
+    {
+        config->prewarm_count = config->max_count_per_server;
+    }
+
+    config->health_check_interval = iniGetIntValue(NULL,
+            "connection_pool_health_check_interval", iniContext,
+            FS_CLIENT_DEFAULT_POOL_HEALTH_CHECK_INTERVAL);
+    if (config->health_check_interval < 0) {
+        config->health_check_interval = 0;
+    }
+
+    config->fail_retry_interval = iniGetIntValue(NULL,
+            "connection_pool_fail_retry_interval", iniContext,
+            FS_CLIENT_DEFAULT_POOL_FAIL_RETRY_INTERVAL);
+    if (config->fail_retry_interval < 0) {
+        config->fail_retry_interval = 0;
+    }
+}
+
+static void load_replica_select_config(IniContext *iniContext)
+{
+    g_fs_client_vars.replica_select.enabled = iniGetBoolValue(NULL,
+            "latency_aware_read", iniContext, true);
+    g_fs_client_vars.replica_select.refresh_interval = iniGetIntValue(NULL,
+            "replica_status_refresh_interval", iniContext,
+            FS_CLIENT_DEFAULT_REPLICA_REFRESH_INTERVAL);
+    if (g_fs_client_vars.replica_select.refresh_interval <= 0) {
+        g_fs_client_vars.replica_select.refresh_interval =
+            FS_CLIENT_DEFAULT_REPLICA_REFRESH_INTERVAL;
+    }
+}
+
+static void load_hedged_read_config(IniContext *iniContext)
+{
+    FSHedgedReadConfig *config;
+
+    config = &g_fs_client_vars.hedged_read;
+    config->enabled = iniGetBoolValue(NULL, "hedged_read",
+            iniContext, false);
+    config->percentile = iniGetIntValue(NULL, "hedged_read_percentile",
+            iniContext, FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE);
+    if (config->percentile <= 0 || config->percentile >= 100) {
+        config->percentile = FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE;
+    }
+
+    config->budget_percent = iniGetIntValue(NULL, "hedged_read_budget",
+            iniContext, FS_CLIENT_DEFAULT_HEDGED_READ_BUDGET_PERCENT);
+    if (config->budget_percent < 0) {
+        config->budget_percent = 0;
+    } else if (config->budget_percent > 100) {
+        config->budget_percent = 100;
+    }
+
+    config->min_delay_ms = iniGetIntValue(NULL, "hedged_read_min_delay",
+            iniContext, FS_CLIENT_DEFAULT_HEDGED_READ_MIN_DELAY_MS);
+    if (config->min_delay_ms <= 0) {
+        config->min_delay_ms = 1;
+    }
+
+    if (config->enabled && !g_fs_client_vars.replica_select.enabled) {
+        logWarning("file: "__FILE__", line: %d, "
+                "hedged_read depends on latency_aware_read, "
+                "disable it", __LINE__);
+        config->enabled = false;
+    }
+}
+
 static int fs_client_do_init_ex(FSClientContext *client_ctx,
         const char *conf_filename, IniContext *iniContext)
 {
@@ -49,6 +147,11 @@ static int fs_client_do_init_ex(FSClientContext *client_ctx,
         g_fs_client_vars.network_timeout = DEFAULT_NETWORK_TIMEOUT;
     }
 
+    load_connection_pool_config(iniContext);
+    load_replica_select_config(iniContext);
+    load_hedged_read_config(iniContext);
+    g_fs_client_vars.topology_subscribe = iniGetBoolValue(NULL,
+            "topology_subscribe", iniContext, false);
     if ((result=fs_cluster_cfg_load_from_ini(&client_ctx->cluster_cfg,
                     iniContext, conf_filename)) != 0)
     {
@@ -60,6 +163,19 @@ static int fs_client_do_init_ex(FSClientContext *client_ctx,
             "base_path: %s, "
             "connect_timeout: %d, "
             "network_timeout: %d, "
+            "use_connection_pool: %d, "
+            "connection_pool_max_count_per_server: %d, "
+            "connection_pool_max_idle_time: %d, "
+            "connection_pool_prewarm_count: %d, "
+            "connection_pool_health_check_interval: %d, "
+            "connection_pool_fail_retry_interval: %d, "
+            "latency_aware_read: %d, "
+            "replica_status_refresh_interval: %d, "
+            "hedged_read: %d, "
+            "hedged_read_percentile: %d, "
+            "hedged_read_budget: %d%%, "
+            "hedged_read_min_delay: %d ms, "
+            "topology_subscribe: %d, "
             "server group count: %d, "
             "data group count: %d",
             g_fs_global_vars.version.major,
@@ -67,6 +183,19 @@ static int fs_client_do_init_ex(FSClientContext *client_ctx,
             g_fs_client_vars.base_path,
             g_fs_client_vars.connect_timeout,
             g_fs_client_vars.network_timeout,
+            g_fs_client_vars.connection_pool.enabled,
+            g_fs_client_vars.connection_pool.max_count_per_server,
+            g_fs_client_vars.connection_pool.max_idle_time,
+            g_fs_client_vars.connection_pool.prewarm_count,
+            g_fs_client_vars.connection_pool.health_check_interval,
+            g_fs_client_vars.connection_pool.fail_retry_interval,
+            g_fs_client_vars.replica_select.enabled,
+            g_fs_client_vars.replica_select.refresh_interval,
+            g_fs_client_vars.hedged_read.enabled,
+            g_fs_client_vars.hedged_read.percentile,
+            g_fs_client_vars.hedged_read.budget_percent,
+            g_fs_client_vars.hedged_read.min_delay_ms,
+            g_fs_client_vars.topology_subscribe,
             FS_SERVER_GROUP_COUNT(client_ctx->cluster_cfg),
             FS_DATA_GROUP_COUNT(client_ctx->cluster_cfg));
 #endif
@@ -108,21 +237,41 @@ int fs_client_init_ex(FSClientContext *client_ctx,
         return result;
     }
 
+    client_ctx->is_simple_conn_mananger = false;
+    client_ctx->is_pooled_conn_mananger = false;
     if (conn_manager == NULL) {
-        if ((result=fs_simple_connection_manager_init(client_ctx,
-                        &client_ctx->conn_manager)) != 0)
-        {
-            return result;
+        if (g_fs_client_vars.connection_pool.enabled) {
+            if ((result=fs_pooled_connection_manager_init(client_ctx,
+                            &client_ctx->conn_manager)) != 0)
+            {
+                return result;
+            }
+            client_ctx->is_pooled_conn_mananger = true;
+        } else {
+            if ((result=fs_simple_connection_manager_init(client_ctx,
+                            &client_ctx->conn_manager)) != 0)
+            {
+                return result;
+            }
+            client_ctx->is_simple_conn_mananger = true;
         }
-        client_ctx->is_simple_conn_mananger = true;
     } else if (conn_manager != &client_ctx->conn_manager) {
         client_ctx->conn_manager = *conn_manager;
-        client_ctx->is_simple_conn_mananger = false;
-    } else {
-        client_ctx->is_simple_conn_mananger = false;
     }
 
+    if (g_fs_client_vars.replica_select.enabled) {
+        if ((result=fs_replica_selector_init(client_ctx)) != 0) {
+            return result;
+        }
+    }
+    fs_hedged_read_init(client_ctx);
+
     srand(time(NULL));
+    if (g_fs_client_vars.topology_subscribe) {
+        if ((result=fs_topology_subscriber_start(client_ctx)) != 0) {
+            return result;
+        }
+    }
     return 0;
 }
 
@@ -132,8 +281,12 @@ void fs_client_destroy_ex(FSClientContext *client_ctx)
         return;
     }
 
+    fs_topology_subscriber_stop(client_ctx);
+    fs_replica_selector_destroy(client_ctx);
     if (client_ctx->is_simple_conn_mananger) {
         fs_simple_connection_manager_destroy(&client_ctx->conn_manager);
+    } else if (client_ctx->is_pooled_conn_mananger) {
+        fs_pooled_connection_manager_destroy(&client_ctx->conn_manager);
     }
     memset(client_ctx, 0, sizeof(FSClientContext));
 }
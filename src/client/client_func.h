@@ -2,6 +2,7 @@
 #ifndef _FS_CLIENT_FUNC_H
 #define _FS_CLIENT_FUNC_H
 
+#include "fastcommon/pthread_func.h"
 #include "fs_global.h"
 #include "client_types.h"
 
@@ -43,6 +44,36 @@ void fs_client_destroy_ex(FSClientContext *client_ctx);
 int fs_alloc_group_servers(FSServerGroup *server_group,
         const int alloc_size);
 
+static inline int fs_master_cache_init(FSClientDataGroupEntry *entry)
+{
+    entry->master_cache.conn = &entry->master_cache.holder;
+    return init_pthread_lock(&entry->master_cache.lock);
+}
+
+//copy out the master cache, the port is 0 when not cached
+static inline void fs_master_cache_get(FSClientDataGroupEntry *entry,
+        ConnectionInfo *conn)
+{
+    PTHREAD_MUTEX_LOCK(&entry->master_cache.lock);
+    *conn = *entry->master_cache.conn;
+    PTHREAD_MUTEX_UNLOCK(&entry->master_cache.lock);
+}
+
+static inline void fs_master_cache_set(FSClientDataGroupEntry *entry,
+        const char *ip_addr, const int port)
+{
+    PTHREAD_MUTEX_LOCK(&entry->master_cache.lock);
+    conn_pool_set_server_info(entry->master_cache.conn, ip_addr, port);
+    PTHREAD_MUTEX_UNLOCK(&entry->master_cache.lock);
+}
+
+static inline void fs_master_cache_clear(FSClientDataGroupEntry *entry)
+{
+    PTHREAD_MUTEX_LOCK(&entry->master_cache.lock);
+    entry->master_cache.conn->port = 0;
+    PTHREAD_MUTEX_UNLOCK(&entry->master_cache.lock);
+}
+
 #ifdef __cplusplus
 }
 #endif
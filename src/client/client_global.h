@@ -5,10 +5,23 @@
 #include "fs_global.h"
 #include "client_types.h"
 
+#define FS_CLIENT_DEFAULT_POOL_MAX_IDLE_TIME           3600
+#define FS_CLIENT_DEFAULT_POOL_PREWARM_COUNT              1
+#define FS_CLIENT_DEFAULT_POOL_HEALTH_CHECK_INTERVAL     30
+#define FS_CLIENT_DEFAULT_POOL_FAIL_RETRY_INTERVAL        3
+#define FS_CLIENT_DEFAULT_REPLICA_REFRESH_INTERVAL       10
+#define FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE         95
+#define FS_CLIENT_DEFAULT_HEDGED_READ_BUDGET_PERCENT      5
+#define FS_CLIENT_DEFAULT_HEDGED_READ_MIN_DELAY_MS        2
+
 typedef struct fs_client_global_vars {
     int connect_timeout;
     int network_timeout;
     char base_path[MAX_PATH_SIZE];
+    FSPooledConnectionConfig connection_pool;
+    FSReplicaSelectConfig replica_select;
+    FSHedgedReadConfig hedged_read;
+    bool topology_subscribe;  //subscribe the data server changes
 
     FSClientContext client_ctx;
 } FSClientGlobalVars;
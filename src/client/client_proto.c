@@ -1,5 +1,6 @@
 #include <sys/stat.h>
 #include <limits.h>
+#include <poll.h>
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
@@ -7,6 +8,8 @@
 #include "fs_proto.h"
 #include "client_global.h"
 #include "client_proto.h"
+#include "replica_selector.h"
+#include "hedged_read.h"
 
 static inline void fs_client_release_connection(
         FSClientContext *client_ctx,
@@ -26,81 +29,155 @@ static inline void proto_pack_block_key(const FSBlockKey *
     long2buff(bkey->offset, proto_bkey->offset);
 }
 
+/* the data version of the update response is an optional trailing field,
+ * return 0 for the old server */
+static inline int64_t get_update_resp_data_version(
+        const FSResponseInfo *response, const FSProtoSliceUpdateResp *resp)
+{
+    return (response->header.body_len == sizeof(FSProtoSliceUpdateResp)) ?
+        buff2long(resp->data_version) : 0;
+}
+
+//the min data version is omitted for any, so the old server accepts it
+static inline int pack_slice_read_min_version(
+        FSProtoSliceReadReqHeader *req_header,
+        const int64_t min_data_version)
+{
+    if (min_data_version > 0) {
+        long2buff(min_data_version, req_header->min_data_version);
+        return sizeof(FSProtoSliceReadReqHeader);
+    } else {
+        return FS_PROTO_SLICE_READ_REQ_MIN_SIZE;
+    }
+}
+
 #define FS_CLIENT_DATA_GROUP_INDEX(hash_code) \
     (hash_code % FS_DATA_GROUP_COUNT(client_ctx->cluster_cfg))
 
-int fs_client_proto_slice_write(FSClientContext *client_ctx,
+/* the chunk requests of a large slice are pipelined on the connection,
+ * so a full block costs one round trip instead of one per chunk.
+ * the responses in flight are drained after an error response to keep
+ * the connection usable */
+static int slice_write_pipeline(ConnectionInfo *conn, const int chunk_size,
         const FSBlockSliceKeyInfo *bs_key, const char *data,
-        int *write_bytes, int *inc_alloc)
+        FSResponseInfo *response, int *write_bytes, int *inc_alloc,
+        int64_t *data_version)
 {
-    ConnectionInfo *conn;
-    const FSConnectionParameters *connection_params;
     char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoSliceWriteReqHeader)];
     FSProtoHeader *proto_header;
     FSProtoSliceWriteReqHeader *req_header;
-    FSResponseInfo response;
+    FSResponseInfo drain_response;
+    FSResponseInfo *resp_info;
     FSProtoSliceUpdateResp resp;
-    int result;
-    int remain;
+    int send_offset;
+    int recv_offset;
+    int inflight;
     int bytes;
-    int i;
+    int result;
+    int r;
 
-    *write_bytes = *inc_alloc = 0;
     proto_header = (FSProtoHeader *)out_buff;
     req_header = (FSProtoSliceWriteReqHeader *)(proto_header + 1);
     proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
-    for (i=0; i<3; i++) {
-        if ((conn=client_ctx->conn_manager.get_master_connection(client_ctx,
-                        FS_CLIENT_DATA_GROUP_INDEX(bs_key->block.hash_code),
-                        &result)) == NULL)
-        {
-            return result;
-        }
-
-        connection_params = client_ctx->conn_manager.get_connection_params(
-                client_ctx, conn);
-        response.error.length = 0;
-        remain = bs_key->slice.length - *write_bytes;
-        while (remain > 0) {
-            if (remain <= connection_params->buffer_size) {
-                bytes = remain;
-            } else {
-                bytes = connection_params->buffer_size;
-            }
 
+    result = 0;
+    inflight = 0;
+    send_offset = recv_offset = *write_bytes;
+    while (1) {
+        while (result == 0 && send_offset < bs_key->slice.length &&
+                inflight < FS_CLIENT_SLICE_PIPELINE_DEPTH)
+        {
+            bytes = FC_MIN(chunk_size, bs_key->slice.length - send_offset);
             FS_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_WRITE_REQ,
                     sizeof(FSProtoSliceWriteReqHeader) + bytes);
-            int2buff(bs_key->slice.offset + *write_bytes,
+            short2buff(FS_PROTO_FLAGS_DATA_VERSION, proto_header->flags);
+            int2buff(bs_key->slice.offset + send_offset,
                     req_header->bs.slice_size.offset);
             int2buff(bytes, req_header->bs.slice_size.length);
 
-            logInfo("sent: %d, current offset: %d, current length: %d",
-                    *write_bytes, bs_key->slice.offset + *write_bytes, bytes);
-
-            if ((result=tcpsenddata_nb(conn->sock, out_buff, sizeof(out_buff),
-                            g_fs_client_vars.network_timeout)) != 0)
-            {
-                break;
-            }
-
-            if ((result=tcpsenddata_nb(conn->sock, (char *)data + *write_bytes,
+            if ((r=tcpsenddata_nb(conn->sock, out_buff, sizeof(out_buff),
+                            g_fs_client_vars.network_timeout)) != 0 ||
+                    (r=tcpsenddata_nb(conn->sock, (char *)data + send_offset,
                             bytes, g_fs_client_vars.network_timeout)) != 0)
             {
-                break;
+                response->error.length = snprintf(response->error.message,
+                        sizeof(response->error.message),
+                        "send data fail, errno: %d, error info: %s",
+                        r, STRERROR(r));
+                return r;
             }
 
-            if ((result=fs_recv_response(conn, &response, g_fs_client_vars.
-                            network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
-                            (char *)&resp, sizeof(FSProtoSliceUpdateResp))) != 0)
-            {
-                break;
-            }
+            send_offset += bytes;
+            inflight++;
+        }
 
+        if (inflight == 0) {
+            break;
+        }
+
+        resp_info = (result == 0) ? response : &drain_response;
+        bytes = FC_MIN(chunk_size, bs_key->slice.length - recv_offset);
+        if ((r=fs_recv_response_ex(conn, resp_info, g_fs_client_vars.
+                        network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
+                        (char *)&resp, FS_PROTO_SLICE_UPDATE_RESP_MIN_SIZE,
+                        sizeof(FSProtoSliceUpdateResp))) != 0)
+        {
+            if (r == EINVAL || is_network_error(r)) {
+                if (resp_info != response) {
+                    *response = *resp_info;
+                }
+                return r;
+            }
+            if (result == 0) {
+                result = r;  //stop sending and drain the in flight
+            }
+        } else if (result == 0) {
             *inc_alloc += buff2int(resp.inc_alloc);
             *write_bytes += bytes;
-            remain -= bytes;
+            if (get_update_resp_data_version(resp_info,
+                        &resp) > *data_version)
+            {
+                *data_version = get_update_resp_data_version(
+                        resp_info, &resp);
+            }
         }
 
+        recv_offset += bytes;
+        inflight--;
+    }
+
+    return result;
+}
+
+int fs_client_proto_slice_write(FSClientContext *client_ctx,
+        const FSBlockSliceKeyInfo *bs_key, const char *data,
+        int *write_bytes, int *inc_alloc)
+{
+    ConnectionInfo *conn;
+    const FSConnectionParameters *connection_params;
+    FSResponseInfo response;
+    int64_t data_version;
+    int data_group_index;
+    int result;
+    int i;
+
+    *write_bytes = *inc_alloc = 0;
+    data_version = 0;
+    data_group_index = FS_CLIENT_DATA_GROUP_INDEX(bs_key->block.hash_code);
+    for (i=0; i<3; i++) {
+        if ((conn=client_ctx->conn_manager.get_master_connection(client_ctx,
+                        data_group_index, &result)) == NULL)
+        {
+            break;
+        }
+
+        connection_params = client_ctx->conn_manager.get_connection_params(
+                client_ctx, conn);
+        response.error.length = 0;
+        result = slice_write_pipeline(conn, connection_params->buffer_size,
+                bs_key, data, &response, write_bytes, inc_alloc,
+                &data_version);
+
         fs_client_release_connection(client_ctx, conn, result);
         if (result != 0) {
             fs_log_network_error(&response, conn, result);
@@ -111,97 +188,442 @@ int fs_client_proto_slice_write(FSClientContext *client_ctx,
         }
     }
 
+    //the written chunks count on the error too
+    if (data_version > 0) {
+        fs_replica_selector_set_data_version(client_ctx,
+                data_group_index, data_version);
+    }
     return result;
 }
 
-int fs_client_proto_slice_read(FSClientContext *client_ctx,
-        const FSBlockSliceKeyInfo *bs_key, char *buff, int *read_bytes)
+static int slice_read_pipeline(ConnectionInfo *conn, const int chunk_size,
+        const FSBlockSliceKeyInfo *bs_key, const int64_t min_data_version,
+        char *buff, FSResponseInfo *response, int *read_bytes)
 {
-    ConnectionInfo *conn;
-    const FSConnectionParameters *connection_params;
     char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoSliceReadReqHeader)];
     FSProtoHeader *proto_header;
     FSProtoSliceReadReqHeader *req_header;
-    FSResponseInfo response;
-    int remain;
+    FSResponseInfo drain_response;
+    FSResponseInfo *resp_info;
+    bool stop;
+    int req_len;
+    int send_offset;
+    int recv_offset;
+    int inflight;
     int curr_len;
     int bytes;
     int result;
-    int i;
+    int r;
 
-    *read_bytes = 0;
     proto_header = (FSProtoHeader *)out_buff;
     req_header = (FSProtoSliceReadReqHeader *)(proto_header + 1);
+    req_len = pack_slice_read_min_version(req_header, min_data_version);
     FS_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_READ_REQ,
-            sizeof(FSProtoSliceReadReqHeader));
+            req_len);
     proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
-    for (i=0; i<3; i++) {
-        if ((conn=client_ctx->conn_manager.get_readable_connection(client_ctx,
-                        FS_CLIENT_DATA_GROUP_INDEX(bs_key->block.hash_code),
-                        &result)) == NULL)
-        {
-            return result;
-        }
-
-        connection_params = client_ctx->conn_manager.get_connection_params(
-                client_ctx, conn);
-        response.error.length = 0;
-        remain = bs_key->slice.length - *read_bytes;
-        while (remain > 0) {
-            if (remain <= connection_params->buffer_size) {
-                curr_len = remain;
-            } else {
-                curr_len = connection_params->buffer_size;
-            }
 
-            int2buff(bs_key->slice.offset + *read_bytes,
+    result = 0;
+    stop = false;  //for the error or the short read
+    inflight = 0;
+    send_offset = recv_offset = *read_bytes;
+    while (1) {
+        while (!stop && send_offset < bs_key->slice.length &&
+                inflight < FS_CLIENT_SLICE_PIPELINE_DEPTH)
+        {
+            curr_len = FC_MIN(chunk_size, bs_key->slice.length - send_offset);
+            int2buff(bs_key->slice.offset + send_offset,
                     req_header->bs.slice_size.offset);
             int2buff(curr_len, req_header->bs.slice_size.length);
 
-            logInfo("recved: %d, current offset: %d, current length: %d",
-                    *read_bytes, bs_key->slice.offset + *read_bytes, curr_len);
-
-            if ((result=fs_send_and_recv_response_header(conn,
-                            out_buff, sizeof(out_buff), &response,
-                            g_fs_client_vars.network_timeout)) != 0)
+            if ((r=tcpsenddata_nb(conn->sock, out_buff, sizeof(FSProtoHeader) +
+                            req_len, g_fs_client_vars.network_timeout)) != 0)
             {
-                break;
+                response->error.length = snprintf(response->error.message,
+                        sizeof(response->error.message),
+                        "send data fail, errno: %d, error info: %s",
+                        r, STRERROR(r));
+                return r;
             }
 
-            if ((result=fs_check_response(conn, &response,
-                            g_fs_client_vars.network_timeout,
-                            FS_SERVICE_PROTO_SLICE_READ_RESP)) != 0)
-            {
-                break;
+            send_offset += curr_len;
+            inflight++;
+        }
+
+        if (inflight == 0) {
+            break;
+        }
+
+        resp_info = stop ? &drain_response : response;
+        curr_len = FC_MIN(chunk_size, bs_key->slice.length - recv_offset);
+        if ((r=fs_recv_response_header(conn, resp_info,
+                        g_fs_client_vars.network_timeout)) != 0)
+        {
+            if (resp_info != response) {
+                *response = *resp_info;
             }
+            return r;
+        }
 
-            if (response.header.body_len > curr_len) {
-                response.error.length = sprintf(response.error.message,
+        if ((r=fs_check_response(conn, resp_info, g_fs_client_vars.
+                        network_timeout, FS_SERVICE_PROTO_SLICE_READ_RESP)) != 0)
+        {
+            if (r == EINVAL || is_network_error(r)) {
+                if (resp_info != response) {
+                    *response = *resp_info;
+                }
+                return r;
+            }
+            if (!stop) {
+                result = r;
+                stop = true;
+            }
+        } else {
+            if (resp_info->header.body_len > curr_len) {
+                response->error.length = sprintf(response->error.message,
                         "reponse body length: %d > slice length: %d",
-                        response.header.body_len, curr_len);
-                result = EINVAL;
-                break;
+                        resp_info->header.body_len, curr_len);
+                return EINVAL;
             }
 
-            if ((result=tcprecvdata_nb_ex(conn->sock, buff + *read_bytes,
-                            response.header.body_len, g_fs_client_vars.
+            if ((r=tcprecvdata_nb_ex(conn->sock, buff + recv_offset,
+                            resp_info->header.body_len, g_fs_client_vars.
                             network_timeout, &bytes)) != 0)
             {
-                response.error.length = snprintf(response.error.message,
-                        sizeof(response.error.message),
+                response->error.length = snprintf(response->error.message,
+                        sizeof(response->error.message),
                         "recv data fail, errno: %d, error info: %s",
-                        result, STRERROR(result));
-                break;
+                        r, STRERROR(r));
+                return r;
+            }
+
+            if (!stop) {
+                *read_bytes += bytes;
+                if (curr_len > bytes) {
+                    stop = true;
+                }
+            }
+        }
+
+        recv_offset += curr_len;
+        inflight--;
+    }
+
+    return result;
+}
+
+static int send_slice_read_request(ConnectionInfo *conn,
+        const FSBlockSliceKeyInfo *bs_key, const int64_t min_data_version,
+        FSResponseInfo *response)
+{
+    char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoSliceReadReqHeader)];
+    FSProtoHeader *proto_header;
+    FSProtoSliceReadReqHeader *req_header;
+    int req_len;
+    int result;
+
+    proto_header = (FSProtoHeader *)out_buff;
+    req_header = (FSProtoSliceReadReqHeader *)(proto_header + 1);
+    req_len = pack_slice_read_min_version(req_header, min_data_version);
+    FS_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_READ_REQ,
+            req_len);
+    proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
+    int2buff(bs_key->slice.offset, req_header->bs.slice_size.offset);
+    int2buff(bs_key->slice.length, req_header->bs.slice_size.length);
+
+    if ((result=tcpsenddata_nb(conn->sock, out_buff, sizeof(FSProtoHeader) +
+                    req_len, g_fs_client_vars.network_timeout)) != 0)
+    {
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "send data fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+    }
+    return result;
+}
+
+static int recv_slice_read_response(ConnectionInfo *conn,
+        const FSBlockSliceKeyInfo *bs_key, char *buff,
+        FSResponseInfo *response, int *read_bytes)
+{
+    int result;
+
+    if ((result=fs_recv_response_header(conn, response,
+                    g_fs_client_vars.network_timeout)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fs_check_response(conn, response, g_fs_client_vars.
+                    network_timeout, FS_SERVICE_PROTO_SLICE_READ_RESP)) != 0)
+    {
+        return result;
+    }
+
+    if (response->header.body_len > bs_key->slice.length) {
+        response->error.length = sprintf(response->error.message,
+                "reponse body length: %d > slice length: %d",
+                response->header.body_len, bs_key->slice.length);
+        return EINVAL;
+    }
+
+    if ((result=tcprecvdata_nb_ex(conn->sock, buff, response->
+                    header.body_len, g_fs_client_vars.network_timeout,
+                    read_bytes)) != 0)
+    {
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "recv data fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+    }
+    return result;
+}
+
+/* return the index of the readable connection, -1 for timeout */
+static int wait_for_response(ConnectionInfo **conns, const int count,
+        const int timeout_ms, FSResponseInfo *response, int *err_no)
+{
+    struct pollfd fds[2];
+    int result;
+    int i;
+
+    for (i=0; i<count; i++) {
+        fds[i].fd = conns[i]->sock;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    while ((result=poll(fds, count, timeout_ms)) < 0 && errno == EINTR) {
+    }
+    if (result < 0) {
+        *err_no = errno != 0 ? errno : EIO;
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "poll fail, errno: %d, error info: %s",
+                *err_no, STRERROR(*err_no));
+        return -1;
+    }
+
+    *err_no = 0;
+    for (i=0; i<count; i++) {
+        if (fds[i].revents != 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* the single request read is sent to another active replica when the
+ * response does not come within the percentile latency, the first
+ * response wins and the connection of the other one is closed.
+ * only the replica which responds gets the latency sample, so this
+ * function calls fs_replica_selector_done for the primary replica too */
+static int slice_read_hedged(FSClientContext *client_ctx,
+        const int data_group_index, FSClientReplicaEntry *replica,
+        ConnectionInfo **conn, const FSBlockSliceKeyInfo *bs_key,
+        const int64_t min_data_version, char *buff,
+        FSResponseInfo *response, int *read_bytes)
+{
+    ConnectionInfo *conns[2];
+    FSClientReplicaEntry *hedge_replica;
+    int64_t start_time_us;
+    int64_t hedge_time_us;
+    int delay_ms;
+    int count;
+    int index;
+    int result;
+
+    start_time_us = get_current_time_us();
+    if ((result=send_slice_read_request(*conn, bs_key,
+                    min_data_version, response)) != 0)
+    {
+        fs_replica_selector_done(replica, 0, result);
+        return result;
+    }
+
+    hedge_time_us = 0;
+    conns[0] = *conn;
+    count = 1;
+    hedge_replica = NULL;
+    if ((delay_ms=fs_hedged_read_get_delay_ms(client_ctx)) > 0) {
+        //just wait for the response when poll fail
+        index = wait_for_response(conns, 1, delay_ms, response, &result);
+        if (index < 0 && result == 0 && fs_hedged_read_acquire(client_ctx) &&
+                (hedge_replica=fs_replica_selector_choose_ex(client_ctx,
+                    data_group_index, replica)) != NULL)
+        {
+            if ((conns[1]=client_ctx->conn_manager.get_spec_connection(
+                            client_ctx, &hedge_replica->conn,
+                            &result)) != NULL)
+            {
+                if ((result=send_slice_read_request(conns[1], bs_key,
+                                min_data_version, response)) == 0)
+                {
+                    fs_replica_selector_begin(hedge_replica);
+                    fs_hedged_read_issued(client_ctx);
+                    hedge_time_us = get_current_time_us();
+                    count = 2;
+                } else {
+                    client_ctx->conn_manager.close_connection(
+                            client_ctx, conns[1]);
+                }
             }
+        }
+    }
+
+    if (count == 1) {
+        index = 0;
+        result = recv_slice_read_response(*conn, bs_key,
+                buff, response, read_bytes);
+        fs_replica_selector_done(replica, get_current_time_us() -
+                start_time_us, result);
+    } else {
+        index = wait_for_response(conns, count, g_fs_client_vars.
+                network_timeout * 1000, response, &result);
+        if (index < 0 && result == 0) {
+            response->error.length = sprintf(response->error.message,
+                    "wait for the hedged read response timeout");
+            fs_replica_selector_done(replica, 0, ETIMEDOUT);
+            fs_replica_selector_done(hedge_replica, 0, ETIMEDOUT);
+            client_ctx->conn_manager.close_connection(client_ctx, conns[1]);
+            return ETIMEDOUT;
+        } else if (index < 0) {
+            index = 0;  //poll fail, wait for the first one
+        }
+
+        result = recv_slice_read_response(conns[index], bs_key,
+                buff, response, read_bytes);
+        if (index == 1) {
+            /* the latency of the primary is unknown, no sample for it
+             * and the result of the hedged one is not its result */
+            fs_hedged_read_won(client_ctx);
+            fs_replica_selector_done(hedge_replica, get_current_time_us() -
+                    hedge_time_us, result);
+            fs_replica_selector_done(replica, 0, ECANCELED);
+        } else {
+            //no latency sample for the hedged one
+            fs_replica_selector_done(replica, get_current_time_us() -
+                    start_time_us, result);
+            fs_replica_selector_done(hedge_replica, 0, ECANCELED);
+        }
+
+        //the response of the other one is still in flight
+        client_ctx->conn_manager.close_connection(
+                client_ctx, conns[1 - index]);
+        *conn = conns[index];
+    }
+
+    //the percentile is of the primary reads, the hedged ones make it lower
+    if (index == 0 && (result == 0 || result == ENOENT)) {
+        fs_hedged_read_add_sample(client_ctx,
+                get_current_time_us() - start_time_us);
+    } else {
+        fs_hedged_read_add_read(client_ctx);
+    }
+    return result;
+}
+
+static ConnectionInfo *get_read_connection(FSClientContext *client_ctx,
+        const int data_group_index, const bool from_master,
+        FSClientReplicaEntry **replica, int *err_no)
+{
+    ConnectionInfo *conn;
+
+    if (from_master) {
+        *replica = NULL;
+        return client_ctx->conn_manager.get_master_connection(
+                client_ctx, data_group_index, err_no);
+    }
+
+    if (g_fs_client_vars.replica_select.enabled && (*replica=
+                fs_replica_selector_choose(client_ctx,
+                    data_group_index)) != NULL)
+    {
+        if ((conn=client_ctx->conn_manager.get_spec_connection(client_ctx,
+                        &(*replica)->conn, err_no)) != NULL)
+        {
+            return conn;
+        }
+
+        //mark the server unavailable on connect fail
+        fs_replica_selector_begin(*replica);
+        fs_replica_selector_done(*replica, 0, *err_no);
+    }
 
-            *read_bytes += bytes;
-            remain -= bytes;
-            if (curr_len > bytes) {
-                break;
+    //let the server choose one
+    *replica = NULL;
+    return client_ctx->conn_manager.get_readable_connection(
+            client_ctx, data_group_index, err_no);
+}
+
+int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
+        const FSBlockSliceKeyInfo *bs_key, const bool read_your_writes,
+        char *buff, int *read_bytes)
+{
+    ConnectionInfo *conn;
+    const FSConnectionParameters *connection_params;
+    FSClientReplicaEntry *replica;
+    FSResponseInfo response;
+    int64_t start_time_us;
+    int64_t min_data_version;
+    int data_group_index;
+    bool from_master;
+    int result;
+    int i;
+
+    *read_bytes = 0;
+    data_group_index = FS_CLIENT_DATA_GROUP_INDEX(bs_key->block.hash_code);
+
+    /* the data version of my writes is remembered by the replica selector,
+     * read from the master directly when it is disabled */
+    from_master = read_your_writes && !g_fs_client_vars.
+        replica_select.enabled;
+    for (i=0; i<3; i++) {
+        if ((conn=get_read_connection(client_ctx, data_group_index,
+                        from_master, &replica, &result)) == NULL)
+        {
+            return result;
+        }
+
+        if (read_your_writes && !from_master) {
+            min_data_version = fs_replica_selector_get_data_version(
+                    client_ctx, data_group_index);
+        } else {
+            min_data_version = 0;
+        }
+
+        if (replica != NULL) {
+            fs_replica_selector_begin(replica);
+        }
+        start_time_us = get_current_time_us();
+        connection_params = client_ctx->conn_manager.get_connection_params(
+                client_ctx, conn);
+        response.error.length = 0;
+        if (replica != NULL && g_fs_client_vars.hedged_read.enabled &&
+                *read_bytes == 0 && bs_key->slice.length <=
+                connection_params->buffer_size)
+        {
+            //the replica is done by slice_read_hedged
+            result = slice_read_hedged(client_ctx, data_group_index,
+                    replica, &conn, bs_key, min_data_version,
+                    buff, &response, read_bytes);
+        } else {
+            result = slice_read_pipeline(conn, connection_params->
+                    buffer_size, bs_key, min_data_version,
+                    buff, &response, read_bytes);
+            if (replica != NULL) {
+                fs_replica_selector_done(replica, get_current_time_us() -
+                        start_time_us, result);
             }
         }
 
         fs_client_release_connection(client_ctx, conn, result);
+        /* the slave has not applied my writes yet,
+         * or the old server rejects the min data version */
+        if ((result == EAGAIN || result == EINVAL) && min_data_version > 0) {
+            from_master = true;
+            continue;
+        }
+
         if (result != 0) {
             fs_log_network_error(&response, conn, result);
         }
@@ -241,14 +663,19 @@ static int fs_client_proto_slice_operate(FSClientContext *client_ctx,
         response.error.length = 0;
         FS_PROTO_SET_HEADER(proto_header, req_cmd,
                 sizeof(FSProtoSliceAllocateReq));
+        short2buff(FS_PROTO_FLAGS_DATA_VERSION, proto_header->flags);
         int2buff(bs_key->slice.offset, req->bs.slice_size.offset);
         int2buff(bs_key->slice.length, req->bs.slice_size.length);
-        if ((result=fs_send_and_recv_response(conn, out_buff,
+        if ((result=fs_send_and_recv_response_ex(conn, out_buff,
                 sizeof(out_buff), &response, g_fs_client_vars.
                 network_timeout, resp_cmd, (char *)&resp,
+                FS_PROTO_SLICE_UPDATE_RESP_MIN_SIZE,
                 sizeof(FSProtoSliceUpdateResp))) == 0)
         {
             *inc_alloc = buff2int(resp.inc_alloc);
+            fs_replica_selector_set_data_version(client_ctx,
+                    FS_CLIENT_DATA_GROUP_INDEX(bs_key->block.hash_code),
+                    get_update_resp_data_version(&response, &resp));
         } else {
             fs_log_network_error(&response, conn, result);
         }
@@ -304,12 +731,17 @@ int fs_client_proto_block_delete(FSClientContext *client_ctx,
         response.error.length = 0;
         FS_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_BLOCK_DELETE_REQ,
                 sizeof(FSProtoBlockDeleteReq));
-        if ((result=fs_send_and_recv_response(conn, out_buff,
+        short2buff(FS_PROTO_FLAGS_DATA_VERSION, proto_header->flags);
+        if ((result=fs_send_and_recv_response_ex(conn, out_buff,
                 sizeof(out_buff), &response, g_fs_client_vars.
                 network_timeout, FS_SERVICE_PROTO_BLOCK_DELETE_RESP,
-                (char *)&resp, sizeof(FSProtoSliceUpdateResp))) == 0)
+                (char *)&resp, FS_PROTO_SLICE_UPDATE_RESP_MIN_SIZE,
+                sizeof(FSProtoSliceUpdateResp))) == 0)
         {
             *dec_alloc = buff2int(resp.inc_alloc);
+            fs_replica_selector_set_data_version(client_ctx,
+                    FS_CLIENT_DATA_GROUP_INDEX(bkey->hash_code),
+                    get_update_resp_data_version(&response, &resp));
         } else {
             fs_log_network_error(&response, conn, result);
         }
@@ -432,8 +864,9 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     FSProtoHeader *header;
     FSProtoClusterStatRespBodyHeader *body_header;
     FSProtoClusterStatRespBodyPart *body_part;
-    FSProtoClusterStatRespBodyPart *body_end;
     FSClientClusterStatEntry *stat;
+    FSClientClusterStatEntry *stat_end;
+    char *p;
     ConnectionInfo *conn;
     char out_buff[sizeof(FSProtoHeader) + 4];
     char fixed_buff[8 * 1024];
@@ -441,7 +874,8 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     FSResponseInfo response;
     int result;
     int out_bytes;
-    int calc_size;
+    int parts_size;
+    int part_size;
 
     if ((conn=client_ctx->conn_manager.get_spec_connection(
                     client_ctx, spec_conn, &result)) == NULL)
@@ -458,6 +892,7 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     }
     FS_PROTO_SET_HEADER(header, FS_SERVICE_PROTO_CLUSTER_STAT_REQ,
             out_bytes - sizeof(FSProtoHeader));
+    short2buff(FS_PROTO_FLAGS_REPLICA_STAT, header->flags);
 
     in_buff = fixed_buff;
     if ((result=fs_send_and_check_response_header(conn, out_buff,
@@ -481,18 +916,27 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     }
 
     body_header = (FSProtoClusterStatRespBodyHeader *)in_buff;
-    body_part = (FSProtoClusterStatRespBodyPart *)(in_buff +
-            sizeof(FSProtoClusterStatRespBodyHeader));
+    part_size = 0;
     if (result == 0) {
         *count = buff2int(body_header->count);
 
-        calc_size = sizeof(FSProtoClusterStatRespBodyHeader) +
-            (*count) * sizeof(FSProtoClusterStatRespBodyPart);
-        if (calc_size != response.header.body_len) {
+        //the old server responds the parts without the replication stat
+        parts_size = response.header.body_len -
+            (int)sizeof(FSProtoClusterStatRespBodyHeader);
+        if (parts_size == (*count) * (int)sizeof(
+                    FSProtoClusterStatRespBodyPart))
+        {
+            part_size = sizeof(FSProtoClusterStatRespBodyPart);
+        } else if (parts_size == (*count) * (int)
+                FS_PROTO_CLUSTER_STAT_RESP_PART_MIN_SIZE)
+        {
+            part_size = FS_PROTO_CLUSTER_STAT_RESP_PART_MIN_SIZE;
+        }
+
+        if (part_size == 0) {
             response.error.length = sprintf(response.error.message,
-                    "response body length: %d != calculate size: %d, "
-                    "server count: %d", response.header.body_len,
-                    calc_size, *count);
+                    "response body length: %d is invalid, "
+                    "server count: %d", response.header.body_len, *count);
             result = EINVAL;
         } else if (size < *count) {
             response.error.length = sprintf(response.error.message,
@@ -507,8 +951,10 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     if (result != 0) {
         fs_log_network_error(&response, conn, result);
     } else {
-        body_end = body_part + (*count);
-        for (stat=stats; body_part<body_end; body_part++, stat++) {
+        p = in_buff + sizeof(FSProtoClusterStatRespBodyHeader);
+        stat_end = stats + (*count);
+        for (stat=stats; stat<stat_end; stat++, p+=part_size) {
+            body_part = (FSProtoClusterStatRespBodyPart *)p;
             stat->data_group_id = buff2int(body_part->data_group_id);
             stat->server_id = buff2int(body_part->server_id);
             stat->is_master = body_part->is_master;
@@ -517,6 +963,15 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
             *(stat->ip_addr + IP_ADDRESS_SIZE - 1) = '\0';
             stat->port = buff2short(body_part->port);
             stat->data_version = buff2long(body_part->data_version);
+            if (part_size == sizeof(FSProtoClusterStatRespBodyPart)) {
+                stat->replica_lag = buff2long(body_part->replica_lag);
+                stat->inflight_count = buff2int(body_part->inflight_count);
+                stat->lagging = body_part->lagging;
+            } else {
+                stat->replica_lag = 0;
+                stat->inflight_count = 0;
+                stat->lagging = false;
+            }
         }
     }
 
@@ -529,3 +984,192 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
 
     return result;
 }
+
+static void service_stat_unpack_disk_io(
+        FSProtoServiceStatRespDiskIO *disk_io,
+        FSClientServiceStatDiskIO *stat)
+{
+    stat->thread_count = buff2int(disk_io->thread_count);
+    stat->queue_depth = buff2int(disk_io->queue_depth);
+    stat->wait_p99 = buff2long(disk_io->wait_p99);
+    stat->service_p50 = buff2long(disk_io->service_p50);
+    stat->service_p99 = buff2long(disk_io->service_p99);
+    stat->service_max = buff2long(disk_io->service_max);
+}
+
+static void service_stat_unpack(FSProtoServiceStatRespBodyHeader *body_header,
+        FSClientServiceStat *stat)
+{
+    FSProtoServiceStatRespDataGroup *dg_part;
+    FSProtoServiceStatRespDisk *disk_part;
+    FSProtoServiceStatRespCommand *cmd_part;
+    FSClientServiceStatDataGroup *dg;
+    FSClientServiceStatDataGroup *dg_end;
+    FSClientServiceStatDisk *disk;
+    FSClientServiceStatDisk *disk_end;
+    FSClientServiceStatCommand *command;
+    FSClientServiceStatCommand *cmd_end;
+    int i;
+
+    stat->server_id = buff2int(body_header->server_id);
+    stat->is_leader = body_header->is_leader;
+    stat->connection.current_count = buff2int(
+            body_header->connection.current_count);
+    stat->connection.max_count = buff2int(body_header->connection.max_count);
+    stat->trunk_io.read_queue_depth = buff2int(
+            body_header->trunk_io.read_queue_depth);
+    stat->trunk_io.write_queue_depth = buff2int(
+            body_header->trunk_io.write_queue_depth);
+    stat->compress.replication_before = buff2long(
+            body_header->compress.replication_before);
+    stat->compress.replication_after = buff2long(
+            body_header->compress.replication_after);
+    stat->compress.fetch_binlog_before = buff2long(
+            body_header->compress.fetch_binlog_before);
+    stat->compress.fetch_binlog_after = buff2long(
+            body_header->compress.fetch_binlog_after);
+
+    dg_part = (FSProtoServiceStatRespDataGroup *)(body_header + 1);
+    dg_end = stat->data_groups.entries + stat->data_groups.count;
+    for (dg=stat->data_groups.entries; dg<dg_end; dg++, dg_part++) {
+        dg->data_group_id = buff2int(dg_part->data_group_id);
+        dg->is_master = dg_part->is_master;
+        dg->status = dg_part->status;
+        dg->data_version = buff2long(dg_part->data_version);
+    }
+
+    disk_part = (FSProtoServiceStatRespDisk *)dg_part;
+    disk_end = stat->disks.entries + stat->disks.count;
+    for (disk=stat->disks.entries; disk<disk_end; disk++, disk_part++) {
+        disk->path_index = buff2int(disk_part->path_index);
+        service_stat_unpack_disk_io(&disk_part->reads, &disk->reads);
+        service_stat_unpack_disk_io(&disk_part->writes, &disk->writes);
+        for (i=0; i<FS_PROTO_DISK_IO_TYPE_COUNT; i++) {
+            disk->types[i].type = disk_part->types[i].type;
+            disk->types[i].ops = buff2long(disk_part->types[i].ops);
+            disk->types[i].bytes = buff2long(disk_part->types[i].bytes);
+            disk->types[i].errors = buff2long(disk_part->types[i].errors);
+        }
+    }
+
+    cmd_part = (FSProtoServiceStatRespCommand *)disk_part;
+    cmd_end = stat->commands.entries + stat->commands.count;
+    for (command=stat->commands.entries; command<cmd_end;
+            command++, cmd_part++)
+    {
+        command->cmd = cmd_part->cmd;
+        command->count = buff2long(cmd_part->count);
+        command->errors = buff2long(cmd_part->errors);
+        command->bytes_in = buff2long(cmd_part->bytes_in);
+        command->bytes_out = buff2long(cmd_part->bytes_out);
+        command->latency.p50 = buff2long(cmd_part->latency.p50);
+        command->latency.p99 = buff2long(cmd_part->latency.p99);
+        command->latency.p999 = buff2long(cmd_part->latency.p999);
+        command->latency.max = buff2long(cmd_part->latency.max);
+    }
+}
+
+int fs_client_proto_service_stat(FSClientContext *client_ctx,
+        const ConnectionInfo *spec_conn, FSClientServiceStat *stat)
+{
+    FSProtoHeader *header;
+    FSProtoServiceStatRespBodyHeader *body_header;
+    ConnectionInfo *conn;
+    char out_buff[sizeof(FSProtoHeader)];
+    char fixed_buff[8 * 1024];
+    char *in_buff;
+    FSResponseInfo response;
+    int result;
+    int data_group_count;
+    int disk_count;
+    int command_count;
+    int calc_size;
+
+    if ((conn=client_ctx->conn_manager.get_spec_connection(
+                    client_ctx, spec_conn, &result)) == NULL)
+    {
+        return result;
+    }
+
+    header = (FSProtoHeader *)out_buff;
+    FS_PROTO_SET_HEADER(header, FS_SERVICE_PROTO_SERVICE_STAT_REQ, 0);
+
+    in_buff = fixed_buff;
+    if ((result=fs_send_and_check_response_header(conn, out_buff,
+                    sizeof(out_buff), &response, g_fs_client_vars.
+                    network_timeout, FS_SERVICE_PROTO_SERVICE_STAT_RESP)) == 0)
+    {
+        if (response.header.body_len < sizeof(
+                    FSProtoServiceStatRespBodyHeader))
+        {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d < expected: %d",
+                    response.header.body_len, (int)sizeof(
+                        FSProtoServiceStatRespBodyHeader));
+            result = EINVAL;
+        } else if (response.header.body_len > sizeof(fixed_buff)) {
+            in_buff = (char *)fc_malloc(response.header.body_len);
+            if (in_buff == NULL) {
+                response.error.length = sprintf(response.error.message,
+                        "malloc %d bytes fail", response.header.body_len);
+                result = ENOMEM;
+            }
+        }
+
+        if (result == 0) {
+            result = tcprecvdata_nb(conn->sock, in_buff,
+                    response.header.body_len, g_fs_client_vars.
+                    network_timeout);
+        }
+    }
+
+    body_header = (FSProtoServiceStatRespBodyHeader *)in_buff;
+    if (result == 0) {
+        data_group_count = buff2int(body_header->data_group_count);
+        disk_count = buff2int(body_header->disk_count);
+        command_count = buff2int(body_header->command_count);
+        calc_size = sizeof(FSProtoServiceStatRespBodyHeader) +
+            data_group_count * sizeof(FSProtoServiceStatRespDataGroup) +
+            disk_count * sizeof(FSProtoServiceStatRespDisk) +
+            command_count * sizeof(FSProtoServiceStatRespCommand);
+        if (calc_size != response.header.body_len) {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d != calculate size: %d, "
+                    "data group count: %d, disk count: %d, "
+                    "command count: %d", response.header.body_len,
+                    calc_size, data_group_count, disk_count,
+                    command_count);
+            result = EINVAL;
+        } else if (stat->data_groups.size < data_group_count ||
+                stat->disks.size < disk_count ||
+                stat->commands.size < command_count)
+        {
+            response.error.length = sprintf(response.error.message,
+                    "data group size %d < %d or disk size %d < %d "
+                    "or command size %d < %d", stat->data_groups.size,
+                    data_group_count, stat->disks.size, disk_count,
+                    stat->commands.size, command_count);
+            result = ENOSPC;
+        }
+    }
+
+    if (result != 0) {
+        stat->data_groups.count = stat->disks.count =
+            stat->commands.count = 0;
+        fs_log_network_error(&response, conn, result);
+    } else {
+        stat->data_groups.count = data_group_count;
+        stat->disks.count = disk_count;
+        stat->commands.count = command_count;
+        service_stat_unpack(body_header, stat);
+    }
+
+    fs_client_release_connection(client_ctx, conn, result);
+    if (in_buff != fixed_buff) {
+        if (in_buff != NULL) {
+            free(in_buff);
+        }
+    }
+
+    return result;
+}
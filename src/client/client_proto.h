@@ -14,8 +14,94 @@ typedef struct fs_client_cluster_stat_entry {
     short port;
     char ip_addr[IP_ADDRESS_SIZE];
     int64_t data_version;
+    int64_t replica_lag;  //reported by the master of the data group
+    int inflight_count;   //reported by the master of the data group
+    bool lagging;
 } FSClientClusterStatEntry;
 
+typedef struct fs_client_service_stat_data_group {
+    int data_group_id;
+    bool is_master;
+    char status;
+    int64_t data_version;
+} FSClientServiceStatDataGroup;
+
+typedef struct fs_client_service_stat_disk_io {
+    int thread_count;
+    int queue_depth;
+    int64_t wait_p99;     //in microseconds
+    int64_t service_p50;  //in microseconds
+    int64_t service_p99;
+    int64_t service_max;
+} FSClientServiceStatDiskIO;
+
+typedef struct fs_client_service_stat_disk {
+    int path_index;
+    FSClientServiceStatDiskIO reads;
+    FSClientServiceStatDiskIO writes;
+    struct {
+        int type;
+        int64_t ops;
+        int64_t bytes;
+        int64_t errors;
+    } types[FS_PROTO_DISK_IO_TYPE_COUNT];
+} FSClientServiceStatDisk;
+
+typedef struct fs_client_service_stat_command {
+    int cmd;
+    int64_t count;
+    int64_t errors;
+    int64_t bytes_in;
+    int64_t bytes_out;
+    struct {
+        int64_t p50;
+        int64_t p99;
+        int64_t p999;
+        int64_t max;
+    } latency;  //in microseconds
+} FSClientServiceStatCommand;
+
+typedef struct fs_client_service_stat {
+    int server_id;
+    bool is_leader;
+
+    struct {
+        int current_count;
+        int max_count;
+    } connection;
+
+    struct {
+        int read_queue_depth;
+        int write_queue_depth;
+    } trunk_io;
+
+    struct {
+        int64_t replication_before;
+        int64_t replication_after;
+        int64_t fetch_binlog_before;
+        int64_t fetch_binlog_after;
+    } compress;
+
+    //the entries arrays are provided by the caller
+    struct {
+        FSClientServiceStatDataGroup *entries;
+        int size;
+        int count;
+    } data_groups;
+
+    struct {
+        FSClientServiceStatDisk *entries;
+        int size;
+        int count;
+    } disks;
+
+    struct {
+        FSClientServiceStatCommand *entries;
+        int size;
+        int count;
+    } commands;
+} FSClientServiceStat;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,8 +110,19 @@ extern "C" {
             const FSBlockSliceKeyInfo *bs_key, const char *buff,
             int *write_bytes, int *inc_alloc);
 
-    int fs_client_proto_slice_read(FSClientContext *client_ctx,
-            const FSBlockSliceKeyInfo *bs_key, char *buff, int *read_bytes);
+    /* read from the active server chosen by the latency. when
+     * read_your_writes is true, the server must have applied the writes
+     * of this client, otherwise the master serves the read */
+    int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
+            const FSBlockSliceKeyInfo *bs_key, const bool read_your_writes,
+            char *buff, int *read_bytes);
+
+    static inline int fs_client_proto_slice_read(FSClientContext *client_ctx,
+            const FSBlockSliceKeyInfo *bs_key, char *buff, int *read_bytes)
+    {
+        return fs_client_proto_slice_read_ex(client_ctx,
+                bs_key, false, buff, read_bytes);
+    }
 
     int fs_client_proto_slice_allocate(FSClientContext *client_ctx,
             const FSBlockSliceKeyInfo *bs_key, int *inc_alloc);
@@ -49,6 +146,9 @@ extern "C" {
             const ConnectionInfo *spec_conn, const int data_group_id,
             FSClientClusterStatEntry *stats, const int size, int *count);
 
+    int fs_client_proto_service_stat(FSClientContext *client_ctx,
+            const ConnectionInfo *spec_conn, FSClientServiceStat *stat);
+
 #ifdef __cplusplus
 }
 #endif
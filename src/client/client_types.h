@@ -1,11 +1,15 @@
 #ifndef _FS_CLIENT_TYPES_H
 #define _FS_CLIENT_TYPES_H
 
+#include <pthread.h>
 #include "fastcommon/common_define.h"
 #include "fastcommon/connection_pool.h"
 #include "fs_types.h"
 #include "fs_cluster_cfg.h"
 
+//the max chunk requests in flight of a large slice read or write
+#define FS_CLIENT_SLICE_PIPELINE_DEPTH  16
+
 struct fs_connection_parameters;
 struct fs_client_context;
 
@@ -30,6 +34,75 @@ typedef struct fs_connection_parameters {
     int data_group_id;  //for master cache
 } FSConnectionParameters;
 
+typedef struct fs_pooled_connection_config {
+    bool enabled;
+    int max_count_per_server;  //0 for no limit
+    int max_idle_time;         //close the idle connection after it
+    int prewarm_count;         //the connections per server at init
+    int health_check_interval; //active test the idle connection
+    int fail_retry_interval;   //fail fast after connect to the server fail
+} FSPooledConnectionConfig;
+
+typedef struct fs_replica_select_config {
+    bool enabled;          //latency aware replica selection for reads
+    int refresh_interval;  //refresh the server status of the data group
+} FSReplicaSelectConfig;
+
+typedef struct fs_client_replica_entry {
+    int server_id;
+    ConnectionInfo conn;              //the service address
+    volatile char status;
+    volatile int inflight_count;      //the reads in flight
+    volatile int64_t latency_ewma_us; //0 for no sample
+    volatile time_t sample_time;      //the time of the last sample
+} FSClientReplicaEntry;
+
+typedef struct fs_client_replica_array {
+    FSClientReplicaEntry *entries;
+    int count;
+    volatile int64_t data_version;  //the max version of my writes
+    volatile time_t refresh_time;
+    pthread_mutex_t lock;  //for the single refresher
+} FSClientReplicaArray;
+
+typedef struct fs_client_replica_selector {
+    FSClientReplicaArray *groups;  //indexed by data group index
+    int count;
+} FSClientReplicaSelector;
+
+#define FS_HEDGED_READ_LATENCY_BUCKETS  32
+
+typedef struct fs_hedged_read_config {
+    bool enabled;
+    int percentile;      //hedge the read slower than this percentile
+    int budget_percent;  //the max hedged reads in percent of the reads
+    int min_delay_ms;    //the min delay before hedging
+} FSHedgedReadConfig;
+
+typedef struct fs_hedged_read_context {
+    /* the latency histogram of the single request reads,
+     * the bucket N for the latency in [2^N - 1, 2^(N+1) - 1) us */
+    volatile int64_t latency_counts[FS_HEDGED_READ_LATENCY_BUCKETS];
+    volatile int64_t sample_count;
+    volatile int delay_us;   //the percentile latency, 0 for no hedging
+    volatile int64_t tokens; //the budget, one hedge costs 100
+
+    struct {
+        volatile int64_t reads;
+        volatile int64_t issued;
+        volatile int64_t won;
+    } stat;
+} FSHedgedReadContext;
+
+typedef struct fs_client_topology_subscriber {
+    pthread_t tid;
+    volatile bool running;
+    volatile bool continue_flag;
+    int server_index;  //the next server to subscribe
+    ConnectionInfo conn;
+    time_t active_test_time;
+} FSClientTopologySubscriber;
+
 typedef struct fs_client_server_entry {
     int server_id;
     ConnectionInfo conn;
@@ -37,10 +110,12 @@ typedef struct fs_client_server_entry {
 } FSClientServerEntry;
 
 typedef struct fs_client_data_group_entry {
-    /* master connection cache */
+    /* master connection cache, changed by the other threads
+     * such as the topology subscriber, so access it with the lock */
     struct {
         ConnectionInfo *conn;
         ConnectionInfo holder;
+        pthread_mutex_t lock;
     } master_cache;
 } FSClientDataGroupEntry;
 
@@ -78,8 +153,12 @@ typedef struct fs_connection_manager {
 typedef struct fs_client_context {
     FSClusterConfig cluster_cfg;
     FSConnectionManager conn_manager;
+    FSClientReplicaSelector replica_selector;
+    FSHedgedReadContext hedged_read;
+    FSClientTopologySubscriber topology_subscriber;
     bool inited;
     bool is_simple_conn_mananger;
+    bool is_pooled_conn_mananger;
 } FSClientContext;
 
 #define FS_CFG_SERVICE_INDEX(client_ctx)  client_ctx->cluster_cfg.service_group_index
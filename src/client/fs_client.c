@@ -145,3 +145,25 @@ int fs_cluster_stat(FSClientContext *client_ctx, const int data_group_id,
 
     return result;
 }
+
+int fs_service_stat(FSClientContext *client_ctx, FCServerInfo *server,
+        FSClientServiceStat *stat)
+{
+    FCAddressPtrArray *addr_ptr_array;
+    FCAddressInfo **addr;
+    FCAddressInfo **end;
+    int result;
+
+    result = ENOENT;
+    addr_ptr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx, server);
+    end = addr_ptr_array->addrs + addr_ptr_array->count;
+    for (addr=addr_ptr_array->addrs; addr<end; addr++) {
+        if ((result=fs_client_proto_service_stat(client_ctx,
+                        &(*addr)->conn, stat)) == 0)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
@@ -8,6 +8,7 @@
 #include "client_func.h"
 #include "client_global.h"
 #include "client_proto.h"
+#include "hedged_read.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -64,6 +65,9 @@ int fs_unlink_file(FSClientContext *client_ctx, const int64_t oid,
 int fs_cluster_stat(FSClientContext *client_ctx, const int data_group_id,
         FSClientClusterStatEntry *stats, const int size, int *count);
 
+int fs_service_stat(FSClientContext *client_ctx, FCServerInfo *server,
+        FSClientServiceStat *stat);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,169 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "hedged_read.h"
+
+//the percentile is calculated every N samples
+#define HEDGED_READ_CALC_INTERVAL     256
+
+//no hedging before the enough samples
+#define HEDGED_READ_MIN_SAMPLES       128
+
+//the counts are halved when reach it, so the old samples fade out
+#define HEDGED_READ_SAMPLE_WINDOW   65536
+
+//the max tokens saved for the burst of the slow reads
+#define HEDGED_READ_MAX_TOKENS       1000
+
+#define HEDGED_READ_TOKEN_COST        100
+
+void fs_hedged_read_init(FSClientContext *client_ctx)
+{
+    memset(&client_ctx->hedged_read, 0, sizeof(FSHedgedReadContext));
+}
+
+static inline int get_bucket_index(const int64_t time_used_us)
+{
+    int index;
+    int64_t value;
+
+    index = 0;
+    value = time_used_us + 1;
+    while (value > 1 && index < FS_HEDGED_READ_LATENCY_BUCKETS - 1) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+}
+
+static void calc_delay(FSHedgedReadContext *ctx)
+{
+    int64_t counts[FS_HEDGED_READ_LATENCY_BUCKETS];
+    int64_t total;
+    int64_t expect;
+    int64_t accumulated;
+    int64_t lower;
+    int64_t upper;
+    int i;
+
+    total = 0;
+    for (i=0; i<FS_HEDGED_READ_LATENCY_BUCKETS; i++) {
+        counts[i] = ctx->latency_counts[i];
+        total += counts[i];
+    }
+    if (total < HEDGED_READ_MIN_SAMPLES) {
+        ctx->delay_us = 0;
+        return;
+    }
+
+    expect = total * g_fs_client_vars.hedged_read.percentile / 100;
+    accumulated = 0;
+    for (i=0; i<FS_HEDGED_READ_LATENCY_BUCKETS; i++) {
+        if (accumulated + counts[i] >= expect) {
+            break;
+        }
+        accumulated += counts[i];
+    }
+    if (i == FS_HEDGED_READ_LATENCY_BUCKETS) {
+        i--;
+    }
+
+    //interpolate in the bucket
+    lower = ((int64_t)1 << i) - 1;
+    upper = ((int64_t)1 << (i + 1)) - 1;
+    if (counts[i] > 0) {
+        ctx->delay_us = lower + (upper - lower) *
+            (expect - accumulated) / counts[i];
+    } else {
+        ctx->delay_us = upper;
+    }
+}
+
+static inline void add_read(FSHedgedReadContext *ctx)
+{
+    __sync_add_and_fetch(&ctx->stat.reads, 1);
+    if (__sync_add_and_fetch(&ctx->tokens, g_fs_client_vars.
+                hedged_read.budget_percent) > HEDGED_READ_MAX_TOKENS)
+    {
+        ctx->tokens = HEDGED_READ_MAX_TOKENS;
+    }
+}
+
+void fs_hedged_read_add_read(FSClientContext *client_ctx)
+{
+    add_read(&client_ctx->hedged_read);
+}
+
+void fs_hedged_read_add_sample(FSClientContext *client_ctx,
+        const int64_t time_used_us)
+{
+    FSHedgedReadContext *ctx;
+    int64_t sample_count;
+    int i;
+
+    ctx = &client_ctx->hedged_read;
+    add_read(ctx);
+    __sync_add_and_fetch(&ctx->latency_counts[
+            get_bucket_index(time_used_us)], 1);
+
+    sample_count = __sync_add_and_fetch(&ctx->sample_count, 1);
+    if (sample_count % HEDGED_READ_CALC_INTERVAL != 0) {
+        return;
+    }
+
+    /* the concurrent samples may be lost by the halving,
+     * it is harmless for the percentile */
+    if (sample_count >= HEDGED_READ_SAMPLE_WINDOW) {
+        for (i=0; i<FS_HEDGED_READ_LATENCY_BUCKETS; i++) {
+            ctx->latency_counts[i] /= 2;
+        }
+        ctx->sample_count = sample_count / 2;
+    }
+    calc_delay(ctx);
+}
+
+int fs_hedged_read_get_delay_ms(FSClientContext *client_ctx)
+{
+    int delay_us;
+    int delay_ms;
+
+    if ((delay_us=client_ctx->hedged_read.delay_us) == 0) {
+        return 0;
+    }
+
+    delay_ms = (delay_us + 999) / 1000;
+    if (delay_ms < g_fs_client_vars.hedged_read.min_delay_ms) {
+        delay_ms = g_fs_client_vars.hedged_read.min_delay_ms;
+    }
+    return delay_ms;
+}
+
+bool fs_hedged_read_acquire(FSClientContext *client_ctx)
+{
+    FSHedgedReadContext *ctx;
+    int64_t tokens;
+
+    ctx = &client_ctx->hedged_read;
+    while ((tokens=ctx->tokens) >= HEDGED_READ_TOKEN_COST) {
+        if (__sync_bool_compare_and_swap(&ctx->tokens, tokens,
+                    tokens - HEDGED_READ_TOKEN_COST))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void fs_hedged_read_get_stat(FSClientContext *client_ctx,
+        FSClientHedgedReadStat *stat)
+{
+    FSHedgedReadContext *ctx;
+
+    ctx = &client_ctx->hedged_read;
+    stat->reads = __sync_add_and_fetch(&ctx->stat.reads, 0);
+    stat->issued = __sync_add_and_fetch(&ctx->stat.issued, 0);
+    stat->won = __sync_add_and_fetch(&ctx->stat.won, 0);
+    stat->delay_us = ctx->delay_us;
+}
@@ -0,0 +1,52 @@
+#ifndef _FS_HEDGED_READ_H
+#define _FS_HEDGED_READ_H
+
+#include "client_global.h"
+
+typedef struct fs_client_hedged_read_stat {
+    int64_t reads;   //the reads which can be hedged
+    int64_t issued;  //the hedged reads sent
+    int64_t won;     //the hedged reads returned first
+    int delay_us;    //the current delay before hedging
+} FSClientHedgedReadStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the single request read is sent to a second active replica when
+ * it does not complete within the configured percentile latency.
+ * the hedged reads are limited by the budget in percent of the reads */
+void fs_hedged_read_init(FSClientContext *client_ctx);
+
+/* add the latency of a read completed by the primary replica */
+void fs_hedged_read_add_sample(FSClientContext *client_ctx,
+        const int64_t time_used_us);
+
+/* add a read without the latency of the primary, such as the hedge won */
+void fs_hedged_read_add_read(FSClientContext *client_ctx);
+
+/* return the delay in ms before hedging, 0 for no hedging */
+int fs_hedged_read_get_delay_ms(FSClientContext *client_ctx);
+
+/* take one hedge from the budget */
+bool fs_hedged_read_acquire(FSClientContext *client_ctx);
+
+static inline void fs_hedged_read_issued(FSClientContext *client_ctx)
+{
+    __sync_add_and_fetch(&client_ctx->hedged_read.stat.issued, 1);
+}
+
+static inline void fs_hedged_read_won(FSClientContext *client_ctx)
+{
+    __sync_add_and_fetch(&client_ctx->hedged_read.stat.won, 1);
+}
+
+void fs_hedged_read_get_stat(FSClientContext *client_ctx,
+        FSClientHedgedReadStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
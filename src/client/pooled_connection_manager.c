@@ -0,0 +1,713 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fc_list.h"
+#include "fastcommon/sched_thread.h"
+#include "client_global.h"
+#include "client_func.h"
+#include "client_proto.h"
+#include "pooled_connection_manager.h"
+
+typedef struct fs_pooled_connection {
+    ConnectionInfo conn;
+    FSConnectionParameters params;
+    time_t last_access_time;
+    struct fs_pooled_server_entry *server;
+    struct fc_list_head dlink;  //for the idle list
+} FSPooledConnection;
+
+typedef struct fs_pooled_server_entry {
+    char ip_addr[IP_ADDRESS_SIZE];
+    int port;
+    int total_count;    //the idle and the in use connections
+    int waiting_count;  //the threads waiting for the max count
+    time_t check_time;  //check the idle connections accessed before it
+    volatile time_t fail_until;     //fail fast after connect fail
+    struct fc_list_head idle_list;  //the tail is the most recent
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct fs_pooled_server_entry *next;  //for hash chain
+} FSPooledServerEntry;
+
+typedef struct fs_pooled_connection_context {
+    FSClientContext *client_ctx;
+    FSPooledConnectionConfig config;
+    struct {
+        FSPooledServerEntry * volatile *buckets;
+        int capacity;
+    } htable;
+    pthread_mutex_t lock;  //for adding the server entry
+    struct {
+        pthread_t tid;
+        volatile bool continue_flag;
+        bool running;
+    } reaper;
+} FSPooledConnectionContext;
+
+//the max interval in seconds to close the expired idle connections
+#define POOLED_REAP_MAX_INTERVAL  60
+
+#define POOLED_CTX(client_ctx) \
+    ((FSPooledConnectionContext *)(client_ctx)->conn_manager.args)
+
+#define CM_DATA_GROUP_ENTRY(client_ctx, data_group_index) \
+    (client_ctx->conn_manager.data_group_array.entries + data_group_index)
+
+static inline unsigned int server_hash_code(const char *ip_addr,
+        const int port)
+{
+    const unsigned char *p;
+    unsigned int hash_code;
+
+    hash_code = port;
+    for (p=(const unsigned char *)ip_addr; *p != '\0'; p++) {
+        hash_code = hash_code * 31 + *p;
+    }
+    return hash_code;
+}
+
+static FSPooledServerEntry *find_server_entry(FSPooledServerEntry *entry,
+        const char *ip_addr, const int port)
+{
+    while (entry != NULL) {
+        if (entry->port == port && strcmp(entry->ip_addr, ip_addr) == 0) {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+static FSPooledServerEntry *get_server_entry(FSPooledConnectionContext *ctx,
+        const char *ip_addr, const int port, int *err_no)
+{
+    FSPooledServerEntry * volatile *bucket;
+    FSPooledServerEntry *entry;
+
+    bucket = ctx->htable.buckets + server_hash_code(ip_addr, port) %
+        ctx->htable.capacity;
+    if ((entry=find_server_entry(*bucket, ip_addr, port)) != NULL) {
+        return entry;
+    }
+
+    PTHREAD_MUTEX_LOCK(&ctx->lock);
+    do {
+        if ((entry=find_server_entry(*bucket, ip_addr, port)) != NULL) {
+            break;
+        }
+
+        entry = (FSPooledServerEntry *)fc_malloc(sizeof(FSPooledServerEntry));
+        if (entry == NULL) {
+            *err_no = ENOMEM;
+            break;
+        }
+        memset(entry, 0, sizeof(FSPooledServerEntry));
+        if ((*err_no=init_pthread_lock(&entry->lock)) != 0 ||
+                (*err_no=pthread_cond_init(&entry->cond, NULL)) != 0)
+        {
+            free(entry);
+            entry = NULL;
+            break;
+        }
+
+        snprintf(entry->ip_addr, sizeof(entry->ip_addr), "%s", ip_addr);
+        entry->port = port;
+        FC_INIT_LIST_HEAD(&entry->idle_list);
+        entry->next = *bucket;
+
+        //the readers search the chain without lock
+        __sync_synchronize();
+        *bucket = entry;
+    } while (0);
+    PTHREAD_MUTEX_UNLOCK(&ctx->lock);
+
+    return entry;
+}
+
+static FSPooledConnection *make_connection(FSPooledConnectionContext *ctx,
+        FSPooledServerEntry *entry, int *err_no)
+{
+    FSPooledConnection *pc;
+
+    pc = (FSPooledConnection *)fc_malloc(sizeof(FSPooledConnection));
+    if (pc == NULL) {
+        *err_no = ENOMEM;
+        return NULL;
+    }
+    memset(pc, 0, sizeof(FSPooledConnection));
+    conn_pool_set_server_info(&pc->conn, entry->ip_addr, entry->port);
+    pc->conn.args = &pc->params;
+    pc->server = entry;
+    FC_INIT_LIST_HEAD(&pc->dlink);
+
+    if ((*err_no=conn_pool_connect_server(&pc->conn, g_fs_client_vars.
+                    connect_timeout)) != 0)
+    {
+        entry->fail_until = get_current_time() +
+            ctx->config.fail_retry_interval;
+        free(pc);
+        return NULL;
+    }
+
+    if ((*err_no=fs_client_proto_join_server(ctx->client_ctx,
+                    &pc->conn, &pc->params)) != 0)
+    {
+        conn_pool_disconnect_server(&pc->conn);
+        free(pc);
+        return NULL;
+    }
+
+    entry->fail_until = 0;
+    return pc;
+}
+
+static void free_connection(FSPooledConnectionContext *ctx,
+        FSPooledConnection *pc, const bool check_others)
+{
+    FSPooledServerEntry *entry;
+
+    entry = pc->server;
+    PTHREAD_MUTEX_LOCK(&entry->lock);
+    entry->total_count--;
+    if (check_others) {
+        /* the other idle connections may be broken too,
+         * such as the server restarted */
+        entry->check_time = get_current_time();
+    }
+    if (entry->waiting_count > 0) {
+        pthread_cond_signal(&entry->cond);
+    }
+    PTHREAD_MUTEX_UNLOCK(&entry->lock);
+
+    conn_pool_disconnect_server(&pc->conn);
+    free(pc);
+}
+
+//call with lock
+static void close_expired_connections(FSPooledConnectionContext *ctx,
+        FSPooledServerEntry *entry, const time_t current_time)
+{
+    FSPooledConnection *pc;
+
+    while (!fc_list_empty(&entry->idle_list)) {
+        pc = fc_list_entry(entry->idle_list.next, FSPooledConnection, dlink);
+        if (current_time - pc->last_access_time < ctx->config.max_idle_time) {
+            break;
+        }
+
+        fc_list_del_init(&pc->dlink);
+        entry->total_count--;
+        conn_pool_disconnect_server(&pc->conn);
+        free(pc);
+    }
+}
+
+static void reap_expired_connections(FSPooledConnectionContext *ctx)
+{
+    FSPooledServerEntry *entry;
+    time_t current_time;
+    int i;
+
+    current_time = get_current_time();
+    for (i=0; i<ctx->htable.capacity; i++) {
+        entry = ctx->htable.buckets[i];
+        while (entry != NULL) {
+            PTHREAD_MUTEX_LOCK(&entry->lock);
+            close_expired_connections(ctx, entry, current_time);
+            PTHREAD_MUTEX_UNLOCK(&entry->lock);
+            entry = entry->next;
+        }
+    }
+}
+
+/* the idle connections of the servers which are no longer accessed
+ * are closed by this thread, such as the servers of the old masters */
+static void *reaper_thread_func(void *arg)
+{
+    FSPooledConnectionContext *ctx;
+    int interval;
+    int seconds;
+
+    ctx = (FSPooledConnectionContext *)arg;
+    interval = ctx->config.max_idle_time / 2;
+    if (interval <= 0) {
+        interval = 1;
+    } else if (interval > POOLED_REAP_MAX_INTERVAL) {
+        interval = POOLED_REAP_MAX_INTERVAL;
+    }
+
+    seconds = 0;
+    while (ctx->reaper.continue_flag) {
+        sleep(1);
+        if (++seconds >= interval) {
+            reap_expired_connections(ctx);
+            seconds = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static inline bool need_health_check(FSPooledConnectionContext *ctx,
+        FSPooledConnection *pc, const time_t current_time)
+{
+    return (pc->last_access_time <= pc->server->check_time) ||
+        (ctx->config.health_check_interval > 0 &&
+         current_time - pc->last_access_time >=
+         ctx->config.health_check_interval);
+}
+
+static ConnectionInfo *get_spec_connection(FSClientContext *client_ctx,
+        const ConnectionInfo *target, int *err_no)
+{
+    FSPooledConnectionContext *ctx;
+    FSPooledServerEntry *entry;
+    FSPooledConnection *pc;
+    FSResponseInfo response;
+    struct timespec ts;
+    time_t current_time;
+    bool need_check;
+
+    ctx = POOLED_CTX(client_ctx);
+    if ((entry=get_server_entry(ctx, target->ip_addr,
+                    target->port, err_no)) == NULL)
+    {
+        return NULL;
+    }
+
+    current_time = get_current_time();
+    if (entry->fail_until > current_time) {
+        *err_no = ECONNREFUSED;
+        return NULL;
+    }
+
+    while (1) {
+        PTHREAD_MUTEX_LOCK(&entry->lock);
+        close_expired_connections(ctx, entry, current_time);
+        if (!fc_list_empty(&entry->idle_list)) {
+            pc = fc_list_entry(entry->idle_list.prev,
+                    FSPooledConnection, dlink);
+            fc_list_del_init(&pc->dlink);
+            need_check = need_health_check(ctx, pc, current_time);
+            PTHREAD_MUTEX_UNLOCK(&entry->lock);
+
+            if (!need_check) {
+                return &pc->conn;
+            }
+            if ((*err_no=fs_active_test(&pc->conn, &response,
+                            g_fs_client_vars.network_timeout)) == 0)
+            {
+                return &pc->conn;
+            }
+
+            free_connection(ctx, pc, true);
+            continue;
+        }
+
+        if (ctx->config.max_count_per_server <= 0 || entry->total_count <
+                ctx->config.max_count_per_server)
+        {
+            entry->total_count++;
+            PTHREAD_MUTEX_UNLOCK(&entry->lock);
+            if ((pc=make_connection(ctx, entry, err_no)) != NULL) {
+                return &pc->conn;
+            }
+
+            PTHREAD_MUTEX_LOCK(&entry->lock);
+            entry->total_count--;
+            if (entry->waiting_count > 0) {
+                pthread_cond_signal(&entry->cond);
+            }
+            PTHREAD_MUTEX_UNLOCK(&entry->lock);
+            return NULL;
+        }
+
+        //wait for the connection released by the other threads
+        ts.tv_sec = get_current_time() + g_fs_client_vars.connect_timeout;
+        ts.tv_nsec = 0;
+        entry->waiting_count++;
+        *err_no = pthread_cond_timedwait(&entry->cond, &entry->lock, &ts);
+        entry->waiting_count--;
+        PTHREAD_MUTEX_UNLOCK(&entry->lock);
+        if (*err_no == ETIMEDOUT) {
+            logError("file: "__FILE__", line: %d, "
+                    "server %s:%u, wait for the idle connection timeout, "
+                    "max connection count: %d", __LINE__, entry->ip_addr,
+                    entry->port, ctx->config.max_count_per_server);
+            return NULL;
+        }
+        current_time = get_current_time();
+    }
+}
+
+static ConnectionInfo *make_connection_by_addrs(FSClientContext *client_ctx,
+        FCAddressPtrArray *addr_array, int *err_no)
+{
+    FCAddressInfo **current;
+    FCAddressInfo **addr;
+    FCAddressInfo **end;
+    ConnectionInfo *conn;
+
+    if (addr_array->count <= 0) {
+        *err_no = ENOENT;
+        return NULL;
+    }
+
+    current = addr_array->addrs + addr_array->index;
+    if ((conn=get_spec_connection(client_ctx, &(*current)->conn,
+                    err_no)) != NULL)
+    {
+        return conn;
+    }
+
+    end = addr_array->addrs + addr_array->count;
+    for (addr=addr_array->addrs; addr<end; addr++) {
+        if (addr == current) {
+            continue;
+        }
+
+        if ((conn=get_spec_connection(client_ctx, &(*addr)->conn,
+                        err_no)) != NULL)
+        {
+            addr_array->index = addr - addr_array->addrs;
+            return conn;
+        }
+    }
+
+    return NULL;
+}
+
+static ConnectionInfo *get_connection(FSClientContext *client_ctx,
+        const int data_group_index, int *err_no)
+{
+    FCServerInfoPtrArray *server_ptr_array;
+    ConnectionInfo *conn;
+    int server_index;
+    int i;
+
+    server_ptr_array = &client_ctx->cluster_cfg.data_groups.mappings
+        [data_group_index].server_group->server_array;
+
+    //the servers failed recently are skipped fast by get_spec_connection
+    server_index = rand() % server_ptr_array->count;
+    for (i=0; i<server_ptr_array->count; i++) {
+        if ((conn=make_connection_by_addrs(client_ctx,
+                        &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx,
+                            server_ptr_array->servers[server_index]),
+                        err_no)) != NULL)
+        {
+            return conn;
+        }
+        server_index = (server_index + 1) % server_ptr_array->count;
+    }
+
+    logError("file: "__FILE__", line: %d, "
+            "data group index: %d, get_connection fail, "
+            "configured server count: %d", __LINE__,
+            data_group_index, server_ptr_array->count);
+    return NULL;
+}
+
+static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
+        const int data_group_index, int *err_no)
+{
+    ConnectionInfo *conn;
+    ConnectionInfo mconn;
+    FSClientServerEntry master;
+
+    fs_master_cache_get(CM_DATA_GROUP_ENTRY(client_ctx,
+                data_group_index), &mconn);
+    if (mconn.port > 0) {
+        if ((conn=get_spec_connection(client_ctx, &mconn, err_no)) != NULL) {
+            ((FSConnectionParameters *)conn->args)->data_group_id =
+                data_group_index + 1;
+            return conn;
+        }
+
+        //the master may be changed, query it again
+        fs_master_cache_clear(CM_DATA_GROUP_ENTRY(client_ctx,
+                    data_group_index));
+    }
+
+    do {
+        if ((*err_no=fs_client_proto_get_master(client_ctx,
+                        data_group_index, &master)) != 0)
+        {
+            break;
+        }
+
+        if ((conn=get_spec_connection(client_ctx, &master.conn,
+                        err_no)) == NULL)
+        {
+            break;
+        }
+
+        ((FSConnectionParameters *)conn->args)->data_group_id =
+            data_group_index + 1;
+        fs_master_cache_set(CM_DATA_GROUP_ENTRY(client_ctx,
+                    data_group_index), conn->ip_addr, conn->port);
+        return conn;
+    } while (0);
+
+    logError("file: "__FILE__", line: %d, "
+            "get_master_connection fail, errno: %d",
+            __LINE__, *err_no);
+    return NULL;
+}
+
+static ConnectionInfo *get_readable_connection(FSClientContext *client_ctx,
+        const int data_group_index, int *err_no)
+{
+    ConnectionInfo *conn;
+    FSClientServerEntry server;
+
+    do {
+        if ((*err_no=fs_client_proto_get_readable_server(client_ctx,
+                        data_group_index, &server)) != 0)
+        {
+            break;
+        }
+
+        if ((conn=get_spec_connection(client_ctx, &server.conn,
+                        err_no)) == NULL)
+        {
+            break;
+        }
+
+        return conn;
+    } while (0);
+
+    logError("file: "__FILE__", line: %d, "
+            "get_readable_connection fail, errno: %d",
+            __LINE__, *err_no);
+    return NULL;
+}
+
+static void release_connection(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
+{
+    FSPooledConnection *pc;
+    FSPooledServerEntry *entry;
+
+    pc = fc_list_entry(conn, FSPooledConnection, conn);
+    pc->params.data_group_id = 0;
+    pc->last_access_time = get_current_time();
+
+    entry = pc->server;
+    PTHREAD_MUTEX_LOCK(&entry->lock);
+    fc_list_add_tail(&pc->dlink, &entry->idle_list);
+    if (entry->waiting_count > 0) {
+        pthread_cond_signal(&entry->cond);
+    }
+    PTHREAD_MUTEX_UNLOCK(&entry->lock);
+}
+
+static void close_connection(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
+{
+    FSPooledConnection *pc;
+
+    pc = fc_list_entry(conn, FSPooledConnection, conn);
+    if (pc->params.data_group_id > 0) {
+        fs_master_cache_clear(CM_DATA_GROUP_ENTRY(client_ctx,
+                    pc->params.data_group_id - 1));
+        pc->params.data_group_id = 0;
+    }
+
+    free_connection(POOLED_CTX(client_ctx), pc, true);
+}
+
+static const struct fs_connection_parameters *get_connection_params(
+        struct fs_client_context *client_ctx, ConnectionInfo *conn)
+{
+    return (FSConnectionParameters *)conn->args;
+}
+
+static int init_data_group_array(FSClientContext *client_ctx,
+        FSClientDataGroupArray *data_group_array)
+{
+    int bytes;
+    int result;
+    FSClientDataGroupEntry *entry;
+    FSClientDataGroupEntry *end;
+
+    data_group_array->count = FS_DATA_GROUP_COUNT(client_ctx->cluster_cfg);
+    bytes = sizeof(FSClientDataGroupEntry) * data_group_array->count;
+    data_group_array->entries = (FSClientDataGroupEntry *)fc_malloc(bytes);
+    if (data_group_array->entries == NULL) {
+        return ENOMEM;
+    }
+    memset(data_group_array->entries, 0, bytes);
+
+    end = data_group_array->entries + data_group_array->count;
+    for (entry=data_group_array->entries; entry<end; entry++) {
+        if ((result=fs_master_cache_init(entry)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static void prewarm_connections(FSPooledConnectionContext *ctx)
+{
+    FCServerInfoArray *server_array;
+    FCServerInfo *server;
+    FCServerInfo *end;
+    FCAddressPtrArray *addr_array;
+    ConnectionInfo *target;
+    FSPooledServerEntry *entry;
+    FSPooledConnection *pc;
+    int connection_count;
+    int result;
+    int i;
+
+    connection_count = 0;
+    server_array = &ctx->client_ctx->cluster_cfg.server_cfg.
+        sorted_server_arrays;
+    end = server_array->servers + server_array->count;
+    for (server=server_array->servers; server<end; server++) {
+        addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(ctx->client_ctx, server);
+        if (addr_array->count <= 0) {
+            continue;
+        }
+
+        target = &addr_array->addrs[addr_array->index]->conn;
+        if ((entry=get_server_entry(ctx, target->ip_addr,
+                        target->port, &result)) == NULL)
+        {
+            return;
+        }
+
+        for (i=0; i<ctx->config.prewarm_count; i++) {
+            entry->total_count++;
+            if ((pc=make_connection(ctx, entry, &result)) == NULL) {
+                entry->total_count--;
+                logWarning("file: "__FILE__", line: %d, "
+                        "prewarm connection to server id: %d, %s:%u fail, "
+                        "errno: %d, error info: %s", __LINE__, server->id,
+                        target->ip_addr, target->port, result,
+                        STRERROR(result));
+                break;
+            }
+
+            pc->last_access_time = get_current_time();
+            fc_list_add_tail(&pc->dlink, &entry->idle_list);
+            connection_count++;
+        }
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "prewarm %d connections of %d servers", __LINE__,
+            connection_count, server_array->count);
+}
+
+int fs_pooled_connection_manager_init_ex(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager,
+        const FSPooledConnectionConfig *config)
+{
+    FSPooledConnectionContext *ctx;
+    int bytes;
+    int result;
+
+    if ((result=init_data_group_array(client_ctx, &conn_manager->
+                    data_group_array)) != 0)
+    {
+        return result;
+    }
+
+    ctx = (FSPooledConnectionContext *)fc_malloc(
+            sizeof(FSPooledConnectionContext));
+    if (ctx == NULL) {
+        return ENOMEM;
+    }
+    memset(ctx, 0, sizeof(FSPooledConnectionContext));
+    if ((result=init_pthread_lock(&ctx->lock)) != 0) {
+        return result;
+    }
+
+    ctx->client_ctx = client_ctx;
+    ctx->config = *config;
+    ctx->htable.capacity = 4 * FC_SID_SERVER_COUNT(client_ctx->
+            cluster_cfg.server_cfg);
+    if (ctx->htable.capacity < 64) {
+        ctx->htable.capacity = 64;
+    }
+    bytes = sizeof(FSPooledServerEntry *) * ctx->htable.capacity;
+    ctx->htable.buckets = (FSPooledServerEntry * volatile *)fc_malloc(bytes);
+    if (ctx->htable.buckets == NULL) {
+        return ENOMEM;
+    }
+    memset((void *)ctx->htable.buckets, 0, bytes);
+
+    conn_manager->args = ctx;
+    conn_manager->get_connection = get_connection;
+    conn_manager->get_spec_connection = get_spec_connection;
+    conn_manager->get_master_connection = get_master_connection;
+    conn_manager->get_readable_connection = get_readable_connection;
+    conn_manager->release_connection = release_connection;
+    conn_manager->close_connection = close_connection;
+    conn_manager->get_connection_params = get_connection_params;
+
+    if (ctx->config.prewarm_count > 0) {
+        prewarm_connections(ctx);
+    }
+
+    ctx->reaper.continue_flag = true;
+    if ((result=fc_create_thread(&ctx->reaper.tid, reaper_thread_func,
+                    ctx, 64 * 1024)) != 0)
+    {
+        ctx->reaper.continue_flag = false;
+        return result;
+    }
+    ctx->reaper.running = true;
+    return 0;
+}
+
+void fs_pooled_connection_manager_destroy(FSConnectionManager *conn_manager)
+{
+    FSPooledConnectionContext *ctx;
+    FSPooledServerEntry *entry;
+    FSPooledServerEntry *deleted;
+    FSPooledConnection *pc;
+    int i;
+
+    if (conn_manager->args == NULL) {
+        return;
+    }
+
+    //the connections in use should be closed or released by the caller
+    ctx = (FSPooledConnectionContext *)conn_manager->args;
+    if (ctx->reaper.running) {
+        ctx->reaper.continue_flag = false;
+        pthread_join(ctx->reaper.tid, NULL);
+        ctx->reaper.running = false;
+    }
+
+    for (i=0; i<ctx->htable.capacity; i++) {
+        entry = ctx->htable.buckets[i];
+        while (entry != NULL) {
+            while (!fc_list_empty(&entry->idle_list)) {
+                pc = fc_list_entry(entry->idle_list.next,
+                        FSPooledConnection, dlink);
+                fc_list_del_init(&pc->dlink);
+                conn_pool_disconnect_server(&pc->conn);
+                free(pc);
+            }
+
+            deleted = entry;
+            entry = entry->next;
+            pthread_cond_destroy(&deleted->cond);
+            pthread_mutex_destroy(&deleted->lock);
+            free(deleted);
+        }
+    }
+
+    free((void *)ctx->htable.buckets);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+    conn_manager->args = NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef _FS_POOLED_CONNECTION_MANAGER_H
+#define _FS_POOLED_CONNECTION_MANAGER_H
+
+#include "client_global.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the connection manager keeps multiple reusable connections per server
+ * for the multi-threaded clients. the idle connections are closed after
+ * max_idle_time by a reaper thread or on the next access, and are checked
+ * by active test before reuse when idle for health_check_interval or a
+ * connection to the same server failed.
+ * the server is skipped for fail_retry_interval after connect fail */
+int fs_pooled_connection_manager_init_ex(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager,
+        const FSPooledConnectionConfig *config);
+
+static inline int fs_pooled_connection_manager_init(
+        FSClientContext *client_ctx, FSConnectionManager *conn_manager)
+{
+    return fs_pooled_connection_manager_init_ex(client_ctx, conn_manager,
+            &g_fs_client_vars.connection_pool);
+}
+
+void fs_pooled_connection_manager_destroy(FSConnectionManager *conn_manager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
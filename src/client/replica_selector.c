@@ -0,0 +1,282 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "client_global.h"
+#include "client_proto.h"
+#include "replica_selector.h"
+
+//the weight of the history is (N - 1) / N
+#define REPLICA_EWMA_WEIGHT  8
+
+static int init_replica_array(FSClientContext *client_ctx,
+        const int data_group_index, FSClientReplicaArray *group)
+{
+    FCServerInfoPtrArray *server_ptr_array;
+    FCServerInfo **server;
+    FCAddressPtrArray *addr_array;
+    FSClientReplicaEntry *entry;
+    int result;
+    int bytes;
+
+    server_ptr_array = &client_ctx->cluster_cfg.data_groups.mappings
+        [data_group_index].server_group->server_array;
+    bytes = sizeof(FSClientReplicaEntry) * server_ptr_array->count;
+    group->entries = (FSClientReplicaEntry *)fc_malloc(bytes);
+    if (group->entries == NULL) {
+        return ENOMEM;
+    }
+    memset(group->entries, 0, bytes);
+
+    if ((result=init_pthread_lock(&group->lock)) != 0) {
+        return result;
+    }
+
+    entry = group->entries;
+    for (server=server_ptr_array->servers; server<server_ptr_array->
+            servers + server_ptr_array->count; server++)
+    {
+        addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx, *server);
+        if (addr_array->count <= 0) {
+            continue;
+        }
+
+        entry->server_id = (*server)->id;
+        conn_pool_set_server_info(&entry->conn, addr_array->addrs[0]->
+                conn.ip_addr, addr_array->addrs[0]->conn.port);
+        entry->status = FS_SERVER_STATUS_INIT;
+        entry++;
+    }
+    group->count = entry - group->entries;
+    group->refresh_time = 0;
+    return 0;
+}
+
+int fs_replica_selector_init(FSClientContext *client_ctx)
+{
+    FSClientReplicaSelector *selector;
+    int bytes;
+    int result;
+    int i;
+
+    selector = &client_ctx->replica_selector;
+    selector->count = FS_DATA_GROUP_COUNT(client_ctx->cluster_cfg);
+    bytes = sizeof(FSClientReplicaArray) * selector->count;
+    selector->groups = (FSClientReplicaArray *)fc_malloc(bytes);
+    if (selector->groups == NULL) {
+        return ENOMEM;
+    }
+    memset(selector->groups, 0, bytes);
+
+    for (i=0; i<selector->count; i++) {
+        if ((result=init_replica_array(client_ctx, i,
+                        selector->groups + i)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+void fs_replica_selector_destroy(FSClientContext *client_ctx)
+{
+    FSClientReplicaSelector *selector;
+    int i;
+
+    selector = &client_ctx->replica_selector;
+    if (selector->groups == NULL) {
+        return;
+    }
+
+    for (i=0; i<selector->count; i++) {
+        if (selector->groups[i].entries != NULL) {
+            free(selector->groups[i].entries);
+            pthread_mutex_destroy(&selector->groups[i].lock);
+        }
+    }
+    free(selector->groups);
+    selector->groups = NULL;
+    selector->count = 0;
+}
+
+static int refresh_replica_status(FSClientContext *client_ctx,
+        const int data_group_index, FSClientReplicaArray *group)
+{
+    FSClientClusterStatEntry stats[FS_MAX_GROUP_SERVERS];
+    FSClientClusterStatEntry *stat;
+    FSClientClusterStatEntry *send;
+    FSClientReplicaEntry *entry;
+    FSClientReplicaEntry *end;
+    int start;
+    int count;
+    int result;
+    int i;
+
+    if (group->count == 0) {
+        return ENOENT;
+    }
+
+    //ask the servers of the data group one by one until success
+    result = ENOENT;
+    count = 0;
+    start = rand() % group->count;
+    for (i=0; i<group->count; i++) {
+        entry = group->entries + (start + i) % group->count;
+        if ((result=fs_client_proto_cluster_stat(client_ctx, &entry->conn,
+                        data_group_index + 1, stats, FS_MAX_GROUP_SERVERS,
+                        &count)) == 0)
+        {
+            break;
+        }
+    }
+
+    if (result != 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, refresh the server status fail, "
+                "errno: %d, error info: %s", __LINE__,
+                data_group_index + 1, result, STRERROR(result));
+        return result;
+    }
+
+    send = stats + count;
+    end = group->entries + group->count;
+    for (entry=group->entries; entry<end; entry++) {
+        for (stat=stats; stat<send; stat++) {
+            if (stat->server_id == entry->server_id) {
+                break;
+            }
+        }
+        entry->status = (stat < send) ? stat->status :
+            FS_SERVER_STATUS_OFFLINE;
+    }
+
+    return 0;
+}
+
+static inline int64_t replica_cost(FSClientReplicaEntry *entry,
+        const time_t current_time)
+{
+    int64_t latency;
+
+    /* the latency of the server not chosen for a while is unknown,
+     * make it attractive to take a new sample */
+    if (current_time - entry->sample_time > g_fs_client_vars.
+            replica_select.refresh_interval)
+    {
+        latency = 0;
+    } else {
+        latency = entry->latency_ewma_us;
+    }
+    return (latency + 1) * (entry->inflight_count + 1);
+}
+
+FSClientReplicaEntry *fs_replica_selector_choose_ex(FSClientContext
+        *client_ctx, const int data_group_index,
+        const FSClientReplicaEntry *exclude)
+{
+    FSClientReplicaArray *group;
+    FSClientReplicaEntry *actives[FS_MAX_GROUP_SERVERS];
+    FSClientReplicaEntry *entry;
+    FSClientReplicaEntry *end;
+    FSClientReplicaEntry *first;
+    FSClientReplicaEntry *second;
+    time_t current_time;
+    int active_count;
+    int index1;
+    int index2;
+
+    group = client_ctx->replica_selector.groups + data_group_index;
+    current_time = get_current_time();
+    /* only one thread refreshes the status, the others choose
+     * by the stale status without waiting for the cluster stat */
+    if (current_time - group->refresh_time >= g_fs_client_vars.
+            replica_select.refresh_interval &&
+            pthread_mutex_trylock(&group->lock) == 0)
+    {
+        if (current_time - group->refresh_time >= g_fs_client_vars.
+                replica_select.refresh_interval)
+        {
+            /* set the refresh time on fail too,
+             * the caller falls back to the server selection */
+            refresh_replica_status(client_ctx, data_group_index, group);
+            group->refresh_time = get_current_time();
+        }
+        PTHREAD_MUTEX_UNLOCK(&group->lock);
+    }
+
+    active_count = 0;
+    end = group->entries + group->count;
+    for (entry=group->entries; entry<end; entry++) {
+        if (entry->status == FS_SERVER_STATUS_ACTIVE && entry != exclude) {
+            actives[active_count++] = entry;
+        }
+    }
+
+    if (active_count == 0) {
+        return NULL;
+    } else if (active_count == 1) {
+        return actives[0];
+    }
+
+    index1 = rand() % active_count;
+    index2 = rand() % (active_count - 1);
+    if (index2 >= index1) {
+        index2++;
+    }
+
+    first = actives[index1];
+    second = actives[index2];
+    return (replica_cost(second, current_time) < replica_cost(
+                first, current_time)) ? second : first;
+}
+
+void fs_replica_selector_done(FSClientReplicaEntry *replica,
+        const int64_t time_used_us, const int result)
+{
+    time_t current_time;
+    int64_t old_latency;
+
+    __sync_sub_and_fetch(&replica->inflight_count, 1);
+    if (result == 0 || result == ENOENT) {
+        current_time = get_current_time();
+        old_latency = replica->latency_ewma_us;
+        if (old_latency == 0 || current_time - replica->sample_time >
+                g_fs_client_vars.replica_select.refresh_interval)
+        {
+            replica->latency_ewma_us = time_used_us;
+        } else {
+            replica->latency_ewma_us = old_latency + (time_used_us -
+                    old_latency) / REPLICA_EWMA_WEIGHT;
+        }
+        replica->sample_time = current_time;
+    } else if (is_network_error(result)) {
+        //skip the server until the next status refresh
+        replica->status = FS_SERVER_STATUS_OFFLINE;
+    }
+}
+
+void fs_replica_selector_set_data_version(FSClientContext *client_ctx,
+        const int data_group_index, const int64_t data_version)
+{
+    FSClientReplicaArray *group;
+    int64_t old_version;
+
+    if (client_ctx->replica_selector.groups == NULL) {
+        return;
+    }
+
+    group = client_ctx->replica_selector.groups + data_group_index;
+    while ((old_version=__sync_add_and_fetch(&group->data_version, 0)) <
+            data_version)
+    {
+        if (__sync_bool_compare_and_swap(&group->data_version,
+                    old_version, data_version))
+        {
+            break;
+        }
+    }
+}
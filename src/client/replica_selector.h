@@ -0,0 +1,56 @@
+#ifndef _FS_REPLICA_SELECTOR_H
+#define _FS_REPLICA_SELECTOR_H
+
+#include "client_global.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the reads are routed to the active servers of the data group by
+ * power of two choices: pick two servers by random and choose the one
+ * with the lower EWMA latency multiplied by the reads in flight.
+ * the server status is refreshed every refresh_interval seconds by one
+ * of the callers, and the others choose by the stale status meanwhile */
+int fs_replica_selector_init(FSClientContext *client_ctx);
+
+void fs_replica_selector_destroy(FSClientContext *client_ctx);
+
+/* choose one except the exclude, return NULL when no active server known */
+FSClientReplicaEntry *fs_replica_selector_choose_ex(FSClientContext
+        *client_ctx, const int data_group_index,
+        const FSClientReplicaEntry *exclude);
+
+static inline FSClientReplicaEntry *fs_replica_selector_choose(
+        FSClientContext *client_ctx, const int data_group_index)
+{
+    return fs_replica_selector_choose_ex(client_ctx, data_group_index, NULL);
+}
+
+static inline void fs_replica_selector_begin(FSClientReplicaEntry *replica)
+{
+    __sync_add_and_fetch(&replica->inflight_count, 1);
+}
+
+void fs_replica_selector_done(FSClientReplicaEntry *replica,
+        const int64_t time_used_us, const int result);
+
+/* remember the data version of my write for read your writes */
+void fs_replica_selector_set_data_version(FSClientContext *client_ctx,
+        const int data_group_index, const int64_t data_version);
+
+static inline int64_t fs_replica_selector_get_data_version(
+        FSClientContext *client_ctx, const int data_group_index)
+{
+    if (client_ctx->replica_selector.groups == NULL) {
+        return 0;
+    }
+    return __sync_add_and_fetch(&client_ctx->replica_selector.
+            groups[data_group_index].data_version, 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -101,9 +101,8 @@ static ConnectionInfo *get_connection(FSClientContext *client_ctx,
     return NULL;
 }
 
-#define CM_MASTER_CACHE_CONN(client_ctx, data_group_index) \
-    (client_ctx->conn_manager.data_group_array.entries[data_group_index]. \
-     master_cache.conn)
+#define CM_DATA_GROUP_ENTRY(client_ctx, data_group_index) \
+    (client_ctx->conn_manager.data_group_array.entries + data_group_index)
 
 static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
         const int data_group_index, int *err_no)
@@ -112,7 +111,8 @@ static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
     ConnectionInfo mconn;
     FSClientServerEntry master;
 
-    mconn = *CM_MASTER_CACHE_CONN(client_ctx, data_group_index);
+    fs_master_cache_get(CM_DATA_GROUP_ENTRY(client_ctx,
+                data_group_index), &mconn);
     if (mconn.port > 0) {
         if ((conn=get_spec_connection(client_ctx, &mconn, err_no)) != NULL) {
             ((FSConnectionParameters *)conn->args)->data_group_id =
@@ -136,7 +136,7 @@ static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
 
         ((FSConnectionParameters *)conn->args)->data_group_id =
             data_group_index + 1;
-        conn_pool_set_server_info(CM_MASTER_CACHE_CONN(client_ctx,
+        fs_master_cache_set(CM_DATA_GROUP_ENTRY(client_ctx,
                     data_group_index), conn->ip_addr, conn->port);
         return conn;
     } while (0);
@@ -193,7 +193,8 @@ static void close_connection(FSClientContext *client_ctx,
         int data_group_index;
         data_group_index = ((FSConnectionParameters *)conn->args)->
             data_group_id - 1;
-        CM_MASTER_CACHE_CONN(client_ctx, data_group_index)->port = 0;
+        fs_master_cache_clear(CM_DATA_GROUP_ENTRY(client_ctx,
+                    data_group_index));
         ((FSConnectionParameters *)conn->args)->data_group_id = 0;
     }
 
@@ -230,6 +231,7 @@ static int init_data_group_array(FSClientContext *client_ctx,
         FSClientDataGroupArray *data_group_array)
 {
     int bytes;
+    int result;
     FSClientDataGroupEntry *entry;
     FSClientDataGroupEntry *end;
 
@@ -243,7 +245,9 @@ static int init_data_group_array(FSClientContext *client_ctx,
 
     end = data_group_array->entries + data_group_array->count;
     for (entry=data_group_array->entries; entry<end; entry++) {
-        entry->master_cache.conn = &entry->master_cache.holder;
+        if ((result=fs_master_cache_init(entry)) != 0) {
+            return result;
+        }
     }
 
     return 0;
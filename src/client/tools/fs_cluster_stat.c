@@ -12,7 +12,7 @@
 static void usage(char *argv[])
 {
     fprintf(stderr, "Usage: %s [-c config_filename=/etc/fstore/client.conf] "
-            "[-g data_group_id=0]\n", argv[0]);
+            "[-g data_group_id=0] [-s for service stat]\n", argv[0]);
 }
 
 static void output(FSClientClusterStatEntry *stats, const int count)
@@ -35,7 +35,7 @@ static void output(FSClientClusterStatEntry *stats, const int count)
         printf( "\tserver_id: %d, host: %s:%d, "
                 "status: %d (%s), "
                 "is_master: %d, "
-                "data_version: %"PRId64"\n",
+                "data_version: %"PRId64,
                 stat->server_id,
                 stat->ip_addr, stat->port,
                 stat->status,
@@ -43,16 +43,136 @@ static void output(FSClientClusterStatEntry *stats, const int count)
                 stat->is_master,
                 stat->data_version
               );
+        if (stat->replica_lag > 0 || stat->inflight_count > 0 ||
+                stat->lagging)
+        {
+            printf(", replica_lag: %"PRId64", inflight_count: %d, "
+                    "lagging: %d", stat->replica_lag,
+                    stat->inflight_count, stat->lagging);
+        }
+        printf("\n");
     }
     printf("\nserver count: %d\n\n", count);
 }
 
+static void output_service_stat(FSClientServiceStat *stat)
+{
+    FSClientServiceStatDataGroup *dg;
+    FSClientServiceStatDataGroup *dg_end;
+    FSClientServiceStatDisk *disk;
+    FSClientServiceStatDisk *disk_end;
+    FSClientServiceStatCommand *command;
+    FSClientServiceStatCommand *cmd_end;
+    int i;
+
+    printf("\nserver_id: %d, is_leader: %d\n", stat->server_id,
+            stat->is_leader);
+    printf("\tconnection: {current: %d, max: %d}\n",
+            stat->connection.current_count, stat->connection.max_count);
+    printf("\ttrunk_io queue depth: {read: %d, write: %d}\n",
+            stat->trunk_io.read_queue_depth,
+            stat->trunk_io.write_queue_depth);
+    printf("\tcompress bytes: {replication: %"PRId64" => %"PRId64", "
+            "fetch_binlog: %"PRId64" => %"PRId64"}\n",
+            stat->compress.replication_before,
+            stat->compress.replication_after,
+            stat->compress.fetch_binlog_before,
+            stat->compress.fetch_binlog_after);
+
+    dg_end = stat->data_groups.entries + stat->data_groups.count;
+    for (dg=stat->data_groups.entries; dg<dg_end; dg++) {
+        printf("\tdata_group_id: %d, is_master: %d, status: %d (%s), "
+                "data_version: %"PRId64"\n", dg->data_group_id,
+                dg->is_master, dg->status,
+                fs_get_server_status_caption(dg->status),
+                dg->data_version);
+    }
+
+    disk_end = stat->disks.entries + stat->disks.count;
+    for (disk=stat->disks.entries; disk<disk_end; disk++) {
+        printf("\tdisk path_index: %d, latency us: read {threads: %d, "
+                "queue depth: %d, wait p99: %"PRId64", service p50: "
+                "%"PRId64", p99: %"PRId64", max: %"PRId64"}, "
+                "write {threads: %d, queue depth: %d, wait p99: %"PRId64", "
+                "service p50: %"PRId64", p99: %"PRId64", max: %"PRId64"}\n",
+                disk->path_index, disk->reads.thread_count,
+                disk->reads.queue_depth, disk->reads.wait_p99,
+                disk->reads.service_p50, disk->reads.service_p99,
+                disk->reads.service_max, disk->writes.thread_count,
+                disk->writes.queue_depth, disk->writes.wait_p99,
+                disk->writes.service_p50, disk->writes.service_p99,
+                disk->writes.service_max);
+        for (i=0; i<FS_PROTO_DISK_IO_TYPE_COUNT; i++) {
+            printf("\t\tIO type: %c, ops: %"PRId64", bytes: %"PRId64", "
+                    "errors: %"PRId64"\n", disk->types[i].type,
+                    disk->types[i].ops, disk->types[i].bytes,
+                    disk->types[i].errors);
+        }
+    }
+
+    cmd_end = stat->commands.entries + stat->commands.count;
+    for (command=stat->commands.entries; command<cmd_end; command++) {
+        printf("\tcmd: %d (%s), count: %"PRId64", errors: %"PRId64", "
+                "bytes in: %"PRId64", bytes out: %"PRId64", latency us: "
+                "{p50: %"PRId64", p99: %"PRId64", p999: %"PRId64", "
+                "max: %"PRId64"}\n", command->cmd,
+                fs_get_cmd_caption(command->cmd), command->count,
+                command->errors, command->bytes_in, command->bytes_out,
+                command->latency.p50, command->latency.p99,
+                command->latency.p999, command->latency.max);
+    }
+}
+
+static int service_stat_all()
+{
+#define SERVICE_MAX_DATA_GROUP_COUNT  1024
+#define SERVICE_MAX_DISK_COUNT         256
+#define SERVICE_MAX_COMMAND_COUNT      256
+    FSClientServiceStatDataGroup data_groups[SERVICE_MAX_DATA_GROUP_COUNT];
+    FSClientServiceStatDisk disks[SERVICE_MAX_DISK_COUNT];
+    FSClientServiceStatCommand commands[SERVICE_MAX_COMMAND_COUNT];
+    FSClientServiceStat stat;
+    FCServerInfo *server;
+    FCServerInfo *end;
+    FCServerInfoArray *server_array;
+    int result;
+    int fail_count;
+
+    stat.data_groups.entries = data_groups;
+    stat.data_groups.size = SERVICE_MAX_DATA_GROUP_COUNT;
+    stat.disks.entries = disks;
+    stat.disks.size = SERVICE_MAX_DISK_COUNT;
+    stat.commands.entries = commands;
+    stat.commands.size = SERVICE_MAX_COMMAND_COUNT;
+
+    fail_count = 0;
+    server_array = &g_fs_client_vars.client_ctx.cluster_cfg.
+        server_cfg.sorted_server_arrays;
+    end = server_array->servers + server_array->count;
+    for (server=server_array->servers; server<end; server++) {
+        if ((result=fs_service_stat(&g_fs_client_vars.client_ctx,
+                        server, &stat)) != 0)
+        {
+            fprintf(stderr, "service stat server id: %d fail, "
+                    "errno: %d, error info: %s\n", server->id,
+                    result, STRERROR(result));
+            fail_count++;
+            continue;
+        }
+        output_service_stat(&stat);
+    }
+    printf("\n");
+
+    return fail_count == 0 ? 0 : EIO;
+}
+
 int main(int argc, char *argv[])
 {
 #define CLUSTER_MAX_STAT_COUNT  256
 	int ch;
     const char *config_filename = "/etc/fstore/client.conf";
     int data_group_id;
+    bool service_stat;
     int alloc_size;
     int count;
     int bytes;
@@ -68,7 +188,8 @@ int main(int argc, char *argv[])
     */
 
     data_group_id = 0;
-    while ((ch=getopt(argc, argv, "hc:g:")) != -1) {
+    service_stat = false;
+    while ((ch=getopt(argc, argv, "hc:g:s")) != -1) {
         switch (ch) {
             case 'h':
                 usage(argv);
@@ -79,6 +200,9 @@ int main(int argc, char *argv[])
             case 'g':
                 data_group_id = strtol(optarg, NULL, 10);
                 break;
+            case 's':
+                service_stat = true;
+                break;
             default:
                 usage(argv);
                 return 1;
@@ -93,6 +217,10 @@ int main(int argc, char *argv[])
         return result;
     }
 
+    if (service_stat) {
+        return service_stat_all();
+    }
+
     alloc_size = FS_DATA_GROUP_COUNT(g_fs_client_vars.
             client_ctx.cluster_cfg) * 5;
     if (alloc_size < CLUSTER_MAX_STAT_COUNT) {
@@ -0,0 +1,411 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "client_global.h"
+#include "client_func.h"
+#include "client_proto.h"
+#include "topology_subscriber.h"
+
+//keep the connection alive when no change pushed
+#define TOPOLOGY_ACTIVE_TEST_INTERVAL  10
+
+//the timeout in ms to check the stop flag
+#define TOPOLOGY_RECV_TIMEOUT_MS     1000
+
+//the retry interval in seconds is doubled on fail until it
+#define TOPOLOGY_RETRY_MAX_INTERVAL    60
+
+static void update_master_cache(FSClientContext *client_ctx,
+        const int data_group_index, FCServerInfo *server,
+        const bool is_master)
+{
+    FCAddressPtrArray *addr_array;
+    FSClientDataGroupEntry *entry;
+    ConnectionInfo *addr;
+    ConnectionInfo *cache;
+    bool same;
+    bool changed;
+
+    //the connection manager of the caller maybe without the master cache
+    if (data_group_index >= client_ctx->conn_manager.
+            data_group_array.count)
+    {
+        return;
+    }
+
+    addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx, server);
+    if (addr_array->count <= 0) {
+        return;
+    }
+
+    addr = &addr_array->addrs[0]->conn;
+    entry = client_ctx->conn_manager.data_group_array.
+        entries + data_group_index;
+    changed = false;
+    PTHREAD_MUTEX_LOCK(&entry->master_cache.lock);
+    cache = entry->master_cache.conn;
+    same = (cache->port == addr->port &&
+            strcmp(cache->ip_addr, addr->ip_addr) == 0);
+    if (is_master) {
+        if (!same) {
+            conn_pool_set_server_info(cache, addr->ip_addr, addr->port);
+            changed = true;
+        }
+    } else if (same) {
+        cache->port = 0;  //the next request asks for the new master
+    }
+    PTHREAD_MUTEX_UNLOCK(&entry->master_cache.lock);
+
+    if (changed) {
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, master changed to "
+                "server id: %d, %s:%d", __LINE__, data_group_index + 1,
+                server->id, addr->ip_addr, addr->port);
+    }
+}
+
+static void update_replica_status(FSClientContext *client_ctx,
+        const int data_group_index, const int server_id, const int status)
+{
+    FSClientReplicaArray *group;
+    FSClientReplicaEntry *entry;
+    FSClientReplicaEntry *end;
+
+    if (client_ctx->replica_selector.groups == NULL) {
+        return;
+    }
+
+    group = client_ctx->replica_selector.groups + data_group_index;
+    end = group->entries + group->count;
+    for (entry=group->entries; entry<end; entry++) {
+        if (entry->server_id == server_id) {
+            entry->status = status;
+            break;
+        }
+    }
+}
+
+static int process_push(FSClientContext *client_ctx,
+        FSResponseInfo *response, char *body_buff, const int body_len)
+{
+    FSProtoPushDataServerStatusHeader *body_header;
+    FSProtoPushDataServerStatusBodyPart *body_part;
+    FSProtoPushDataServerStatusBodyPart *body_end;
+    FCServerInfo *server;
+    int data_server_count;
+    int calc_size;
+    int data_group_index;
+    int server_id;
+
+    if (body_len < sizeof(FSProtoPushDataServerStatusHeader)) {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d is too short", body_len);
+        return EINVAL;
+    }
+
+    body_header = (FSProtoPushDataServerStatusHeader *)body_buff;
+    data_server_count = buff2int(body_header->data_server_count);
+    calc_size = sizeof(FSProtoPushDataServerStatusHeader) +
+        data_server_count * sizeof(FSProtoPushDataServerStatusBodyPart);
+    if (calc_size != body_len) {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d != calculate size: %d, "
+                "data server count: %d", body_len, calc_size,
+                data_server_count);
+        return EINVAL;
+    }
+
+    body_part = (FSProtoPushDataServerStatusBodyPart *)(body_header + 1);
+    body_end = body_part + data_server_count;
+    for (; body_part < body_end; body_part++) {
+        data_group_index = buff2int(body_part->data_group_id) - 1;
+        server_id = buff2int(body_part->server_id);
+        if (data_group_index < 0 || data_group_index >=
+                FS_DATA_GROUP_COUNT(client_ctx->cluster_cfg))
+        {
+            continue;
+        }
+        if ((server=fc_server_get_by_id(&client_ctx->cluster_cfg.
+                        server_cfg, server_id)) == NULL)
+        {
+            continue;
+        }
+
+        update_master_cache(client_ctx, data_group_index,
+                server, body_part->is_master);
+        update_replica_status(client_ctx, data_group_index,
+                server_id, body_part->status);
+    }
+
+    return 0;
+}
+
+static int subscribe_topology(FSClientContext *client_ctx)
+{
+    FSClientTopologySubscriber *subscriber;
+    FCServerInfoArray *server_array;
+    FCServerInfo *server;
+    FCAddressPtrArray *addr_array;
+    FSProtoHeader *header;
+    FSResponseInfo response;
+    char out_buff[sizeof(FSProtoHeader)];
+    int result;
+
+    subscriber = &client_ctx->topology_subscriber;
+    server_array = &client_ctx->cluster_cfg.server_cfg.sorted_server_arrays;
+    if (server_array->count <= 0) {
+        return ENOENT;
+    }
+
+    subscriber->server_index %= server_array->count;
+    server = server_array->servers + subscriber->server_index++;
+    addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx, server);
+    if (addr_array->count <= 0) {
+        return ENOENT;
+    }
+
+    conn_pool_set_server_info(&subscriber->conn, addr_array->addrs[0]->
+            conn.ip_addr, addr_array->addrs[0]->conn.port);
+    if ((result=conn_pool_connect_server(&subscriber->conn,
+                    g_fs_client_vars.connect_timeout)) != 0)
+    {
+        return result;
+    }
+
+    response.error.length = 0;
+    header = (FSProtoHeader *)out_buff;
+    FS_PROTO_SET_HEADER(header, FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_REQ, 0);
+    if ((result=fs_send_and_recv_none_body_response(&subscriber->conn,
+                    out_buff, sizeof(out_buff), &response,
+                    g_fs_client_vars.network_timeout,
+                    FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_RESP)) != 0)
+    {
+        fs_log_network_error(&response, &subscriber->conn, result);
+        conn_pool_disconnect_server(&subscriber->conn);
+        return result;
+    }
+
+    subscriber->active_test_time = get_current_time();
+    logDebug("file: "__FILE__", line: %d, "
+            "subscribe topology from server %s:%d", __LINE__,
+            subscriber->conn.ip_addr, subscriber->conn.port);
+    return 0;
+}
+
+static int active_test(FSClientTopologySubscriber *subscriber)
+{
+    FSProtoHeader header;
+    int result;
+
+    FS_PROTO_SET_HEADER(&header, FS_PROTO_ACTIVE_TEST_REQ, 0);
+    if ((result=tcpsenddata_nb(subscriber->conn.sock, &header,
+                    sizeof(header), g_fs_client_vars.network_timeout)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "send data to server %s:%d fail, "
+                "errno: %d, error info: %s", __LINE__,
+                subscriber->conn.ip_addr, subscriber->conn.port,
+                result, STRERROR(result));
+        return result;
+    }
+
+    subscriber->active_test_time = get_current_time();
+    return 0;
+}
+
+static int recv_and_process(FSClientContext *client_ctx,
+        FSResponseInfo *response)
+{
+    FSClientTopologySubscriber *subscriber;
+    FSProtoHeader header_proto;
+    char fixed_buff[8 * 1024];
+    char *in_buff;
+    int recv_bytes;
+    int result;
+
+    subscriber = &client_ctx->topology_subscriber;
+    if ((result=tcprecvdata_nb_ms(subscriber->conn.sock, &header_proto,
+                    sizeof(FSProtoHeader), TOPOLOGY_RECV_TIMEOUT_MS,
+                    &recv_bytes)) != 0)
+    {
+        if (result == ETIMEDOUT) {
+            if (recv_bytes == 0) {
+                return 0;
+            }
+            result = EIO;
+        }
+        response->error.length = sprintf(response->error.message,
+                "recv data fail, recv bytes: %d, "
+                "errno: %d, error info: %s",
+                recv_bytes, result, STRERROR(result));
+        return result;
+    }
+
+    fs_proto_extract_header(&header_proto, &response->header);
+    in_buff = fixed_buff;
+    if (response->header.body_len > sizeof(fixed_buff)) {
+        in_buff = (char *)fc_malloc(response->header.body_len);
+        if (in_buff == NULL) {
+            response->error.length = sprintf(response->error.message,
+                    "malloc %d bytes fail", response->header.body_len);
+            return ENOMEM;
+        }
+    }
+
+    do {
+        if (response->header.body_len > 0 && (result=tcprecvdata_nb(
+                        subscriber->conn.sock, in_buff, response->
+                        header.body_len, g_fs_client_vars.
+                        network_timeout)) != 0)
+        {
+            response->error.length = sprintf(response->error.message,
+                    "recv body fail, errno: %d, error info: %s",
+                    result, STRERROR(result));
+            break;
+        }
+
+        if (response->header.status != 0) {
+            response->error.length = snprintf(response->error.message,
+                    sizeof(response->error.message), "%.*s",
+                    response->header.body_len, in_buff);
+            result = response->header.status;
+            break;
+        }
+
+        if (response->header.cmd == FS_PROTO_ACTIVE_TEST_RESP) {
+            result = 0;
+        } else if (response->header.cmd ==
+                FS_CLUSTER_PROTO_PUSH_DATA_SERVER_STATUS)
+        {
+            result = process_push(client_ctx, response, in_buff,
+                    response->header.body_len);
+        } else {
+            response->error.length = sprintf(response->error.message,
+                    "unexpect cmd: %d (%s)", response->header.cmd,
+                    fs_get_cmd_caption(response->header.cmd));
+            result = EINVAL;
+        }
+    } while (0);
+
+    if (in_buff != fixed_buff) {
+        free(in_buff);
+    }
+    return result;
+}
+
+static void wait_for_retry(FSClientTopologySubscriber *subscriber,
+        int *retry_interval)
+{
+    int i;
+
+    for (i=0; i<*retry_interval && subscriber->continue_flag; i++) {
+        sleep(1);
+    }
+
+    if (*retry_interval < TOPOLOGY_RETRY_MAX_INTERVAL) {
+        *retry_interval = FC_MIN(2 * (*retry_interval),
+                TOPOLOGY_RETRY_MAX_INTERVAL);
+    }
+}
+
+static void *topology_subscriber_thread_func(void *arg)
+{
+    FSClientContext *client_ctx;
+    FSClientTopologySubscriber *subscriber;
+    FSResponseInfo response;
+    int server_count;
+    int unsupported_count;
+    int retry_interval;
+    int result;
+
+    client_ctx = (FSClientContext *)arg;
+    subscriber = &client_ctx->topology_subscriber;
+    server_count = client_ctx->cluster_cfg.server_cfg.
+        sorted_server_arrays.count;
+    unsupported_count = 0;
+    retry_interval = 1;
+    while (subscriber->continue_flag) {
+        if ((result=subscribe_topology(client_ctx)) != 0) {
+            /* the server answers the error, such as the old server
+             * without this command, stop when all servers reject it */
+            if (!is_network_error(result) && result != ENOENT &&
+                    ++unsupported_count >= server_count)
+            {
+                logWarning("file: "__FILE__", line: %d, "
+                        "all of the %d servers reject the topology "
+                        "subscription, errno: %d, stop subscribing",
+                        __LINE__, server_count, result);
+                break;
+            }
+
+            wait_for_retry(subscriber, &retry_interval);
+            continue;
+        }
+
+        unsupported_count = 0;
+        retry_interval = 1;
+        result = 0;
+        while (subscriber->continue_flag) {
+            if (get_current_time() - subscriber->active_test_time >=
+                    TOPOLOGY_ACTIVE_TEST_INTERVAL)
+            {
+                if ((result=active_test(subscriber)) != 0) {
+                    break;
+                }
+            }
+
+            response.error.length = 0;
+            if ((result=recv_and_process(client_ctx, &response)) != 0) {
+                fs_log_network_error(&response, &subscriber->conn, result);
+                break;
+            }
+        }
+
+        conn_pool_disconnect_server(&subscriber->conn);
+        if (result != 0 && subscriber->continue_flag) {
+            wait_for_retry(subscriber, &retry_interval);
+        }
+    }
+
+    return NULL;
+}
+
+int fs_topology_subscriber_start(FSClientContext *client_ctx)
+{
+    FSClientTopologySubscriber *subscriber;
+    int result;
+
+    subscriber = &client_ctx->topology_subscriber;
+    subscriber->server_index = rand();
+    subscriber->conn.sock = -1;
+    subscriber->continue_flag = true;
+    if ((result=fc_create_thread(&subscriber->tid,
+                    topology_subscriber_thread_func,
+                    client_ctx, 64 * 1024)) != 0)
+    {
+        subscriber->continue_flag = false;
+        return result;
+    }
+
+    subscriber->running = true;
+    return 0;
+}
+
+void fs_topology_subscriber_stop(FSClientContext *client_ctx)
+{
+    FSClientTopologySubscriber *subscriber;
+
+    subscriber = &client_ctx->topology_subscriber;
+    if (!subscriber->running) {
+        return;
+    }
+
+    subscriber->continue_flag = false;
+    pthread_join(subscriber->tid, NULL);
+    subscriber->running = false;
+}
@@ -0,0 +1,23 @@
+#ifndef _FS_TOPOLOGY_SUBSCRIBER_H
+#define _FS_TOPOLOGY_SUBSCRIBER_H
+
+#include "client_global.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* subscribe the data server changes from one of the servers, the master
+ * cache and the replica status are updated by the pushed changes.
+ * the thread connects to the next server and subscribes again on error
+ * with the exponential backoff, and exits when all servers reject it */
+int fs_topology_subscriber_start(FSClientContext *client_ctx);
+
+/* stop and wait for the thread exit */
+void fs_topology_subscriber_stop(FSClientContext *client_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -634,6 +634,61 @@ static int set_server_data_mappings(FSClusterConfig *cluster_cfg,
     return 0;
 }
 
+static int load_write_ack_mode(const char *cluster_filename,
+        IniContext *ini_context, const char *section_name,
+        const int default_value, int *write_ack_mode)
+{
+    char *mode;
+
+    mode = iniGetStrValue(section_name, "write_ack_mode", ini_context);
+    if (mode == NULL || *mode == '\0') {
+        *write_ack_mode = default_value;
+    } else if (strcasecmp(mode, "all") == 0) {
+        *write_ack_mode = FS_WRITE_ACK_MODE_ALL;
+    } else if (strcasecmp(mode, "majority") == 0) {
+        *write_ack_mode = FS_WRITE_ACK_MODE_MAJORITY;
+    } else if (strcasecmp(mode, "master_only") == 0 ||
+            strcasecmp(mode, "async") == 0)
+    {
+        *write_ack_mode = FS_WRITE_ACK_MODE_MASTER_ONLY;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, section: %s, invalid write_ack_mode: %s, "
+                "expect: all, majority or master_only", __LINE__,
+                cluster_filename, section_name != NULL ?
+                section_name : "global", mode);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int load_replication_topology(const char *cluster_filename,
+        IniContext *ini_context, const char *section_name,
+        const int default_value, int *replication_topology)
+{
+    char *topology;
+
+    topology = iniGetStrValue(section_name,
+            "replication_topology", ini_context);
+    if (topology == NULL || *topology == '\0') {
+        *replication_topology = default_value;
+    } else if (strcasecmp(topology, "star") == 0) {
+        *replication_topology = FS_REPLICATION_TOPOLOGY_STAR;
+    } else if (strcasecmp(topology, "chain") == 0) {
+        *replication_topology = FS_REPLICATION_TOPOLOGY_CHAIN;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, section: %s, invalid "
+                "replication_topology: %s, expect: star or chain",
+                __LINE__, cluster_filename, section_name != NULL ?
+                section_name : "global", topology);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
 static int load_one_server_group(FSClusterConfig *cluster_cfg,
         const char *cluster_filename, IniContext *ini_context,
         const int server_group_id, FSServerGroup *server_group,
@@ -645,6 +700,20 @@ static int load_one_server_group(FSClusterConfig *cluster_cfg,
     server_group->server_group_id = server_group_id;
     sprintf(section_name, "server-group-%d", server_group_id);
 
+    if ((result=load_write_ack_mode(cluster_filename, ini_context,
+                    section_name, cluster_cfg->write_ack_mode,
+                    &server_group->write_ack_mode)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=load_replication_topology(cluster_filename, ini_context,
+                    section_name, cluster_cfg->replication_topology,
+                    &server_group->replication_topology)) != 0)
+    {
+        return result;
+    }
+
     server_ids->count = 0;
     if ((result=get_ids(cluster_filename, ini_context,
                     section_name, "server_ids", server_ids)) != 0)
@@ -705,6 +774,20 @@ static int load_groups(FSClusterConfig *cluster_cfg,
         return result;
     }
 
+    if ((result=load_write_ack_mode(cluster_filename, ini_context, NULL,
+                    FS_WRITE_ACK_MODE_ALL, &cluster_cfg->
+                    write_ack_mode)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=load_replication_topology(cluster_filename, ini_context,
+                    NULL, FS_REPLICATION_TOPOLOGY_STAR, &cluster_cfg->
+                    replication_topology)) != 0)
+    {
+        return result;
+    }
+
     INIT_ID_ARRAY(server_ids);
     for (i=0; i<cluster_cfg->server_groups.count; i++) {
         server_group_id = i + 1;
@@ -875,6 +958,12 @@ void fs_cluster_cfg_to_log(FSClusterConfig *cluster_cfg)
         logInfo("[server-group-%d]", sgroup->server_group_id);
         logInfo("server_ids = %s", server_id_buff);
         logInfo("data_group_ids = %s", group_id_buff);
+        logInfo("write_ack_mode = %s",
+                fs_cluster_cfg_get_write_ack_mode_caption(
+                    sgroup->write_ack_mode));
+        logInfo("replication_topology = %s",
+                fs_cluster_cfg_get_replication_topology_caption(
+                    sgroup->replication_topology));
     }
 }
 
@@ -943,6 +1032,26 @@ int fc_cluster_cfg_to_string(FSClusterConfig *cluster_cfg, FastBuffer *buffer)
         {
             return result;
         }
+
+        //keep the config sign unchanged for the default mode
+        if (sgroup->write_ack_mode != FS_WRITE_ACK_MODE_ALL) {
+            if ((result=fast_buffer_append(buffer, "write_ack_mode = %s\n",
+                            fs_cluster_cfg_get_write_ack_mode_caption(
+                                sgroup->write_ack_mode))) != 0)
+            {
+                return result;
+            }
+        }
+
+        if (sgroup->replication_topology != FS_REPLICATION_TOPOLOGY_STAR) {
+            if ((result=fast_buffer_append(buffer,
+                            "replication_topology = %s\n",
+                            fs_cluster_cfg_get_replication_topology_caption(
+                                sgroup->replication_topology))) != 0)
+            {
+                return result;
+            }
+        }
     }
 
     return 0;
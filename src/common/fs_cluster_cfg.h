@@ -14,6 +14,8 @@ typedef struct {
 
 typedef struct {
     int server_group_id;
+    int write_ack_mode;
+    int replication_topology;
     FCServerInfoPtrArray server_array;
     FSIdArray data_group;
 } FSServerGroup;
@@ -52,6 +54,8 @@ typedef struct {
     int cluster_group_index;
     int replica_group_index;
     int service_group_index;
+    int write_ack_mode;  //the default value of the server groups
+    int replication_topology;  //the default value of the server groups
 } FSClusterConfig;
 
 #define FS_SERVER_GROUP_COUNT(cluster_cfg) \
@@ -130,6 +134,29 @@ extern "C" {
         }
     }
 
+    static inline const char *fs_cluster_cfg_get_write_ack_mode_caption(
+            const int write_ack_mode)
+    {
+        switch (write_ack_mode) {
+            case FS_WRITE_ACK_MODE_MAJORITY:
+                return "majority";
+            case FS_WRITE_ACK_MODE_MASTER_ONLY:
+                return "master_only";
+            default:
+                return "all";
+        }
+    }
+
+    static inline const char *fs_cluster_cfg_get_replication_topology_caption(
+            const int replication_topology)
+    {
+        if (replication_topology == FS_REPLICATION_TOPOLOGY_CHAIN) {
+            return "chain";
+        } else {
+            return "star";
+        }
+    }
+
     void fs_cluster_cfg_to_log(FSClusterConfig *cluster_cfg);
 
     int fc_cluster_cfg_to_string(FSClusterConfig *cluster_cfg,
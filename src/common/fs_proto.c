@@ -74,38 +74,68 @@ int fs_check_response(ConnectionInfo *conn, FSResponseInfo *response,
     return response->header.status;
 }
 
-int fs_send_and_recv_response_header(ConnectionInfo *conn, char *data,
-        const int len, FSResponseInfo *response, const int network_timeout)
+int fs_recv_response_header(ConnectionInfo *conn,
+        FSResponseInfo *response, const int network_timeout)
 {
     int result;
     FSProtoHeader header_proto;
 
-    if ((result=tcpsenddata_nb(conn->sock, data, len, network_timeout)) != 0) {
+    if ((result=tcprecvdata_nb(conn->sock, &header_proto,
+            sizeof(FSProtoHeader), network_timeout)) != 0)
+    {
         response->error.length = snprintf(response->error.message,
                 sizeof(response->error.message),
-                "send data fail, errno: %d, error info: %s",
+                "recv data fail, errno: %d, error info: %s",
                 result, STRERROR(result));
         return result;
     }
 
-    if ((result=tcprecvdata_nb(conn->sock, &header_proto,
-            sizeof(FSProtoHeader), network_timeout)) != 0)
-    {
+    fs_proto_extract_header(&header_proto, &response->header);
+    return 0;
+}
+
+int fs_send_and_recv_response_header(ConnectionInfo *conn, char *data,
+        const int len, FSResponseInfo *response, const int network_timeout)
+{
+    int result;
+
+    if ((result=tcpsenddata_nb(conn->sock, data, len, network_timeout)) != 0) {
         response->error.length = snprintf(response->error.message,
                 sizeof(response->error.message),
-                "recv data fail, errno: %d, error info: %s",
+                "send data fail, errno: %d, error info: %s",
                 result, STRERROR(result));
         return result;
     }
 
-    fs_proto_extract_header(&header_proto, &response->header);
+    return fs_recv_response_header(conn, response, network_timeout);
+}
+
+static inline int check_response_body_length(FSResponseInfo *response,
+        const int min_body_len, const int max_body_len)
+{
+    if (min_body_len == max_body_len) {
+        if (response->header.body_len != min_body_len) {
+            response->error.length = sprintf(response->error.message,
+                    "response body length: %d != %d",
+                    response->header.body_len, min_body_len);
+            return EINVAL;
+        }
+    } else if (response->header.body_len != min_body_len &&
+            response->header.body_len != max_body_len)
+    {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d != %d or %d",
+                response->header.body_len, min_body_len, max_body_len);
+        return EINVAL;
+    }
+
     return 0;
 }
 
-int fs_send_and_recv_response(ConnectionInfo *conn, char *send_data,
+int fs_send_and_recv_response_ex(ConnectionInfo *conn, char *send_data,
         const int send_len, FSResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd,
-        char *recv_data, const int expect_body_len)
+        char *recv_data, const int min_body_len, const int max_body_len)
 {
     int result;
     int recv_bytes;
@@ -117,19 +147,17 @@ int fs_send_and_recv_response(ConnectionInfo *conn, char *send_data,
         return result;
     }
 
-    if (response->header.body_len != expect_body_len) {
-        response->error.length = sprintf(response->error.message,
-                "response body length: %d != %d",
-                response->header.body_len,
-                expect_body_len);
-        return EINVAL;
+    if ((result=check_response_body_length(response,
+                    min_body_len, max_body_len)) != 0)
+    {
+        return result;
     }
-    if (expect_body_len == 0) {
+    if (response->header.body_len == 0) {
         return 0;
     }
 
-    if ((result=tcprecvdata_nb_ex(conn->sock, recv_data,
-                    expect_body_len, network_timeout, &recv_bytes)) != 0)
+    if ((result=tcprecvdata_nb_ex(conn->sock, recv_data, response->
+                    header.body_len, network_timeout, &recv_bytes)) != 0)
     {
         response->error.length = snprintf(response->error.message,
                 sizeof(response->error.message),
@@ -141,9 +169,19 @@ int fs_send_and_recv_response(ConnectionInfo *conn, char *send_data,
     return result;
 }
 
-int fs_recv_response(ConnectionInfo *conn, FSResponseInfo *response,
+int fs_send_and_recv_response(ConnectionInfo *conn, char *send_data,
+        const int send_len, FSResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd,
         char *recv_data, const int expect_body_len)
+{
+    return fs_send_and_recv_response_ex(conn, send_data, send_len,
+            response, network_timeout, expect_cmd, recv_data,
+            expect_body_len, expect_body_len);
+}
+
+int fs_recv_response_ex(ConnectionInfo *conn, FSResponseInfo *response,
+        const int network_timeout, const unsigned char expect_cmd,
+        char *recv_data, const int min_body_len, const int max_body_len)
 {
     int result;
     int recv_bytes;
@@ -166,19 +204,17 @@ int fs_recv_response(ConnectionInfo *conn, FSResponseInfo *response,
         return result;
     }
 
-    if (response->header.body_len != expect_body_len) {
-        response->error.length = sprintf(response->error.message,
-                "response body length: %d != %d",
-                response->header.body_len,
-                expect_body_len);
-        return EINVAL;
+    if ((result=check_response_body_length(response,
+                    min_body_len, max_body_len)) != 0)
+    {
+        return result;
     }
-    if (expect_body_len == 0) {
+    if (response->header.body_len == 0) {
         return 0;
     }
 
-    if ((result=tcprecvdata_nb_ex(conn->sock, recv_data,
-                    expect_body_len, network_timeout, &recv_bytes)) != 0)
+    if ((result=tcprecvdata_nb_ex(conn->sock, recv_data, response->
+                    header.body_len, network_timeout, &recv_bytes)) != 0)
     {
         response->error.length = snprintf(response->error.message,
                 sizeof(response->error.message),
@@ -191,6 +227,14 @@ int fs_recv_response(ConnectionInfo *conn, FSResponseInfo *response,
     return result;
 }
 
+int fs_recv_response(ConnectionInfo *conn, FSResponseInfo *response,
+        const int network_timeout, const unsigned char expect_cmd,
+        char *recv_data, const int expect_body_len)
+{
+    return fs_recv_response_ex(conn, response, network_timeout,
+            expect_cmd, recv_data, expect_body_len, expect_body_len);
+}
+
 int fs_active_test(ConnectionInfo *conn, FSResponseInfo *response,
         const int network_timeout)
 {
@@ -270,6 +314,10 @@ const char *fs_get_cmd_caption(const int cmd)
             return "GET_READABLE_SERVER_REQ";
         case FS_SERVICE_PROTO_GET_READABLE_SERVER_RESP:
             return "GET_READABLE_SERVER_RESP";
+        case FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_REQ:
+            return "SUBSCRIBE_TOPOLOGY_REQ";
+        case FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_RESP:
+            return "SUBSCRIBE_TOPOLOGY_RESP";
         case FS_CLUSTER_PROTO_GET_SERVER_STATUS_REQ:
             return "GET_SERVER_STATUS_REQ";
         case FS_CLUSTER_PROTO_GET_SERVER_STATUS_RESP:
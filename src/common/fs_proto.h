@@ -1,6 +1,7 @@
 #ifndef _FS_PROTO_H
 #define _FS_PROTO_H
 
+#include <stddef.h>
 #include "fastcommon/fast_task_queue.h"
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
@@ -40,6 +41,11 @@
 #define FS_SERVICE_PROTO_GET_READABLE_SERVER_REQ  49
 #define FS_SERVICE_PROTO_GET_READABLE_SERVER_RESP 50
 
+/* the server pushes FS_CLUSTER_PROTO_PUSH_DATA_SERVER_STATUS
+ * to the client after the response */
+#define FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_REQ   51
+#define FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_RESP  52
+
 //cluster commands
 #define FS_CLUSTER_PROTO_GET_SERVER_STATUS_REQ   61
 #define FS_CLUSTER_PROTO_GET_SERVER_STATUS_RESP  62
@@ -65,6 +71,12 @@
 #define FS_REPLICA_PROTO_RPC_REQ                 99
 #define FS_REPLICA_PROTO_RPC_RESP               100
 
+//the compression of the replication and recovery streams
+#define FS_COMPRESS_ALGORITHM_NONE     0
+#define FS_COMPRESS_ALGORITHM_LZ4      1
+#define FS_COMPRESS_ALGORITHM_ZSTD     2
+
+#define FS_PROTO_DISK_IO_TYPE_COUNT  5   //the IO types of the disk stat
 
 #define FS_PROTO_MAGIC_CHAR        '@'
 #define FS_PROTO_SET_MAGIC(m)   \
@@ -82,11 +94,36 @@
 #define FS_PROTO_MAGIC_PARAMS(m) \
     m[0], m[1], m[2], m[3]
 
+//the request carries the trace id for the sampled tracing
+#define FS_PROTO_FLAGS_TRACE       1
+
+//the slice update request accepts the data version in the response
+#define FS_PROTO_FLAGS_DATA_VERSION  2
+
+//the cluster stat request accepts the replication stat of the slaves
+#define FS_PROTO_FLAGS_REPLICA_STAT  4
+
+#define FS_PROTO_TRACE_ID_MAX      0xFFFFFF  //the trace id is 24 bits
+
+#define FS_PROTO_SET_TRACE_ID(buff, id) \
+    do {  \
+        (buff)[0] = ((id) >> 16) & 0xFF; \
+        (buff)[1] = ((id) >> 8) & 0xFF;  \
+        (buff)[2] = (id) & 0xFF;         \
+    } while (0)
+
+#define FS_PROTO_GET_TRACE_ID(buff) \
+    ((((unsigned char)(buff)[0]) << 16) | \
+     (((unsigned char)(buff)[1]) << 8) |  \
+     ((unsigned char)(buff)[2]))
+
 #define FS_PROTO_SET_HEADER(header, _cmd, _body_len) \
     do {  \
         FS_PROTO_SET_MAGIC((header)->magic);   \
         (header)->cmd = _cmd;      \
         (header)->status[0] = (header)->status[1] = 0; \
+        (header)->flags[0] = (header)->flags[1] = 0;   \
+        FS_PROTO_SET_TRACE_ID((header)->trace_id, 0);  \
         int2buff(_body_len, (header)->body_len); \
     } while (0)
 
@@ -103,7 +140,7 @@ typedef struct fs_proto_header {
     char status[2];         //status to store errno
     char flags[2];
     unsigned char cmd;      //the command code
-    char padding[3];
+    char trace_id[3];       //valid when flags with FS_PROTO_FLAGS_TRACE
 } FSProtoHeader;
 
 typedef struct fs_proto_client_join_req {
@@ -138,8 +175,15 @@ typedef struct fs_proto_slice_write_req_header {
 typedef struct fs_proto_slice_update_resp {
     char inc_alloc[4];   //increase alloc space in bytes
     char padding[4];
+
+    /* the data version assigned by the master, the optional trailing
+     * field for the request with FS_PROTO_FLAGS_DATA_VERSION */
+    char data_version[8];
 } FSProtoSliceUpdateResp;
 
+#define FS_PROTO_SLICE_UPDATE_RESP_MIN_SIZE \
+    offsetof(FSProtoSliceUpdateResp, data_version)
+
 typedef struct fs_proto_slice_allocate_req {
     FSProtoBlockSlice bs;
 } FSProtoSliceAllocateReq;
@@ -154,8 +198,15 @@ typedef struct fs_proto_block_delete_req {
 
 typedef struct fs_proto_slice_read_req_header {
     FSProtoBlockSlice bs;
+
+    /* for read your writes, the optional trailing field
+     * which is omitted for any data version */
+    char min_data_version[8];
 } FSProtoSliceReadReqHeader;
 
+#define FS_PROTO_SLICE_READ_REQ_MIN_SIZE \
+    offsetof(FSProtoSliceReadReqHeader, min_data_version)
+
 typedef struct {
     unsigned char servers[16];
     unsigned char cluster[16];
@@ -184,10 +235,10 @@ typedef struct fs_proto_report_ds_status_req {
     char padding[7];
 } FSProtoReportDSStatusReq;
 
-typedef struct fs_proto_service_stat_resp {
+typedef struct fs_proto_service_stat_resp_body_header {
     char server_id[4];
     char is_leader;
-    char status;
+    char padding[3];
 
     struct {
         char current_count[4];
@@ -195,14 +246,70 @@ typedef struct fs_proto_service_stat_resp {
     } connection;
 
     struct {
-        char current_data_version[8];
-        struct {
-            char ns[8];
-            char dir[8];
-            char file[8];
-        } counters;
-    } dentry;
-} FSProtoServiceStatResp;
+        char read_queue_depth[4];
+        char write_queue_depth[4];
+    } trunk_io;
+
+    struct {
+        char replication_before[8];
+        char replication_after[8];
+        char fetch_binlog_before[8];
+        char fetch_binlog_after[8];
+    } compress;   //the bytes before and after compressed
+
+    char data_group_count[4];
+    char disk_count[4];
+    char command_count[4];
+    char padding2[4];
+} FSProtoServiceStatRespBodyHeader;
+
+typedef struct fs_proto_service_stat_resp_data_group {
+    char data_group_id[4];
+    char is_master;
+    char status;
+    char padding[2];
+    char data_version[8];
+} FSProtoServiceStatRespDataGroup;
+
+typedef struct fs_proto_service_stat_resp_disk_io {
+    char thread_count[4];
+    char queue_depth[4];
+    char wait_p99[8];     //in microseconds
+    char service_p50[8];  //in microseconds
+    char service_p99[8];
+    char service_max[8];
+} FSProtoServiceStatRespDiskIO;
+
+typedef struct fs_proto_service_stat_resp_disk_type {
+    unsigned char type;
+    char padding[7];
+    char ops[8];
+    char bytes[8];
+    char errors[8];
+} FSProtoServiceStatRespDiskType;
+
+typedef struct fs_proto_service_stat_resp_disk {
+    char path_index[4];
+    char padding[4];
+    FSProtoServiceStatRespDiskIO reads;
+    FSProtoServiceStatRespDiskIO writes;
+    FSProtoServiceStatRespDiskType types[FS_PROTO_DISK_IO_TYPE_COUNT];
+} FSProtoServiceStatRespDisk;
+
+typedef struct fs_proto_service_stat_resp_command {
+    unsigned char cmd;
+    char padding[7];
+    char count[8];
+    char errors[8];
+    char bytes_in[8];
+    char bytes_out[8];
+    struct {
+        char p50[8];
+        char p99[8];
+        char p999[8];
+        char max[8];
+    } latency;   //in microseconds
+} FSProtoServiceStatRespCommand;
 
 typedef struct fs_proto_cluster_stat_resp_body_header {
     char count[4];
@@ -217,8 +324,18 @@ typedef struct fs_proto_cluster_stat_resp_body_part {
     char is_master;
     char status;
     char padding[4];
+
+    /* the replication stat of the slave, the optional trailing fields
+     * for the request with FS_PROTO_FLAGS_REPLICA_STAT */
+    char replica_lag[8];     //the data versions the slave lags behind
+    char inflight_count[4];  //the in flight rpc count to the slave
+    char lagging;
+    char padding2[3];
 } FSProtoClusterStatRespBodyPart;
 
+#define FS_PROTO_CLUSTER_STAT_RESP_PART_MIN_SIZE \
+    offsetof(FSProtoClusterStatRespBodyPart, replica_lag)
+
 /* for FS_SERVICE_PROTO_GET_MASTER_RESP and
    FS_SERVICE_PROTO_GET_READABLE_SERVER_RESP
    */
@@ -252,9 +369,17 @@ typedef struct fs_proto_join_server_req {
     char buffer_size[4]; //the task size
     char replica_channels_between_two_servers[4];
     FSProtoConfigSigns config_signs;
+    char compress_algorithm;  //optional, sent when the compression enabled
+    char padding[7];
 } FSProtoJoinServerReq;
 
+//the length without the optional compress algorithm
+#define FS_PROTO_JOIN_SERVER_REQ_MIN_SIZE  \
+    ((int)sizeof(FSProtoJoinServerReq) - 8)
+
 typedef struct fs_proto_join_server_resp {
+    char compress_algorithm;  //the algorithm accepted by the slave
+    char padding[7];
 } FSProtoJoinServerResp;
 
 typedef struct fs_proto_push_data_server_status_header  {
@@ -288,25 +413,42 @@ typedef struct fs_proto_replia_fetch_binlog_first_req {
     char last_data_version[8];   //NOT including
     char data_group_id[4];
     char padding[4];
+    char compress_algorithm;  //optional, sent when the compression enabled
+    char reserved[7];
 } FSProtoReplicaFetchBinlogFirstReq;
 
+//the length without the optional compress algorithm
+#define FS_PROTO_FETCH_BINLOG_FIRST_REQ_MIN_SIZE  \
+    ((int)sizeof(FSProtoReplicaFetchBinlogFirstReq) - 8)
+
 typedef struct fs_proto_replia_fetch_binlog_resp_body_header {
-    char binlog_length[4];  //current binlog length
+    char binlog_length[4];  //current binlog length, compressed or not
     char is_last;
-    char padding[7];
+    char compress_algorithm;  //FS_COMPRESS_ALGORITHM_NONE for raw binlog
+    char padding[6];
     char binlog[0];
 } FSProtoReplicaFetchBinlogRespBodyHeader;
 
 typedef struct fs_proto_replica_rpc_req_body_header {
     char count[4];
-    char padding[4];
+    char compress_algorithm;  //the body parts are compressed as a whole
+    char flags;               //FS_REPLICA_RPC_FLAGS_CHAIN
+    char padding[2];
 } FSProtoReplicaRPCReqBodyHeader;
 
+/* each body part is followed by FSProtoReplicaRPCReqChain, only sent to
+ * the peers of the chain replication groups which support it */
+#define FS_REPLICA_RPC_FLAGS_CHAIN   1
+
+typedef struct fs_proto_replica_rpc_req_chain {
+    char members[8];  //the bitmap of the data server indexes to forward
+} FSProtoReplicaRPCReqChain;
+
 typedef struct fs_proto_replica_rpc_req_body_part {
     char data_version[8];
     char body_len[4];
     unsigned char cmd;
-    char padding[3];
+    char trace_id[3];  //the trace id of the master, 0 for not sampled
     char body[0];
 } FSProtoReplicaRPCReqBodyPart;
 
@@ -317,8 +459,9 @@ typedef struct fs_proto_replica_rpc_resp_body_header {
 
 typedef struct fs_proto_replica_rpc_resp_body_part {
     char data_version[8];
+    char data_group_id[4];
     char err_no[2];
-    char padding[6];
+    char padding[2];
 } FSProtoReplicaRPCRespBodyPart;
 
 #ifdef __cplusplus
@@ -332,10 +475,19 @@ int fs_proto_set_body_length(struct fast_task_info *task);
 int fs_check_response(ConnectionInfo *conn, FSResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd);
 
+/* the response body length is min_body_len or max_body_len,
+ * the latter for the optional trailing fields */
+int fs_recv_response_ex(ConnectionInfo *conn, FSResponseInfo *response,
+        const int network_timeout, const unsigned char expect_cmd,
+        char *recv_data, const int min_body_len, const int max_body_len);
+
 int fs_recv_response(ConnectionInfo *conn, FSResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd,
         char *recv_data, const int expect_body_len);
 
+int fs_recv_response_header(ConnectionInfo *conn,
+        FSResponseInfo *response, const int network_timeout);
+
 int fs_send_and_recv_response_header(ConnectionInfo *conn, char *data,
         const int len, FSResponseInfo *response, const int network_timeout);
 
@@ -361,6 +513,11 @@ static inline int fs_send_and_check_response_header(ConnectionInfo *conn,
     return 0;
 }
 
+int fs_send_and_recv_response_ex(ConnectionInfo *conn, char *send_data,
+        const int send_len, FSResponseInfo *response,
+        const int network_timeout, const unsigned char expect_cmd,
+        char *recv_data, const int min_body_len, const int max_body_len);
+
 int fs_send_and_recv_response(ConnectionInfo *conn, char *send_data,
         const int send_len, FSResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd,
@@ -384,6 +541,11 @@ static inline void fs_proto_extract_header(FSProtoHeader *header_proto,
     header_info->body_len = buff2int(header_proto->body_len);
     header_info->flags = buff2short(header_proto->flags);
     header_info->status = buff2short(header_proto->status);
+    if ((header_info->flags & FS_PROTO_FLAGS_TRACE) != 0) {
+        header_info->trace_id = FS_PROTO_GET_TRACE_ID(header_proto->trace_id);
+    } else {
+        header_info->trace_id = 0;
+    }
 }
 
 int fs_active_test(ConnectionInfo *conn, FSResponseInfo *response,
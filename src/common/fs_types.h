@@ -31,6 +31,18 @@
 #define FS_SERVER_STATUS_ONLINE    23
 #define FS_SERVER_STATUS_ACTIVE    24
 
+//when to response the client for the write request of the data group
+#define FS_WRITE_ACK_MODE_ALL          'A'  //all the active slaves acked
+#define FS_WRITE_ACK_MODE_MAJORITY     'M'  //the majority of replicas acked
+#define FS_WRITE_ACK_MODE_MASTER_ONLY  'O'  //async replication
+
+//how the master replicates to the slaves of the data group
+#define FS_REPLICATION_TOPOLOGY_STAR   'S'  //to all slaves directly
+#define FS_REPLICATION_TOPOLOGY_CHAIN  'C'  //each replica to the next one
+
+//the bit count of the chain members in the replication rpc
+#define FS_REPLICA_CHAIN_MAX_SERVERS   64
+
 #define FS_FILE_BLOCK_ALIGN(offset) \
     (offset & (~(FS_FILE_BLOCK_SIZE - 1)))
 
@@ -63,6 +75,7 @@ typedef struct {
     short flags;
     short status;
     unsigned char cmd; //command
+    int trace_id;      //0 for not traced
 } FSHeaderInfo;
 
 typedef struct {
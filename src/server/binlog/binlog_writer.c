@@ -26,6 +26,11 @@
 #define BINLOG_INDEX_ITEM_CURRENT_WRITE     "current_write"
 #define BINLOG_INDEX_ITEM_CURRENT_COMPRESS  "current_compress"
 
+static struct {
+    BinlogWriterThread *threads[FS_BINLOG_WRITER_MAX_THREADS];
+    volatile int count;
+} writer_thread_array = {{NULL}, 0};
+
 #define GET_BINLOG_FILENAME(writer) \
     sprintf(writer->file.name, "%s/%s/%s"BINLOG_FILE_EXT_FMT,  \
             DATA_PATH_STR, writer->cfg.subdir_name, BINLOG_FILE_PREFIX, \
@@ -153,6 +158,7 @@ static int open_next_binlog(BinlogWriterInfo *writer)
 static int do_write_to_file(BinlogWriterInfo *writer,
         char *buff, const int len)
 {
+    int64_t start_time;
     int result;
 
     if (fc_safe_write(writer->file.fd, buff, len) != len) {
@@ -166,6 +172,7 @@ static int do_write_to_file(BinlogWriterInfo *writer,
         return result;
     }
 
+    start_time = get_current_time_us();
     if (fsync(writer->file.fd) != 0) {
         result = errno != 0 ? errno : EIO;
         logCrit("file: "__FILE__", line: %d, "
@@ -176,6 +183,8 @@ static int do_write_to_file(BinlogWriterInfo *writer,
         SF_G_CONTINUE_FLAG = false;
         return result;
     }
+    fs_histogram_add(&writer->thread->fsync_latency,
+            get_current_time_us() - start_time);
 
     writer->file.size += len;
     return 0;
@@ -616,8 +625,32 @@ int binlog_writer_init_by_version(BinlogWriterInfo *writer,
     return binlog_writer_init_normal(writer, subdir_name);
 }
 
+int binlog_writer_get_stats(BinlogWriterStat *stats, const int size)
+{
+    BinlogWriterThread *thread;
+    BinlogWriterStat *stat;
+    int count;
+    int i;
+
+    count = __sync_add_and_fetch(&writer_thread_array.count, 0);
+    if (count > size) {
+        count = size;
+    }
+
+    for (i=0, stat=stats; i<count; i++, stat++) {
+        thread = writer_thread_array.threads[i];
+        stat->name = thread->name;
+
+        //the allocated buffers are freed after written
+        stat->queue_depth = thread->mblock.info.element_used_count;
+        fs_histogram_stat(&thread->fsync_latency, &stat->fsync_latency);
+    }
+
+    return count;
+}
+
 int binlog_writer_init_thread_ex(BinlogWriterThread *thread,
-        BinlogWriterInfo *writer, const int order_by,
+        const char *name, BinlogWriterInfo *writer, const int order_by,
         const int max_record_size, const int writer_count)
 {
     const int alloc_elements_once = 1024;
@@ -625,6 +658,7 @@ int binlog_writer_init_thread_ex(BinlogWriterThread *thread,
     int result;
     int bytes;
 
+    thread->name = name;
     thread->order_by = order_by;
     writer->cfg.max_record_size = max_record_size;
     writer->thread = thread;
@@ -650,6 +684,11 @@ int binlog_writer_init_thread_ex(BinlogWriterThread *thread,
     thread->flush_writers.alloc = writer_count;
     thread->flush_writers.count = 0;
 
+    if (writer_thread_array.count < FS_BINLOG_WRITER_MAX_THREADS) {
+        writer_thread_array.threads[writer_thread_array.count] = thread;
+        __sync_add_and_fetch(&writer_thread_array.count, 1);
+    }
+
     return fc_create_thread(&tid, binlog_writer_func, thread,
             SF_G_THREAD_STACK_SIZE);
 }
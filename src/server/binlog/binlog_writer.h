@@ -4,11 +4,14 @@
 #define _BINLOG_WRITER_H_
 
 #include "fastcommon/fc_queue.h"
+#include "../server_stat.h"
 #include "binlog_types.h"
 
 #define FS_BINLOG_WRITER_TYPE_ORDER_BY_NONE    0
 #define FS_BINLOG_WRITER_TYPE_ORDER_BY_VERSION 1
 
+#define FS_BINLOG_WRITER_MAX_THREADS  8
+
 struct binlog_writer_info;
 
 typedef struct binlog_writer_ptr_array {
@@ -34,13 +37,21 @@ typedef struct binlog_writer_buffer_ring {
 } BinlogWriterBufferRing;
 
 typedef struct binlog_writer_thread {
+    const char *name;
     struct fast_mblock_man mblock;
     struct fc_queue queue;
     volatile bool running;
     int order_by;
     BinlogWriterPtrArray flush_writers;
+    FSLatencyHistogram fsync_latency;  //in microseconds
 } BinlogWriterThread;
 
+typedef struct binlog_writer_stat {
+    const char *name;
+    int64_t queue_depth;  //the records waiting to write
+    FSHistogramStat fsync_latency;
+} BinlogWriterStat;
+
 typedef struct binlog_writer_info {
     struct {
         char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
@@ -83,11 +94,13 @@ int binlog_writer_init_by_version(BinlogWriterInfo *writer,
         const int ring_size);
 
 int binlog_writer_init_thread_ex(BinlogWriterThread *thread,
-        BinlogWriterInfo *writer, const int order_by,
+        const char *name, BinlogWriterInfo *writer, const int order_by,
         const int max_record_size, const int writer_count);
 
-#define binlog_writer_init_thread(thread, writer, order_by, max_record_size) \
-    binlog_writer_init_thread_ex(thread, writer, order_by, max_record_size, 1)
+#define binlog_writer_init_thread(thread, name, writer, \
+        order_by, max_record_size) \
+    binlog_writer_init_thread_ex(thread, name, writer, \
+            order_by, max_record_size, 1)
 
 static inline int binlog_writer_init(BinlogWriterContext *context,
         const char *subdir_name, const int max_record_size)
@@ -99,8 +112,9 @@ static inline int binlog_writer_init(BinlogWriterContext *context,
         return result;
     }
 
-    return binlog_writer_init_thread(&context->thread, &context->writer,
-            FS_BINLOG_WRITER_TYPE_ORDER_BY_NONE, max_record_size);
+    return binlog_writer_init_thread(&context->thread, subdir_name,
+            &context->writer, FS_BINLOG_WRITER_TYPE_ORDER_BY_NONE,
+            max_record_size);
 }
 
 static inline void binlog_writer_set_next_version(BinlogWriterInfo *writer,
@@ -119,6 +133,9 @@ int binlog_get_current_write_index(BinlogWriterInfo *writer);
 void binlog_get_current_write_position(BinlogWriterInfo *writer,
         FSBinlogFilePosition *position);
 
+//return the stat count of the writer threads
+int binlog_writer_get_stats(BinlogWriterStat *stats, const int size);
+
 static inline BinlogWriterBuffer *binlog_writer_alloc_buffer(
         BinlogWriterThread *thread)
 {
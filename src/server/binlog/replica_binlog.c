@@ -277,7 +277,8 @@ int replica_binlog_init()
     binlog_writer_array.base_id = min_id;
     writer = binlog_writer_array.holders;
     if ((result=binlog_writer_init_thread_ex(&binlog_writer_thread,
-                    writer, FS_BINLOG_WRITER_TYPE_ORDER_BY_VERSION,
+                    FS_REPLICA_BINLOG_SUBDIR_NAME, writer,
+                    FS_BINLOG_WRITER_TYPE_ORDER_BY_VERSION,
                     FS_REPLICA_BINLOG_MAX_RECORD_SIZE, id_array->count)) != 0)
     {
         return result;
@@ -422,6 +423,36 @@ int replica_binlog_record_unpack(const string_t *line,
     return result;
 }
 
+static inline int pack_slice_record(char *buff, const int64_t data_version,
+        const FSBlockSliceKeyInfo *bs_key, const int op_type)
+{
+    return sprintf(buff, "%d %"PRId64" %c %"PRId64" %"PRId64" %d %d\n",
+            (int)g_current_time, data_version, op_type,
+            bs_key->block.oid, bs_key->block.offset,
+            bs_key->slice.offset, bs_key->slice.length);
+}
+
+static inline int pack_block_record(char *buff, const int64_t data_version,
+        const FSBlockKey *bkey)
+{
+    return sprintf(buff, "%d %"PRId64" %c %"PRId64" %"PRId64"\n",
+            (int)g_current_time, data_version,
+            REPLICA_BINLOG_OP_TYPE_DEL_BLOCK,
+            bkey->oid, bkey->offset);
+}
+
+int replica_binlog_record_pack(const ReplicaBinlogRecord *record,
+        char *buff)
+{
+    if (record->op_type == REPLICA_BINLOG_OP_TYPE_DEL_BLOCK) {
+        return pack_block_record(buff, record->data_version,
+                &record->bs_key.block);
+    } else {
+        return pack_slice_record(buff, record->data_version,
+                &record->bs_key, record->op_type);
+    }
+}
+
 static BinlogWriterBuffer *alloc_binlog_buffer(const int data_group_id,
         const int64_t data_version, BinlogWriterInfo **writer)
 {
@@ -449,11 +480,8 @@ int replica_binlog_log_slice(const int data_group_id, const int64_t data_version
         return ENOMEM;
     }
 
-    wbuffer->bf.length = sprintf(wbuffer->bf.buff,
-            "%d %"PRId64" %c %"PRId64" %"PRId64" %d %d\n",
-            (int)g_current_time, data_version, op_type,
-            bs_key->block.oid, bs_key->block.offset,
-            bs_key->slice.offset, bs_key->slice.length);
+    wbuffer->bf.length = pack_slice_record(wbuffer->bf.buff,
+            data_version, bs_key, op_type);
     push_to_binlog_write_queue(writer->thread, wbuffer);
     return 0;
 }
@@ -470,11 +498,8 @@ int replica_binlog_log_del_block(const int data_group_id,
         return ENOMEM;
     }
 
-    wbuffer->bf.length = sprintf(wbuffer->bf.buff,
-            "%d %"PRId64" %c %"PRId64" %"PRId64"\n",
-            (int)g_current_time, data_version,
-            REPLICA_BINLOG_OP_TYPE_DEL_BLOCK,
-            bkey->oid, bkey->offset);
+    wbuffer->bf.length = pack_block_record(wbuffer->bf.buff,
+            data_version, bkey);
     push_to_binlog_write_queue(writer->thread, wbuffer);
     return 0;
 }
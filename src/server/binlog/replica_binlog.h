@@ -47,6 +47,9 @@ extern "C" {
     int replica_binlog_record_unpack(const string_t *line,
             ReplicaBinlogRecord *record, char *error_info);
 
+    int replica_binlog_record_pack(const ReplicaBinlogRecord *record,
+            char *buff);
+
     int replica_binlog_log_slice(const int data_group_id,
             const int64_t data_version, const FSBlockSliceKeyInfo *bs_key,
             const int op_type);
@@ -276,7 +276,8 @@ static int init_binlog_writer()
     }
 
     return binlog_writer_init_thread(&binlog_writer.thread,
-            &binlog_writer.writer, FS_BINLOG_WRITER_TYPE_ORDER_BY_VERSION,
+            FS_SLICE_BINLOG_SUBDIR_NAME, &binlog_writer.writer,
+            FS_BINLOG_WRITER_TYPE_ORDER_BY_VERSION,
             FS_SLICE_BINLOG_MAX_RECORD_SIZE);
 }
 
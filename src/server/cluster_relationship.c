@@ -54,6 +54,7 @@ typedef struct fs_cluster_server_detect_array {
 
 FSClusterServerInfo *g_next_leader = NULL;
 static FSMyDataGroupArray my_data_group_array = {NULL, 0};
+static volatile int offline_slave_count = 0;  //the slaves to report
 static FSClusterServerDetectArray inactive_server_array = {NULL, 0};
 
 #define SET_SERVER_DETECT_ENTRY(entry, server) \
@@ -345,7 +346,7 @@ static int do_notify_leader_changed(FSClusterServerInfo *cs,
     return result;
 }
 
-static int report_my_status_to_leader(FSClusterDataServerInfo *ds)
+static int report_ds_status_to_leader(FSClusterDataServerInfo *ds)
 {
     FSClusterServerInfo *leader;
     FSProtoHeader *header;
@@ -765,12 +766,70 @@ void cluster_relationship_set_my_status(FSClusterDataServerInfo *ds,
     if (CLUSTER_MYSELF_PTR == CLUSTER_LEADER_ATOM_PTR) {  //leader
         cluster_topology_data_server_chg_notify(ds, false);
     } else if (notify_leader) {   //follower
-        if (report_my_status_to_leader(ds) != 0) {
+        if (report_ds_status_to_leader(ds) != 0) {
             ds->last_report_version = -1;   //trigger report to leader
         }
     }
 }
 
+void cluster_relationship_offline_slave(FSClusterDataServerInfo *ds)
+{
+    int old_status;
+
+    old_status = __sync_add_and_fetch(&ds->status, 0);
+    if (!(old_status == FS_SERVER_STATUS_ONLINE ||
+                old_status == FS_SERVER_STATUS_ACTIVE))
+    {
+        return;
+    }
+
+    if (__sync_bool_compare_and_swap(&ds->status, old_status,
+                FS_SERVER_STATUS_OFFLINE) && __sync_bool_compare_and_swap(
+                    &ds->offline_reporting, 0, 1))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, slave server id: %d missed "
+                "the updates, mark it offline", __LINE__,
+                ds->dg->id, ds->cs->server->id);
+        __sync_add_and_fetch(&offline_slave_count, 1);
+    }
+}
+
+static void report_offline_slaves()
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    bool is_leader;
+
+    if (__sync_add_and_fetch(&offline_slave_count, 0) == 0) {
+        return;
+    }
+
+    is_leader = (CLUSTER_MYSELF_PTR == CLUSTER_LEADER_ATOM_PTR);
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        end = group->data_server_array.servers +
+            group->data_server_array.count;
+        for (ds=group->data_server_array.servers; ds<end; ds++) {
+            if (!__sync_add_and_fetch(&ds->offline_reporting, 0)) {
+                continue;
+            }
+
+            if (is_leader) {
+                cluster_topology_data_server_chg_notify(ds, false);
+                __sync_add_and_fetch(&CLUSTER_CURRENT_VERSION, 1);
+            } else if (report_ds_status_to_leader(ds) != 0) {
+                continue;  //retry in the next round
+            }
+
+            __sync_bool_compare_and_swap(&ds->offline_reporting, 1, 0);
+            __sync_sub_and_fetch(&offline_slave_count, 1);
+        }
+    }
+}
+
 static int cluster_process_leader_push(FSResponseInfo *response,
         char *body_buff, const int body_len)
 {
@@ -809,8 +868,21 @@ static int cluster_process_leader_push(FSResponseInfo *response,
         //logInfo("data_group_id: %d, server_id: %d", data_group_id, server_id);
         if ((ds=fs_get_data_server(data_group_id, server_id)) != NULL) {
             if (ds->cs != CLUSTER_MYSELF_PTR) {
-                ds->status = body_part->status;
+                //keep the lagging slave offline before reported
+                if (!__sync_add_and_fetch(&ds->offline_reporting, 0)) {
+                    ds->status = body_part->status;
+                }
                 ds->data_version = buff2long(body_part->data_version);
+            } else if (body_part->status == FS_SERVER_STATUS_OFFLINE &&
+                    !ds->is_master && (ds->status == FS_SERVER_STATUS_ONLINE
+                        || ds->status == FS_SERVER_STATUS_ACTIVE))
+            {
+                //reported by the master as missed the updates
+                logWarning("file: "__FILE__", line: %d, "
+                        "data group id: %d, the leader marks me offline, "
+                        "recover the data", __LINE__, data_group_id);
+                cluster_relationship_set_my_status(ds,
+                        FS_SERVER_STATUS_OFFLINE, true);
             }
             if (ds->is_master != body_part->is_master) { //master changed
                 ds->is_master = body_part->is_master;
@@ -833,6 +905,9 @@ static int cluster_process_leader_push(FSResponseInfo *response,
                             data_group_id, ds->cs->server->id);
                 }
             }
+
+            //forward to the clients connected to me
+            cluster_topology_notify_subscribers(ds);
         }
     }
 
@@ -1013,6 +1088,7 @@ static int cluster_ping_leader(ConnectionInfo *conn)
         }
 
         leader_deal_data_version_changes();
+        report_offline_slaves();
         cluster_topology_check_and_make_delay_decisions();
         return 0;  //do not need ping myself
     }
@@ -1045,6 +1121,8 @@ static int cluster_ping_leader(ConnectionInfo *conn)
         return result;
     }
 
+    report_offline_slaves();
+
     if ((result=proto_ping_leader(conn)) != 0) {
         conn_pool_disconnect_server(conn);
     }
@@ -32,6 +32,11 @@ bool cluster_relationship_set_ds_status_and_dv(FSClusterDataServerInfo *ds,
 void cluster_relationship_set_my_status(FSClusterDataServerInfo *ds,
         const int new_status, const bool notify_leader);
 
+/* the master marks the slave missed the updates as OFFLINE, and reports
+ * it to the leader by the cluster thread, so the slave recovers the data
+ * before it becomes ACTIVE again */
+void cluster_relationship_offline_slave(FSClusterDataServerInfo *ds);
+
 void cluster_relationship_add_to_inactive_sarray(FSClusterServerInfo *cs);
 
 void cluster_relationship_remove_from_inactive_sarray(FSClusterServerInfo *cs);
@@ -23,6 +23,15 @@
 #include "cluster_relationship.h"
 #include "cluster_topology.h"
 
+typedef struct {
+    pthread_mutex_t lock;
+    struct fc_list_head head;  //the subscribers of all nio threads
+} FSTopologySubscriberContext;
+
+static FSTopologySubscriberContext subscriber_ctx = {
+    PTHREAD_MUTEX_INITIALIZER, {&subscriber_ctx.head, &subscriber_ctx.head}
+};
+
 static FSClusterDataServerInfo *find_data_group_server(
         const int gindex, FSClusterServerInfo *cs)
 {
@@ -81,14 +90,35 @@ int cluster_topology_init_notify_ctx(FSClusterTopologyNotifyContext *notify_ctx)
     return 0;
 }
 
+static inline void push_change_event(FSClusterTopologyNotifyContext *ctx,
+        FSClusterDataServerInfo *data_server)
+{
+    FSDataServerChangeEvent *event;
+    struct fast_task_info *task;
+    bool notify;
+
+    task = (struct fast_task_info *)ctx->task;
+    if (task == NULL) {
+        return;
+    }
+
+    event = ctx->events + (data_server->dg->index *
+            CLUSTER_SERVER_ARRAY.count + data_server->cs->server_index);
+    assert(event->data_server == data_server);
+
+    if (__sync_bool_compare_and_swap(&event->in_queue, 0, 1)) { //fetch event
+        fc_queue_push_ex(&ctx->queue, event, &notify);
+        if (notify) {
+            iovent_notify_thread(task->thread_data);
+        }
+    }
+}
+
 void cluster_topology_data_server_chg_notify(FSClusterDataServerInfo *
         data_server, const bool notify_self)
 {
     FSClusterServerInfo *cs;
     FSClusterServerInfo *end;
-    FSDataServerChangeEvent *event;
-    struct fast_task_info *task;
-    bool notify;
 
     end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
     for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
@@ -97,25 +127,15 @@ void cluster_topology_data_server_chg_notify(FSClusterDataServerInfo *
         {
             continue;
         }
-        task = (struct fast_task_info *)cs->notify_ctx.task;
-        if (task == NULL) {
-            continue;
-        }
 
-        event = cs->notify_ctx.events + (data_server->dg->index *
-                CLUSTER_SERVER_ARRAY.count + data_server->cs->server_index);
-        assert(event->data_server == data_server);
-
-        if (__sync_bool_compare_and_swap(&event->in_queue, 0, 1)) { //fetch event
-            fc_queue_push_ex(&cs->notify_ctx.queue, event, &notify);
-            if (notify) {
-                iovent_notify_thread(task->thread_data);
-            }
-        }
+        push_change_event(&cs->notify_ctx, data_server);
     }
+
+    cluster_topology_notify_subscribers(data_server);
 }
 
-void cluster_topology_sync_all_data_servers(FSClusterServerInfo *cs)
+static void sync_all_data_servers(FSClusterTopologyNotifyContext *ctx,
+        FSClusterServerInfo *exclude)
 {
     FSClusterDataGroupInfo *group;
     FSClusterDataGroupInfo *gend;
@@ -127,20 +147,92 @@ void cluster_topology_sync_all_data_servers(FSClusterServerInfo *cs)
     for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
         ds_end = group->data_server_array.servers + group->data_server_array.count;
         for (ds=group->data_server_array.servers; ds<ds_end; ds++) {
-            if (ds->cs == cs) {
+            if (ds->cs == exclude) {
                 continue;
             }
 
-            event = cs->notify_ctx.events + (ds->dg->index *
+            event = ctx->events + (ds->dg->index *
                     CLUSTER_SERVER_ARRAY.count + ds->cs->server_index);
             assert(event->data_server == ds);
             if (__sync_bool_compare_and_swap(&event->in_queue, 0, 1)) { //fetch event
-                fc_queue_push(&cs->notify_ctx.queue, event);
+                fc_queue_push(&ctx->queue, event);
             }
         }
     }
 }
 
+void cluster_topology_sync_all_data_servers(FSClusterServerInfo *cs)
+{
+    sync_all_data_servers(&cs->notify_ctx, cs);
+}
+
+void cluster_topology_notify_subscribers(FSClusterDataServerInfo *data_server)
+{
+    FSTopologySubscriber *subscriber;
+
+    PTHREAD_MUTEX_LOCK(&subscriber_ctx.lock);
+    fc_list_for_each_entry(subscriber, &subscriber_ctx.head, glink) {
+        push_change_event(&subscriber->notify_ctx, data_server);
+    }
+    PTHREAD_MUTEX_UNLOCK(&subscriber_ctx.lock);
+}
+
+int cluster_topology_subscribe(struct fast_task_info *task,
+        struct fc_list_head *thread_subscribers)
+{
+    FSTopologySubscriber *subscriber;
+    int result;
+
+    subscriber = (FSTopologySubscriber *)fc_malloc(
+            sizeof(FSTopologySubscriber));
+    if (subscriber == NULL) {
+        return ENOMEM;
+    }
+    memset(subscriber, 0, sizeof(FSTopologySubscriber));
+
+    if ((result=cluster_topology_init_notify_ctx(
+                    &subscriber->notify_ctx)) != 0)
+    {
+        if (result == ENOMEM) {  //the events alloc fail
+            fc_queue_destroy(&subscriber->notify_ctx.queue);
+        }
+        free(subscriber);
+        return result;
+    }
+
+    //push all data servers after the response sent
+    subscriber->notify_ctx.task = task;
+    sync_all_data_servers(&subscriber->notify_ctx, NULL);
+    fc_list_add_tail(&subscriber->dlink, thread_subscribers);
+
+    PTHREAD_MUTEX_LOCK(&subscriber_ctx.lock);
+    fc_list_add_tail(&subscriber->glink, &subscriber_ctx.head);
+    PTHREAD_MUTEX_UNLOCK(&subscriber_ctx.lock);
+
+    ((FSServerTaskArg *)task->arg)->context.service.subscriber = subscriber;
+    return 0;
+}
+
+void cluster_topology_unsubscribe(struct fast_task_info *task)
+{
+    FSTopologySubscriber *subscriber;
+
+    subscriber = ((FSServerTaskArg *)task->arg)->context.service.subscriber;
+    if (subscriber == NULL) {
+        return;
+    }
+
+    PTHREAD_MUTEX_LOCK(&subscriber_ctx.lock);
+    fc_list_del_init(&subscriber->glink);
+    PTHREAD_MUTEX_UNLOCK(&subscriber_ctx.lock);
+
+    fc_list_del_init(&subscriber->dlink);
+    fc_queue_destroy(&subscriber->notify_ctx.queue);
+    free(subscriber->notify_ctx.events);
+    free(subscriber);
+    ((FSServerTaskArg *)task->arg)->context.service.subscriber = NULL;
+}
+
 static int process_notify_events(FSClusterTopologyNotifyContext *ctx)
 {
     FSDataServerChangeEvent *event;
@@ -188,6 +280,16 @@ static int process_notify_events(FSClusterTopologyNotifyContext *ctx)
     return sf_send_add_event((struct fast_task_info *)ctx->task);
 }
 
+void cluster_topology_process_subscriber_events(
+        struct fc_list_head *thread_subscribers)
+{
+    FSTopologySubscriber *subscriber;
+
+    fc_list_for_each_entry(subscriber, thread_subscribers, dlink) {
+        process_notify_events(&subscriber->notify_ctx);
+    }
+}
+
 int cluster_topology_process_notify_events(FSClusterNotifyContextPtrArray *
         notify_ctx_ptr_array)
 {
@@ -68,6 +68,18 @@ void cluster_topology_data_server_chg_notify(FSClusterDataServerInfo *
 
 void cluster_topology_sync_all_data_servers(FSClusterServerInfo *cs);
 
+/* the clients subscribe the data server changes by the service port,
+ * the changes are pushed in the nio thread of the subscriber task */
+void cluster_topology_notify_subscribers(FSClusterDataServerInfo *data_server);
+
+int cluster_topology_subscribe(struct fast_task_info *task,
+        struct fc_list_head *thread_subscribers);
+
+void cluster_topology_unsubscribe(struct fast_task_info *task);
+
+void cluster_topology_process_subscriber_events(
+        struct fc_list_head *thread_subscribers);
+
 int cluster_topology_process_notify_events(FSClusterNotifyContextPtrArray *
         notify_ctx_ptr_array);
 
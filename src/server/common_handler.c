@@ -30,6 +30,8 @@
 #include "replication/replication_common.h"
 #include "cluster_topology.h"
 #include "cluster_relationship.h"
+#include "server_stat.h"
+#include "server_trace.h"
 #include "common_handler.h"
 
 static int handler_check_config_sign(struct fast_task_info *task,
@@ -130,6 +132,8 @@ int handler_deal_task_done(struct fast_task_info *task)
 
     if (!TASK_ARG->context.need_response) {
         time_used = (int)(get_current_time_us() - TASK_ARG->req_start_time);
+        server_stat_add_command(REQUEST.header.cmd, sizeof(FSProtoHeader) +
+                REQUEST.header.body_len, 0, time_used, RESPONSE_STATUS != 0);
 
         switch (REQUEST.header.cmd) {
             case FS_PROTO_ACTIVE_TEST_RESP:
@@ -169,6 +173,11 @@ int handler_deal_task_done(struct fast_task_info *task)
 
     r = sf_send_add_event(task);
     time_used = (int)(get_current_time_us() - TASK_ARG->req_start_time);
+    server_stat_add_command(REQUEST.header.cmd, sizeof(FSProtoHeader) +
+            REQUEST.header.body_len, sizeof(FSProtoHeader) +
+            RESPONSE.header.body_len, time_used, RESPONSE_STATUS != 0);
+    server_trace_finish(&SLICE_OP_CTX, TASK_CTX.which_side,
+            REQUEST.header.cmd, RESPONSE_STATUS);
     if (time_used > 50 * 1000) {
         lwarning("process a request timed used: %s us, "
                 "cmd: %d (%s), req body len: %d, resp body len: %d",
@@ -34,6 +34,13 @@ static inline void handler_init_task_context(struct fast_task_info *task)
     REQUEST.header.cmd = ((FSProtoHeader *)task->data)->cmd;
     REQUEST.header.body_len = task->length - sizeof(FSProtoHeader);
     REQUEST.header.status = buff2short(((FSProtoHeader *)task->data)->status);
+    REQUEST.header.flags = buff2short(((FSProtoHeader *)task->data)->flags);
+    if ((REQUEST.header.flags & FS_PROTO_FLAGS_TRACE) != 0) {
+        REQUEST.header.trace_id = FS_PROTO_GET_TRACE_ID(
+                ((FSProtoHeader *)task->data)->trace_id);
+    } else {
+        REQUEST.header.trace_id = 0;
+    }
     REQUEST.body = task->data + sizeof(FSProtoHeader);
 }
 
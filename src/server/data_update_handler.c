@@ -29,17 +29,18 @@
 #include "server_func.h"
 #include "server_group_info.h"
 #include "server_storage.h"
+#include "server_trace.h"
 #include "data_update_handler.h"
 
-static int parse_check_block_key_ex(struct fast_task_info *task,
+int du_handler_parse_check_block_key_ex(FSResponseInfo *response,
         FSSliceOpContext *op_ctx, const FSProtoBlockKey *bkey,
         const bool master_only)
 {
     op_ctx->info.bs_key.block.oid = buff2long(bkey->oid);
     op_ctx->info.bs_key.block.offset = buff2long(bkey->offset);
     if (op_ctx->info.bs_key.block.offset % FS_FILE_BLOCK_SIZE != 0) {
-        RESPONSE.error.length = sprintf(
-                RESPONSE.error.message, "block offset: %"PRId64" "
+        response->error.length = sprintf(
+                response->error.message, "block offset: %"PRId64" "
                 "NOT the multiple of the block size %d",
                 op_ctx->info.bs_key.block.offset, FS_FILE_BLOCK_SIZE);
         return EINVAL;
@@ -51,7 +52,7 @@ static int parse_check_block_key_ex(struct fast_task_info *task,
 
     op_ctx->info.myself = fs_get_my_data_server(op_ctx->info.data_group_id);
     if (op_ctx->info.myself == NULL) {
-        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+        response->error.length = sprintf(response->error.message,
                 "data group id: %d NOT belongs to me",
                 op_ctx->info.data_group_id);
         return ENOENT;
@@ -62,14 +63,24 @@ static int parse_check_block_key_ex(struct fast_task_info *task,
 
     if (master_only) {
         if (!op_ctx->info.myself->is_master) {
-            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+            response->error.length = sprintf(response->error.message,
                     "data group id: %d, i am NOT master",
                     op_ctx->info.data_group_id);
             return EINVAL;
         }
+
+        //backpressure when the slaves can't keep up
+        if (replication_caller_check_window(op_ctx->info.data_group_id,
+                    FS_BLOCK_HASH_CODE(op_ctx->info.bs_key.block)) != 0)
+        {
+            response->error.length = sprintf(response->error.message,
+                    "data group id: %d, the replication window is full, "
+                    "please retry later", op_ctx->info.data_group_id);
+            return EBUSY;
+        }
     } else {
         if (op_ctx->info.myself->status != FS_SERVER_STATUS_ACTIVE) {
-            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+            response->error.length = sprintf(response->error.message,
                     "data group id: %d, i am NOT active, my status: %d",
                     op_ctx->info.data_group_id, op_ctx->info.myself->status);
             return EINVAL;
@@ -79,13 +90,13 @@ static int parse_check_block_key_ex(struct fast_task_info *task,
     return 0;
 }
 
-int du_handler_parse_check_block_slice(struct fast_task_info *task,
+int du_handler_parse_check_block_slice_ex(FSResponseInfo *response,
         FSSliceOpContext *op_ctx, const FSProtoBlockSlice *bs,
         const bool master_only)
 {
     int result;
 
-    if ((result=parse_check_block_key_ex(task, op_ctx,
+    if ((result=du_handler_parse_check_block_key_ex(response, op_ctx,
                     &bs->bkey, master_only)) != 0)
     {
         return result;
@@ -96,8 +107,8 @@ int du_handler_parse_check_block_slice(struct fast_task_info *task,
     if (op_ctx->info.bs_key.slice.offset < 0 || op_ctx->info.bs_key.slice.offset >=
             FS_FILE_BLOCK_SIZE)
     {
-        RESPONSE.error.length = sprintf(
-                RESPONSE.error.message, "slice offset: %d "
+        response->error.length = sprintf(
+                response->error.message, "slice offset: %d "
                 "is invalid which < 0 or exceeds the block size %d",
                 op_ctx->info.bs_key.slice.offset, FS_FILE_BLOCK_SIZE);
         return EINVAL;
@@ -105,7 +116,7 @@ int du_handler_parse_check_block_slice(struct fast_task_info *task,
     if (op_ctx->info.bs_key.slice.length <= 0 || op_ctx->info.bs_key.slice.offset +
             op_ctx->info.bs_key.slice.length > FS_FILE_BLOCK_SIZE)
     {
-        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+        response->error.length = sprintf(response->error.message,
                 "slice offset: %d, length: %d is invalid which <= 0, "
                 "or offset + length exceeds the block size %d",
                 op_ctx->info.bs_key.slice.offset,
@@ -117,13 +128,19 @@ int du_handler_parse_check_block_slice(struct fast_task_info *task,
 }
 
 static inline void fill_slice_update_response(struct fast_task_info *task,
-        const int inc_alloc)
+        FSSliceOpContext *op_ctx, const int inc_alloc)
 {
     FSProtoSliceUpdateResp *resp;
     resp = (FSProtoSliceUpdateResp *)REQUEST.body;
     int2buff(inc_alloc, resp->inc_alloc);
 
-    RESPONSE.header.body_len = sizeof(FSProtoSliceUpdateResp);
+    //the old clients expect the response without the data version
+    if ((REQUEST.header.flags & FS_PROTO_FLAGS_DATA_VERSION) != 0) {
+        long2buff(op_ctx->info.data_version, resp->data_version);
+        RESPONSE.header.body_len = sizeof(FSProtoSliceUpdateResp);
+    } else {
+        RESPONSE.header.body_len = FS_PROTO_SLICE_UPDATE_RESP_MIN_SIZE;
+    }
     TASK_ARG->context.response_done = true;
 }
 
@@ -131,7 +148,8 @@ static int handle_slice_write_replica_done(struct fast_task_info *task)
 {
     TASK_ARG->context.deal_func = NULL;
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SLICE_WRITE_RESP;
-    fill_slice_update_response(task, SLICE_OP_CTX.write.inc_alloc);
+    fill_slice_update_response(task, &SLICE_OP_CTX,
+            SLICE_OP_CTX.write.inc_alloc);
 
     logInfo("file: "__FILE__", line: %d, "
             "inc_alloc: %d, status: %d", __LINE__,
@@ -168,7 +186,8 @@ static void master_slice_write_done_notify(FSSliceOpContext *op_ctx)
             TASK_ARG->context.deal_func = handle_slice_write_replica_done;
         } else {
             RESPONSE.header.cmd = FS_SERVICE_PROTO_SLICE_WRITE_RESP;
-            fill_slice_update_response(task, op_ctx->write.inc_alloc);
+            fill_slice_update_response(task, op_ctx,
+                    op_ctx->write.inc_alloc);
         }
 
         logInfo("file: "__FILE__", line: %d, "
@@ -213,9 +232,18 @@ static void slave_slice_write_done_notify(FSSliceOpContext *op_ctx)
     if (SERVER_TASK_TYPE == FS_SERVER_TASK_TYPE_REPLICATION &&
             REPLICA_REPLICATION != NULL)
     {
-        replication_callee_push_to_rpc_result_queue(REPLICA_REPLICATION,
-                op_ctx->info.data_version, op_ctx->result);
+        //ack after the next replica of the chain acked
+        if (!(op_ctx->result == 0 && replication_caller_forward_to_chain_next(
+                        REPLICA_REPLICATION, op_ctx,
+                        FS_SERVICE_PROTO_SLICE_WRITE_REQ) == 0))
+        {
+            replication_callee_push_to_rpc_result_queue(REPLICA_REPLICATION,
+                    op_ctx->info.data_group_id, op_ctx->info.data_version,
+                    op_ctx->result);
+        }
     }
+    server_trace_finish(op_ctx, TASK_CTX.which_side,
+            FS_SERVICE_PROTO_SLICE_WRITE_REQ, op_ctx->result);
 
     op_buffer_ctx = fc_list_entry(op_ctx, FSSliceOpBufferContext, op_ctx);
     shared_buffer_release(op_buffer_ctx->buffer);
@@ -301,6 +329,7 @@ int du_handler_deal_slice_write(struct fast_task_info *task,
     }
     */
 
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_PARSE);
     op_ctx->info.write_data_binlog = true;
     if ((result=fs_slice_write(op_ctx, buff)) != 0) {
         du_handler_set_slice_op_error_msg(task, op_ctx, "write", result);
@@ -330,6 +359,7 @@ int du_handler_deal_slice_allocate(struct fast_task_info *task,
         return result;
     }
 
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_PARSE);
     op_ctx->info.write_data_binlog = true;
     if ((result=fs_slice_allocate_ex(op_ctx, ((FSServerContext *)
                         task->thread_data->arg)->service.slice_ptr_array,
@@ -340,7 +370,7 @@ int du_handler_deal_slice_allocate(struct fast_task_info *task,
     }
 
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SLICE_ALLOCATE_RESP;
-    fill_slice_update_response(task, inc_alloc);
+    fill_slice_update_response(task, op_ctx, inc_alloc);
     return 0;
 }
 
@@ -364,6 +394,7 @@ int du_handler_deal_slice_delete(struct fast_task_info *task,
         return result;
     }
 
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_PARSE);
     op_ctx->info.write_data_binlog = true;
     if ((result=fs_delete_slices(op_ctx, &dec_alloc)) != 0) {
         du_handler_set_slice_op_error_msg(task, op_ctx, "delete", result);
@@ -371,7 +402,7 @@ int du_handler_deal_slice_delete(struct fast_task_info *task,
     }
 
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SLICE_DELETE_RESP;
-    fill_slice_update_response(task, dec_alloc);
+    fill_slice_update_response(task, op_ctx, dec_alloc);
     return 0;
 }
 
@@ -389,12 +420,13 @@ int du_handler_deal_block_delete(struct fast_task_info *task,
     }
 
     req = (FSProtoBlockDeleteReq *)op_ctx->info.body;
-    if ((result=parse_check_block_key_ex(task, op_ctx, &req->bkey,
+    if ((result=du_handler_parse_check_block_key(task, op_ctx, &req->bkey,
                     TASK_CTX.which_side == FS_WHICH_SIDE_MASTER)) != 0)
     {
         return result;
     }
 
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_PARSE);
     op_ctx->info.write_data_binlog = true;
     if ((result=fs_delete_block(op_ctx, &dec_alloc)) != 0) {
         set_block_op_error_msg(task, op_ctx, "delete", result);
@@ -402,6 +434,6 @@ int du_handler_deal_block_delete(struct fast_task_info *task,
     }
 
     RESPONSE.header.cmd = FS_SERVICE_PROTO_BLOCK_DELETE_RESP;
-    fill_slice_update_response(task, dec_alloc);
+    fill_slice_update_response(task, op_ctx, dec_alloc);
     return 0;
 }
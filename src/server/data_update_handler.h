@@ -16,7 +16,20 @@ extern "C" {
 #define du_handler_parse_check_readable_block_slice(task, bs) \
     du_handler_parse_check_block_slice(task, &SLICE_OP_CTX, bs, false)
 
-int du_handler_parse_check_block_slice(struct fast_task_info *task,
+#define du_handler_parse_check_block_key(task, op_ctx, bkey, master_only) \
+    du_handler_parse_check_block_key_ex(&RESPONSE, op_ctx, bkey, master_only)
+
+#define du_handler_parse_check_block_slice(task, op_ctx, bs, master_only) \
+    du_handler_parse_check_block_slice_ex(&RESPONSE, op_ctx, bs, master_only)
+
+#define du_handler_set_slice_op_error_msg(task, op_ctx, caption, result) \
+    du_handler_set_slice_op_error_msg_ex(&RESPONSE, op_ctx, caption, result)
+
+int du_handler_parse_check_block_key_ex(FSResponseInfo *response,
+        FSSliceOpContext *op_ctx, const FSProtoBlockKey *bkey,
+        const bool master_only);
+
+int du_handler_parse_check_block_slice_ex(FSResponseInfo *response,
         FSSliceOpContext *op_ctx, const FSProtoBlockSlice *bs,
         const bool master_only);
 
@@ -32,10 +45,11 @@ int du_handler_deal_slice_delete(struct fast_task_info *task,
 int du_handler_deal_block_delete(struct fast_task_info *task,
         FSSliceOpContext *op_ctx);
 
-static inline void du_handler_set_slice_op_error_msg(struct fast_task_info *
-        task, FSSliceOpContext *op_ctx, const char *caption, const int result)
+static inline void du_handler_set_slice_op_error_msg_ex(FSResponseInfo *
+        response, FSSliceOpContext *op_ctx, const char *caption,
+        const int result)
 {
-    RESPONSE.error.length = sprintf(RESPONSE.error.message,
+    response->error.length = sprintf(response->error.message,
             "slice %s fail, result: %d, block {oid: %"PRId64", "
             "offset: %"PRId64"}, slice {offset: %d, length: %d}",
             caption, result, op_ctx->info.bs_key.block.oid,
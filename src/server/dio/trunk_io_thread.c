@@ -1,9 +1,13 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#ifdef OS_LINUX
+#include <linux/falloc.h>
+#endif
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
 #include "fastcommon/fast_mblock.h"
+#include "fastcommon/sched_thread.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "../binlog/trunk_binlog.h"
@@ -13,9 +17,29 @@
 #define IO_THREAD_ROLE_WRITER   'W'
 #define IO_THREAD_ROLE_READER   'R'
 
+#define TRUNK_ZERO_BUFFER_SIZE  (1024 * 1024)
+
+//the write latency halves every N seconds without samples
+#define TRUNK_WRITE_LATENCY_DECAY_SECONDS  5
+
+static const int io_types[FS_IO_TYPE_COUNT] = {
+    FS_IO_TYPE_CREATE_TRUNK, FS_IO_TYPE_DELETE_TRUNK,
+    FS_IO_TYPE_PUNCH_HOLE, FS_IO_TYPE_WRITE_SLICE,
+    FS_IO_TYPE_READ_SLICE
+};
+
+typedef struct trunk_io_thread_stat {
+    FSLatencyHistogram wait;
+    FSLatencyHistogram service;
+    TrunkIOTypeStat types[FS_IO_TYPE_COUNT];  //updated by the IO thread only
+} TrunkIOThreadStat;
+
+struct trunk_io_path_context;
 typedef struct trunk_io_thread_context {
     TrunkIOBuffer *head;
     TrunkIOBuffer *tail;
+    volatile int queue_depth;
+    struct trunk_io_path_context *path_ctx;
     pthread_mutex_t lock;
     pthread_cond_t cond;
     struct fast_mblock_man mblock;
@@ -24,6 +48,7 @@ typedef struct trunk_io_thread_context {
         TrunkIdFDPair pair;
     } fd_cache;
     int role;
+    TrunkIOThreadStat stat;
 } TrunkIOThreadContext;
 
 typedef struct trunk_io_thread_context_array {
@@ -34,6 +59,10 @@ typedef struct trunk_io_thread_context_array {
 typedef struct trunk_io_path_context {
     TrunkIOThreadContextArray writes;
     TrunkIOThreadContextArray reads;
+    volatile int64_t write_latency_us;  //EWMA of slice write time
+    volatile time_t latency_sample_time;
+    volatile bool punch_unsupported;  //the file system not support
+    const string_t *path;
 } TrunkIOPathContext;
 
 typedef struct trunk_io_path_contexts_array {
@@ -45,6 +74,22 @@ static TrunkIOPathContextArray io_path_context_array = {0, NULL};
 
 static void *trunk_io_thread_func(void *arg);
 
+static inline int get_io_type_index(const int type)
+{
+    switch (type) {
+        case FS_IO_TYPE_CREATE_TRUNK:
+            return 0;
+        case FS_IO_TYPE_DELETE_TRUNK:
+            return 1;
+        case FS_IO_TYPE_PUNCH_HOLE:
+            return 2;
+        case FS_IO_TYPE_WRITE_SLICE:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
 static int alloc_path_contexts()
 {
     int bytes;
@@ -115,16 +160,21 @@ static int init_thread_context(TrunkIOThreadContext *ctx)
             ctx, SF_G_THREAD_STACK_SIZE);
 }
 
-static int init_thread_contexts(TrunkIOThreadContextArray *ctx_array,
-        const int role)
+static int init_thread_contexts(TrunkIOPathContext *path_ctx,
+        TrunkIOThreadContextArray *ctx_array, const int role)
 {
     int result;
     TrunkIOThreadContext *ctx;
     TrunkIOThreadContext *end;
-    
+    int i;
+
     end = ctx_array->contexts + ctx_array->count;
     for (ctx=ctx_array->contexts; ctx<end; ctx++) {
         ctx->role = role;
+        ctx->path_ctx = path_ctx;
+        for (i=0; i<FS_IO_TYPE_COUNT; i++) {
+            ctx->stat.types[i].type = io_types[i];
+        }
         if ((result=init_thread_context(ctx)) != 0) {
             return result;
         }
@@ -145,6 +195,7 @@ static int init_path_contexts(FSStoragePathArray *parray)
     end = parray->paths + parray->count;
     for (p=parray->paths; p<end; p++) {
         path_ctx = io_path_context_array.paths + p->store.index;
+        path_ctx->path = &p->store.path;
         thread_count = p->write_thread_count + p->read_thread_count;
         if ((thread_ctxs=alloc_thread_contexts(thread_count)) == NULL)
         {
@@ -153,7 +204,7 @@ static int init_path_contexts(FSStoragePathArray *parray)
 
         path_ctx->writes.contexts = thread_ctxs;
         path_ctx->writes.count = p->write_thread_count;
-        if ((result=init_thread_contexts(&path_ctx->writes,
+        if ((result=init_thread_contexts(path_ctx, &path_ctx->writes,
                         IO_THREAD_ROLE_WRITER)) != 0)
         {
             return result;
@@ -161,7 +212,7 @@ static int init_path_contexts(FSStoragePathArray *parray)
 
         path_ctx->reads.contexts = thread_ctxs + p->write_thread_count;
         path_ctx->reads.count = p->read_thread_count;
-        if ((result=init_thread_contexts(&path_ctx->reads,
+        if ((result=init_thread_contexts(path_ctx, &path_ctx->reads,
                         IO_THREAD_ROLE_READER)) != 0)
         {
             return result;
@@ -171,6 +222,151 @@ static int init_path_contexts(FSStoragePathArray *parray)
     return 0;
 }
 
+static void sum_role_stat(TrunkIOThreadContextArray *ctx_array,
+        TrunkIORoleStat *role_stat, TrunkIOTypeStat *types)
+{
+    FSLatencyHistogram wait;
+    FSLatencyHistogram service;
+    TrunkIOThreadContext *ctx;
+    TrunkIOThreadContext *end;
+    int i;
+
+    memset(&wait, 0, sizeof(wait));
+    memset(&service, 0, sizeof(service));
+    role_stat->thread_count = ctx_array->count;
+    role_stat->queue_depth = 0;
+    end = ctx_array->contexts + ctx_array->count;
+    for (ctx=ctx_array->contexts; ctx<end; ctx++) {
+        role_stat->queue_depth += ctx->queue_depth;
+        fs_histogram_merge(&wait, &ctx->stat.wait);
+        fs_histogram_merge(&service, &ctx->stat.service);
+        for (i=0; i<FS_IO_TYPE_COUNT; i++) {
+            types[i].ops += ctx->stat.types[i].ops;
+            types[i].bytes += ctx->stat.types[i].bytes;
+            types[i].errors += ctx->stat.types[i].errors;
+        }
+    }
+
+    fs_histogram_stat(&wait, &role_stat->wait);
+    fs_histogram_stat(&service, &role_stat->service);
+}
+
+int trunk_io_thread_get_path_count()
+{
+    return io_path_context_array.count;
+}
+
+int trunk_io_thread_get_path_stat(const int path_index,
+        TrunkIOPathStat *stat)
+{
+    TrunkIOPathContext *path_ctx;
+    int i;
+
+    if (path_index < 0 || path_index >= io_path_context_array.count) {
+        return ENOENT;
+    }
+    path_ctx = io_path_context_array.paths + path_index;
+    if (path_ctx->path == NULL) {
+        return ENOENT;
+    }
+
+    stat->path_index = path_index;
+    for (i=0; i<FS_IO_TYPE_COUNT; i++) {
+        stat->types[i].type = io_types[i];
+        stat->types[i].ops = stat->types[i].bytes =
+            stat->types[i].errors = 0;
+    }
+    sum_role_stat(&path_ctx->reads, &stat->reads, stat->types);
+    sum_role_stat(&path_ctx->writes, &stat->writes, stat->types);
+    return 0;
+}
+
+static int thread_stat_to_string(TrunkIOThreadContextArray *ctx_array,
+        char *buff, const int size)
+{
+    TrunkIOThreadContext *ctx;
+    TrunkIOThreadContext *end;
+    FSHistogramStat service;
+    int len;
+
+    len = 0;
+    end = ctx_array->contexts + ctx_array->count;
+    for (ctx=ctx_array->contexts; ctx<end && len<size; ctx++) {
+        fs_histogram_stat(&ctx->stat.service, &service);
+        len += snprintf(buff + len, size - len, "%s%d/%"PRId64,
+                (ctx == ctx_array->contexts ? "" : " "),
+                ctx->queue_depth, service.p99);
+    }
+    return len;
+}
+
+static int log_stat_func(void *args)
+{
+    TrunkIOPathContext *path_ctx;
+    TrunkIOPathStat stat;
+    TrunkIOTypeStat *type_stat;
+    char read_threads[256];
+    char write_threads[256];
+    char types[512];
+    int len;
+    int i;
+
+    for (i=0; i<io_path_context_array.count; i++) {
+        if (trunk_io_thread_get_path_stat(i, &stat) != 0) {
+            continue;
+        }
+
+        path_ctx = io_path_context_array.paths + i;
+        thread_stat_to_string(&path_ctx->reads, read_threads,
+                sizeof(read_threads));
+        thread_stat_to_string(&path_ctx->writes, write_threads,
+                sizeof(write_threads));
+
+        len = 0;
+        for (type_stat=stat.types; type_stat<stat.types +
+                FS_IO_TYPE_COUNT && len<sizeof(types); type_stat++)
+        {
+            len += snprintf(types + len, sizeof(types) - len,
+                    "%s%c: %"PRId64"/%"PRId64"/%"PRId64,
+                    (type_stat == stat.types ? "" : ", "),
+                    type_stat->type, type_stat->ops,
+                    type_stat->bytes, type_stat->errors);
+        }
+
+        logInfo("file: "__FILE__", line: %d, "
+                "disk IO stat of path #%d: %s, latency in us, "
+                "read {queue depth: %d, wait p99: %"PRId64", "
+                "service p50: %"PRId64", p99: %"PRId64", max: %"PRId64", "
+                "threads depth/p99: %s}, write {queue depth: %d, "
+                "wait p99: %"PRId64", service p50: %"PRId64", "
+                "p99: %"PRId64", max: %"PRId64", threads depth/p99: %s}, "
+                "ops/bytes/errors {%s}", __LINE__, i,
+                path_ctx->path->str, stat.reads.queue_depth,
+                stat.reads.wait.p99, stat.reads.service.p50,
+                stat.reads.service.p99, stat.reads.service.max,
+                read_threads, stat.writes.queue_depth,
+                stat.writes.wait.p99, stat.writes.service.p50,
+                stat.writes.service.p99, stat.writes.service.max,
+                write_threads, types);
+    }
+
+    return 0;
+}
+
+static int setup_log_stat_task()
+{
+    ScheduleEntry schedule_entry;
+    ScheduleArray schedule_array;
+
+    INIT_SCHEDULE_ENTRY(schedule_entry, sched_generate_next_id(),
+            0, 0, 0, STORAGE_CFG.io_stat_log_interval,
+            log_stat_func, NULL);
+
+    schedule_array.count = 1;
+    schedule_array.entries = &schedule_entry;
+    return sched_add_entries(&schedule_array);
+}
+
 int trunk_io_thread_init()
 {
     int result;
@@ -186,6 +382,12 @@ int trunk_io_thread_init()
         return result;
     }
 
+    if (STORAGE_CFG.io_stat_log_interval > 0) {
+        if ((result=setup_log_stat_task()) != 0) {
+            return result;
+        }
+    }
+
     logInfo("io_path_context_array.count: %d", io_path_context_array.count);
     return 0;
 }
@@ -194,8 +396,63 @@ void trunk_io_thread_terminate()
 {
 }
 
-int trunk_io_thread_push(const int type, const int path_index,
+static int get_queue_depth(TrunkIOThreadContextArray *ctx_array)
+{
+    TrunkIOThreadContext *ctx;
+    TrunkIOThreadContext *end;
+    int depth;
+
+    depth = 0;
+    end = ctx_array->contexts + ctx_array->count;
+    for (ctx=ctx_array->contexts; ctx<end; ctx++) {
+        depth += ctx->queue_depth;
+    }
+    return depth;
+}
+
+int trunk_io_thread_get_write_queue_depth(const int path_index)
+{
+    return get_queue_depth(&io_path_context_array.paths[path_index].writes);
+}
+
+void trunk_io_thread_get_queue_depths(int *read_depth, int *write_depth)
+{
+    TrunkIOPathContext *path_ctx;
+    TrunkIOPathContext *end;
+
+    *read_depth = *write_depth = 0;
+    end = io_path_context_array.paths + io_path_context_array.count;
+    for (path_ctx=io_path_context_array.paths; path_ctx<end; path_ctx++) {
+        *read_depth += get_queue_depth(&path_ctx->reads);
+        *write_depth += get_queue_depth(&path_ctx->writes);
+    }
+}
+
+/* the latency halves every TRUNK_WRITE_LATENCY_DECAY_SECONDS without
+ * samples, so the path looked slow is chosen and sampled again */
+static inline int64_t get_decayed_write_latency(TrunkIOPathContext *path_ctx)
+{
+    int64_t latency;
+    int shift;
+
+    latency = path_ctx->write_latency_us;
+    shift = (get_current_time() - path_ctx->latency_sample_time) /
+        TRUNK_WRITE_LATENCY_DECAY_SECONDS;
+    if (shift <= 0) {
+        return latency;
+    }
+    return (shift < 63) ? latency >> shift : 0;
+}
+
+int64_t trunk_io_thread_get_write_latency(const int path_index)
+{
+    return get_decayed_write_latency(io_path_context_array.
+            paths + path_index);
+}
+
+int trunk_io_thread_push_ex(const int type, const int path_index,
         const uint32_t hash_code, void *entry, char *buff,
+        struct iovec *iovs, const int iovcnt,
         trunk_io_notify_func notify_func, void *notify_args)
 {
     TrunkIOPathContext *path_ctx;
@@ -220,7 +477,9 @@ int trunk_io_thread_push(const int type, const int path_index,
     }
 
     iob->type = type;
-    if (type == FS_IO_TYPE_CREATE_TRUNK || type == FS_IO_TYPE_DELETE_TRUNK) {
+    if (type == FS_IO_TYPE_CREATE_TRUNK || type == FS_IO_TYPE_DELETE_TRUNK ||
+            type == FS_IO_TYPE_PUNCH_HOLE)
+    {
         iob->space = *((FSTrunkSpaceInfo *)entry);
     } else {
         iob->slice = (OBSliceEntry *)entry;
@@ -232,8 +491,11 @@ int trunk_io_thread_push(const int type, const int path_index,
         iob->data.str = NULL;
     }
     iob->data.len = 0;
+    iob->iovec_array.iovs = iovs;
+    iob->iovec_array.count = iovcnt;
     iob->notify.func = notify_func;
     iob->notify.args = notify_args;
+    iob->push_time_us = get_current_time_us();
     iob->next = NULL;
 
     if (thread_ctx->tail == NULL) {
@@ -244,6 +506,7 @@ int trunk_io_thread_push(const int type, const int path_index,
         notify = false;
     }
     thread_ctx->tail = iob;
+    thread_ctx->queue_depth++;
     pthread_mutex_unlock(&thread_ctx->lock);
 
     if (notify) {
@@ -325,6 +588,65 @@ static int get_read_fd(TrunkIOThreadContext *ctx,
     return 0;
 }
 
+static int fill_trunk_zeros(int fd, const char *trunk_filename,
+        const int64_t size)
+{
+    static char zero_buff[TRUNK_ZERO_BUFFER_SIZE];
+    int64_t offset;
+    int bytes;
+    int result;
+
+    offset = 0;
+    while (offset < size) {
+        bytes = (size - offset < TRUNK_ZERO_BUFFER_SIZE) ?
+            size - offset : TRUNK_ZERO_BUFFER_SIZE;
+        if ((bytes=pwrite(fd, zero_buff, bytes, offset)) < 0) {
+            result = errno != 0 ? errno : EIO;
+            if (result == EINTR) {
+                continue;
+            }
+
+            logError("file: "__FILE__", line: %d, "
+                    "write to trunk file: %s fail, offset: %"PRId64", "
+                    "errno: %d, error info: %s", __LINE__, trunk_filename,
+                    offset, result, STRERROR(result));
+            return result;
+        }
+        offset += bytes;
+    }
+
+    return 0;
+}
+
+static int prealloc_trunk_file(int fd, const char *trunk_filename,
+        const int64_t size)
+{
+    if (STORAGE_CFG.trunk_file_prealloc == FS_TRUNK_FILE_PREALLOC_NONE) {
+        return 0;
+    }
+
+#ifdef OS_LINUX
+    if (fallocate(fd, 0, 0, size) != 0) {
+        int result;
+
+        result = errno != 0 ? errno : EIO;
+        if (result != EOPNOTSUPP) {
+            logError("file: "__FILE__", line: %d, "
+                    "fallocate file \"%s\" fail, size: %"PRId64", "
+                    "errno: %d, error info: %s", __LINE__, trunk_filename,
+                    size, result, STRERROR(result));
+            return result;
+        }
+        //the file system not support, fall back to ftruncate
+    }
+#endif
+
+    if (STORAGE_CFG.trunk_file_prealloc == FS_TRUNK_FILE_PREALLOC_ZERO) {
+        return fill_trunk_zeros(fd, trunk_filename, size);
+    }
+    return 0;
+}
+
 static int do_create_trunk(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
 {
     char trunk_filename[PATH_MAX];
@@ -363,9 +685,13 @@ static int do_create_trunk(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
     }
 
     if (ftruncate(fd, iob->space.size) == 0) {
-        result = trunk_binlog_write(FS_IO_TYPE_CREATE_TRUNK,
-                iob->space.store->index, &iob->space.id_info,
-                iob->space.size);
+        if ((result=prealloc_trunk_file(fd, trunk_filename,
+                        iob->space.size)) == 0)
+        {
+            result = trunk_binlog_write(FS_IO_TYPE_CREATE_TRUNK,
+                    iob->space.store->index, &iob->space.id_info,
+                    iob->space.size);
+        }
     } else {
         result = errno != 0 ? errno : EACCES;
         logError("file: "__FILE__", line: %d, "
@@ -399,6 +725,50 @@ static int do_delete_trunk(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
     return result;
 }
 
+static int do_punch_hole(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    char trunk_filename[PATH_MAX];
+    int fd;
+    int result;
+
+    if (ctx->path_ctx->punch_unsupported) {
+        return 0;
+    }
+
+    if ((result=get_write_fd(ctx, &iob->space, &fd)) != 0) {
+        return result;
+    }
+
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                iob->space.offset, iob->space.size) == 0)
+    {
+        return 0;
+    }
+
+    result = errno != 0 ? errno : EIO;
+    get_trunk_filename(&iob->space, trunk_filename, sizeof(trunk_filename));
+    if (result == EOPNOTSUPP) {
+        ctx->path_ctx->punch_unsupported = true;
+        logWarning("file: "__FILE__", line: %d, "
+                "the file system of store path: %s not support "
+                "punching hole, the deleted space of the trunk files "
+                "can't be released, trunk file: %s", __LINE__,
+                iob->space.store->path.str, trunk_filename);
+        return 0;
+    }
+
+    logError("file: "__FILE__", line: %d, "
+            "punch hole of trunk file: %s fail, offset: %"PRId64", "
+            "size: %"PRId64", errno: %d, error info: %s", __LINE__,
+            trunk_filename, iob->space.offset, iob->space.size,
+            result, STRERROR(result));
+    return result;
+#else
+    return 0;
+#endif
+}
+
 static int do_write_slice(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
 {
     int fd;
@@ -494,10 +864,115 @@ static int do_read_slice(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
     return 0;
 }
 
+static int do_readv_slices(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
+{
+    struct iovec *iov;
+    struct iovec *end;
+    int64_t offset;
+    int iovcnt;
+    int fd;
+    int bytes;
+    int result;
+
+    if ((result=get_read_fd(ctx, &iob->slice->space, &fd)) != 0) {
+        return result;
+    }
+
+    offset = iob->slice->space.offset + iob->slice->read_offset;
+    iov = iob->iovec_array.iovs;
+    end = iob->iovec_array.iovs + iob->iovec_array.count;
+    while (iov < end) {
+        iovcnt = end - iov;
+        if ((bytes=preadv(fd, iov, iovcnt, offset + iob->data.len)) < 0) {
+            char trunk_filename[PATH_MAX];
+
+            result = errno != 0 ? errno : EIO;
+            if (result == EINTR) {
+                continue;
+            }
+
+            trunk_fd_cache_delete(&ctx->fd_cache.context,
+                    iob->slice->space.id_info.id);
+
+            get_trunk_filename(&iob->slice->space, trunk_filename,
+                    sizeof(trunk_filename));
+            logError("file: "__FILE__", line: %d, "
+                    "readv trunk file: %s fail, offset: %"PRId64", "
+                    "iovcnt: %d, errno: %d, error info: %s",
+                    __LINE__, trunk_filename, offset + iob->data.len,
+                    iovcnt, result, STRERROR(result));
+            return result;
+        } else if (bytes == 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "readv trunk id: %"PRId64" fail, offset: %"PRId64", "
+                    "unexpected end of file", __LINE__, iob->slice->
+                    space.id_info.id, offset + iob->data.len);
+            return ENODATA;
+        }
+
+        iob->data.len += bytes;
+
+        //skip the filled iovecs for partial read
+        while (iov < end && bytes >= (int)iov->iov_len) {
+            bytes -= iov->iov_len;
+            iov++;
+        }
+        if (bytes > 0) {
+            iov->iov_base = (char *)iov->iov_base + bytes;
+            iov->iov_len -= bytes;
+        }
+    }
+
+    return 0;
+}
+
+static inline void update_write_latency(TrunkIOPathContext *path_ctx,
+        const int64_t time_used)
+{
+    int64_t old_latency;
+
+    //EWMA with weight 1/8, the race among the writer threads is harmless
+    old_latency = get_decayed_write_latency(path_ctx);
+    if (old_latency == 0) {
+        path_ctx->write_latency_us = time_used;
+    } else {
+        path_ctx->write_latency_us = old_latency +
+            (time_used - old_latency) / 8;
+    }
+    path_ctx->latency_sample_time = get_current_time();
+}
+
+static inline void update_io_stat(TrunkIOThreadContext *ctx,
+        TrunkIOBuffer *iob, const int64_t start_time,
+        const int64_t end_time, const int result)
+{
+    TrunkIOTypeStat *type_stat;
+
+    fs_histogram_add(&ctx->stat.wait, start_time - iob->push_time_us);
+    fs_histogram_add(&ctx->stat.service, end_time - start_time);
+
+    type_stat = ctx->stat.types + get_io_type_index(iob->type);
+    type_stat->ops++;
+    if (result != 0) {
+        type_stat->errors++;
+    } else if (iob->type == FS_IO_TYPE_READ_SLICE ||
+            iob->type == FS_IO_TYPE_WRITE_SLICE)
+    {
+        type_stat->bytes += iob->data.len;
+    } else {
+        type_stat->bytes += iob->space.size;
+    }
+}
+
 static int trunk_io_deal_buffer(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
 {
+    int64_t start_time;
+    int64_t end_time;
     int result;
 
+    start_time = get_current_time_us();
+    iob->start_time_us = start_time;
+
     switch (iob->type) {
         case FS_IO_TYPE_CREATE_TRUNK:
             result = do_create_trunk(ctx, iob);
@@ -505,11 +980,18 @@ static int trunk_io_deal_buffer(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
         case FS_IO_TYPE_DELETE_TRUNK:
             result = do_delete_trunk(ctx, iob);
             break;
+        case FS_IO_TYPE_PUNCH_HOLE:
+            result = do_punch_hole(ctx, iob);
+            break;
         case FS_IO_TYPE_WRITE_SLICE:
             result = do_write_slice(ctx, iob);
             break;
         case FS_IO_TYPE_READ_SLICE:
-            result = do_read_slice(ctx, iob);
+            if (iob->iovec_array.count > 0) {
+                result = do_readv_slices(ctx, iob);
+            } else {
+                result = do_read_slice(ctx, iob);
+            }
             break;
         default:
             logError("file: "__FILE__", line: %d, "
@@ -518,6 +1000,12 @@ static int trunk_io_deal_buffer(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
             break;
     }
 
+    end_time = get_current_time_us();
+    if (iob->type == FS_IO_TYPE_WRITE_SLICE) {
+        update_write_latency(ctx->path_ctx, end_time - start_time);
+    }
+    update_io_stat(ctx, iob, start_time, end_time, result);
+
     if (iob->notify.func != NULL) {
         iob->notify.func(iob, result);
     }
@@ -551,6 +1039,7 @@ static void *trunk_io_thread_func(void *arg)
             iob_ptr = &iob_obj;
             iob_obj = *iob;
             fast_mblock_free_object(&ctx->mblock, iob);
+            ctx->queue_depth--;
         }
         pthread_mutex_unlock(&ctx->lock);
 
@@ -2,14 +2,19 @@
 #ifndef _TRUNK_IO_THREAD_H
 #define _TRUNK_IO_THREAD_H
 
+#include <sys/uio.h>
 #include "../../common/fs_types.h"
 #include "../storage/storage_config.h"
 #include "../storage/object_block_index.h"
+#include "../server_stat.h"
 
 #define FS_IO_TYPE_CREATE_TRUNK   'C'
 #define FS_IO_TYPE_DELETE_TRUNK   'D'
 #define FS_IO_TYPE_READ_SLICE     'R'
 #define FS_IO_TYPE_WRITE_SLICE    'W'
+#define FS_IO_TYPE_PUNCH_HOLE     'P'
+
+#define FS_IO_TYPE_COUNT  5  //for the IO stat
 
 struct trunk_io_buffer;
 
@@ -26,13 +31,41 @@ typedef struct trunk_io_buffer {
     };
 
     string_t data;
+    struct {
+        struct iovec *iovs;
+        int count;
+    } iovec_array;  //scatter list for merged slices read, count 0 for none
+
     struct {
         trunk_io_notify_func func;
         void *args;
     } notify;
+    int64_t push_time_us;  //for the queue wait time stat
+    int64_t start_time_us; //for the trace spans of the notify func
     struct trunk_io_buffer *next;
 } TrunkIOBuffer;
 
+typedef struct trunk_io_type_stat {
+    int type;
+    int64_t ops;
+    int64_t bytes;  //the trunk size for the trunk ops
+    int64_t errors;
+} TrunkIOTypeStat;
+
+typedef struct trunk_io_role_stat {
+    int thread_count;
+    int queue_depth;
+    FSHistogramStat wait;     //the queue wait time in microseconds
+    FSHistogramStat service;  //the disk IO time in microseconds
+} TrunkIORoleStat;
+
+typedef struct trunk_io_path_stat {
+    int path_index;
+    TrunkIORoleStat reads;
+    TrunkIORoleStat writes;
+    TrunkIOTypeStat types[FS_IO_TYPE_COUNT];
+} TrunkIOPathStat;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,10 +73,37 @@ extern "C" {
     int trunk_io_thread_init();
     void trunk_io_thread_terminate();
 
-    int trunk_io_thread_push(const int type, const int path_index,
+    //the pending write IO count of the store path
+    int trunk_io_thread_get_write_queue_depth(const int path_index);
+
+    //the pending IO count of all store paths
+    void trunk_io_thread_get_queue_depths(int *read_depth, int *write_depth);
+
+    //the recent slice write time in microseconds (EWMA)
+    int64_t trunk_io_thread_get_write_latency(const int path_index);
+
+    //the max store path index + 1
+    int trunk_io_thread_get_path_count();
+
+    /* the stat of the store path summed over its IO threads
+     * return 0 for success, ENOENT when the path index is not used */
+    int trunk_io_thread_get_path_stat(const int path_index,
+            TrunkIOPathStat *stat);
+
+    int trunk_io_thread_push_ex(const int type, const int path_index,
             const uint32_t hash_code, void *entry, char *buff,
+            struct iovec *iovs, const int iovcnt,
             trunk_io_notify_func notify_func, void *notify_args);
 
+    static inline int trunk_io_thread_push(const int type,
+            const int path_index, const uint32_t hash_code,
+            void *entry, char *buff, trunk_io_notify_func
+            notify_func, void *notify_args)
+    {
+        return trunk_io_thread_push_ex(type, path_index, hash_code,
+                entry, buff, NULL, 0, notify_func, notify_args);
+    }
+
     static inline int io_thread_push_trunk_op(const int type,
             const FSTrunkSpaceInfo *space, trunk_io_notify_func
             notify_func, void *notify_args)
@@ -53,6 +113,14 @@ extern "C" {
                 notify_func, notify_args);
     }
 
+    /* release the disk space of the dead range by punching hole,
+     * the space offset and size should be aligned by the fs block size */
+    static inline int io_thread_push_punch_hole(const FSTrunkSpaceInfo *space)
+    {
+        return io_thread_push_trunk_op(FS_IO_TYPE_PUNCH_HOLE,
+                space, NULL, NULL);
+    }
+
     static inline int io_thread_push_slice_op(const int type,
             OBSliceEntry *slice, char *buff, trunk_io_notify_func
             notify_func, void *notify_args)
@@ -62,6 +130,18 @@ extern "C" {
                 notify_func, notify_args);
     }
 
+    /* read the physically contiguous slices with one preadv call,
+     * the slice is the first one of these slices */
+    static inline int io_thread_push_slices_readv(OBSliceEntry *slice,
+            struct iovec *iovs, const int iovcnt, trunk_io_notify_func
+            notify_func, void *notify_args)
+    {
+        return trunk_io_thread_push_ex(FS_IO_TYPE_READ_SLICE,
+                slice->space.store->index, FS_BLOCK_HASH_CODE(
+                    slice->ob->bkey), slice, NULL, iovs, iovcnt,
+                notify_func, notify_args);
+    }
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,7 +35,9 @@
 #include "server_storage.h"
 #include "server_binlog.h"
 #include "server_replication.h"
+#include "recovery/recovery_thread.h"
 #include "dio/trunk_io_thread.h"
+#include "metrics_exporter.h"
 
 static bool daemon_mode = true;
 static int setup_server_env(const char *config_filename);
@@ -181,16 +183,26 @@ int main(int argc, char *argv[])
         sf_enable_thread_notify_ex(&REPLICA_SF_CTX, true);
         sf_set_remove_from_ready_list_ex(&REPLICA_SF_CTX, false);
 
-        result = sf_service_init(service_alloc_thread_extra_data, NULL,
-                NULL, fs_proto_set_body_length, service_deal_task,
+        result = sf_service_init(service_alloc_thread_extra_data,
+                service_thread_loop_callback, NULL,
+                fs_proto_set_body_length, service_deal_task,
                 service_task_finish_cleanup, NULL, 1000,
                 sizeof(FSProtoHeader), sizeof(FSServerTaskArg));
         if (result != 0) {
             break;
         }
+        sf_enable_thread_notify(true);
         sf_set_remove_from_ready_list(false);
 
-        result = replication_common_start();
+        if ((result=replication_common_start()) != 0) {
+            break;
+        }
+
+        if ((result=metrics_exporter_init()) != 0) {
+            break;
+        }
+
+        result = recovery_thread_init();
     } while (0);
 
     if (result != 0) {
@@ -209,7 +221,10 @@ int main(int argc, char *argv[])
         pthread_kill(schedule_tid, SIGINT);
     }
 
+    recovery_thread_destroy();
+    metrics_exporter_terminate();
     trunk_io_thread_terminate();
+    server_replication_terminate();
 
     wait_count = 0;
     while ((SF_G_ALIVE_THREAD_COUNT != 0 || SF_ALIVE_THREAD_COUNT(
@@ -0,0 +1,612 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/fast_buffer.h"
+#include "sf/sf_global.h"
+#include "common/fs_proto.h"
+#include "server_global.h"
+#include "server_stat.h"
+#include "dio/trunk_io_thread.h"
+#include "binlog/binlog_writer.h"
+#include "storage/object_block_index.h"
+#include "storage/storage_allocator.h"
+#include "replication/replication_caller.h"
+#include "metrics_exporter.h"
+
+#define METRICS_NETWORK_TIMEOUT     5
+#define METRICS_REQUEST_MAX_SIZE 4096
+#define METRICS_CONTENT_TYPE  "application/openmetrics-text; " \
+    "version=1.0.0; charset=utf-8"
+
+typedef struct {
+    int cmd;
+    FSCommandStat *stat;
+    FSHistogramStat latency;
+} MetricsCommandEntry;
+
+static int listen_sock = -1;
+static volatile bool continue_flag = false;
+static bool running = false;
+static pthread_t exporter_tid;
+static FastBuffer page_buffer;
+
+static void output_family(FastBuffer *buffer, const char *name,
+        const char *type, const char *help)
+{
+    fast_buffer_append(buffer, "# TYPE %s %s\n# HELP %s %s\n",
+            name, type, name, help);
+}
+
+/* the samples of the summary family, the max as the quantile 1,
+ * the microseconds to seconds. the labels end with a comma */
+static void output_quantiles(FastBuffer *buffer, const char *name,
+        const char *labels, const FSHistogramStat *stat)
+{
+    int len;
+
+    len = strlen(labels) - 1;
+    fast_buffer_append(buffer, "%s{%squantile=\"0.5\"} %.6f\n"
+            "%s{%squantile=\"0.99\"} %.6f\n"
+            "%s{%squantile=\"0.999\"} %.6f\n"
+            "%s{%squantile=\"1\"} %.6f\n"
+            "%s_sum{%.*s} %.6f\n%s_count{%.*s} %"PRId64"\n",
+            name, labels, stat->p50 / 1000000.00,
+            name, labels, stat->p99 / 1000000.00,
+            name, labels, stat->p999 / 1000000.00,
+            name, labels, stat->max / 1000000.00,
+            name, len, labels, stat->sum / 1000000.00,
+            name, len, labels, stat->count);
+}
+
+static const char *get_io_type_name(const int type)
+{
+    switch (type) {
+        case FS_IO_TYPE_CREATE_TRUNK:
+            return "create_trunk";
+        case FS_IO_TYPE_DELETE_TRUNK:
+            return "delete_trunk";
+        case FS_IO_TYPE_PUNCH_HOLE:
+            return "punch_hole";
+        case FS_IO_TYPE_WRITE_SLICE:
+            return "write_slice";
+        case FS_IO_TYPE_READ_SLICE:
+            return "read_slice";
+        default:
+            return "unknown";
+    }
+}
+
+static void output_server(FastBuffer *buffer)
+{
+    output_family(buffer, "fs_server_is_leader", "gauge",
+            "if this server is the cluster leader");
+    fast_buffer_append(buffer, "fs_server_is_leader{server_id=\"%d\"} %d\n",
+            CLUSTER_MY_SERVER_ID, MYSELF_IS_LEADER ? 1 : 0);
+
+    output_family(buffer, "fs_connections", "gauge",
+            "the client connection count");
+    fast_buffer_append(buffer, "fs_connections{state=\"current\"} %d\n"
+            "fs_connections{state=\"max\"} %d\n",
+            SF_G_CONN_CURRENT_COUNT, SF_G_CONN_MAX_COUNT);
+}
+
+static void output_commands(FastBuffer *buffer)
+{
+    MetricsCommandEntry entries[FS_STAT_COMMAND_COUNT];
+    MetricsCommandEntry *entry;
+    MetricsCommandEntry *end;
+    FSCommandStat *stat;
+    char labels[128];
+    int cmd;
+
+    end = entries;
+    for (cmd=0; cmd<FS_STAT_COMMAND_COUNT; cmd++) {
+        stat = server_stat_get_command(cmd);
+        if (stat->count > 0) {
+            end->cmd = cmd;
+            end->stat = stat;
+            fs_histogram_stat(&stat->latency, &end->latency);
+            end++;
+        }
+    }
+
+#define OUTPUT_COMMAND_COUNTER(name, field, help) \
+    do { \
+        output_family(buffer, name, "counter", help); \
+        for (entry=entries; entry<end; entry++) { \
+            fast_buffer_append(buffer, name"_total{cmd=\"%s\","   \
+                    "code=\"%d\"} %"PRId64"\n", fs_get_cmd_caption( \
+                        entry->cmd), entry->cmd, entry->stat->field); \
+        } \
+    } while (0)
+
+    OUTPUT_COMMAND_COUNTER("fs_requests", count,
+            "the processed request count");
+    OUTPUT_COMMAND_COUNTER("fs_request_errors", errors,
+            "the request count with error status");
+    OUTPUT_COMMAND_COUNTER("fs_request_received_bytes", bytes_in,
+            "the received bytes including the headers");
+    OUTPUT_COMMAND_COUNTER("fs_request_sent_bytes", bytes_out,
+            "the sent bytes including the headers");
+
+    output_family(buffer, "fs_request_latency_seconds", "summary",
+            "the request process time percentiles");
+    for (entry=entries; entry<end; entry++) {
+        snprintf(labels, sizeof(labels), "cmd=\"%s\",code=\"%d\",",
+                fs_get_cmd_caption(entry->cmd), entry->cmd);
+        output_quantiles(buffer, "fs_request_latency_seconds",
+                labels, &entry->latency);
+    }
+}
+
+static void output_data_groups(FastBuffer *buffer)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo *myself;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *dend;
+    int64_t replica_lag;
+    int inflight_count;
+    bool lagging;
+
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+
+#define OUTPUT_MY_DATA_GROUPS(name, type, help, format, value) \
+    do { \
+        output_family(buffer, name, type, help); \
+        for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) { \
+            if ((myself=group->myself) != NULL) { \
+                fast_buffer_append(buffer, name"{data_group=\"%d\"} " \
+                        format"\n", group->id, value); \
+            } \
+        } \
+    } while (0)
+
+    OUTPUT_MY_DATA_GROUPS("fs_data_group_is_master", "gauge",
+            "if this server is the master of the data group",
+            "%d", __sync_add_and_fetch(&myself->is_master, 0) ? 1 : 0);
+    OUTPUT_MY_DATA_GROUPS("fs_data_group_status", "gauge",
+            "the status of this server in the data group",
+            "%d", __sync_add_and_fetch(&myself->status, 0));
+    OUTPUT_MY_DATA_GROUPS("fs_data_group_version", "gauge",
+            "the data version of this server in the data group",
+            "%"PRId64, __sync_add_and_fetch(&myself->data_version, 0));
+
+    //the stat of the slaves is only known by the master
+#define OUTPUT_SLAVES(name, help, format, value) \
+    do { \
+        output_family(buffer, name, "gauge", help); \
+        for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) { \
+            if ((myself=group->myself) == NULL || !__sync_add_and_fetch( \
+                        &myself->is_master, 0)) \
+            { \
+                continue; \
+            } \
+            dend = group->data_server_array.servers + \
+                group->data_server_array.count; \
+            for (ds=group->data_server_array.servers; ds<dend; ds++) { \
+                if (ds == myself) { \
+                    continue; \
+                } \
+                replication_caller_get_slave_stat(ds, &replica_lag, \
+                        &inflight_count, &lagging); \
+                fast_buffer_append(buffer, name"{data_group=\"%d\"," \
+                        "server_id=\"%d\"} "format"\n", group->id, \
+                        ds->cs->server->id, value); \
+            } \
+        } \
+    } while (0)
+
+    OUTPUT_SLAVES("fs_replica_lag_versions",
+            "the data versions which the slave not acked yet",
+            "%"PRId64, replica_lag);
+    OUTPUT_SLAVES("fs_replica_inflight_rpcs",
+            "the in flight rpc count of the replications to the slave",
+            "%d", inflight_count);
+    OUTPUT_SLAVES("fs_replica_lagging",
+            "if the slave is too slow to catch up",
+            "%d", lagging ? 1 : 0);
+
+    output_family(buffer, "fs_replica_compress_bytes", "counter",
+            "the bytes before and after compressed");
+    fast_buffer_append(buffer,
+            "fs_replica_compress_bytes_total{stream=\"replication\","
+            "stage=\"before\"} %"PRId64"\n"
+            "fs_replica_compress_bytes_total{stream=\"replication\","
+            "stage=\"after\"} %"PRId64"\n"
+            "fs_replica_compress_bytes_total{stream=\"fetch_binlog\","
+            "stage=\"before\"} %"PRId64"\n"
+            "fs_replica_compress_bytes_total{stream=\"fetch_binlog\","
+            "stage=\"after\"} %"PRId64"\n",
+            REPLICA_COMPRESS_STAT.replication.bytes_before,
+            REPLICA_COMPRESS_STAT.replication.bytes_after,
+            REPLICA_COMPRESS_STAT.fetch_binlog.bytes_before,
+            REPLICA_COMPRESS_STAT.fetch_binlog.bytes_after);
+}
+
+static void output_binlog_writers(FastBuffer *buffer)
+{
+    BinlogWriterStat stats[FS_BINLOG_WRITER_MAX_THREADS];
+    BinlogWriterStat *stat;
+    BinlogWriterStat *end;
+    char labels[128];
+    int count;
+
+    count = binlog_writer_get_stats(stats, FS_BINLOG_WRITER_MAX_THREADS);
+    end = stats + count;
+
+    output_family(buffer, "fs_binlog_writer_queue_depth", "gauge",
+            "the binlog records waiting to write");
+    for (stat=stats; stat<end; stat++) {
+        fast_buffer_append(buffer, "fs_binlog_writer_queue_depth"
+                "{writer=\"%s\"} %"PRId64"\n", stat->name,
+                stat->queue_depth);
+    }
+
+    output_family(buffer, "fs_binlog_fsyncs", "counter",
+            "the fsync count of the binlog files");
+    for (stat=stats; stat<end; stat++) {
+        fast_buffer_append(buffer, "fs_binlog_fsyncs_total"
+                "{writer=\"%s\"} %"PRId64"\n", stat->name,
+                stat->fsync_latency.count);
+    }
+
+    output_family(buffer, "fs_binlog_fsync_latency_seconds", "summary",
+            "the fsync time percentiles of the binlog files");
+    for (stat=stats; stat<end; stat++) {
+        snprintf(labels, sizeof(labels), "writer=\"%s\",", stat->name);
+        output_quantiles(buffer, "fs_binlog_fsync_latency_seconds",
+                labels, &stat->fsync_latency);
+    }
+}
+
+static void output_disks(FastBuffer *buffer)
+{
+    TrunkIOPathStat *stats;
+    TrunkIOPathStat *stat;
+    TrunkIOPathStat *end;
+    TrunkIORoleStat *role_stat;
+    TrunkIOTypeStat *type_stat;
+    char labels[128];
+    int path_count;
+    int i;
+
+    path_count = trunk_io_thread_get_path_count();
+    stats = (TrunkIOPathStat *)fc_malloc(sizeof(TrunkIOPathStat) *
+            (path_count > 0 ? path_count : 1));
+    if (stats == NULL) {
+        return;
+    }
+
+    end = stats;
+    for (i=0; i<path_count; i++) {
+        if (trunk_io_thread_get_path_stat(i, end) == 0) {
+            end++;
+        }
+    }
+
+    output_family(buffer, "fs_disk_queue_depth", "gauge",
+            "the pending IO count of the disk threads");
+    for (stat=stats; stat<end; stat++) {
+        fast_buffer_append(buffer, "fs_disk_queue_depth{path_index=\"%d\","
+                "role=\"read\"} %d\nfs_disk_queue_depth{path_index=\"%d\","
+                "role=\"write\"} %d\n", stat->path_index,
+                stat->reads.queue_depth, stat->path_index,
+                stat->writes.queue_depth);
+    }
+
+#define OUTPUT_DISK_LATENCY(name, field, help) \
+    do { \
+        output_family(buffer, name, "summary", help); \
+        for (stat=stats; stat<end; stat++) { \
+            for (i=0; i<2; i++) { \
+                role_stat = (i == 0) ? &stat->reads : &stat->writes; \
+                snprintf(labels, sizeof(labels), "path_index=\"%d\"," \
+                        "role=\"%s\",", stat->path_index, \
+                        (i == 0) ? "read" : "write"); \
+                output_quantiles(buffer, name, labels, &role_stat->field); \
+            } \
+        } \
+    } while (0)
+
+    OUTPUT_DISK_LATENCY("fs_disk_wait_seconds", wait,
+            "the queue wait time percentiles of the disk IO");
+    OUTPUT_DISK_LATENCY("fs_disk_service_seconds", service,
+            "the disk IO time percentiles");
+
+#define OUTPUT_DISK_COUNTER(name, field, help) \
+    do { \
+        output_family(buffer, name, "counter", help); \
+        for (stat=stats; stat<end; stat++) { \
+            for (type_stat=stat->types; type_stat<stat->types + \
+                    FS_IO_TYPE_COUNT; type_stat++) \
+            { \
+                fast_buffer_append(buffer, name"_total{path_index=\"%d\"," \
+                        "type=\"%s\"} %"PRId64"\n", stat->path_index, \
+                        get_io_type_name(type_stat->type), \
+                        type_stat->field); \
+            } \
+        } \
+    } while (0)
+
+    OUTPUT_DISK_COUNTER("fs_disk_ops", ops, "the disk IO count");
+    OUTPUT_DISK_COUNTER("fs_disk_bytes", bytes, "the disk IO bytes");
+    OUTPUT_DISK_COUNTER("fs_disk_errors", errors, "the disk IO errors");
+
+    free(stats);
+}
+
+static inline FSTrunkAllocator *get_store_path_allocator(
+        FSStoragePathInfo *path_info)
+{
+    if (path_info == NULL || path_info->store.index >=
+            g_allocator_mgr->allocator_ptr_array.count)
+    {
+        return NULL;
+    }
+    return g_allocator_mgr->allocator_ptr_array.
+        allocators[path_info->store.index];
+}
+
+static void output_storage(FastBuffer *buffer)
+{
+    FSStoragePathInfo **pp;
+    FSStoragePathInfo **end;
+    FSTrunkAllocator *allocator;
+    OBIndexStat index_stat;
+
+    end = STORAGE_CFG.paths_by_index.paths +
+        STORAGE_CFG.paths_by_index.count;
+
+#define OUTPUT_STORE_PATHS(name, type, help, format, value) \
+    do { \
+        output_family(buffer, name, type, help); \
+        for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) { \
+            if (*pp != NULL) { \
+                fast_buffer_append(buffer, name"{path_index=\"%d\"} " \
+                        format"\n", (*pp)->store.index, value); \
+            } \
+        } \
+    } while (0)
+
+    output_family(buffer, "fs_store_path_info", "gauge",
+            "the path of the store path index");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if (*pp != NULL) {
+            fast_buffer_append(buffer, "fs_store_path_info"
+                    "{path_index=\"%d\",path=\"%s\"} 1\n",
+                    (*pp)->store.index, (*pp)->store.path.str);
+        }
+    }
+
+    OUTPUT_STORE_PATHS("fs_store_path_trunks", "gauge",
+            "the trunk file count", "%d",
+            __sync_add_and_fetch(&(*pp)->trunk_stat.trunk_count, 0));
+    OUTPUT_STORE_PATHS("fs_store_path_trunk_bytes", "gauge",
+            "the total size of the trunk files", "%"PRId64,
+            __sync_add_and_fetch(&(*pp)->trunk_stat.total_bytes, 0));
+    OUTPUT_STORE_PATHS("fs_store_path_trunk_used_bytes", "gauge",
+            "the used space of the trunk files", "%"PRId64,
+            __sync_add_and_fetch(&(*pp)->trunk_stat.used_bytes, 0));
+    output_family(buffer, "fs_store_path_alloc_blocked", "counter",
+            "the times of the writers blocked for no free trunk");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if ((allocator=get_store_path_allocator(*pp)) != NULL) {
+            fast_buffer_append(buffer, "fs_store_path_alloc_blocked_total"
+                    "{path_index=\"%d\"} %"PRId64"\n", (*pp)->store.index,
+                    trunk_allocator_get_blocked_count(allocator));
+        }
+    }
+    output_family(buffer, "fs_store_path_prealloc_trunks", "gauge",
+            "the current prealloc trunk target of the writers");
+    for (pp=STORAGE_CFG.paths_by_index.paths; pp<end; pp++) {
+        if ((allocator=get_store_path_allocator(*pp)) != NULL) {
+            fast_buffer_append(buffer, "fs_store_path_prealloc_trunks"
+                    "{path_index=\"%d\"} %d\n", (*pp)->store.index,
+                    trunk_allocator_get_prealloc_trunks(allocator));
+        }
+    }
+    OUTPUT_STORE_PATHS("fs_store_path_avail_bytes", "gauge",
+            "the available disk space for the new trunk files",
+            "%"PRId64, (*pp)->avail_space);
+
+    ob_index_get_stat(&index_stat);
+    output_family(buffer, "fs_index_blocks", "gauge",
+            "the object block count in the index");
+    fast_buffer_append(buffer, "fs_index_blocks %"PRId64"\n",
+            index_stat.block_count);
+    output_family(buffer, "fs_index_slices", "gauge",
+            "the slice count in the index");
+    fast_buffer_append(buffer, "fs_index_slices %"PRId64"\n",
+            index_stat.slice_count);
+    output_family(buffer, "fs_index_memory_bytes", "gauge",
+            "the memory of the index hashtable and entries");
+    fast_buffer_append(buffer, "fs_index_memory_bytes %"PRId64"\n",
+            index_stat.memory_bytes);
+}
+
+static void generate_page(FastBuffer *buffer)
+{
+    fast_buffer_reset(buffer);
+    output_server(buffer);
+    output_commands(buffer);
+    output_data_groups(buffer);
+    output_binlog_writers(buffer);
+    output_disks(buffer);
+    output_storage(buffer);
+    fast_buffer_append(buffer, "# EOF\n");
+}
+
+static int recv_request_line(int sock, char *buff, const int size)
+{
+    int total;
+    int bytes;
+
+    total = 0;
+    while (total < size - 1) {
+        bytes = recv(sock, buff + total, size - 1 - total, 0);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno != 0 ? errno : EIO;
+        } else if (bytes == 0) {
+            break;
+        }
+
+        total += bytes;
+        *(buff + total) = '\0';
+        if (strstr(buff, "\r\n\r\n") != NULL) {
+            return 0;
+        }
+    }
+
+    *(buff + total) = '\0';
+    return strchr(buff, '\n') != NULL ? 0 : EINVAL;
+}
+
+static void deal_request(int sock, const char *client_ip)
+{
+    char request[METRICS_REQUEST_MAX_SIZE];
+    char header[256];
+    const char *body;
+    int body_len;
+    int header_len;
+    int result;
+
+    if ((result=recv_request_line(sock, request, sizeof(request))) != 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "recv metrics request from %s fail, "
+                "errno: %d, error info: %s", __LINE__,
+                client_ip, result, STRERROR(result));
+        return;
+    }
+
+    if (strncmp(request, "GET /metrics ", 13) == 0 ||
+            strncmp(request, "GET / ", 6) == 0)
+    {
+        generate_page(&page_buffer);
+        body = page_buffer.data;
+        body_len = page_buffer.length;
+        header_len = snprintf(header, sizeof(header),
+                "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                "Content-Length: %d\r\nConnection: close\r\n\r\n",
+                METRICS_CONTENT_TYPE, body_len);
+    } else {
+        body = "Not Found\n";
+        body_len = strlen(body);
+        header_len = snprintf(header, sizeof(header),
+                "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n"
+                "Content-Length: %d\r\nConnection: close\r\n\r\n",
+                body_len);
+    }
+
+    if ((result=tcpsenddata_nb(sock, header, header_len,
+                    METRICS_NETWORK_TIMEOUT)) == 0)
+    {
+        result = tcpsenddata_nb(sock, (char *)body, body_len,
+                METRICS_NETWORK_TIMEOUT);
+    }
+    if (result != 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "send metrics page to %s fail, errno: %d, error info: %s",
+                __LINE__, client_ip, result, STRERROR(result));
+    }
+}
+
+static void *metrics_exporter_thread_func(void *arg)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    char client_ip[IP_ADDRESS_SIZE];
+    int sock;
+
+    while (continue_flag) {
+        addr_len = sizeof(addr);
+        sock = accept(listen_sock, (struct sockaddr *)&addr, &addr_len);
+        if (sock < 0) {
+            if (!continue_flag) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+
+            logError("file: "__FILE__", line: %d, "
+                    "accept fail, errno: %d, error info: %s",
+                    __LINE__, errno, STRERROR(errno));
+            sleep(1);
+            continue;
+        }
+
+        tcpsetserveropt(sock, METRICS_NETWORK_TIMEOUT);
+        inet_ntop(AF_INET, &addr.sin_addr, client_ip, sizeof(client_ip));
+        deal_request(sock, client_ip);
+        close(sock);
+    }
+
+    return NULL;
+}
+
+int metrics_exporter_init()
+{
+    int result;
+
+    if (!METRICS_ENABLED) {
+        return 0;
+    }
+
+    if ((result=fast_buffer_init_ex(&page_buffer, 64 * 1024)) != 0) {
+        return result;
+    }
+
+    if ((listen_sock=socketServer(METRICS_BIND_ADDR,
+                    METRICS_PORT, &result)) < 0)
+    {
+        return result;
+    }
+
+    continue_flag = true;
+    if ((result=fc_create_thread(&exporter_tid, metrics_exporter_thread_func,
+                    NULL, SF_G_THREAD_STACK_SIZE)) != 0)
+    {
+        continue_flag = false;
+        return result;
+    }
+    running = true;
+
+    logInfo("file: "__FILE__", line: %d, "
+            "metrics exporter listen on %s:%d", __LINE__,
+            *METRICS_BIND_ADDR != '\0' ? METRICS_BIND_ADDR : "*",
+            METRICS_PORT);
+    return 0;
+}
+
+void metrics_exporter_terminate()
+{
+    continue_flag = false;
+    if (listen_sock >= 0) {
+        //wake up the blocked accept
+        shutdown(listen_sock, SHUT_RDWR);
+    }
+
+    if (running) {
+        pthread_join(exporter_tid, NULL);
+        running = false;
+    }
+
+    if (listen_sock >= 0) {
+        close(listen_sock);
+        listen_sock = -1;
+    }
+}
@@ -0,0 +1,23 @@
+//metrics_exporter.h
+
+#ifndef _METRICS_EXPORTER_H_
+#define _METRICS_EXPORTER_H_
+
+#include "server_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* serve the OpenMetrics text page for Prometheus by a dedicated thread.
+ * the page is generated from the atomic counters which the stat command
+ * uses, so the scraping never takes the locks of the IO paths */
+int metrics_exporter_init();
+
+void metrics_exporter_terminate();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,339 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "../binlog/replica_binlog.h"
+#include "data_recovery.h"
+#include "binlog_dedup.h"
+
+#define DEDUP_RECORD_MAX_LENGTH  128
+
+typedef struct dedup_record {
+    ReplicaBinlogRecord record;
+    bool skip;
+} DedupRecord;
+
+/* the fetched binlog is deduped in chunks to bound the memory, the
+ * superseded records across the chunks are replayed in order as well */
+#define DEDUP_CHUNK_MAX_RECORDS  (256 * 1024)
+
+typedef struct dedup_record_array {
+    DedupRecord *records;
+    DedupRecord **sorted;
+    int64_t count;
+} DedupRecordArray;
+
+typedef struct dedup_context {
+    DedupRecordArray array;
+    char full_filename[PATH_MAX];  //the replay binlog
+    int fd;
+} DedupContext;
+
+static int dedup_write_chunk(DataRecoveryContext *ctx,
+        DedupContext *dedup_ctx);
+
+static int add_to_record_array(DataRecoveryContext *ctx,
+        const ReplicaBinlogRecord *record, void *args)
+{
+    DedupContext *dedup_ctx;
+    DedupRecordArray *array;
+    int result;
+
+    dedup_ctx = (DedupContext *)args;
+    array = &dedup_ctx->array;
+    if (array->count == DEDUP_CHUNK_MAX_RECORDS) {
+        if ((result=dedup_write_chunk(ctx, dedup_ctx)) != 0) {
+            return result;
+        }
+    }
+
+    array->records[array->count].record = *record;
+    array->records[array->count].skip = false;
+    array->count++;
+    ctx->fetch.count++;
+    ctx->fetch.last_data_version = record->data_version;
+    return 0;
+}
+
+static inline int compare_int64(const int64_t n1, const int64_t n2)
+{
+    if (n1 < n2) {
+        return -1;
+    } else if (n1 > n2) {
+        return 1;
+    }
+    return 0;
+}
+
+static inline int compare_block_key(const FSBlockKey *bkey1,
+        const FSBlockKey *bkey2)
+{
+    int sub;
+    if ((sub=compare_int64(bkey1->oid, bkey2->oid)) != 0) {
+        return sub;
+    }
+
+    return compare_int64(bkey1->offset, bkey2->offset);
+}
+
+static inline bool is_same_slice(const FSBlockSliceKeyInfo *bs_key1,
+        const FSBlockSliceKeyInfo *bs_key2)
+{
+    return compare_block_key(&bs_key1->block, &bs_key2->block) == 0 &&
+        bs_key1->slice.offset == bs_key2->slice.offset &&
+        bs_key1->slice.length == bs_key2->slice.length;
+}
+
+static int compare_by_block(const void *p1, const void *p2)
+{
+    const DedupRecord *r1;
+    const DedupRecord *r2;
+    int sub;
+
+    r1 = *((const DedupRecord **)p1);
+    r2 = *((const DedupRecord **)p2);
+    if ((sub=compare_block_key(&r1->record.bs_key.block,
+                    &r2->record.bs_key.block)) != 0)
+    {
+        return sub;
+    }
+
+    return compare_int64(r1->record.data_version,
+            r2->record.data_version);
+}
+
+static int compare_by_slice(const void *p1, const void *p2)
+{
+    const DedupRecord *r1;
+    const DedupRecord *r2;
+    int sub;
+
+    r1 = *((const DedupRecord **)p1);
+    r2 = *((const DedupRecord **)p2);
+    if ((sub=compare_block_key(&r1->record.bs_key.block,
+                    &r2->record.bs_key.block)) != 0)
+    {
+        return sub;
+    }
+    if ((sub=r1->record.bs_key.slice.offset -
+                r2->record.bs_key.slice.offset) != 0)
+    {
+        return sub;
+    }
+    if ((sub=r1->record.bs_key.slice.length -
+                r2->record.bs_key.slice.length) != 0)
+    {
+        return sub;
+    }
+
+    return compare_int64(r1->record.data_version,
+            r2->record.data_version);
+}
+
+/* the records before the last block deletion of the same block
+ * are useless, skip them
+ */
+static void skip_deleted_block_records(DedupRecordArray *array)
+{
+    DedupRecord **start;
+    DedupRecord **end;
+    DedupRecord **current;
+    DedupRecord **last_del;
+
+    qsort(array->sorted, array->count, sizeof(DedupRecord *),
+            compare_by_block);
+    end = array->sorted + array->count;
+    start = array->sorted;
+    while (start < end) {
+        last_del = NULL;
+        current = start;
+        while (current < end && compare_block_key(&(*current)->
+                    record.bs_key.block, &(*start)->record.
+                    bs_key.block) == 0)
+        {
+            if ((*current)->record.op_type ==
+                    REPLICA_BINLOG_OP_TYPE_DEL_BLOCK)
+            {
+                last_del = current;
+            }
+            current++;
+        }
+
+        if (last_del != NULL) {
+            while (start < last_del) {
+                (*start)->skip = true;
+                start++;
+            }
+        }
+        start = current;
+    }
+}
+
+/* for the operations of the same slice, only the last one takes effect */
+static void skip_overwritten_slice_records(DedupRecordArray *array)
+{
+    DedupRecord **current;
+    DedupRecord **end;
+    DedupRecord **last;
+    int count;
+
+    count = 0;
+    end = array->sorted + array->count;
+    for (current=array->sorted; current<end; current++) {
+        if (!((*current)->skip || (*current)->record.op_type ==
+                    REPLICA_BINLOG_OP_TYPE_DEL_BLOCK))
+        {
+            array->sorted[count++] = *current;
+        }
+    }
+
+    qsort(array->sorted, count, sizeof(DedupRecord *), compare_by_slice);
+    end = array->sorted + count;
+    last = array->sorted;
+    for (current=array->sorted + 1; current<end; current++) {
+        if (is_same_slice(&(*last)->record.bs_key,
+                    &(*current)->record.bs_key))
+        {
+            (*last)->skip = true;
+        }
+        last = current;
+    }
+}
+
+static int open_replay_binlog(DataRecoveryContext *ctx,
+        DedupContext *dedup_ctx)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    int result;
+
+    data_recovery_get_subdir_name(ctx, RECOVERY_BINLOG_SUBDIR_NAME_REPLAY,
+            subdir_name);
+    binlog_reader_get_filename(subdir_name, 0, dedup_ctx->full_filename,
+            sizeof(dedup_ctx->full_filename));
+    if ((dedup_ctx->fd=open(dedup_ctx->full_filename, O_WRONLY |
+                    O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open binlog file %s fail, errno: %d, error info: %s",
+                __LINE__, dedup_ctx->full_filename, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static int write_replay_binlog(DataRecoveryContext *ctx,
+        DedupContext *dedup_ctx)
+{
+    DedupRecord *record;
+    DedupRecord *end;
+    char *p;
+    int result;
+
+    result = 0;
+    p = ctx->buffer->buff;
+    end = dedup_ctx->array.records + dedup_ctx->array.count;
+    for (record=dedup_ctx->array.records; record<end; record++) {
+        if (record->skip) {
+            continue;
+        }
+
+        if (ctx->buffer->capacity - (p - ctx->buffer->buff) <
+                DEDUP_RECORD_MAX_LENGTH)
+        {
+            if (fc_safe_write(dedup_ctx->fd, ctx->buffer->buff, p - ctx->
+                        buffer->buff) != p - ctx->buffer->buff)
+            {
+                result = errno != 0 ? errno : EIO;
+                break;
+            }
+            p = ctx->buffer->buff;
+        }
+
+        p += replica_binlog_record_pack(&record->record, p);
+        ctx->replay_count++;
+    }
+
+    if (result == 0 && p > ctx->buffer->buff) {
+        if (fc_safe_write(dedup_ctx->fd, ctx->buffer->buff, p - ctx->
+                    buffer->buff) != p - ctx->buffer->buff)
+        {
+            result = errno != 0 ? errno : EIO;
+        }
+    }
+
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "write to binlog file %s fail, errno: %d, error info: %s",
+                __LINE__, dedup_ctx->full_filename, result, STRERROR(result));
+    }
+    return result;
+}
+
+/* dedup the records of the chunk and append the remain ones
+ * to the replay binlog in the order of the fetched binlog */
+static int dedup_write_chunk(DataRecoveryContext *ctx,
+        DedupContext *dedup_ctx)
+{
+    DedupRecordArray *array;
+    int64_t i;
+    int result;
+
+    array = &dedup_ctx->array;
+    if (array->count == 0) {
+        return 0;
+    }
+
+    for (i=0; i<array->count; i++) {
+        array->sorted[i] = array->records + i;
+    }
+    skip_deleted_block_records(array);
+    skip_overwritten_slice_records(array);
+    result = write_replay_binlog(ctx, dedup_ctx);
+    array->count = 0;
+    return result;
+}
+
+int data_recovery_dedup_binlog(DataRecoveryContext *ctx)
+{
+    DedupContext dedup_ctx;
+    int result;
+
+    memset(&dedup_ctx, 0, sizeof(dedup_ctx));
+    dedup_ctx.array.records = (DedupRecord *)fc_malloc(
+            sizeof(DedupRecord) * DEDUP_CHUNK_MAX_RECORDS);
+    if (dedup_ctx.array.records == NULL) {
+        return ENOMEM;
+    }
+    dedup_ctx.array.sorted = (DedupRecord **)fc_malloc(
+            sizeof(DedupRecord *) * DEDUP_CHUNK_MAX_RECORDS);
+    if (dedup_ctx.array.sorted == NULL) {
+        free(dedup_ctx.array.records);
+        return ENOMEM;
+    }
+
+    ctx->fetch.count = 0;
+    ctx->replay_count = 0;
+    if ((result=open_replay_binlog(ctx, &dedup_ctx)) == 0) {
+        if ((result=data_recovery_for_each_record(ctx,
+                        RECOVERY_BINLOG_SUBDIR_NAME_FETCH,
+                        add_to_record_array, &dedup_ctx)) == 0)
+        {
+            result = dedup_write_chunk(ctx, &dedup_ctx);
+        }
+        close(dedup_ctx.fd);
+    }
+
+    free(dedup_ctx.array.sorted);
+    free(dedup_ctx.array.records);
+    return result;
+}
@@ -0,0 +1,21 @@
+//binlog_dedup.h
+
+#ifndef _BINLOG_DEDUP_H_
+#define _BINLOG_DEDUP_H_
+
+#include "recovery_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* remove the superseded records of the fetched binlog in bounded chunks,
+ * and write the remain records to the replay binlog
+ */
+int data_recovery_dedup_binlog(DataRecoveryContext *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
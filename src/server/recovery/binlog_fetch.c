@@ -13,10 +13,12 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
 #include "fastcommon/sched_thread.h"
+#include "fastcommon/sockopt.h"
 #include "sf/sf_global.h"
 #include "../../common/fs_proto.h"
 #include "../server_global.h"
 #include "../binlog/replica_binlog.h"
+#include "../replication/replica_compress.h"
 #include "data_recovery.h"
 #include "binlog_fetch.h"
 
@@ -109,19 +111,37 @@ static int check_and_open_binlog_file(DataRecoveryContext *ctx)
     return 0;
 }
 
-static int fetch_binlog_to_local(ConnectionInfo *conn,
-        DataRecoveryContext *ctx, char *out_buff,
-        const int out_bytes, bool *is_last)
+static int send_fetch_request(ConnectionInfo *conn,
+        char *out_buff, const int out_bytes)
+{
+    int result;
+
+    if ((result=tcpsenddata_nb(conn->sock, out_buff, out_bytes,
+                    SF_G_NETWORK_TIMEOUT)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "send data to server %s:%d fail, "
+                "errno: %d, error info: %s", __LINE__,
+                conn->ip_addr, conn->port, result, STRERROR(result));
+    }
+    return result;
+}
+
+static int recv_binlog_to_local(ConnectionInfo *conn,
+        DataRecoveryContext *ctx, bool *is_last)
 {
     int result;
     int binlog_length;
+    int raw_length;
+    char *binlog;
     FSProtoReplicaFetchBinlogRespBodyHeader *resp_header;
     FSResponseInfo response;
 
     response.error.length = 0;
-    if ((result=fs_send_and_check_response_header(conn, out_buff,
-            out_bytes, &response, SF_G_NETWORK_TIMEOUT,
-            FS_REPLICA_PROTO_FETCH_BINLOG_RESP)) != 0)
+    if ((result=fs_recv_response_header(conn, &response,
+                    SF_G_NETWORK_TIMEOUT)) != 0 ||
+            (result=fs_check_response(conn, &response, SF_G_NETWORK_TIMEOUT,
+                                      FS_REPLICA_PROTO_FETCH_BINLOG_RESP)) != 0)
     {
         fs_log_network_error(&response, conn, result);
         return result;
@@ -168,7 +188,28 @@ static int fetch_binlog_to_local(ConnectionInfo *conn,
         return 0;
     }
 
-    if (write(ctx->fd, resp_header + 1, binlog_length) != binlog_length) {
+    binlog = (char *)(resp_header + 1);
+    if (ctx->fetch.raw_buffer != NULL && resp_header->compress_algorithm !=
+            FS_COMPRESS_ALGORITHM_NONE)
+    {
+        if ((result=replica_decompress(resp_header->compress_algorithm,
+                        binlog, binlog_length, ctx->fetch.raw_buffer->buff,
+                        ctx->fetch.raw_buffer->capacity, &raw_length)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, decompress binlog fail, "
+                    "server %s:%d", __LINE__, ctx->data_group_id,
+                    conn->ip_addr, conn->port);
+            return result;
+        }
+
+        ctx->fetch.compress_stat.bytes_before += raw_length;
+        ctx->fetch.compress_stat.bytes_after += binlog_length;
+        binlog = ctx->fetch.raw_buffer->buff;
+        binlog_length = raw_length;
+    }
+
+    if (write(ctx->fd, binlog, binlog_length) != binlog_length) {
         result = errno != 0 ? errno : EPERM;
         logError("file: "__FILE__", line: %d, "
                 "write to file fail, errno: %d, error info: %s",
@@ -179,40 +220,78 @@ static int fetch_binlog_to_local(ConnectionInfo *conn,
     return 0;
 }
 
+/* the NEXT requests are pipelined without waiting for the responses,
+ * the in flight requests are the credits of the master to stream the
+ * binlog chunks. the master handles the requests in order, so the
+ * chunks are appended to the local binlog in order too. after the
+ * master reports the last chunk, the in flight responses are drained
+ * which may carry the new binlog appended in the meantime */
 static int proto_fetch_binlog(ConnectionInfo *conn, DataRecoveryContext *ctx)
 {
     int result;
+    int inflight;
     bool is_last;
+    bool finished;
     FSProtoHeader *header;
     FSProtoReplicaFetchBinlogFirstReq *req;
     char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoReplicaFetchBinlogFirstReq)];
+    char next_buff[sizeof(FSProtoHeader)];
+    int out_bytes;
+
+    //the compress algorithm is sent only when enabled for the old servers
+    if (ctx->fetch.raw_buffer == NULL) {
+        out_bytes = sizeof(FSProtoHeader) +
+            FS_PROTO_FETCH_BINLOG_FIRST_REQ_MIN_SIZE;
+    } else {
+        out_bytes = sizeof(out_buff);
+    }
 
     header = (FSProtoHeader *)out_buff;
     FS_PROTO_SET_HEADER(header, FS_REPLICA_PROTO_FETCH_BINLOG_FIRST_REQ,
-            sizeof(out_buff) - sizeof(FSProtoHeader));
+            out_bytes - sizeof(FSProtoHeader));
 
     req = (FSProtoReplicaFetchBinlogFirstReq *)(out_buff + sizeof(FSProtoHeader));
     long2buff(ctx->last_data_version, req->last_data_version);
     int2buff(ctx->data_group_id, req->data_group_id);
- 
-    if ((result=fetch_binlog_to_local(conn, ctx, out_buff,
-                    sizeof(out_buff), &is_last)) != 0)
-    {
+    memset(req->padding, 0, sizeof(req->padding));
+    req->compress_algorithm = REPLICA_COMPRESS_ALGORITHM;
+    memset(req->reserved, 0, sizeof(req->reserved));
+
+    if ((result=send_fetch_request(conn, out_buff, out_bytes)) != 0) {
+        return result;
+    }
+    if ((result=recv_binlog_to_local(conn, ctx, &is_last)) != 0) {
         return result;
     }
-
     if (is_last) {
         return 0;
     }
 
-    FS_PROTO_SET_HEADER(header, FS_REPLICA_PROTO_FETCH_BINLOG_NEXT_REQ, 0);
-    do {
-        if ((result=fetch_binlog_to_local(conn, ctx, out_buff,
-                        sizeof(FSProtoHeader), &is_last)) != 0)
-        {
+    FS_PROTO_SET_HEADER((FSProtoHeader *)next_buff,
+            FS_REPLICA_PROTO_FETCH_BINLOG_NEXT_REQ, 0);
+    inflight = 0;
+    finished = false;
+    while (1) {
+        while (!finished && inflight < RECOVERY_FETCH_BINLOG_WINDOW) {
+            if ((result=send_fetch_request(conn, next_buff,
+                            sizeof(next_buff))) != 0)
+            {
+                return result;
+            }
+            inflight++;
+        }
+
+        if (inflight == 0) {
+            break;
+        }
+        if ((result=recv_binlog_to_local(conn, ctx, &is_last)) != 0) {
             return result;
         }
-    } while (!is_last);
+        inflight--;
+        if (is_last) {
+            finished = true;
+        }
+    }
 
     return 0;
 }
@@ -236,6 +315,15 @@ static int do_fetch_binlog(DataRecoveryContext *ctx)
 
     result = proto_fetch_binlog(&conn, ctx);
     conn_pool_disconnect_server(&conn);
+    if (result == 0 && ctx->fetch.compress_stat.bytes_after > 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, fetch binlog from server %s:%d, "
+                "compress algorithm: %s, bytes before compress: %"PRId64
+                ", after: %"PRId64, __LINE__, ctx->data_group_id,
+                conn.ip_addr, conn.port, replica_compress_get_caption(
+                    REPLICA_COMPRESS_ALGORITHM), ctx->fetch.compress_stat.
+                bytes_before, ctx->fetch.compress_stat.bytes_after);
+    }
     return result;
 }
 
@@ -247,5 +335,8 @@ int data_recovery_fetch_binlog(DataRecoveryContext *ctx)
         return result;
     }
 
-    return do_fetch_binlog(ctx);
+    result = do_fetch_binlog(ctx);
+    close(ctx->fd);
+    ctx->fd = -1;
+    return result;
 }
@@ -0,0 +1,854 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "fastcommon/fc_queue.h"
+#include "fastcommon/fast_mblock.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_proto.h"
+#include "../../common/fs_func.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../storage/slice_op.h"
+#include "data_recovery.h"
+#include "binlog_replay.h"
+
+#define REPLAY_WAITING_TASKS_PER_THREAD     1024
+#define REPLAY_SOURCE_REBALANCE_INTERVAL      64
+
+typedef struct binlog_replay_task {
+    ReplicaBinlogRecord record;
+    struct binlog_replay_task *next;
+} BinlogReplayTask;
+
+typedef struct binlog_replay_rate_limiter {
+    pthread_mutex_t lock;
+    time_t current_time;
+    int64_t bytes;
+} BinlogReplayRateLimiter;
+
+/* the ACTIVE data server of the data group to read the slice data */
+typedef struct binlog_replay_source {
+    FSClusterDataServerInfo *ds;
+    volatile int thread_count;  //the threads reading from this source
+    volatile char failed;       //skip this source in the current round
+    volatile int64_t avg_cost;  //EWMA of the read time in us per 64KB
+    volatile int64_t read_bytes;
+    BinlogReplayRateLimiter *limiter;  //shared by the data groups
+} BinlogReplaySource;
+
+struct binlog_replay_context;
+
+typedef struct binlog_replay_thread_context {
+    struct fc_queue queue;
+    BinlogReplaySource *source;
+    ConnectionInfo conn;   //to the source for slice data
+    int read_count;        //for rebalance
+    FSSliceOpContext op_ctx;
+    OBSlicePtrArray slice_ptr_array;
+    struct {
+        char *buff;
+        int size;
+    } buffer;
+    struct {
+        bool done;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+    } notify;  //for slice write
+    int result;
+    struct binlog_replay_context *replay;
+} BinlogReplayThreadContext;
+
+typedef struct binlog_replay_context {
+    DataRecoveryContext *recovery;
+    FSClusterDataServerInfo *master;
+    struct fast_mblock_man task_allocator;
+    volatile int running_count;
+    volatile int64_t waiting_count;
+    volatile bool finished;
+    int thread_count;
+    BinlogReplayThreadContext *threads;
+    struct {
+        BinlogReplaySource *sources;
+        int count;
+    } source_array;
+} BinlogReplayContext;
+
+static BinlogReplayRateLimiter io_budget = {PTHREAD_MUTEX_INITIALIZER, 0, 0};
+
+/* the limiters of the source servers indexed by the server index,
+ * the data groups recovering concurrently share the read budget */
+static struct {
+    pthread_mutex_t lock;  //for the lazy init
+    BinlogReplayRateLimiter *limiters;
+} source_limiters = {PTHREAD_MUTEX_INITIALIZER, NULL};
+
+static void rate_limiter_wait(BinlogReplayRateLimiter *limiter,
+        const int64_t max_bytes_per_second, const int bytes)
+{
+    while (SF_G_CONTINUE_FLAG) {
+        PTHREAD_MUTEX_LOCK(&limiter->lock);
+        if (limiter->current_time != g_current_time) {
+            limiter->current_time = g_current_time;
+            limiter->bytes = 0;
+        }
+        if (limiter->bytes == 0 || limiter->bytes + bytes <=
+                max_bytes_per_second)
+        {
+            limiter->bytes += bytes;
+            PTHREAD_MUTEX_UNLOCK(&limiter->lock);
+            return;
+        }
+        PTHREAD_MUTEX_UNLOCK(&limiter->lock);
+
+        usleep(10 * 1000);
+    }
+}
+
+static int check_init_source_limiters()
+{
+    BinlogReplayRateLimiter *limiters;
+    int result;
+    int i;
+
+    result = 0;
+    PTHREAD_MUTEX_LOCK(&source_limiters.lock);
+    do {
+        if (source_limiters.limiters != NULL) {
+            break;
+        }
+
+        limiters = (BinlogReplayRateLimiter *)fc_calloc(
+                CLUSTER_SERVER_ARRAY.count, sizeof(BinlogReplayRateLimiter));
+        if (limiters == NULL) {
+            result = ENOMEM;
+            break;
+        }
+        for (i=0; i<CLUSTER_SERVER_ARRAY.count; i++) {
+            if ((result=init_pthread_lock(&limiters[i].lock)) != 0) {
+                break;
+            }
+        }
+        if (result != 0) {
+            free(limiters);
+            break;
+        }
+
+        source_limiters.limiters = limiters;
+    } while (0);
+    PTHREAD_MUTEX_UNLOCK(&source_limiters.lock);
+
+    return result;
+}
+
+static int check_alloc_buffer(BinlogReplayThreadContext *thread,
+        const int size)
+{
+    char *buff;
+    int alloc_size;
+
+    if (thread->buffer.size >= size) {
+        return 0;
+    }
+
+    alloc_size = (thread->buffer.size == 0) ?
+        g_sf_global_vars.min_buff_size : thread->buffer.size;
+    while (alloc_size < size) {
+        alloc_size *= 2;
+    }
+    if ((buff=(char *)fc_malloc(alloc_size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if (thread->buffer.buff != NULL) {
+        free(thread->buffer.buff);
+    }
+    thread->buffer.buff = buff;
+    thread->buffer.size = alloc_size;
+    return 0;
+}
+
+/* the read size of each request can't exceed the task buffer
+ * of the service */
+static int do_fetch_slice_data(BinlogReplayThreadContext *thread,
+        const FSBlockSliceKeyInfo *bs_key, int *read_bytes)
+{
+    char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoSliceReadReqHeader)];
+    FSProtoHeader *proto_header;
+    FSProtoSliceReadReqHeader *req_header;
+    FSResponseInfo response;
+    int max_length;
+    int remain;
+    int curr_len;
+    int bytes;
+    int result;
+
+    *read_bytes = 0;
+    max_length = g_sf_global_vars.min_buff_size - sizeof(FSProtoHeader);
+    proto_header = (FSProtoHeader *)out_buff;
+    req_header = (FSProtoSliceReadReqHeader *)(proto_header + 1);
+    //without the min data version, so the old master accepts it
+    FS_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_READ_REQ,
+            FS_PROTO_SLICE_READ_REQ_MIN_SIZE);
+    proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
+
+    result = 0;
+    response.error.length = 0;
+    remain = bs_key->slice.length;
+    while (remain > 0) {
+        curr_len = (remain <= max_length) ? remain : max_length;
+        int2buff(bs_key->slice.offset + *read_bytes,
+                req_header->bs.slice_size.offset);
+        int2buff(curr_len, req_header->bs.slice_size.length);
+
+        if ((result=fs_send_and_recv_response_header(&thread->conn,
+                        out_buff, sizeof(FSProtoHeader) +
+                        FS_PROTO_SLICE_READ_REQ_MIN_SIZE, &response,
+                        SF_G_NETWORK_TIMEOUT)) != 0)
+        {
+            break;
+        }
+
+        if ((result=fs_check_response(&thread->conn, &response,
+                        SF_G_NETWORK_TIMEOUT,
+                        FS_SERVICE_PROTO_SLICE_READ_RESP)) != 0)
+        {
+            break;
+        }
+
+        if (response.header.body_len > curr_len) {
+            response.error.length = sprintf(response.error.message,
+                    "reponse body length: %d > slice length: %d",
+                    response.header.body_len, curr_len);
+            result = EINVAL;
+            break;
+        }
+
+        if ((result=tcprecvdata_nb_ex(thread->conn.sock, thread->buffer.
+                        buff + *read_bytes, response.header.body_len,
+                        SF_G_NETWORK_TIMEOUT, &bytes)) != 0)
+        {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message),
+                    "recv data fail, errno: %d, error info: %s",
+                    result, STRERROR(result));
+            break;
+        }
+
+        *read_bytes += bytes;
+        remain -= bytes;
+        if (curr_len > bytes) {
+            break;
+        }
+    }
+
+    if (result != 0 && result != ENOENT) {
+        fs_log_network_error(&response, &thread->conn, result);
+    }
+    return result;
+}
+
+static inline int64_t calc_source_score(BinlogReplaySource *source,
+        const int thread_count)
+{
+    int64_t avg_cost;
+
+    avg_cost = __sync_add_and_fetch(&source->avg_cost, 0);
+    return (int64_t)thread_count * (avg_cost > 0 ? avg_cost : 1);
+}
+
+/* the master has all data before the binlog fetched, the slave can
+ * serve the slice only when its data version >= the record's */
+static inline bool source_is_available(BinlogReplaySource *source,
+        const uint64_t data_version)
+{
+    if (__sync_add_and_fetch(&source->failed, 0)) {
+        return false;
+    }
+    if (__sync_add_and_fetch(&source->ds->status, 0) !=
+            FS_SERVER_STATUS_ACTIVE)
+    {
+        return false;
+    }
+
+    return __sync_add_and_fetch(&source->ds->is_master, 0) ||
+        __sync_add_and_fetch(&source->ds->data_version, 0) >= data_version;
+}
+
+static BinlogReplaySource *choose_source(BinlogReplayThreadContext *thread,
+        const uint64_t data_version)
+{
+    BinlogReplaySource *source;
+    BinlogReplaySource *end;
+    BinlogReplaySource *best;
+    int64_t score;
+    int64_t min_score;
+
+    best = NULL;
+    min_score = 0;
+    end = thread->replay->source_array.sources +
+        thread->replay->source_array.count;
+    for (source=thread->replay->source_array.sources; source<end; source++) {
+        if (!source_is_available(source, data_version)) {
+            continue;
+        }
+
+        if (source == thread->source) {
+            score = calc_source_score(source, __sync_add_and_fetch(
+                        &source->thread_count, 0));
+        } else {
+            score = calc_source_score(source, __sync_add_and_fetch(
+                        &source->thread_count, 0) + 1);
+        }
+        if (best == NULL || score < min_score) {
+            best = source;
+            min_score = score;
+        }
+    }
+
+    return best;
+}
+
+static void detach_source(BinlogReplayThreadContext *thread)
+{
+    if (thread->source == NULL) {
+        return;
+    }
+
+    conn_pool_disconnect_server(&thread->conn);
+    __sync_sub_and_fetch(&thread->source->thread_count, 1);
+    thread->source = NULL;
+}
+
+static void set_source_failed(BinlogReplayThreadContext *thread,
+        BinlogReplaySource *source, const int result)
+{
+    if (__sync_bool_compare_and_swap(&source->failed, 0, 1)) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, read from the source server id: %d "
+                "fail, errno: %d, error info: %s, skip it in this round",
+                __LINE__, thread->op_ctx.info.data_group_id,
+                source->ds->cs->server->id, result, STRERROR(result));
+    }
+}
+
+static inline void mark_source_failed(BinlogReplayThreadContext *thread,
+        const int result)
+{
+    BinlogReplaySource *source;
+
+    source = thread->source;
+    detach_source(thread);
+    set_source_failed(thread, source, result);
+}
+
+/* the thread re-chooses the source when the current one is unavailable
+ * for the record, and every REPLAY_SOURCE_REBALANCE_INTERVAL reads so
+ * that the threads move away from the slow sources */
+static int check_choose_source(BinlogReplayThreadContext *thread,
+        const uint64_t data_version)
+{
+    BinlogReplaySource *source;
+    int result;
+
+    while (1) {
+        if (thread->source != NULL && source_is_available(
+                    thread->source, data_version) && ++thread->read_count %
+                REPLAY_SOURCE_REBALANCE_INTERVAL != 0)
+        {
+            return 0;
+        }
+
+        if ((source=choose_source(thread, data_version)) == NULL) {
+            detach_source(thread);
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, no available source to read "
+                    "the slice of data version: %"PRId64, __LINE__,
+                    thread->op_ctx.info.data_group_id, data_version);
+            return EHOSTUNREACH;
+        }
+        if (source == thread->source) {
+            return 0;
+        }
+
+        detach_source(thread);
+        if ((result=fc_server_make_connection_ex(&SERVICE_GROUP_ADDRESS_ARRAY(
+                            source->ds->cs->server), &thread->conn,
+                        SF_G_CONNECT_TIMEOUT, NULL, true)) == 0)
+        {
+            __sync_add_and_fetch(&source->thread_count, 1);
+            thread->source = source;
+            return 0;
+        }
+
+        set_source_failed(thread, source, result);
+    }
+}
+
+static inline void update_source_cost(BinlogReplaySource *source,
+        const int bytes, const int64_t time_used)
+{
+    int64_t cost;
+    int64_t avg_cost;
+
+    __sync_add_and_fetch(&source->read_bytes, bytes);
+    cost = time_used * 64 * 1024 / (bytes > 0 ? bytes : 1);
+    avg_cost = __sync_add_and_fetch(&source->avg_cost, 0);
+    __sync_bool_compare_and_swap(&source->avg_cost, avg_cost,
+            (avg_cost > 0) ? (avg_cost * 7 + cost) / 8 : cost);
+}
+
+/* read the slice from the sources, switch to the others on fail */
+static int fetch_slice_data(BinlogReplayThreadContext *thread,
+        const FSBlockSliceKeyInfo *bs_key, const uint64_t data_version,
+        int *read_bytes)
+{
+    int64_t start_time;
+    int result;
+
+    while (1) {
+        if (!SF_G_CONTINUE_FLAG) {
+            return EINTR;
+        }
+        if ((result=check_choose_source(thread, data_version)) != 0) {
+            return result;
+        }
+
+        if (RECOVERY_SOURCE_READ_BYTES_PER_SECOND > 0) {
+            rate_limiter_wait(thread->source->limiter,
+                    RECOVERY_SOURCE_READ_BYTES_PER_SECOND,
+                    bs_key->slice.length);
+        }
+
+        start_time = get_current_time_us();
+        if ((result=do_fetch_slice_data(thread, bs_key, read_bytes)) == 0) {
+            update_source_cost(thread->source, *read_bytes,
+                    get_current_time_us() - start_time);
+            return 0;
+        }
+        if (result == ENOENT) {
+            return result;
+        }
+
+        mark_source_failed(thread, result);
+    }
+}
+
+static void slice_write_done_notify(FSSliceOpContext *op_ctx)
+{
+    BinlogReplayThreadContext *thread;
+
+    thread = (BinlogReplayThreadContext *)op_ctx->notify.args;
+    PTHREAD_MUTEX_LOCK(&thread->notify.lock);
+    thread->notify.done = true;
+    pthread_cond_signal(&thread->notify.cond);
+    PTHREAD_MUTEX_UNLOCK(&thread->notify.lock);
+}
+
+static int replay_slice_write(BinlogReplayThreadContext *thread)
+{
+    FSSliceOpContext *op_ctx;
+    int read_bytes;
+    int result;
+
+    op_ctx = &thread->op_ctx;
+    if ((result=check_alloc_buffer(thread, op_ctx->info.
+                    bs_key.slice.length)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fetch_slice_data(thread, &op_ctx->info.bs_key,
+                    op_ctx->info.data_version, &read_bytes)) != 0)
+    {
+        //the slice is removed by the later operations
+        return (result == ENOENT) ? 0 : result;
+    }
+    if (read_bytes == 0) {
+        return 0;
+    }
+    op_ctx->info.bs_key.slice.length = read_bytes;
+
+    //all data groups share the disk write budget of the recovery
+    if (RECOVERY_WRITE_BYTES_PER_SECOND > 0) {
+        rate_limiter_wait(&io_budget, RECOVERY_WRITE_BYTES_PER_SECOND,
+                read_bytes);
+    }
+
+    thread->notify.done = false;
+    op_ctx->notify.func = slice_write_done_notify;
+    op_ctx->notify.args = thread;
+    if ((result=fs_slice_write(op_ctx, thread->buffer.buff)) != 0) {
+        return result;
+    }
+
+    PTHREAD_MUTEX_LOCK(&thread->notify.lock);
+    while (!thread->notify.done) {
+        pthread_cond_wait(&thread->notify.cond, &thread->notify.lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&thread->notify.lock);
+
+    return op_ctx->result;
+}
+
+static int replay_task(BinlogReplayThreadContext *thread,
+        BinlogReplayTask *task)
+{
+    FSSliceOpContext *op_ctx;
+    const char *caption;
+    int result;
+    int inc_alloc;
+
+    op_ctx = &thread->op_ctx;
+    op_ctx->result = 0;
+    op_ctx->info.data_version = task->record.data_version;
+    op_ctx->info.bs_key = task->record.bs_key;
+    switch (task->record.op_type) {
+        case REPLICA_BINLOG_OP_TYPE_WRITE_SLICE:
+            caption = "write";
+            result = replay_slice_write(thread);
+            break;
+        case REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE:
+            caption = "allocate";
+            result = fs_slice_allocate_ex(op_ctx,
+                    &thread->slice_ptr_array, &inc_alloc);
+            break;
+        case REPLICA_BINLOG_OP_TYPE_DEL_SLICE:
+            caption = "delete slice";
+            result = fs_delete_slices(op_ctx, &inc_alloc);
+            break;
+        case REPLICA_BINLOG_OP_TYPE_DEL_BLOCK:
+            caption = "delete block";
+            result = fs_delete_block(op_ctx, &inc_alloc);
+            break;
+        default:
+            caption = "unkown";
+            result = EINVAL;
+            break;
+    }
+
+    if (result == ENOENT && task->record.op_type !=
+            REPLICA_BINLOG_OP_TYPE_WRITE_SLICE)
+    {
+        result = 0;
+    }
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "data group id: %d, replay %s fail, data version: %"PRId64
+                ", block {oid: %"PRId64", offset: %"PRId64"}, "
+                "slice {offset: %d, length: %d}, errno: %d, "
+                "error info: %s", __LINE__, op_ctx->info.data_group_id,
+                caption, task->record.data_version,
+                task->record.bs_key.block.oid,
+                task->record.bs_key.block.offset,
+                task->record.bs_key.slice.offset,
+                task->record.bs_key.slice.length,
+                result, STRERROR(result));
+    }
+    return result;
+}
+
+static void *binlog_replay_thread_func(void *arg)
+{
+    BinlogReplayThreadContext *thread;
+    BinlogReplayTask *task;
+    BinlogReplayTask *next;
+
+    thread = (BinlogReplayThreadContext *)arg;
+    while (1) {
+        if ((task=(BinlogReplayTask *)fc_queue_pop_all(
+                        &thread->queue)) == NULL)
+        {
+            if (thread->replay->finished) {
+                break;
+            }
+            continue;
+        }
+
+        do {
+            next = task->next;
+            if (thread->result == 0) {
+                if (SF_G_CONTINUE_FLAG) {
+                    thread->result = replay_task(thread, task);
+                } else {
+                    thread->result = EINTR;
+                }
+            }
+
+            fast_mblock_free_object(&thread->replay->task_allocator, task);
+            __sync_sub_and_fetch(&thread->replay->waiting_count, 1);
+            task = next;
+        } while (task != NULL);
+    }
+
+    __sync_sub_and_fetch(&thread->replay->running_count, 1);
+    return NULL;
+}
+
+static int init_replay_thread(BinlogReplayContext *replay,
+        BinlogReplayThreadContext *thread)
+{
+    int result;
+
+    thread->replay = replay;
+    thread->op_ctx.info.write_data_binlog = false;
+    thread->op_ctx.info.data_group_id = replay->recovery->data_group_id;
+    thread->op_ctx.info.myself = replay->master->dg->myself;
+    ob_index_init_slice_ptr_array(&thread->slice_ptr_array);
+    if ((result=fc_queue_init(&thread->queue, (long)
+                    (&((BinlogReplayTask *)NULL)->next))) != 0)
+    {
+        return result;
+    }
+    if ((result=init_pthread_lock(&thread->notify.lock)) != 0) {
+        return result;
+    }
+    if ((result=pthread_cond_init(&thread->notify.cond, NULL)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "pthread_cond_init fail, "
+                "errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static void destroy_replay_thread(BinlogReplayThreadContext *thread)
+{
+    detach_source(thread);
+    if (thread->buffer.buff != NULL) {
+        free(thread->buffer.buff);
+        thread->buffer.buff = NULL;
+    }
+    ob_index_free_slice_ptr_array(&thread->slice_ptr_array);
+    fc_queue_destroy(&thread->queue);
+    pthread_cond_destroy(&thread->notify.cond);
+    pthread_mutex_destroy(&thread->notify.lock);
+}
+
+static int init_replay_sources(BinlogReplayContext *replay)
+{
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    BinlogReplaySource *source;
+    FSClusterDataGroupInfo *group;
+    int bytes;
+    int result;
+
+    if ((result=check_init_source_limiters()) != 0) {
+        return result;
+    }
+
+    group = replay->master->dg;
+    bytes = sizeof(BinlogReplaySource) * group->data_server_array.count;
+    if ((replay->source_array.sources=(BinlogReplaySource *)
+                fc_malloc(bytes)) == NULL)
+    {
+        return ENOMEM;
+    }
+    memset(replay->source_array.sources, 0, bytes);
+
+    source = replay->source_array.sources;
+    end = group->data_server_array.servers + group->data_server_array.count;
+    for (ds=group->data_server_array.servers; ds<end; ds++) {
+        if (ds == group->myself) {
+            continue;
+        }
+
+        source->limiter = source_limiters.limiters + ds->cs->server_index;
+        source->ds = ds;
+        source++;
+        replay->source_array.count++;
+    }
+
+    return 0;
+}
+
+static void destroy_replay_sources(BinlogReplayContext *replay)
+{
+    BinlogReplaySource *source;
+    BinlogReplaySource *end;
+
+    if (replay->source_array.sources == NULL) {
+        return;
+    }
+
+    end = replay->source_array.sources + replay->source_array.count;
+    for (source=replay->source_array.sources; source<end; source++) {
+        if (source->read_bytes > 0) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "data group id: %d, read %"PRId64" bytes from the "
+                    "source server id: %d, avg cost: %"PRId64" us per 64KB",
+                    __LINE__, replay->recovery->data_group_id,
+                    source->read_bytes, source->ds->cs->server->id,
+                    source->avg_cost);
+        }
+    }
+    free(replay->source_array.sources);
+    replay->source_array.sources = NULL;
+}
+
+static int init_replay_context(BinlogReplayContext *replay,
+        DataRecoveryContext *ctx)
+{
+    BinlogReplayThreadContext *thread;
+    BinlogReplayThreadContext *end;
+    pthread_t tid;
+    int bytes;
+    int result;
+
+    memset(replay, 0, sizeof(*replay));
+    replay->recovery = ctx;
+    if ((replay->master=data_recovery_get_master(ctx, &result)) == NULL) {
+        return result;
+    }
+
+    if ((result=fast_mblock_init_ex1(&replay->task_allocator,
+                    "replay_task", sizeof(BinlogReplayTask),
+                    4096, NULL, NULL, true)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=init_replay_sources(replay)) != 0) {
+        return result;
+    }
+
+    replay->thread_count = FC_MIN(RECOVERY_THREADS_PER_DATA_GROUP,
+            ctx->replay_count);
+    bytes = sizeof(BinlogReplayThreadContext) * replay->thread_count;
+    if ((replay->threads=(BinlogReplayThreadContext *)
+                fc_malloc(bytes)) == NULL)
+    {
+        return ENOMEM;
+    }
+    memset(replay->threads, 0, bytes);
+
+    end = replay->threads + replay->thread_count;
+    for (thread=replay->threads; thread<end; thread++) {
+        if ((result=init_replay_thread(replay, thread)) != 0) {
+            return result;
+        }
+    }
+
+    for (thread=replay->threads; thread<end; thread++) {
+        __sync_add_and_fetch(&replay->running_count, 1);
+        if ((result=fc_create_thread(&tid, binlog_replay_thread_func,
+                        thread, SF_G_THREAD_STACK_SIZE)) != 0)
+        {
+            __sync_sub_and_fetch(&replay->running_count, 1);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static void destroy_replay_context(BinlogReplayContext *replay)
+{
+    BinlogReplayThreadContext *thread;
+    BinlogReplayThreadContext *end;
+
+    if (replay->threads != NULL) {
+        end = replay->threads + replay->thread_count;
+        for (thread=replay->threads; thread<end; thread++) {
+            destroy_replay_thread(thread);
+        }
+        free(replay->threads);
+        replay->threads = NULL;
+    }
+    destroy_replay_sources(replay);
+    fast_mblock_destroy(&replay->task_allocator);
+}
+
+static void wait_replay_threads_exit(BinlogReplayContext *replay)
+{
+    BinlogReplayThreadContext *thread;
+    BinlogReplayThreadContext *end;
+
+    replay->finished = true;
+    end = replay->threads + replay->thread_count;
+    while (__sync_add_and_fetch(&replay->running_count, 0) > 0) {
+        for (thread=replay->threads; thread<end; thread++) {
+            fc_queue_terminate(&thread->queue);
+        }
+        usleep(10 * 1000);
+    }
+}
+
+static int dispatch_replay_task(DataRecoveryContext *ctx,
+        const ReplicaBinlogRecord *record, void *args)
+{
+    BinlogReplayContext *replay;
+    BinlogReplayThreadContext *thread;
+    BinlogReplayTask *task;
+
+    replay = (BinlogReplayContext *)args;
+    while (__sync_add_and_fetch(&replay->waiting_count, 0) >=
+            REPLAY_WAITING_TASKS_PER_THREAD * replay->thread_count)
+    {
+        if (!SF_G_CONTINUE_FLAG) {
+            return EINTR;
+        }
+        usleep(1000);
+    }
+
+    if ((task=(BinlogReplayTask *)fast_mblock_alloc_object(
+                    &replay->task_allocator)) == NULL)
+    {
+        return ENOMEM;
+    }
+    task->record = *record;
+    fs_calc_block_hashcode(&task->record.bs_key.block);
+
+    /* the operations of the same block must be replayed by
+     * the same thread to keep their order
+     */
+    thread = replay->threads + FS_BLOCK_HASH_CODE(task->record.
+            bs_key.block) % replay->thread_count;
+    __sync_add_and_fetch(&replay->waiting_count, 1);
+    fc_queue_push(&thread->queue, task);
+    return 0;
+}
+
+int data_recovery_replay_binlog(DataRecoveryContext *ctx)
+{
+    BinlogReplayContext replay;
+    BinlogReplayThreadContext *thread;
+    BinlogReplayThreadContext *end;
+    int result;
+
+    if (ctx->replay_count == 0) {
+        return 0;
+    }
+
+    if ((result=init_replay_context(&replay, ctx)) == 0) {
+        result = data_recovery_for_each_record(ctx,
+                RECOVERY_BINLOG_SUBDIR_NAME_REPLAY,
+                dispatch_replay_task, &replay);
+    }
+
+    if (replay.threads != NULL) {
+        wait_replay_threads_exit(&replay);
+        end = replay.threads + replay.thread_count;
+        for (thread=replay.threads; thread<end && result==0; thread++) {
+            result = thread->result;
+        }
+    }
+    destroy_replay_context(&replay);
+    return result;
+}
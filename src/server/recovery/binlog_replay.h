@@ -0,0 +1,21 @@
+//binlog_replay.h
+
+#ifndef _BINLOG_REPLAY_H_
+#define _BINLOG_REPLAY_H_
+
+#include "recovery_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* replay the deduped binlog concurrently, the slice data is read
+ * from the ACTIVE servers of the data group through the service protocol
+ */
+int data_recovery_replay_binlog(DataRecoveryContext *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
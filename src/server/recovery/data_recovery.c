@@ -17,6 +17,10 @@
 #include "../server_global.h"
 #include "../server_group_info.h"
 #include "../server_replication.h"
+#include "../replication/replica_compress.h"
+#include "binlog_fetch.h"
+#include "binlog_dedup.h"
+#include "binlog_replay.h"
 #include "data_recovery.h"
 
 static int init_recovery_sub_path(DataRecoveryContext *ctx, const char *subdir)
@@ -48,7 +52,7 @@ static int init_recovery_sub_path(DataRecoveryContext *ctx, const char *subdir)
     for (i=0; i<3; i++) {
         path_len += sprintf(filepath + path_len, "/%s", subdir_names[i]);
 
-        logInfo("%d. filepath: %s", i + 1, filepath);
+        logDebug("%d. filepath: %s", i + 1, filepath);
         if ((result=fc_check_mkdir_ex(filepath, 0775, &create)) != 0) {
             return result;
         }
@@ -109,6 +113,13 @@ int data_recovery_init(DataRecoveryContext *ctx, const int data_group_id)
 
     ctx->start_time = get_current_time_ms();
     ctx->data_group_id = data_group_id;
+    ctx->fd = -1;
+    ctx->fetch.count = 0;
+    ctx->fetch.last_data_version = 0;
+    ctx->fetch.raw_buffer = NULL;
+    ctx->fetch.compress_stat.bytes_before = 0;
+    ctx->fetch.compress_stat.bytes_after = 0;
+    ctx->replay_count = 0;
 
     if ((master=data_recovery_get_master(ctx, &result)) == NULL) {
         return result;
@@ -133,11 +144,193 @@ int data_recovery_init(DataRecoveryContext *ctx, const int data_group_id)
         return ENOMEM;
     }
 
+    if (REPLICA_COMPRESS_ALGORITHM != FS_COMPRESS_ALGORITHM_NONE) {
+        ctx->fetch.raw_buffer = replication_callee_alloc_shared_buffer(
+                server_ctx);
+        if (ctx->fetch.raw_buffer == NULL) {
+            return ENOMEM;
+        }
+        if ((result=shared_buffer_check_capacity(ctx->fetch.raw_buffer,
+                        g_sf_global_vars.max_buff_size)) != 0)
+        {
+            return result;
+        }
+    }
+
     return 0;
 }
 
 void data_recovery_destroy(DataRecoveryContext *ctx)
 {
-    shared_buffer_release(ctx->buffer);
-    ctx->buffer = NULL;
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+        ctx->fd = -1;
+    }
+
+    if (ctx->buffer != NULL) {
+        shared_buffer_release(ctx->buffer);
+        ctx->buffer = NULL;
+    }
+
+    if (ctx->fetch.raw_buffer != NULL) {
+        shared_buffer_release(ctx->fetch.raw_buffer);
+        ctx->fetch.raw_buffer = NULL;
+    }
+}
+
+int data_recovery_for_each_record(DataRecoveryContext *ctx,
+        const char *subdir, data_recovery_record_func func, void *args)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char error_info[256];
+    ReplicaBinlogRecord record;
+    string_t line;
+    char *buff;
+    char *end;
+    char *line_end;
+    int read_bytes;
+    int result;
+
+    data_recovery_get_subdir_name(ctx, subdir, subdir_name);
+    if ((result=binlog_reader_init(&ctx->reader, subdir_name,
+                    NULL, NULL)) != 0)
+    {
+        return result;
+    }
+
+    buff = ctx->reader.binlog_buffer.buff;
+    while ((result=binlog_reader_integral_read(&ctx->reader, buff,
+                    ctx->reader.binlog_buffer.size, &read_bytes)) == 0)
+    {
+        line.str = buff;
+        end = buff + read_bytes;
+        while (line.str < end) {
+            line_end = (char *)memchr(line.str, '\n', end - line.str);
+            line.len = (line_end - line.str) + 1;
+            if ((result=replica_binlog_record_unpack(&line,
+                            &record, error_info)) != 0)
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "data group id: %d, binlog file: %s, unpack "
+                        "record fail, error info: %s", __LINE__,
+                        ctx->data_group_id, ctx->reader.filename,
+                        error_info);
+                break;
+            }
+
+            if ((result=func(ctx, &record, args)) != 0) {
+                break;
+            }
+            line.str = line_end + 1;
+        }
+
+        if (result != 0) {
+            break;
+        }
+    }
+
+    binlog_reader_destroy(&ctx->reader);
+    return (result == ENOENT) ? 0 : result;
+}
+
+static int unlink_recovery_binlog(DataRecoveryContext *ctx,
+        const char *subdir)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char full_filename[PATH_MAX];
+
+    data_recovery_get_subdir_name(ctx, subdir, subdir_name);
+    binlog_reader_get_filename(subdir_name, 0,
+            full_filename, sizeof(full_filename));
+    if (unlink(full_filename) != 0 && errno != ENOENT) {
+        logError("file: "__FILE__", line: %d, "
+                "unlink file %s fail, errno: %d, error info: %s",
+                __LINE__, full_filename, errno, STRERROR(errno));
+        return errno != 0 ? errno : EPERM;
+    }
+
+    return 0;
+}
+
+static int log_to_replica_binlog(DataRecoveryContext *ctx,
+        const ReplicaBinlogRecord *record, void *args)
+{
+    if (record->op_type == REPLICA_BINLOG_OP_TYPE_DEL_BLOCK) {
+        return replica_binlog_log_del_block(ctx->data_group_id,
+                record->data_version, &record->bs_key.block);
+    } else {
+        return replica_binlog_log_slice(ctx->data_group_id,
+                record->data_version, &record->bs_key,
+                record->op_type);
+    }
+}
+
+static void set_my_data_version(FSClusterDataServerInfo *myself,
+        const uint64_t data_version)
+{
+    uint64_t old_version;
+
+    while (1) {
+        old_version = __sync_add_and_fetch(&myself->data_version, 0);
+        if (old_version == data_version || __sync_bool_compare_and_swap(
+                    &myself->data_version, old_version, data_version))
+        {
+            break;
+        }
+    }
+}
+
+int data_recovery_start(DataRecoveryContext *ctx)
+{
+    FSClusterDataServerInfo *master;
+    FSClusterDataServerInfo *myself;
+    uint64_t old_version;
+    int result;
+
+    if ((master=data_recovery_get_master(ctx, &result)) == NULL) {
+        return result;
+    }
+    myself = master->dg->myself;
+    old_version = __sync_add_and_fetch(&myself->data_version, 0);
+
+    if ((result=data_recovery_fetch_binlog(ctx)) != 0) {
+        return result;
+    }
+    if ((result=data_recovery_dedup_binlog(ctx)) != 0) {
+        return result;
+    }
+
+    if (ctx->fetch.count > 0) {
+        /* the slice operations of replay push my data version forward,
+         * rollback it on fail so that the next round fetches again
+         */
+        if ((result=data_recovery_replay_binlog(ctx)) != 0) {
+            set_my_data_version(myself, old_version);
+            return result;
+        }
+
+        if ((result=data_recovery_for_each_record(ctx,
+                        RECOVERY_BINLOG_SUBDIR_NAME_FETCH,
+                        log_to_replica_binlog, NULL)) != 0)
+        {
+            set_my_data_version(myself, old_version);
+            return result;
+        }
+        set_my_data_version(myself, ctx->fetch.last_data_version);
+
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, recovery done, fetched binlog "
+                "records: %"PRId64", replayed records: %"PRId64", "
+                "data version: %"PRId64", time used: %"PRId64" ms",
+                __LINE__, ctx->data_group_id, ctx->fetch.count,
+                ctx->replay_count, ctx->fetch.last_data_version,
+                get_current_time_ms() - ctx->start_time);
+    }
+
+    if ((result=unlink_recovery_binlog(ctx,
+                    RECOVERY_BINLOG_SUBDIR_NAME_REPLAY)) != 0)
+    {
+        return result;
+    }
+    return unlink_recovery_binlog(ctx, RECOVERY_BINLOG_SUBDIR_NAME_FETCH);
 }
@@ -14,6 +14,12 @@ int data_recovery_init(DataRecoveryContext *ctx, const int data_group_id);
 
 void data_recovery_destroy(DataRecoveryContext *ctx);
 
+/* one recovery round: fetch, dedup and replay the binlog from the master */
+int data_recovery_start(DataRecoveryContext *ctx);
+
+int data_recovery_for_each_record(DataRecoveryContext *ctx,
+        const char *subdir, data_recovery_record_func func, void *args);
+
 static inline void data_recovery_get_subdir_name(DataRecoveryContext *ctx,
         const char *subdir, char *subdir_name)
 {
@@ -0,0 +1,168 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../cluster_relationship.h"
+#include "../replication/replication_apply.h"
+#include "data_recovery.h"
+#include "recovery_thread.h"
+
+static volatile bool recovery_thread_running = false;
+
+static inline bool need_recovery(FSClusterDataGroupInfo *group)
+{
+    int status;
+
+    if (group->myself == NULL || __sync_add_and_fetch(
+                &group->myself->is_master, 0) ||
+            __sync_fetch_and_add(&group->master, 0) == NULL)
+    {
+        return false;
+    }
+
+    status = __sync_add_and_fetch(&group->myself->status, 0);
+    return (status == FS_SERVER_STATUS_INIT ||
+            status == FS_SERVER_STATUS_OFFLINE);
+}
+
+static int recovery_round(FSClusterDataGroupInfo *group,
+        int64_t *fetch_count)
+{
+    DataRecoveryContext ctx;
+    int result;
+
+    memset(&ctx, 0, sizeof(ctx));
+    if ((result=data_recovery_init(&ctx, group->id)) == 0) {
+        result = data_recovery_start(&ctx);
+    }
+    *fetch_count = ctx.fetch.count;
+    data_recovery_destroy(&ctx);
+    return result;
+}
+
+/* the data group becomes ONLINE when the binlog gap is small enough.
+ * the replicated updates are held since then, and are applied after
+ * the binlog is recovered to the version before the first held one,
+ * because the data versions of the replica binlog must be continuous */
+static int recovery_data_group(FSClusterDataGroupInfo *group)
+{
+    int64_t fetch_count;
+    uint64_t my_version;
+    uint64_t held_min_version;
+    bool catching_up;
+    int result;
+
+    cluster_relationship_set_my_status(group->myself,
+            FS_SERVER_STATUS_SYNCING, true);
+
+    catching_up = false;
+    while (SF_G_CONTINUE_FLAG) {
+        result = recovery_round(group, &fetch_count);
+        if (catching_up && result == EBUSY) {  //i am the master now
+            replication_apply_finish_catch_up(group,
+                    group->myself->data_version);
+            return 0;
+        }
+
+        if (result != 0) {
+            if (!catching_up) {
+                cluster_relationship_set_my_status(group->myself,
+                        FS_SERVER_STATUS_OFFLINE, true);
+                return result;
+            }
+
+            //the held updates can NOT be applied before the recovery
+            sleep(1);
+            continue;
+        }
+
+        if (!catching_up) {
+            if (fetch_count <= RECOVERY_MAX_VERSION_GAP) {
+                replication_apply_start_catch_up(group);
+                cluster_relationship_set_my_status(group->myself,
+                        FS_SERVER_STATUS_ONLINE, true);
+                catching_up = true;
+            }
+            continue;
+        }
+
+        my_version = __sync_add_and_fetch(&group->myself->data_version, 0);
+        held_min_version = replication_apply_get_held_min_version(group);
+        if (held_min_version != 0 && held_min_version <= my_version + 1) {
+            replication_apply_finish_catch_up(group, my_version);
+            logInfo("file: "__FILE__", line: %d, "
+                    "data group id: %d, catch up done, data version: "
+                    "%"PRId64, __LINE__, group->id, my_version);
+            return 0;
+        }
+
+        if (fetch_count == 0) {
+            sleep(1);
+        }
+    }
+
+    return EINTR;
+}
+
+static void *recovery_thread_func(void *arg)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *end;
+    int result;
+
+    end = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    while (SF_G_CONTINUE_FLAG) {
+        sleep(1);
+
+        for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<end &&
+                SF_G_CONTINUE_FLAG; group++)
+        {
+            if (!need_recovery(group)) {
+                continue;
+            }
+
+            if ((result=recovery_data_group(group)) != 0) {
+                logError("file: "__FILE__", line: %d, "
+                        "data group id: %d, data recovery fail, "
+                        "errno: %d, error info: %s, try again later",
+                        __LINE__, group->id, result, STRERROR(result));
+            }
+        }
+    }
+
+    recovery_thread_running = false;
+    return NULL;
+}
+
+int recovery_thread_init()
+{
+    pthread_t tid;
+    int result;
+
+    recovery_thread_running = true;
+    if ((result=fc_create_thread(&tid, recovery_thread_func,
+                    NULL, SF_G_THREAD_STACK_SIZE)) != 0)
+    {
+        recovery_thread_running = false;
+    }
+    return result;
+}
+
+void recovery_thread_destroy()
+{
+    int i;
+
+    for (i=0; i<300 && recovery_thread_running; i++) {
+        usleep(10 * 1000);
+    }
+}
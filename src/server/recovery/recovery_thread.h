@@ -0,0 +1,21 @@
+//recovery_thread.h
+
+#ifndef _RECOVERY_THREAD_H_
+#define _RECOVERY_THREAD_H_
+
+#include "recovery_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* start the thread to recover the data groups which status
+ * are INIT or OFFLINE from their masters */
+int recovery_thread_init();
+void recovery_thread_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
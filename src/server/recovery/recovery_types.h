@@ -10,6 +10,7 @@
 #include "fastcommon/common_blocked_queue.h"
 #include "../server_types.h"
 #include "../binlog/binlog_reader.h"
+#include "../binlog/replica_binlog.h"
 
 #define RECOVERY_BINLOG_SUBDIR_NAME_FETCH   "fetch"
 #define RECOVERY_BINLOG_SUBDIR_NAME_REPLAY  "replay"
@@ -19,10 +20,20 @@ typedef struct data_recovery_context {
     uint64_t last_data_version;
     int data_group_id;
     int fd;
+    struct {
+        int64_t count;  //the fetched binlog records
+        uint64_t last_data_version;
+        SharedBuffer *raw_buffer;   //for the compressed binlog
+        FSReplicaCompressStat compress_stat;
+    } fetch;
+    int64_t replay_count;  //the binlog records to replay after dedup
     SharedBuffer *buffer;  //for network
     ServerBinlogReader reader;
 } DataRecoveryContext;
 
+typedef int (*data_recovery_record_func)(DataRecoveryContext *ctx,
+        const ReplicaBinlogRecord *record, void *args);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
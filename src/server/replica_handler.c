@@ -31,7 +31,9 @@
 #include "cluster_topology.h"
 #include "cluster_relationship.h"
 #include "common_handler.h"
+#include "server_trace.h"
 #include "data_update_handler.h"
+#include "replication/replica_compress.h"
 #include "replica_handler.h"
 
 int replica_handler_init()
@@ -126,6 +128,66 @@ static int replica_check_master(struct fast_task_info *task,
     return 0;
 }
 
+static int replica_check_compress_buffer(struct fast_task_info *task,
+        const int size)
+{
+    BufferInfo *buffer;
+
+    buffer = &SERVER_CTX->replica.compress_buffer;
+    if (buffer->alloc_size >= size) {
+        return 0;
+    }
+
+    if (buffer->buff != NULL) {
+        free(buffer->buff);
+    }
+    buffer->buff = (char *)fc_malloc(size);
+    if (buffer->buff == NULL) {
+        buffer->alloc_size = 0;
+        return ENOMEM;
+    }
+    buffer->alloc_size = size;
+    return 0;
+}
+
+/* read the binlog to the compress buffer of the thread and compress
+ * it to the output, the raw binlog is copied when the ratio is poor */
+static int replica_read_compressed_binlog(struct fast_task_info *task,
+        char *buff, const int size, int *read_bytes, int *send_bytes,
+        char *compress_algorithm)
+{
+    BufferInfo *buffer;
+    int max_len;
+    int result;
+
+    if ((result=replica_check_compress_buffer(task, size)) != 0) {
+        return result;
+    }
+
+    buffer = &SERVER_CTX->replica.compress_buffer;
+    result = binlog_reader_integral_read(REPLICA_READER,
+            buffer->buff, size, read_bytes);
+    if (!(result == 0 || result == ENOENT)) {
+        return result;
+    }
+
+    max_len = (int64_t)*read_bytes * REPLICA_COMPRESS_MAX_RATIO / 100;
+    if (*read_bytes >= REPLICA_COMPRESS_MIN_BYTES && replica_compress(
+                REPLICA_FETCH_COMPRESS_ALGORITHM, buffer->buff,
+                *read_bytes, buff, max_len, send_bytes) == 0)
+    {
+        *compress_algorithm = REPLICA_FETCH_COMPRESS_ALGORITHM;
+    } else {
+        memcpy(buff, buffer->buff, *read_bytes);
+        *send_bytes = *read_bytes;
+        *compress_algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    }
+
+    replica_compress_stat_add(&REPLICA_COMPRESS_STAT.fetch_binlog,
+            *read_bytes, *send_bytes);
+    return result;
+}
+
 static int replica_fetch_binlog_output(struct fast_task_info *task)
 {
     FSProtoReplicaFetchBinlogRespBodyHeader *body_header;
@@ -133,24 +195,33 @@ static int replica_fetch_binlog_output(struct fast_task_info *task)
     int result;
     int size;
     int read_bytes;
+    int send_bytes;
 
     body_header = (FSProtoReplicaFetchBinlogRespBodyHeader *)REQUEST.body;
     buff = (char *)(body_header + 1);
     size = (task->data + task->size) - buff;
-    result = binlog_reader_integral_read(REPLICA_READER,
-            buff, size, &read_bytes);
+    if (REPLICA_FETCH_COMPRESS_ALGORITHM == FS_COMPRESS_ALGORITHM_NONE) {
+        result = binlog_reader_integral_read(REPLICA_READER,
+                buff, size, &read_bytes);
+        send_bytes = read_bytes;
+        body_header->compress_algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    } else {
+        result = replica_read_compressed_binlog(task, buff, size,
+                &read_bytes, &send_bytes, &body_header->compress_algorithm);
+    }
     if (!(result == 0 || result == ENOENT)) {
         return result;
     }
 
-    int2buff(read_bytes, body_header->binlog_length);
+    int2buff(send_bytes, body_header->binlog_length);
+    memset(body_header->padding, 0, sizeof(body_header->padding));
     if (size - read_bytes < FS_REPLICA_BINLOG_MAX_RECORD_SIZE) {
         body_header->is_last = false;
     } else {
         body_header->is_last = binlog_reader_is_last_file(REPLICA_READER);
     }
 
-    RESPONSE.header.body_len = sizeof(*body_header) + read_bytes;
+    RESPONSE.header.body_len = sizeof(*body_header) + send_bytes;
     RESPONSE.header.cmd = FS_REPLICA_PROTO_FETCH_BINLOG_RESP;
     TASK_ARG->context.response_done = true;
     return 0;
@@ -163,15 +234,27 @@ static int replica_deal_fetch_binlog_first(struct fast_task_info *task)
     int data_group_id;
     int result;
 
-    if ((result=server_expect_body_length(task,
-                    sizeof(FSProtoReplicaFetchBinlogFirstReq))) != 0)
+    if (REQUEST.header.body_len != FS_PROTO_FETCH_BINLOG_FIRST_REQ_MIN_SIZE &&
+            REQUEST.header.body_len != sizeof(FSProtoReplicaFetchBinlogFirstReq))
     {
-        return result;
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "request body length: %d != %d or %d",
+                REQUEST.header.body_len,
+                FS_PROTO_FETCH_BINLOG_FIRST_REQ_MIN_SIZE,
+                (int)sizeof(FSProtoReplicaFetchBinlogFirstReq));
+        return EINVAL;
     }
 
     req = (FSProtoReplicaFetchBinlogFirstReq *)REQUEST.body;
     last_data_version = buff2long(req->last_data_version);
     data_group_id = buff2int(req->data_group_id);
+    if (REQUEST.header.body_len == sizeof(FSProtoReplicaFetchBinlogFirstReq)
+            && replica_compress_is_supported(req->compress_algorithm))
+    {
+        REPLICA_FETCH_COMPRESS_ALGORITHM = req->compress_algorithm;
+    } else {
+        REPLICA_FETCH_COMPRESS_ALGORITHM = FS_COMPRESS_ALGORITHM_NONE;
+    }
 
     if ((result=replica_check_master(task, data_group_id)) != 0) {
         return result;
@@ -224,18 +307,31 @@ static int replica_deal_join_server_req(struct fast_task_info *task)
     int server_id;
     int buffer_size;
     int replica_channels_between_two_servers;
+    int compress_algorithm;
     FSProtoJoinServerReq *req;
     FSClusterServerInfo *peer;
-    //FSProtoJoinServerResp *resp;
+    FSProtoJoinServerResp *resp;
     FSReplication *replication;
 
-    if ((result=server_expect_body_length(task,
-                    sizeof(FSProtoJoinServerReq))) != 0)
+    if (REQUEST.header.body_len != FS_PROTO_JOIN_SERVER_REQ_MIN_SIZE &&
+            REQUEST.header.body_len != sizeof(FSProtoJoinServerReq))
     {
-        return result;
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "request body length: %d != %d or %d",
+                REQUEST.header.body_len, FS_PROTO_JOIN_SERVER_REQ_MIN_SIZE,
+                (int)sizeof(FSProtoJoinServerReq));
+        return EINVAL;
     }
 
     req = (FSProtoJoinServerReq *)REQUEST.body;
+    if (REQUEST.header.body_len == sizeof(FSProtoJoinServerReq) &&
+            REPLICA_COMPRESS_ALGORITHM != FS_COMPRESS_ALGORITHM_NONE &&
+            replica_compress_is_supported(req->compress_algorithm))
+    {
+        compress_algorithm = req->compress_algorithm;
+    } else {
+        compress_algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    }
     server_id = buff2int(req->server_id);
     buffer_size = buff2int(req->buffer_size);
     replica_channels_between_two_servers = buff2int(
@@ -280,13 +376,27 @@ static int replica_deal_join_server_req(struct fast_task_info *task)
         return ENOENT;
     }
 
+    if ((result=replica_compress_context_init(&replication->compress,
+                    compress_algorithm, task->size)) != 0)
+    {
+        return result;
+    }
+
     replication_processor_bind_task(replication, task);
+    resp = (FSProtoJoinServerResp *)REQUEST.body;
+    resp->compress_algorithm = compress_algorithm;
+    memset(resp->padding, 0, sizeof(resp->padding));
+    RESPONSE.header.body_len = sizeof(FSProtoJoinServerResp);
     RESPONSE.header.cmd = FS_REPLICA_PROTO_JOIN_SERVER_RESP;
+    TASK_ARG->context.response_done = true;
     return 0;
 }
 
 static int replica_deal_join_server_resp(struct fast_task_info *task)
 {
+    int result;
+    int compress_algorithm;
+
     if (!(SERVER_TASK_TYPE == FS_SERVER_TASK_TYPE_REPLICATION &&
                 REPLICA_REPLICATION != NULL))
     {
@@ -295,6 +405,27 @@ static int replica_deal_join_server_resp(struct fast_task_info *task)
         return EINVAL;
     }
 
+    //the old server responds without body
+    if (REQUEST.header.body_len >= sizeof(FSProtoJoinServerResp)) {
+        compress_algorithm = ((FSProtoJoinServerResp *)
+                REQUEST.body)->compress_algorithm;
+    } else {
+        compress_algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    }
+    if (!(compress_algorithm == FS_COMPRESS_ALGORITHM_NONE ||
+                compress_algorithm == REPLICA_COMPRESS_ALGORITHM))
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "peer server id: %d, unexpect compress algorithm: %d",
+                REPLICA_REPLICATION->peer->server->id, compress_algorithm);
+        return EINVAL;
+    }
+    if ((result=replica_compress_context_init(&REPLICA_REPLICATION->
+                    compress, compress_algorithm, task->size)) != 0)
+    {
+        return result;
+    }
+
     set_replication_stage(REPLICA_REPLICATION, FS_REPLICATION_STAGE_SYNCING);
     return 0;
 }
@@ -336,27 +467,40 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
         const int count)
 {
     FSProtoReplicaRPCReqBodyPart *body_part;
+    FSProtoReplicaRPCReqChain *chain;
     FSSliceOpBufferContext *op_buffer_ctx;
     FSSliceOpContext *op_ctx;
+    char *body;
+    char *body_data;
+    int64_t data_version;
+    uint64_t chain_members;
+    int trace_id;
     int result;
     int current_len;
+    int part_len;
     int last_index;
     int blen;
     int i;
 
     TASK_CTX.which_side = FS_WHICH_SIDE_SLAVE;
+    body = buffer->buff + sizeof(FSProtoHeader);
+    part_len = sizeof(FSProtoReplicaRPCReqBodyPart);
+    if ((((FSProtoReplicaRPCReqBodyHeader *)body)->flags &
+                FS_REPLICA_RPC_FLAGS_CHAIN) != 0)
+    {
+        part_len += sizeof(FSProtoReplicaRPCReqChain);
+    }
     last_index = count - 1;
     current_len = sizeof(FSProtoReplicaRPCReqBodyHeader);
     for (i=0; i<count; i++) {
-        body_part = (FSProtoReplicaRPCReqBodyPart *)
-            (buffer->buff + current_len);
+        body_part = (FSProtoReplicaRPCReqBodyPart *)(body + current_len);
         blen = buff2int(body_part->body_len);
         if (blen <= 0) {
             RESPONSE.error.length = sprintf(RESPONSE.error.message,
                     "rpc body length: %d <= 0", blen);
             return EINVAL;
         }
-        current_len += sizeof(*body_part) + blen;
+        current_len += part_len + blen;
         if (i < last_index) {
             if (REQUEST.header.body_len < current_len) {
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
@@ -373,6 +517,35 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
             }
         }
 
+        data_version = buff2long(body_part->data_version);
+        if (data_version <= 0) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "invalid data version: %"PRId64, data_version);
+            return EINVAL;
+        }
+
+        //the chain members follow the body part header
+        body_data = (char *)body_part + part_len;
+        if (part_len > sizeof(*body_part)) {
+            chain = (FSProtoReplicaRPCReqChain *)(body_part + 1);
+            chain_members = buff2long(chain->members);
+        } else {
+            chain_members = 0;
+        }
+
+        trace_id = FS_PROTO_GET_TRACE_ID(body_part->trace_id);
+        if ((result=replication_apply_push(REPLICA_REPLICATION,
+                        buffer, body_part->cmd, data_version, trace_id,
+                        chain_members, body_data, blen)) == 0)
+        {
+            continue;
+        } else if (result != EAGAIN) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "push to apply queue fail, data version: %"PRId64,
+                    data_version);
+            return result;
+        }
+
         if (body_part->cmd == FS_SERVICE_PROTO_SLICE_WRITE_REQ) {
             if ((op_buffer_ctx=replication_callee_alloc_op_buffer_ctx(
                             SERVER_CTX)) == NULL)
@@ -387,14 +560,12 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
             op_ctx = &SLICE_OP_CTX;
         }
 
-        op_ctx->info.data_version = buff2long(body_part->data_version);
-        if (op_ctx->info.data_version <= 0) {
-            RESPONSE.error.length = sprintf(RESPONSE.error.message,
-                    "invalid data version: %"PRId64, op_ctx->info.data_version);
-            return EINVAL;
-        }
-        
-        op_ctx->info.body = (char *)(body_part + 1);
+        op_ctx->info.data_version = data_version;
+        op_ctx->info.chain_members = chain_members;
+        op_ctx->info.body = body_data;
+        op_ctx->info.body_len = blen;
+        server_trace_begin(&op_ctx->trace, trace_id,
+                TASK_ARG->req_start_time);
         switch (body_part->cmd) {
             case FS_SERVICE_PROTO_SLICE_WRITE_REQ:
                 result = du_handler_deal_slice_write(task, op_ctx);
@@ -416,8 +587,19 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
 
         if (result != TASK_STATUS_CONTINUE) {
             int r;
-            r = replication_callee_push_to_rpc_result_queue(
-                    REPLICA_REPLICATION, op_ctx->info.data_version, result);
+
+            //ack after the next replica of the chain acked
+            if (result == 0 && replication_caller_forward_to_chain_next(
+                        REPLICA_REPLICATION, op_ctx, body_part->cmd) == 0)
+            {
+                r = 0;
+            } else {
+                r = replication_callee_push_to_rpc_result_queue(
+                        REPLICA_REPLICATION, op_ctx->info.data_group_id,
+                        op_ctx->info.data_version, result);
+            }
+            server_trace_finish(op_ctx, TASK_CTX.which_side,
+                    body_part->cmd, result);
             if (r != 0) {
                 return r;
             }
@@ -427,6 +609,63 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
     return 0;
 }
 
+/* decompress the body parts to a shared buffer, the headers are copied
+ * and the request body length is set to the raw length */
+static SharedBuffer *replica_decompress_rpc_req(struct fast_task_info *task,
+        const int compress_algorithm, int *err_no)
+{
+    SharedBuffer *buffer;
+    int header_len;
+    int compressed_len;
+    int raw_len;
+
+    if (compress_algorithm != REPLICA_REPLICATION->compress.algorithm) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "compress algorithm: %d != negotiated: %d",
+                compress_algorithm, REPLICA_REPLICATION->compress.algorithm);
+        *err_no = EINVAL;
+        return NULL;
+    }
+
+    if ((buffer=replication_callee_alloc_shared_buffer(SERVER_CTX)) == NULL) {
+        *err_no = ENOMEM;
+        return NULL;
+    }
+
+    //the raw package is limited by the task size of the peer
+    header_len = sizeof(FSProtoHeader) +
+        sizeof(FSProtoReplicaRPCReqBodyHeader);
+    if ((*err_no=shared_buffer_check_capacity(buffer, header_len +
+                    task->size)) != 0)
+    {
+        shared_buffer_release(buffer);
+        return NULL;
+    }
+
+    compressed_len = REQUEST.header.body_len -
+        sizeof(FSProtoReplicaRPCReqBodyHeader);
+    if ((*err_no=replica_decompress(compress_algorithm,
+                    task->data + header_len, compressed_len,
+                    buffer->buff + header_len, buffer->capacity -
+                    header_len, &raw_len)) != 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "decompress rpc body fail, algorithm: %s, "
+                "compressed length: %d", replica_compress_get_caption(
+                    compress_algorithm), compressed_len);
+        shared_buffer_release(buffer);
+        return NULL;
+    }
+
+    replica_compress_stat_add(&REPLICA_REPLICATION->compress.stat,
+            raw_len, compressed_len);
+    memcpy(buffer->buff, task->data, header_len);
+    buffer->length = header_len + raw_len;
+    REQUEST.header.body_len = sizeof(FSProtoReplicaRPCReqBodyHeader) +
+        raw_len;
+    return buffer;
+}
+
 static int replica_deal_rpc_req(struct fast_task_info *task)
 {
     FSProtoReplicaRPCReqBodyHeader *body_header;
@@ -440,8 +679,7 @@ static int replica_deal_rpc_req(struct fast_task_info *task)
     }
 
     if ((result=server_check_min_body_length(task,
-                    sizeof(FSProtoReplicaRPCReqBodyHeader) +
-                    sizeof(FSProtoReplicaRPCReqBodyPart))) != 0)
+                    sizeof(FSProtoReplicaRPCReqBodyHeader))) != 0)
     {
         return result;
     }
@@ -454,20 +692,39 @@ static int replica_deal_rpc_req(struct fast_task_info *task)
         return EINVAL;
     }
 
+    //the old servers do not set the compress algorithm
+    if (REPLICA_REPLICATION->compress.algorithm !=
+            FS_COMPRESS_ALGORITHM_NONE && body_header->
+            compress_algorithm != FS_COMPRESS_ALGORITHM_NONE)
+    {
+        if ((buffer=replica_decompress_rpc_req(task, body_header->
+                        compress_algorithm, &result)) == NULL)
+        {
+            return result;
+        }
+    } else {
+        buffer = NULL;
+    }
+
     min_body_len = sizeof(FSProtoReplicaRPCReqBodyHeader) +
         sizeof(FSProtoReplicaRPCReqBodyPart) * count;
     if (REQUEST.header.body_len < min_body_len) {
         RESPONSE.error.length = sprintf(RESPONSE.error.message,
                 "body length: %d < min length: %d, rpc count: %d",
                 REQUEST.header.body_len, min_body_len, count);
+        if (buffer != NULL) {
+            shared_buffer_release(buffer);
+        }
         return EINVAL;
     }
 
-    if ((buffer=replication_callee_alloc_shared_buffer(SERVER_CTX)) == NULL) {
+    //the slice write reads the data from the shared buffer directly
+    if (buffer == NULL && (buffer=replication_callee_take_task_buffer(
+                    SERVER_CTX, task)) == NULL)
+    {
         return ENOMEM;
     }
 
-    memcpy(buffer->buff, REQUEST.body, task->length - sizeof(FSProtoHeader));
     result = handle_rpc_req(task, buffer, count);
     shared_buffer_release(buffer);
 
@@ -479,6 +736,7 @@ static int replica_deal_rpc_resp(struct fast_task_info *task)
     int result;
     int count;
     int expect_body_len;
+    int data_group_id;
     short err_no;
     uint64_t data_version;
     FSProtoReplicaRPCRespBodyHeader *body_header;
@@ -514,6 +772,7 @@ static int replica_deal_rpc_resp(struct fast_task_info *task)
     bp_end = body_part + count;
     for (; body_part<bp_end; body_part++) {
         data_version = buff2long(body_part->data_version);
+        data_group_id = buff2int(body_part->data_group_id);
         err_no = buff2short(body_part->err_no);
         if (err_no != 0) {
             result = err_no;
@@ -527,7 +786,8 @@ static int replica_deal_rpc_resp(struct fast_task_info *task)
         //logInfo("push_binlog_resp data_version: %"PRId64", errno: %d", data_version, err_no);
 
         if ((result=replication_processors_deal_rpc_response(
-                        REPLICA_REPLICATION, data_version)) != 0)
+                        REPLICA_REPLICATION, data_group_id,
+                        data_version)) != 0)
         {
             RESPONSE.error.length = sprintf(
                     RESPONSE.error.message,
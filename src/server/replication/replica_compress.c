@@ -0,0 +1,198 @@
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef FS_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef FS_WITH_ZSTD
+#include <zstd.h>
+#endif
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "../../common/fs_proto.h"
+#include "replica_compress.h"
+
+#define REPLICA_COMPRESS_ZSTD_LEVEL       1   //the fastest level
+#define REPLICA_COMPRESS_MIN_BYPASS      16
+#define REPLICA_COMPRESS_MAX_BYPASS    1024
+
+int replica_compress_get_algorithm(const char *caption)
+{
+    if (strcasecmp(caption, "none") == 0) {
+        return FS_COMPRESS_ALGORITHM_NONE;
+    } else if (strcasecmp(caption, "lz4") == 0) {
+        return FS_COMPRESS_ALGORITHM_LZ4;
+    } else if (strcasecmp(caption, "zstd") == 0) {
+        return FS_COMPRESS_ALGORITHM_ZSTD;
+    } else {
+        return -1;
+    }
+}
+
+const char *replica_compress_get_caption(const int algorithm)
+{
+    switch (algorithm) {
+        case FS_COMPRESS_ALGORITHM_NONE:
+            return "none";
+        case FS_COMPRESS_ALGORITHM_LZ4:
+            return "lz4";
+        case FS_COMPRESS_ALGORITHM_ZSTD:
+            return "zstd";
+        default:
+            return "unkown";
+    }
+}
+
+bool replica_compress_is_supported(const int algorithm)
+{
+    switch (algorithm) {
+        case FS_COMPRESS_ALGORITHM_NONE:
+            return true;
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_ALGORITHM_LZ4:
+            return true;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_ALGORITHM_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+int replica_compress(const int algorithm, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        int *dest_len)
+{
+    switch (algorithm) {
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_ALGORITHM_LZ4:
+            *dest_len = LZ4_compress_default(src, dest, src_len, dest_size);
+            return (*dest_len > 0) ? 0 : EOVERFLOW;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_ALGORITHM_ZSTD:
+        {
+            size_t bytes;
+            bytes = ZSTD_compress(dest, dest_size, src, src_len,
+                    REPLICA_COMPRESS_ZSTD_LEVEL);
+            if (ZSTD_isError(bytes)) {
+                *dest_len = 0;
+                return EOVERFLOW;
+            }
+            *dest_len = bytes;
+            return 0;
+        }
+#endif
+        default:
+            *dest_len = 0;
+            return EOPNOTSUPP;
+    }
+}
+
+int replica_decompress(const int algorithm, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        int *dest_len)
+{
+    switch (algorithm) {
+#ifdef FS_WITH_LZ4
+        case FS_COMPRESS_ALGORITHM_LZ4:
+            *dest_len = LZ4_decompress_safe(src, dest, src_len, dest_size);
+            if (*dest_len < 0) {
+                logError("file: "__FILE__", line: %d, "
+                        "lz4 decompress fail, source length: %d, "
+                        "dest size: %d, error code: %d", __LINE__,
+                        src_len, dest_size, *dest_len);
+                *dest_len = 0;
+                return EINVAL;
+            }
+            return 0;
+#endif
+#ifdef FS_WITH_ZSTD
+        case FS_COMPRESS_ALGORITHM_ZSTD:
+        {
+            size_t bytes;
+            bytes = ZSTD_decompress(dest, dest_size, src, src_len);
+            if (ZSTD_isError(bytes)) {
+                logError("file: "__FILE__", line: %d, "
+                        "zstd decompress fail, source length: %d, "
+                        "dest size: %d, error info: %s", __LINE__,
+                        src_len, dest_size, ZSTD_getErrorName(bytes));
+                *dest_len = 0;
+                return EINVAL;
+            }
+            *dest_len = bytes;
+            return 0;
+        }
+#endif
+        default:
+            logError("file: "__FILE__", line: %d, "
+                    "unsupported compress algorithm: %d (%s)", __LINE__,
+                    algorithm, replica_compress_get_caption(algorithm));
+            *dest_len = 0;
+            return EOPNOTSUPP;
+    }
+}
+
+int replica_compress_context_init(FSReplicaCompressContext *ctx,
+        const int algorithm, const int buffer_size)
+{
+    ctx->algorithm = algorithm;
+    ctx->skip_batches = 0;
+    ctx->bypass_batches = REPLICA_COMPRESS_MIN_BYPASS;
+    ctx->buffer.length = 0;
+    if (algorithm == FS_COMPRESS_ALGORITHM_NONE ||
+            ctx->buffer.alloc_size >= buffer_size)
+    {
+        return 0;
+    }
+
+    if (ctx->buffer.buff != NULL) {
+        free(ctx->buffer.buff);
+    }
+    ctx->buffer.buff = (char *)fc_malloc(buffer_size);
+    if (ctx->buffer.buff == NULL) {
+        ctx->buffer.alloc_size = 0;
+        ctx->algorithm = FS_COMPRESS_ALGORITHM_NONE;
+        return ENOMEM;
+    }
+    ctx->buffer.alloc_size = buffer_size;
+    return 0;
+}
+
+void replica_compress_context_destroy(FSReplicaCompressContext *ctx)
+{
+    if (ctx->buffer.buff != NULL) {
+        free(ctx->buffer.buff);
+        ctx->buffer.buff = NULL;
+        ctx->buffer.alloc_size = 0;
+    }
+    ctx->algorithm = FS_COMPRESS_ALGORITHM_NONE;
+}
+
+int replica_compress_batch(FSReplicaCompressContext *ctx,
+        char *dest, const int dest_size, int *dest_len)
+{
+    int max_len;
+
+    max_len = (int64_t)ctx->buffer.length * REPLICA_COMPRESS_MAX_RATIO / 100;
+    if (max_len > dest_size) {
+        max_len = dest_size;
+    }
+
+    if (replica_compress(ctx->algorithm, ctx->buffer.buff,
+                ctx->buffer.length, dest, max_len, dest_len) == 0)
+    {
+        ctx->bypass_batches = REPLICA_COMPRESS_MIN_BYPASS;
+        return 0;
+    }
+
+    ctx->skip_batches = ctx->bypass_batches;
+    if (ctx->bypass_batches < REPLICA_COMPRESS_MAX_BYPASS) {
+        ctx->bypass_batches *= 2;
+    }
+    return EOVERFLOW;
+}
@@ -0,0 +1,75 @@
+//replica_compress.h
+
+#ifndef _REPLICA_COMPRESS_H_
+#define _REPLICA_COMPRESS_H_
+
+#include "common/fs_proto.h"
+#include "../server_global.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the replication batches and the fetched binlog chunks are compressed
+ * as a whole with LZ4 or zstd. the algorithm is negotiated per connection
+ * and the codecs are compiled in when make.sh found their libraries.
+ * the batch is sent raw when its compressed size exceeds the max ratio,
+ * and the next batches skip the compression for a while which doubles
+ * for each poor batch, so the incompressible streams cost little CPU
+ */
+int replica_compress_get_algorithm(const char *caption);
+
+const char *replica_compress_get_caption(const int algorithm);
+
+bool replica_compress_is_supported(const int algorithm);
+
+/* compress the source to the dest within the dest size
+ * return 0 for success, EOVERFLOW when the dest is too small
+ */
+int replica_compress(const int algorithm, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        int *dest_len);
+
+int replica_decompress(const int algorithm, const char *src,
+        const int src_len, char *dest, const int dest_size,
+        int *dest_len);
+
+int replica_compress_context_init(FSReplicaCompressContext *ctx,
+        const int algorithm, const int buffer_size);
+
+void replica_compress_context_destroy(FSReplicaCompressContext *ctx);
+
+/* compress the raw batch in ctx->buffer to the dest
+ * return 0 for success, EOVERFLOW for the poor ratio to send raw
+ */
+int replica_compress_batch(FSReplicaCompressContext *ctx,
+        char *dest, const int dest_size, int *dest_len);
+
+static inline bool replica_compress_need_try(
+        FSReplicaCompressContext *ctx, const int length)
+{
+    if (ctx->algorithm == FS_COMPRESS_ALGORITHM_NONE ||
+            length < REPLICA_COMPRESS_MIN_BYTES)
+    {
+        return false;
+    }
+
+    if (ctx->skip_batches > 0) {
+        ctx->skip_batches--;
+        return false;
+    }
+    return true;
+}
+
+static inline void replica_compress_stat_add(FSReplicaCompressStat *stat,
+        const int bytes_before, const int bytes_after)
+{
+    __sync_add_and_fetch(&stat->bytes_before, bytes_before);
+    __sync_add_and_fetch(&stat->bytes_after, bytes_after);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,488 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/fast_mblock.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_proto.h"
+#include "../../common/fs_func.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../server_storage.h"
+#include "../server_trace.h"
+#include "../data_update_handler.h"
+#include "replication_caller.h"
+#include "replication_callee.h"
+#include "version_window.h"
+#include "replication_apply.h"
+
+typedef struct replication_apply_thread_context {
+    struct fc_queue queue;
+    OBSlicePtrArray slice_ptr_array;  //for slice allocate
+    FSResponseInfo response;          //for the error info
+} ReplicationApplyThreadContext;
+
+typedef struct {
+    int count;
+    volatile int64_t pending;  //the entries in queue or applying
+    ReplicationApplyThreadContext *contexts;
+    struct fast_mblock_man entry_allocator;
+} ReplicationApplyContext;
+
+static ReplicationApplyContext apply_ctx = {0, 0, NULL};
+
+static void apply_done(ReplicationApplyEntry *entry, const int result)
+{
+    /* the same as handle_rpc_req: forward to the next replica of the chain
+     * when success, otherwise ack to the upstream directly */
+    if (!(result == 0 && replication_caller_forward_to_chain_next(
+                    entry->replication, &entry->op_ctx, entry->cmd) == 0))
+    {
+        replication_callee_ack_upstream(entry->replication,
+                entry->task_version, entry->op_ctx.info.data_group_id,
+                entry->op_ctx.info.data_version, result);
+    }
+    server_trace_finish(&entry->op_ctx, FS_WHICH_SIDE_SLAVE,
+            entry->cmd, result);
+
+    shared_buffer_release(entry->buffer);
+    fast_mblock_free_object(&apply_ctx.entry_allocator, entry);
+    __sync_sub_and_fetch(&apply_ctx.pending, 1);
+}
+
+static void log_apply_error(ReplicationApplyEntry *entry,
+        const char *error_info, const int result)
+{
+    logError("file: "__FILE__", line: %d, "
+            "peer server id: %d, apply cmd: %d fail, data_group_id: %d, "
+            "data_version: %"PRId64", errno: %d, error info: %s",
+            __LINE__, entry->replication->peer->server->id, entry->cmd,
+            entry->op_ctx.info.data_group_id, entry->op_ctx.info.
+            data_version, result, error_info);
+}
+
+static void slice_write_done_notify(FSSliceOpContext *op_ctx)
+{
+    ReplicationApplyEntry *entry;
+
+    entry = (ReplicationApplyEntry *)op_ctx->notify.args;
+    if (op_ctx->result != 0) {
+        log_apply_error(entry, STRERROR(op_ctx->result), op_ctx->result);
+    }
+    apply_done(entry, op_ctx->result);
+}
+
+static int apply_slice_write(ReplicationApplyThreadContext *thread,
+        ReplicationApplyEntry *entry)
+{
+    FSSliceOpContext *op_ctx;
+    FSProtoSliceWriteReqHeader *req_header;
+    int result;
+
+    op_ctx = &entry->op_ctx;
+    req_header = (FSProtoSliceWriteReqHeader *)op_ctx->info.body;
+    if ((result=du_handler_parse_check_block_slice_ex(&thread->response,
+                    op_ctx, &req_header->bs, false)) != 0)
+    {
+        return result;
+    }
+
+    if (sizeof(FSProtoSliceWriteReqHeader) + op_ctx->info.bs_key.
+            slice.length != op_ctx->info.body_len)
+    {
+        thread->response.error.length = sprintf(thread->response.
+                error.message, "body header length: %d + slice length: "
+                "%d != body length: %d", (int)sizeof(
+                    FSProtoSliceWriteReqHeader), op_ctx->info.bs_key.
+                slice.length, op_ctx->info.body_len);
+        return EINVAL;
+    }
+
+    op_ctx->notify.func = slice_write_done_notify;
+    op_ctx->notify.args = entry;
+    op_ctx->info.write_data_binlog = true;
+    if ((result=fs_slice_write(op_ctx, op_ctx->info.body +
+                    sizeof(FSProtoSliceWriteReqHeader))) != 0)
+    {
+        du_handler_set_slice_op_error_msg_ex(&thread->response,
+                op_ctx, "write", result);
+        return result;
+    }
+
+    return TASK_STATUS_CONTINUE;
+}
+
+static int apply_slice_update(ReplicationApplyThreadContext *thread,
+        ReplicationApplyEntry *entry)
+{
+    FSSliceOpContext *op_ctx;
+    const FSProtoBlockSlice *bs;
+    const char *caption;
+    int result;
+    int inc_alloc;
+
+    op_ctx = &entry->op_ctx;
+    if (op_ctx->info.body_len != sizeof(FSProtoBlockSlice)) {
+        thread->response.error.length = sprintf(thread->response.
+                error.message, "body length: %d != expected: %d",
+                op_ctx->info.body_len, (int)sizeof(FSProtoBlockSlice));
+        return EINVAL;
+    }
+
+    bs = (const FSProtoBlockSlice *)op_ctx->info.body;
+    if ((result=du_handler_parse_check_block_slice_ex(&thread->response,
+                    op_ctx, bs, false)) != 0)
+    {
+        return result;
+    }
+
+    op_ctx->info.write_data_binlog = true;
+    if (entry->cmd == FS_SERVICE_PROTO_SLICE_ALLOCATE_REQ) {
+        caption = "allocate";
+        result = fs_slice_allocate_ex(op_ctx,
+                &thread->slice_ptr_array, &inc_alloc);
+    } else {
+        caption = "delete";
+        result = fs_delete_slices(op_ctx, &inc_alloc);
+    }
+
+    if (result != 0) {
+        du_handler_set_slice_op_error_msg_ex(&thread->response,
+                op_ctx, caption, result);
+    }
+    return result;
+}
+
+static int apply_block_delete(ReplicationApplyThreadContext *thread,
+        ReplicationApplyEntry *entry)
+{
+    FSSliceOpContext *op_ctx;
+    int result;
+    int dec_alloc;
+
+    op_ctx = &entry->op_ctx;
+    if (op_ctx->info.body_len != sizeof(FSProtoBlockDeleteReq)) {
+        thread->response.error.length = sprintf(thread->response.
+                error.message, "body length: %d != expected: %d",
+                op_ctx->info.body_len, (int)sizeof(FSProtoBlockDeleteReq));
+        return EINVAL;
+    }
+
+    if ((result=du_handler_parse_check_block_key_ex(&thread->response,
+                    op_ctx, &((FSProtoBlockDeleteReq *)op_ctx->info.body)->
+                    bkey, false)) != 0)
+    {
+        return result;
+    }
+
+    op_ctx->info.write_data_binlog = true;
+    if ((result=fs_delete_block(op_ctx, &dec_alloc)) != 0) {
+        thread->response.error.length = sprintf(thread->response.
+                error.message, "block delete fail, result: %d", result);
+    }
+    return result;
+}
+
+static void apply_entry(ReplicationApplyThreadContext *thread,
+        ReplicationApplyEntry *entry)
+{
+    int result;
+
+    thread->response.error.length = 0;
+    server_trace_add_span(&entry->op_ctx.trace, FS_TRACE_STAGE_PARSE);
+    switch (entry->cmd) {
+        case FS_SERVICE_PROTO_SLICE_WRITE_REQ:
+            result = apply_slice_write(thread, entry);
+            break;
+        case FS_SERVICE_PROTO_SLICE_ALLOCATE_REQ:
+        case FS_SERVICE_PROTO_SLICE_DELETE_REQ:
+            result = apply_slice_update(thread, entry);
+            break;
+        case FS_SERVICE_PROTO_BLOCK_DELETE_REQ:
+            result = apply_block_delete(thread, entry);
+            break;
+        default:
+            thread->response.error.length = sprintf(thread->response.
+                    error.message, "unkown cmd: %d", entry->cmd);
+            result = EINVAL;
+            break;
+    }
+
+    if (result == TASK_STATUS_CONTINUE) {
+        return;
+    }
+
+    if (result != 0) {
+        log_apply_error(entry, thread->response.error.message, result);
+    }
+    apply_done(entry, result);
+}
+
+static void *replication_apply_thread_func(void *arg)
+{
+    ReplicationApplyThreadContext *thread;
+    ReplicationApplyEntry *head;
+    ReplicationApplyEntry *entry;
+
+    thread = (ReplicationApplyThreadContext *)arg;
+    while (SF_G_CONTINUE_FLAG) {
+        head = (ReplicationApplyEntry *)fc_queue_pop_all(&thread->queue);
+        while (head != NULL) {
+            entry = head;
+            head = head->next;
+            apply_entry(thread, entry);
+        }
+    }
+
+    return NULL;
+}
+
+static inline void push_to_apply_thread(ReplicationApplyEntry *entry)
+{
+    /* the data group is the hash code modulo the data group count,
+     * divide it out so the blocks of one group spread to all threads */
+    entry->thread = apply_ctx.contexts + (FS_BLOCK_HASH_CODE(entry->
+                op_ctx.info.bs_key.block) / FS_DATA_GROUP_COUNT(
+                    CLUSTER_CONFIG_CTX)) % apply_ctx.count;
+    fc_queue_push(&entry->thread->queue, entry);
+}
+
+/* hold the update when the data group is catching up by data recovery */
+static bool hold_entry(FSClusterDataGroupInfo *group,
+        ReplicationApplyEntry *entry)
+{
+    bool held;
+
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    if (group->recovery.catching_up) {
+        entry->next = NULL;
+        if (group->recovery.tail == NULL) {
+            group->recovery.head = entry;
+        } else {
+            group->recovery.tail->next = entry;
+        }
+        group->recovery.tail = entry;
+        held = true;
+    } else {
+        held = false;
+    }
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    return held;
+}
+
+int replication_apply_push(FSReplication *replication, SharedBuffer *buffer,
+        const unsigned char cmd, const uint64_t data_version,
+        const int trace_id, const uint64_t chain_members,
+        char *body, const int body_len)
+{
+    FSClusterDataGroupInfo *group;
+    ReplicationApplyEntry *entry;
+    FSBlockKey bkey;
+    int data_group_id;
+    bool catching_up;
+
+    //all the update requests start with the block key
+    if (body_len < sizeof(FSProtoBlockKey)) {
+        logError("file: "__FILE__", line: %d, "
+                "peer server id: %d, cmd: %d, body length: %d is too short",
+                __LINE__, replication->peer->server->id, cmd, body_len);
+        return EINVAL;
+    }
+
+    bkey.oid = buff2long(((FSProtoBlockKey *)body)->oid);
+    bkey.offset = buff2long(((FSProtoBlockKey *)body)->offset);
+    fs_calc_block_hashcode(&bkey);
+    data_group_id = FS_BLOCK_HASH_CODE(bkey) %
+        FS_DATA_GROUP_COUNT(CLUSTER_CONFIG_CTX) + 1;
+    if ((group=fs_get_data_group(data_group_id)) == NULL) {
+        return ENOENT;
+    }
+
+    catching_up = __sync_add_and_fetch(&group->recovery.catching_up, 0);
+    if (!catching_up && REPLICA_APPLY_THREADS == 0) {
+        return EAGAIN;  //apply in the caller thread
+    }
+
+    if ((entry=(ReplicationApplyEntry *)fast_mblock_alloc_object(
+                    &apply_ctx.entry_allocator)) == NULL)
+    {
+        return ENOMEM;
+    }
+
+    memset(&entry->op_ctx, 0, sizeof(entry->op_ctx));
+    entry->op_ctx.info.data_version = data_version;
+    entry->op_ctx.info.data_group_id = data_group_id;
+    entry->op_ctx.info.chain_members = chain_members;
+    entry->op_ctx.info.bs_key.block = bkey;
+    entry->op_ctx.info.body = body;
+    entry->op_ctx.info.body_len = body_len;
+    server_trace_begin(&entry->op_ctx.trace, trace_id, ((FSServerTaskArg *)
+                replication->task->arg)->req_start_time);
+    entry->cmd = cmd;
+    entry->replication = replication;
+    entry->task_version = __sync_add_and_fetch(&((FSServerTaskArg *)
+                replication->task->arg)->task_version, 0);
+    shared_buffer_hold(buffer);
+    entry->buffer = buffer;
+    __sync_add_and_fetch(&apply_ctx.pending, 1);
+
+    if (catching_up && hold_entry(group, entry)) {
+        return 0;
+    }
+
+    if (REPLICA_APPLY_THREADS == 0) {  //catching up finished
+        shared_buffer_release(entry->buffer);
+        fast_mblock_free_object(&apply_ctx.entry_allocator, entry);
+        __sync_sub_and_fetch(&apply_ctx.pending, 1);
+        return EAGAIN;
+    }
+
+    push_to_apply_thread(entry);
+    return 0;
+}
+
+uint64_t replication_apply_get_held_min_version(
+        FSClusterDataGroupInfo *group)
+{
+    ReplicationApplyEntry *entry;
+    uint64_t min_version;
+
+    min_version = 0;
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    for (entry=group->recovery.head; entry!=NULL; entry=entry->next) {
+        if (min_version == 0 || entry->op_ctx.info.
+                data_version < min_version)
+        {
+            min_version = entry->op_ctx.info.data_version;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    return min_version;
+}
+
+void replication_apply_start_catch_up(FSClusterDataGroupInfo *group)
+{
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    group->recovery.catching_up = 1;
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+}
+
+void replication_apply_finish_catch_up(FSClusterDataGroupInfo *group,
+        const uint64_t recovered_version)
+{
+    ReplicationApplyEntry *head;
+    ReplicationApplyEntry *entry;
+
+    //the versions before it are recovered from the binlog of the master
+    version_window_reset(&group->applied, recovered_version);
+
+    /* the updates arrive during the dispatching are held too,
+     * so the updates of the same block are applied in order */
+    while (1) {
+        PTHREAD_MUTEX_LOCK(&group->lock);
+        head = group->recovery.head;
+        group->recovery.head = group->recovery.tail = NULL;
+        if (head == NULL && (REPLICA_APPLY_THREADS > 0 ||
+                    __sync_add_and_fetch(&apply_ctx.pending, 0) == 0))
+        {
+            group->recovery.catching_up = 0;
+        }
+        PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+        if (head == NULL) {
+            if (!__sync_add_and_fetch(&group->recovery.catching_up, 0)) {
+                break;
+            }
+
+            //wait the apply thread done when apply in the nio threads
+            usleep(10 * 1000);
+            continue;
+        }
+
+        while (head != NULL) {
+            entry = head;
+            head = head->next;
+            if (entry->op_ctx.info.data_version <= recovered_version) {
+                apply_done(entry, 0);  //recovered from the binlog
+            } else {
+                push_to_apply_thread(entry);
+            }
+        }
+    }
+}
+
+int replication_apply_init()
+{
+    int result;
+    int bytes;
+    ReplicationApplyThreadContext *ctx;
+    ReplicationApplyThreadContext *end;
+
+    if ((result=fast_mblock_init_ex2(&apply_ctx.entry_allocator,
+                    "replica_apply_entry", sizeof(ReplicationApplyEntry),
+                    4096, NULL, NULL, true, NULL, NULL, NULL)) != 0)
+    {
+        return result;
+    }
+
+    //one thread at least for the held updates of data recovery
+    apply_ctx.count = (REPLICA_APPLY_THREADS > 0) ? REPLICA_APPLY_THREADS : 1;
+    bytes = sizeof(ReplicationApplyThreadContext) * apply_ctx.count;
+    apply_ctx.contexts = (ReplicationApplyThreadContext *)fc_malloc(bytes);
+    if (apply_ctx.contexts == NULL) {
+        return ENOMEM;
+    }
+    memset(apply_ctx.contexts, 0, bytes);
+
+    end = apply_ctx.contexts + apply_ctx.count;
+    for (ctx=apply_ctx.contexts; ctx<end; ctx++) {
+        if ((result=fc_queue_init(&ctx->queue, (long)(&((
+                                ReplicationApplyEntry *)NULL)->next))) != 0)
+        {
+            return result;
+        }
+        ob_index_init_slice_ptr_array(&ctx->slice_ptr_array);
+    }
+
+    return create_work_threads_ex(&apply_ctx.count,
+            replication_apply_thread_func, apply_ctx.contexts,
+            sizeof(ReplicationApplyThreadContext), NULL,
+            SF_G_THREAD_STACK_SIZE);
+}
+
+void replication_apply_terminate()
+{
+    ReplicationApplyThreadContext *ctx;
+    ReplicationApplyThreadContext *end;
+
+    end = apply_ctx.contexts + apply_ctx.count;
+    for (ctx=apply_ctx.contexts; ctx<end; ctx++) {
+        fc_queue_terminate(&ctx->queue);
+    }
+}
+
+void replication_apply_destroy()
+{
+    ReplicationApplyThreadContext *ctx;
+    ReplicationApplyThreadContext *end;
+
+    if (apply_ctx.contexts == NULL) {
+        return;
+    }
+
+    end = apply_ctx.contexts + apply_ctx.count;
+    for (ctx=apply_ctx.contexts; ctx<end; ctx++) {
+        fc_queue_destroy(&ctx->queue);
+    }
+    free(apply_ctx.contexts);
+    apply_ctx.contexts = NULL;
+}
@@ -0,0 +1,42 @@
+//replication_apply.h
+
+#ifndef _REPLICATION_APPLY_H_
+#define _REPLICATION_APPLY_H_
+
+#include "replication_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int replication_apply_init();
+void replication_apply_destroy();
+void replication_apply_terminate();
+
+/* dispatch the replicated update to the apply thread by the block,
+ * the result is pushed to the rpc result queue of the replication.
+ * the update is held when the data group is catching up by data recovery.
+ * return EAGAIN when the caller should apply it (replica_apply_threads is 0)
+ */
+int replication_apply_push(FSReplication *replication, SharedBuffer *buffer,
+        const unsigned char cmd, const uint64_t data_version,
+        const int trace_id, const uint64_t chain_members,
+        char *body, const int body_len);
+
+/* hold the replicated updates of the data group from now on */
+void replication_apply_start_catch_up(FSClusterDataGroupInfo *group);
+
+/* return the min data version of the held updates, 0 for none */
+uint64_t replication_apply_get_held_min_version(
+        FSClusterDataGroupInfo *group);
+
+/* ack the held updates which data version <= recovered_version,
+ * apply the others and stop holding */
+void replication_apply_finish_catch_up(FSClusterDataGroupInfo *group,
+        const uint64_t recovered_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
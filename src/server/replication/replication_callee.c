@@ -22,6 +22,7 @@
 #include "../server_group_info.h"
 #include "replication_processor.h"
 #include "rpc_result_ring.h"
+#include "version_window.h"
 #include "replication_callee.h"
 
 /*
@@ -66,12 +67,56 @@ int replication_callee_init_allocator(FSServerContext *server_context)
     return 0;
 }
 
+SharedBuffer *replication_callee_take_task_buffer(
+        FSServerContext *server_context, struct fast_task_info *task)
+{
+    SharedBuffer *buffer;
+    char *buff;
+    int capacity;
+
+    if ((buffer=replication_callee_alloc_shared_buffer(
+                    server_context)) == NULL)
+    {
+        return NULL;
+    }
+
+    /* the task buffer is allocated alone when the buffer size is variable,
+     * exchange the buffers instead of copying the package */
+    if (g_sf_global_vars.max_buff_size > g_sf_global_vars.min_buff_size &&
+            buffer->capacity >= g_sf_global_vars.min_buff_size)
+    {
+        buff = buffer->buff;
+        capacity = buffer->capacity;
+        buffer->buff = task->data;
+        buffer->capacity = task->size;
+        task->data = buff;
+        task->size = capacity;
+    } else {
+        if (shared_buffer_check_capacity(buffer, task->length) != 0) {
+            shared_buffer_release(buffer);
+            return NULL;
+        }
+        memcpy(buffer->buff, task->data, task->length);
+    }
+
+    buffer->length = task->length;
+    return buffer;
+}
+
 int replication_callee_push_to_rpc_result_queue(FSReplication *replication,
-        const uint64_t data_version, const int err_no)
+        const int data_group_id, const uint64_t data_version,
+        const int err_no)
 {
+    FSClusterDataGroupInfo *group;
     ReplicationRPCResult *r;
     bool notify;
 
+    /* all the replicated updates are done here, including the failed ones,
+     * the read your writes check uses the contiguous watermark of them */
+    if ((group=fs_get_data_group(data_group_id)) != NULL) {
+        version_window_mark(&group->applied, data_version);
+    }
+
     if (replication == NULL) {
         return ENOENT;
     }
@@ -82,6 +127,7 @@ int replication_callee_push_to_rpc_result_queue(FSReplication *replication,
         return ENOMEM;
     }
 
+    r->data_group_id = data_group_id;
     r->data_version = data_version;
     r->err_no = err_no;
     fc_queue_push_ex(&replication->context.callee.done_queue, r, &notify);
@@ -126,6 +172,8 @@ int replication_callee_deal_rpc_result_queue(FSReplication *replication)
 
         long2buff(r->data_version, ((FSProtoReplicaRPCRespBodyPart *)
                     p)->data_version);
+        int2buff(r->data_group_id, ((FSProtoReplicaRPCRespBodyPart *)
+                    p)->data_group_id);
         short2buff(r->err_no, ((FSProtoReplicaRPCRespBodyPart *)p)->
                 err_no);
         p += sizeof(FSProtoReplicaRPCRespBodyPart);
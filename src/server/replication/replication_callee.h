@@ -37,8 +37,34 @@ static inline SharedBuffer *replication_callee_alloc_shared_buffer(
             replica.shared_buffer_ctx, 1);
 }
 
+/* take over the received package of the task as a shared buffer,
+ * the package (including the header) is in buffer->buff */
+SharedBuffer *replication_callee_take_task_buffer(
+        FSServerContext *server_context, struct fast_task_info *task);
+
 int replication_callee_push_to_rpc_result_queue(FSReplication *replication,
-        const uint64_t data_version, const int err_no);
+        const int data_group_id, const uint64_t data_version,
+        const int err_no);
+
+/* ack to the upstream replica which sent the rpc,
+ * skip when the connection changed */
+static inline void replication_callee_ack_upstream(FSReplication *upstream,
+        const int64_t task_version, const int data_group_id,
+        const uint64_t data_version, const int err_no)
+{
+    struct fast_task_info *task;
+
+    task = upstream->task;
+    if (task == NULL || upstream->stage != FS_REPLICATION_STAGE_SYNCING ||
+            __sync_add_and_fetch(&((FSServerTaskArg *)task->arg)->
+                task_version, 0) != task_version)
+    {
+        return;
+    }
+
+    replication_callee_push_to_rpc_result_queue(upstream,
+            data_group_id, data_version, err_no);
+}
 
 int replication_callee_deal_rpc_result_queue(FSReplication *replication);
 
@@ -16,14 +16,18 @@
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/ioevent_loop.h"
 #include "sf/sf_global.h"
+#include "../../common/fs_proto.h"
 #include "../server_global.h"
 #include "../server_group_info.h"
+#include "../cluster_relationship.h"
 #include "replication_processor.h"
 #include "rpc_result_ring.h"
+#include "version_window.h"
 #include "replication_caller.h"
 
 typedef struct {
     struct fast_mblock_man rpc_allocator;
+    SharedBufferContext buffer_ctx;  //for the copies of the request packages
 } ReplicationMasterContext;
 
 static ReplicationMasterContext repl_mctx;
@@ -42,6 +46,12 @@ int replication_caller_init()
         return result;
     }
 
+    if ((result=shared_buffer_init(&repl_mctx.buffer_ctx, 256,
+                    g_sf_global_vars.min_buff_size)) != 0)
+    {
+        return result;
+    }
+
     return 0;
 }
 
@@ -62,12 +72,21 @@ static inline ReplicationRPCEntry *replication_caller_alloc_rpc_entry()
     return rpc;
 }
 
+static inline void free_rpc_entry(ReplicationRPCEntry *rpc)
+{
+    if (rpc->buffer != NULL) {
+        shared_buffer_release(rpc->buffer);
+        rpc->buffer = NULL;
+    }
+    fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+}
+
 void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc)
 {
     if (__sync_sub_and_fetch(&rpc->reffer_count, 1) == 0) {
         logInfo("file: "__FILE__", line: %d, "
                 "free record buffer: %p", __LINE__, rpc);
-        fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+        free_rpc_entry(rpc);
     }
 }
 
@@ -76,65 +95,304 @@ static inline void push_to_slave_replica_queue(FSReplication *replication,
 {
     bool notify;
 
+    replication_window_acquire(&replication->context.
+            caller.window, rpc->body_len);
     fc_queue_push_ex(&replication->context.caller.rpc_queue, rpc, &notify);
     if (notify) {
         iovent_notify_thread(replication->task->thread_data);
     }
 }
 
+/* the slave missed the update skipped or discarded on the lagging channel,
+ * mark it offline to recover the missed updates when i am the master */
+static inline void offline_lagging_slave(FSClusterDataServerInfo *ds)
+{
+    FSClusterDataServerInfo *myself;
+
+    myself = ds->dg->myself;
+    if (myself != NULL && __sync_add_and_fetch(&myself->is_master, 0)) {
+        cluster_relationship_offline_slave(ds);
+    }
+}
+
+void replication_caller_offline_lagging_slave(FSReplication *replication,
+        const int data_group_id)
+{
+    FSClusterDataServerInfo *ds;
+
+    if ((ds=fs_get_data_server(data_group_id, replication->
+                    peer->server->id)) != NULL)
+    {
+        offline_lagging_slave(ds);
+    }
+}
+
+static void set_replication_lagging(FSReplication *replication,
+        FSClusterDataServerInfo *ds)
+{
+    offline_lagging_slave(ds);
+    if (__sync_bool_compare_and_swap(&replication->context.
+                caller.lagging, 0, 1))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "the window of slave server id: %d is full, "
+                "in flight rpc count: %d, bytes: %"PRId64", "
+                "mark it as lagging", __LINE__,
+                replication->peer->server->id,
+                replication->context.caller.window.count,
+                replication->context.caller.window.bytes);
+        iovent_notify_thread(replication->task->thread_data);
+    }
+}
+
+/* the slave count to wait before response to the client,
+ * the master is counted as one of the majority */
+static inline int get_required_ack_count(FSClusterDataGroupInfo *group)
+{
+    switch (group->write_ack_mode) {
+        case FS_WRITE_ACK_MODE_MAJORITY:
+            return FC_MIN(group->data_server_array.count / 2,
+                    group->slave_ds_array.count);
+        case FS_WRITE_ACK_MODE_MASTER_ONLY:
+            return 0;
+        default:
+            return group->slave_ds_array.count;
+    }
+}
+
 static int push_to_slave_queues(FSClusterDataGroupInfo *group,
-        const uint32_t hash_code, ReplicationRPCEntry *rpc)
+        const uint32_t hash_code, ReplicationRPCEntry *rpc,
+        const int required_count, int *active_count)
 {
     FSClusterDataServerInfo **ds;
     FSClusterDataServerInfo **end;
     FSReplication *replication;
+    struct fast_task_info *task;
     int status;
-    int inactive_count;
 
+    //the rpc entry maybe freed by the replication threads after pushed
+    task = rpc->task;
     __sync_add_and_fetch(&rpc->reffer_count,
             group->slave_ds_array.count);
 
-    __sync_add_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->context.
-            service.waiting_rpc_count, group->slave_ds_array.count);
+    if (task != NULL) {
+        replication_caller_set_waiting_rpc_count(task,
+                rpc->task_version, required_count);
+    }
 
-    inactive_count = 0;
+    /* push to all active slaves even though the client does NOT wait
+     * all of them, the lagging slaves catch up through the rpc queue */
+    *active_count = 0;
     end = group->slave_ds_array.servers + group->slave_ds_array.count;
     for (ds=group->slave_ds_array.servers; ds<end; ds++) {
         status = __sync_fetch_and_add(&(*ds)->status, 0);
         if (!(status == FS_SERVER_STATUS_ONLINE ||
                     status == FS_SERVER_STATUS_ACTIVE))
         {
-            inactive_count++;
+            version_window_untrack(&(*ds)->acked);
             continue;
         }
 
         replication = (*ds)->cs->repl_ptr_array.replications[hash_code %
             (*ds)->cs->repl_ptr_array.count];
         if (replication->task == NULL) {
-            inactive_count++;
+            version_window_untrack(&(*ds)->acked);
+            continue;
+        }
+        if (__sync_add_and_fetch(&replication->context.caller.lagging, 0)) {
+            offline_lagging_slave(*ds);
+            version_window_untrack(&(*ds)->acked);
+            continue;
+        }
+
+        /* the required slaves are checked by replication_caller_check_window
+         * before the update, mark the slave exceeds the window as lagging */
+        if (replication_window_full(&replication->context.caller.window)) {
+            set_replication_lagging(replication, *ds);
+            version_window_untrack(&(*ds)->acked);
             continue;
         }
 
+        version_window_track(&(*ds)->acked, rpc->data_version);
         push_to_slave_replica_queue(replication, rpc);
+        (*active_count)++;
+    }
+
+    if (*active_count < group->slave_ds_array.count) {
+        __sync_sub_and_fetch(&rpc->reffer_count,
+                group->slave_ds_array.count - *active_count);
     }
 
-    if (inactive_count > 0) {
-        __sync_sub_and_fetch(&rpc->reffer_count, inactive_count);
+    if (task == NULL) {
+        return 0;
+    }
+
+    //the inactive slaves never ack
+    if (*active_count < required_count) {
+        if (replication_caller_desc_waiting_rpc_count(task,
+                    rpc->task_version, required_count -
+                    *active_count) == 0)
+        {
+            return 0;
+        }
+    }
+    return TASK_STATUS_CONTINUE;
+}
+
+static int copy_request_package(ReplicationRPCEntry *rpc,
+        struct fast_task_info *task)
+{
+    int result;
+
+    if ((rpc->buffer=shared_buffer_alloc(&repl_mctx.buffer_ctx, 1)) == NULL) {
+        return ENOMEM;
     }
 
-    if (__sync_sub_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->
-                context.service.waiting_rpc_count, inactive_count) == 0)
+    if ((result=shared_buffer_check_capacity(rpc->buffer,
+                    task->length)) != 0)
     {
+        shared_buffer_release(rpc->buffer);
+        rpc->buffer = NULL;
+        return result;
+    }
+
+    memcpy(rpc->buffer->buff, task->data, task->length);
+    rpc->buffer->length = task->length;
+    return 0;
+}
+
+static inline bool is_active_data_server(FSClusterDataServerInfo *ds)
+{
+    int status;
+
+    status = __sync_fetch_and_add(&ds->status, 0);
+    return (status == FS_SERVER_STATUS_ONLINE ||
+            status == FS_SERVER_STATUS_ACTIVE);
+}
+
+/* the master decides the members of the chain by its view, which are
+ * the active slaves, so all the replicas forward by the same chain */
+static uint64_t get_chain_members(FSClusterDataGroupInfo *group)
+{
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    uint64_t members;
+
+    members = 0;
+    end = group->data_server_array.servers + group->data_server_array.count;
+    for (ds=group->data_server_array.servers; ds<end; ds++) {
+        if (ds != group->myself && is_active_data_server(ds)) {
+            members |= 1ULL << (ds - group->data_server_array.servers);
+        }
+    }
+
+    return members;
+}
+
+/* the chain follows the order of the data servers from the master, the
+ * passed members are cleared so the chain never goes back after wrapped.
+ * the member which channel is broken or lagging is skipped, and so is
+ * the one exceeds the window when skip_full, return NULL for the tail */
+static FSReplication *get_chain_next_replication(
+        FSClusterDataGroupInfo *group, FSClusterDataServerInfo *current,
+        const uint32_t hash_code, uint64_t *members, const bool skip_full)
+{
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    FSReplication *replication;
+    uint64_t bit;
+
+    if (current == NULL) {
+        return NULL;
+    }
+
+    *members &= ~(1ULL << (current - group->data_server_array.servers));
+    end = group->data_server_array.servers + group->data_server_array.count;
+    ds = current;
+    while (*members != 0) {
+        if (++ds == end) {
+            ds = group->data_server_array.servers;
+        }
+        bit = 1ULL << (ds - group->data_server_array.servers);
+        if ((*members & bit) == 0) {
+            continue;
+        }
+        *members &= ~bit;
+
+        replication = ds->cs->repl_ptr_array.replications[hash_code %
+            ds->cs->repl_ptr_array.count];
+        if (replication->task == NULL) {
+            continue;
+        }
+        if (__sync_add_and_fetch(&replication->context.caller.lagging, 0)) {
+            offline_lagging_slave(ds);
+            continue;
+        }
+        if (skip_full && replication_window_full(
+                    &replication->context.caller.window))
+        {
+            set_replication_lagging(replication, ds);
+            continue;
+        }
+
+        return replication;
+    }
+
+    return NULL;
+}
+
+static int push_to_chain_next(FSClusterDataGroupInfo *group,
+        const uint32_t hash_code, ReplicationRPCEntry *rpc,
+        const int required_count, int *active_count)
+{
+    FSReplication *replication;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    FSClusterDataServerInfo *next;
+    struct fast_task_info *task;
+    uint64_t members;
+
+    members = get_chain_members(group);
+    replication = get_chain_next_replication(group,
+            group->myself, hash_code, &members, true);
+
+    //the acks of the next replica cover the whole chain
+    next = (replication != NULL) ? fs_get_data_server(group->id,
+            replication->peer->server->id) : NULL;
+    end = group->data_server_array.servers + group->data_server_array.count;
+    for (ds=group->data_server_array.servers; ds<end; ds++) {
+        if (ds == next) {
+            version_window_track(&ds->acked, rpc->data_version);
+        } else if (ds != group->myself) {
+            version_window_untrack(&ds->acked);
+        }
+    }
+
+    if (replication == NULL) {
+        *active_count = 0;
         return 0;
-    } else {
-        return TASK_STATUS_CONTINUE;
     }
+
+    *active_count = 1;
+    task = rpc->task;
+    if (task != NULL) {
+        replication_caller_set_waiting_rpc_count(task,
+                rpc->task_version, required_count);
+    }
+
+    rpc->chain_members = members;
+    __sync_add_and_fetch(&rpc->reffer_count, 1);
+    push_to_slave_replica_queue(replication, rpc);
+    return (task != NULL) ? TASK_STATUS_CONTINUE : 0;
 }
 
 int replication_caller_push_to_slave_queues(struct fast_task_info *task)
 {
     FSClusterDataGroupInfo *group;
     ReplicationRPCEntry *rpc;
+    int target_count;
+    int required_count;
+    int active_count;
     int result;
 
     if ((group=fs_get_data_group(OP_CTX_INFO.data_group_id)) == NULL) {
@@ -149,13 +407,220 @@ int replication_caller_push_to_slave_queues(struct fast_task_info *task)
         return ENOMEM;
     }
 
-    rpc->task = task;
+    /* for chain replication, the next replica acks after
+     * all the following replicas acked */
+    if (group->replication_topology == FS_REPLICATION_TOPOLOGY_CHAIN) {
+        target_count = 1;
+        required_count = (group->write_ack_mode ==
+                FS_WRITE_ACK_MODE_MASTER_ONLY) ? 0 : 1;
+    } else {
+        target_count = group->slave_ds_array.count;
+        required_count = get_required_ack_count(group);
+    }
+
+    rpc->data_version = OP_CTX_INFO.data_version;
+    rpc->data_group_id = OP_CTX_INFO.data_group_id;
+    rpc->body_len = task->length - sizeof(FSProtoHeader);
+    rpc->trace_id = SLICE_OP_CTX.trace.trace_id;
+    rpc->upstream = NULL;
+    rpc->chain_members = 0;
+    rpc->task = (required_count == 0) ? NULL : task;
+
+    /* a new version for each request, so the late acks of the
+     * former request are ignored */
     rpc->task_version = __sync_add_and_fetch(&((FSServerTaskArg *)
-                task->arg)->task_version, 0);
-    if ((result=push_to_slave_queues(group, OP_CTX_INFO.bs_key.block.hash_code,
-                    rpc)) != TASK_STATUS_CONTINUE)
+                task->arg)->task_version, 1);
+
+    /* the client task buffer will be reused when response before
+     * all slaves acked, so copy the request package */
+    if (required_count < target_count) {
+        if ((result=copy_request_package(rpc, task)) != 0) {
+            fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+            return result;
+        }
+    } else {
+        rpc->buffer = NULL;
+    }
+
+    if (group->replication_topology == FS_REPLICATION_TOPOLOGY_CHAIN) {
+        result = push_to_chain_next(group, OP_CTX_INFO.bs_key.block.
+                hash_code, rpc, required_count, &active_count);
+    } else {
+        result = push_to_slave_queues(group, OP_CTX_INFO.bs_key.block.
+                hash_code, rpc, required_count, &active_count);
+    }
+    if (active_count == 0) {
+        free_rpc_entry(rpc);
+    }
+    return result;
+}
+
+int replication_caller_forward_to_chain_next(FSReplication *upstream,
+        FSSliceOpContext *op_ctx, const unsigned char cmd)
+{
+    FSClusterDataGroupInfo *group;
+    FSReplication *replication;
+    ReplicationRPCEntry *rpc;
+    uint64_t members;
+    int length;
+    int result;
+
+    if ((group=fs_get_data_group(op_ctx->info.data_group_id)) == NULL) {
+        return ENOENT;
+    }
+
+    if (group->replication_topology != FS_REPLICATION_TOPOLOGY_CHAIN ||
+            upstream->task == NULL)
+    {
+        return ENOENT;
+    }
+
+    //follow the chain members from the master instead of my view
+    members = op_ctx->info.chain_members;
+    if ((replication=get_chain_next_replication(group, group->myself,
+                    op_ctx->info.bs_key.block.hash_code,
+                    &members, true)) == NULL)
     {
+        return ENOENT;
+    }
+
+    if ((rpc=replication_caller_alloc_rpc_entry()) == NULL) {
+        return ENOMEM;
+    }
+
+    rpc->data_version = op_ctx->info.data_version;
+    rpc->data_group_id = op_ctx->info.data_group_id;
+    rpc->body_len = op_ctx->info.body_len;
+    rpc->trace_id = op_ctx->trace.trace_id;
+    rpc->task = NULL;
+    rpc->upstream = upstream;
+    rpc->chain_members = members;
+    rpc->task_version = __sync_add_and_fetch(&((FSServerTaskArg *)
+                upstream->task->arg)->task_version, 0);
+    if ((rpc->buffer=shared_buffer_alloc(&repl_mctx.buffer_ctx, 1)) == NULL) {
         fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+        return ENOMEM;
+    }
+
+    length = sizeof(FSProtoHeader) + op_ctx->info.body_len;
+    if ((result=shared_buffer_check_capacity(rpc->buffer, length)) != 0) {
+        free_rpc_entry(rpc);
+        return result;
+    }
+
+    FS_PROTO_SET_HEADER((FSProtoHeader *)rpc->buffer->buff,
+            cmd, op_ctx->info.body_len);
+    memcpy(rpc->buffer->buff + sizeof(FSProtoHeader),
+            op_ctx->info.body, op_ctx->info.body_len);
+    rpc->buffer->length = length;
+
+    __sync_add_and_fetch(&rpc->reffer_count, 1);
+    push_to_slave_replica_queue(replication, rpc);
+    return 0;
+}
+
+int replication_caller_check_window(const int data_group_id,
+        const uint32_t hash_code)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataServerInfo **ds;
+    FSClusterDataServerInfo **end;
+    FSReplication *replication;
+    int required_count;
+    int active_count;
+    int full_count;
+    uint64_t members;
+
+    if ((group=fs_get_data_group(data_group_id)) == NULL) {
+        return ENOENT;
+    }
+
+    if (group->slave_ds_array.count == 0) {
+        return 0;
+    }
+
+    if (group->replication_topology == FS_REPLICATION_TOPOLOGY_CHAIN) {
+        if (group->write_ack_mode == FS_WRITE_ACK_MODE_MASTER_ONLY) {
+            return 0;
+        }
+        members = get_chain_members(group);
+        if ((replication=get_chain_next_replication(group, group->myself,
+                        hash_code, &members, false)) == NULL)
+        {
+            return 0;
+        }
+        return replication_window_full(&replication->context.
+                caller.window) ? EBUSY : 0;
+    }
+
+    if ((required_count=get_required_ack_count(group)) == 0) {
+        return 0;
+    }
+
+    active_count = full_count = 0;
+    end = group->slave_ds_array.servers + group->slave_ds_array.count;
+    for (ds=group->slave_ds_array.servers; ds<end; ds++) {
+        if (!is_active_data_server(*ds)) {
+            continue;
+        }
+
+        replication = (*ds)->cs->repl_ptr_array.replications[hash_code %
+            (*ds)->cs->repl_ptr_array.count];
+        if (replication->task == NULL || __sync_add_and_fetch(
+                    &replication->context.caller.lagging, 0))
+        {
+            continue;
+        }
+
+        active_count++;
+        if (replication_window_full(&replication->context.caller.window)) {
+            full_count++;
+        }
+    }
+
+    /* reject only when the required slaves exceed the window,
+     * the inactive slaves are NOT waited as before */
+    if (full_count > 0 && active_count - full_count < required_count) {
+        return EBUSY;
+    }
+    return 0;
+}
+
+void replication_caller_get_slave_stat(FSClusterDataServerInfo *ds,
+        int64_t *replica_lag, int *inflight_count, bool *lagging)
+{
+    FSClusterDataServerInfo *myself;
+    FSReplication **replication;
+    FSReplication **end;
+    int64_t data_version;
+    int64_t acked_version;
+
+    *replica_lag = 0;
+    *inflight_count = 0;
+    *lagging = false;
+    myself = ds->dg->myself;
+    if (myself == NULL || myself == ds || !__sync_add_and_fetch(
+                &myself->is_master, 0))
+    {
+        return;
+    }
+
+    data_version = __sync_add_and_fetch(&myself->data_version, 0);
+    acked_version = version_window_get(&ds->acked);
+    if (data_version > acked_version) {
+        *replica_lag = data_version - acked_version;
+    }
+
+    //the replication channels are shared by the data groups
+    end = ds->cs->repl_ptr_array.replications +
+        ds->cs->repl_ptr_array.count;
+    for (replication=ds->cs->repl_ptr_array.replications;
+            replication<end; replication++)
+    {
+        *inflight_count += __sync_add_and_fetch(&(*replication)->
+                context.caller.window.count, 0);
+        if (__sync_add_and_fetch(&(*replication)->context.caller.lagging, 0)) {
+            *lagging = true;
+        }
     }
-    return result;
 }
@@ -5,10 +5,57 @@
 
 #include "replication_types.h"
 
+/* the waiting rpc count of the task is packed with the low bits of the
+ * task version in one word and changed by CAS, so the late acks of the
+ * former request never decrease the count of the current request */
+#define FS_WAITING_RPC_COUNT_BITS   16
+#define FS_WAITING_RPC_COUNT_MASK   ((1 << FS_WAITING_RPC_COUNT_BITS) - 1)
+
+#define FS_WAITING_RPC_PACK(task_version, count) \
+    (int64_t)(((uint64_t)(task_version) << FS_WAITING_RPC_COUNT_BITS) | \
+            ((count) & FS_WAITING_RPC_COUNT_MASK))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+static inline void replication_caller_set_waiting_rpc_count(
+        struct fast_task_info *task, const int64_t task_version,
+        const int count)
+{
+    __sync_lock_test_and_set(&((FSServerTaskArg *)task->arg)->context.
+            service.waiting_rpc_count, FS_WAITING_RPC_PACK(
+                task_version, count));
+}
+
+/* decrease the waiting rpc count of the request with the task version,
+ * return the remaining count, or -1 when the request is NOT waiting */
+static inline int replication_caller_desc_waiting_rpc_count(
+        struct fast_task_info *task, const int64_t task_version,
+        const int dec)
+{
+    volatile int64_t *waiting;
+    int64_t old_value;
+    int count;
+
+    waiting = &((FSServerTaskArg *)task->arg)->context.
+        service.waiting_rpc_count;
+    do {
+        old_value = __sync_add_and_fetch(waiting, 0);
+        count = old_value & FS_WAITING_RPC_COUNT_MASK;
+        if (count == 0 || old_value != FS_WAITING_RPC_PACK(
+                    task_version, count))
+        {
+            return -1;
+        }
+
+        count = (count > dec) ? count - dec : 0;
+    } while (!__sync_bool_compare_and_swap(waiting, old_value,
+                FS_WAITING_RPC_PACK(task_version, count)));
+
+    return count;
+}
+
 int replication_caller_init();
 void replication_caller_destroy();
 
@@ -16,6 +63,26 @@ void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc);
 
 int replication_caller_push_to_slave_queues(struct fast_task_info *task);
 
+/* check the in flight window of the slaves the client waits for before
+ * the update, return EBUSY when they exceed the window */
+int replication_caller_check_window(const int data_group_id,
+        const uint32_t hash_code);
+
+/* the rpc of the data group is discarded on the lagging channel, mark
+ * the slave on the peer offline when i am the master of the group */
+void replication_caller_offline_lagging_slave(FSReplication *replication,
+        const int data_group_id);
+
+/* the replication stat of the slave when i am the master of the group,
+ * all zero otherwise */
+void replication_caller_get_slave_stat(FSClusterDataServerInfo *ds,
+        int64_t *replica_lag, int *inflight_count, bool *lagging);
+
+/* forward the rpc applied by this slave to the next replica of the chain,
+ * return ENOENT when not chain replication or this slave is the tail */
+int replication_caller_forward_to_chain_next(FSReplication *upstream,
+        FSSliceOpContext *op_ctx, const unsigned char cmd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,8 @@
 #include "../server_group_info.h"
 #include "replication_processor.h"
 #include "rpc_result_ring.h"
+#include "replica_compress.h"
+#include "version_window.h"
 #include "replication_common.h"
 
 typedef struct {
@@ -54,12 +56,33 @@ static int rpc_result_alloc_init_func(void *element, void *args)
     return 0;
 }
 
+/* the servers of the chain groups forward the rpc by the chain members,
+ * the old servers are NOT in these groups as the topology is in the
+ * config sign of the cluster */
+static bool is_chain_peer(FSClusterServerInfo *peer)
+{
+    FSClusterDataServerInfo **ds;
+    FSClusterDataServerInfo **end;
+
+    end = peer->ds_ptr_array.servers + peer->ds_ptr_array.count;
+    for (ds=peer->ds_ptr_array.servers; ds<end; ds++) {
+        if ((*ds)->dg->replication_topology ==
+                FS_REPLICATION_TOPOLOGY_CHAIN)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static int init_replication_context(FSReplication *replication)
 {
     int result;
     int alloc_size;
 
     replication->connection_info.conn.sock = -1;
+    replication->chain_rpc = is_chain_peer(replication->peer);
     if ((result=fc_queue_init(&replication->context.caller.rpc_queue,
                     (long)(&((ReplicationRPCEntry *)NULL)->nexts) +
                     sizeof(void *) * replication->peer->link_index)) != 0)
@@ -89,7 +112,8 @@ static int init_replication_context(FSReplication *replication)
     {
         return result;
     }
-
+    replication->context.caller.rpc_result_ctx.window =
+        &replication->context.caller.window;
 
     logInfo("file: "__FILE__", line: %d, "
             "replication: %d, thread_index: %d",
@@ -175,6 +199,38 @@ static int init_replication_common_array()
     return 0;
 }
 
+/* the in flight versions of a slave are limited by the windows of
+ * the channels, the acked versions of the slaves and the applied versions
+ * of myself as slave are tracked within twice of them */
+static int init_version_windows()
+{
+    int result;
+    int count;
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+
+    count = 2 * REPLICA_CHANNELS_BETWEEN_TWO_SERVERS *
+        REPLICA_WINDOW_MAX_COUNT;
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        if ((result=version_window_init(&group->applied, count)) != 0) {
+            return result;
+        }
+
+        end = group->data_server_array.servers +
+            group->data_server_array.count;
+        for (ds=group->data_server_array.servers; ds<end; ds++) {
+            if ((result=version_window_init(&ds->acked, count)) != 0) {
+                return result;
+            }
+        }
+    }
+
+    return 0;
+}
+
 int replication_common_init()
 {
     int result;
@@ -184,6 +240,10 @@ int replication_common_init()
         return result;
     }
 
+    if ((result=init_version_windows()) != 0) {
+        return result;
+    }
+
     if ((result=init_pthread_lock(&repl_ctx.lock)) != 0) {
         logError("file: "__FILE__", line: %d, "
                 "init_pthread_lock fail, errno: %d, error info: %s",
@@ -228,6 +288,7 @@ void replication_common_destroy()
             replication++)
     {
         fc_queue_destroy(&replication->context.caller.rpc_queue);
+        replica_compress_context_destroy(&replication->compress);
     }
     free(repl_ctx.repl_array.replications);
     repl_ctx.repl_array.replications = NULL;
@@ -10,6 +10,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/uio.h>
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
 #include "fastcommon/shared_func.h"
@@ -22,12 +23,33 @@
 #include "../server_global.h"
 #include "../server_group_info.h"
 #include "../binlog/binlog_reader.h"
+#include "../server_trace.h"
+#include "../service_handler.h"
 #include "rpc_result_ring.h"
+#include "version_window.h"
+#include "replica_compress.h"
 #include "replication_common.h"
 #include "replication_caller.h"
 #include "replication_callee.h"
 #include "replication_processor.h"
 
+#define REPLICATION_MAX_RPC_COUNT_PER_SEND  128
+
+typedef struct {
+    char header[sizeof(FSProtoHeader) +
+        sizeof(FSProtoReplicaRPCReqBodyHeader)];
+    FSProtoReplicaRPCReqBodyPart parts[REPLICATION_MAX_RPC_COUNT_PER_SEND];
+    FSProtoReplicaRPCReqChain chains[REPLICATION_MAX_RPC_COUNT_PER_SEND];
+    struct fast_task_info *tasks[REPLICATION_MAX_RPC_COUNT_PER_SEND];
+    SharedBuffer *buffers[REPLICATION_MAX_RPC_COUNT_PER_SEND];
+    struct iovec iovs[1 + 3 * REPLICATION_MAX_RPC_COUNT_PER_SEND];
+    int count;   //rpc count
+    int task_count;    //the client tasks which buffer held
+    int buffer_count;  //the package copies held
+    int iovcnt;
+    int length;  //package length
+} ReplicationSendContext;
+
 static void replication_queue_discard_all(FSReplication *replication);
 
 static int alloc_replication_ptr_array(FSReplicationPtrArray *array)
@@ -148,7 +170,22 @@ int replication_processor_unbind(FSReplication *replication)
                 replica.connected, replication)) == 0)
     {
         replication_queue_discard_all(replication);
-        rpc_result_ring_clear_all(&replication->context.caller.rpc_result_ctx);
+        rpc_result_ring_clear_all_ex(&replication->context.caller.
+                rpc_result_ctx, __sync_add_and_fetch(&replication->
+                    context.caller.lagging, 0) ? replication : NULL);
+        if (replication->compress.algorithm != FS_COMPRESS_ALGORITHM_NONE) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "peer server id: %d, compress algorithm: %s, "
+                    "bytes before compress: %"PRId64", after: %"PRId64,
+                    __LINE__, replication->peer->server->id,
+                    replica_compress_get_caption(replication->
+                        compress.algorithm), replication->compress.
+                    stat.bytes_before, replication->compress.
+                    stat.bytes_after);
+            replication->compress.algorithm = FS_COMPRESS_ALGORITHM_NONE;
+        }
+        __sync_bool_compare_and_swap(&replication->context.
+                caller.lagging, 1, 0);
         if (replication->is_client) {
             result = replication_processor_bind_thread(replication);
         } else {
@@ -309,10 +346,20 @@ static int send_join_server_package(FSReplication *replication)
 	FSProtoHeader *header;
     FSProtoJoinServerReq *req;
 	char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoJoinServerReq)];
+    int out_bytes;
+
+    /* the compress algorithm is sent only when enabled,
+     * so the join request is compatible with the old servers */
+    replication->compress.algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    if (REPLICA_COMPRESS_ALGORITHM == FS_COMPRESS_ALGORITHM_NONE) {
+        out_bytes = sizeof(FSProtoHeader) + FS_PROTO_JOIN_SERVER_REQ_MIN_SIZE;
+    } else {
+        out_bytes = sizeof(out_buff);
+    }
 
     header = (FSProtoHeader *)out_buff;
     FS_PROTO_SET_HEADER(header, FS_REPLICA_PROTO_JOIN_SERVER_REQ,
-            sizeof(out_buff) - sizeof(FSProtoHeader));
+            out_bytes - sizeof(FSProtoHeader));
 
     req = (FSProtoJoinServerReq *)(out_buff + sizeof(FSProtoHeader));
     int2buff(CLUSTER_MY_SERVER_ID, req->server_id);
@@ -323,8 +370,10 @@ static int send_join_server_package(FSReplication *replication)
             SERVERS_CONFIG_SIGN_LEN);
     memcpy(req->config_signs.cluster, CLUSTER_CONFIG_SIGN_BUF,
             CLUSTER_CONFIG_SIGN_LEN);
+    req->compress_algorithm = REPLICA_COMPRESS_ALGORITHM;
+    memset(req->padding, 0, sizeof(req->padding));
     if ((result=tcpsenddata_nb(replication->connection_info.conn.sock,
-                    out_buff, sizeof(out_buff), SF_G_NETWORK_TIMEOUT)) != 0)
+                    out_buff, out_bytes, SF_G_NETWORK_TIMEOUT)) != 0)
     {
         logError("file: "__FILE__", line: %d, "
                 "send data to server %s:%d fail, "
@@ -343,17 +392,30 @@ static int send_join_server_package(FSReplication *replication)
 
 static void decrease_task_waiting_rpc_count(ReplicationRPCEntry *rb)
 {
-    if (rb->task_version != __sync_add_and_fetch(&((FSServerTaskArg *)
-                    rb->task->arg)->task_version, 0))
-    {
-        logWarning("file: "__FILE__", line: %d, "
-                "task %p already cleanup", __LINE__, rb->task);
+    int count;
+
+    if (rb->upstream != NULL) {
+        replication_callee_ack_upstream(rb->upstream, rb->task_version,
+                rb->data_group_id, rb->data_version, 0);
+        return;
+    }
+
+    if (rb->task == NULL) {
         return;
     }
 
-    if (__sync_sub_and_fetch(&((FSServerTaskArg *)rb->task->arg)->
-                context.service.waiting_rpc_count, 1) == 0)
+    if ((count=replication_caller_desc_waiting_rpc_count(rb->task,
+                    rb->task_version, 1)) < 0)
     {
+        //the client responsed already when rb->buffer != NULL
+        if (rb->buffer == NULL) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "task %p already cleanup", __LINE__, rb->task);
+        }
+        return;
+    }
+
+    if (count == 0) {
         sf_nio_notify(rb->task, SF_NIO_STAGE_CONTINUE);
     }
 }
@@ -362,10 +424,20 @@ static void discard_queue(FSReplication *replication,
         ReplicationRPCEntry *head)
 {
     ReplicationRPCEntry *rb;
+    bool lagging;
+
+    lagging = __sync_add_and_fetch(&replication->context.caller.lagging, 0);
     while (head != NULL) {
         rb = head;
         head = head->nexts[replication->peer->link_index];
 
+        if (lagging && rb->upstream == NULL) {
+            replication_caller_offline_lagging_slave(
+                    replication, rb->data_group_id);
+        }
+
+        replication_window_release(&replication->context.
+                caller.window, rb->body_len);
         decrease_task_waiting_rpc_count(rb);
         replication_caller_release_rpc_entry(rb);
     }
@@ -491,19 +563,161 @@ void clean_connected_replications(FSServerContext *server_ctx)
     }
 }
 
+static inline bool hold_task_buffer(ReplicationRPCEntry *rb)
+{
+    FSServerTaskArg *task_arg;
+
+    task_arg = (FSServerTaskArg *)rb->task->arg;
+    __sync_add_and_fetch(&task_arg->buffer_reffer_count, 1);
+    if (rb->task_version == __sync_add_and_fetch(
+                &task_arg->task_version, 0))
+    {
+        return true;
+    }
+
+    //the nio thread may defer the cleanup for this transient hold
+    service_task_release_buffer(rb->task);
+    return false;
+}
+
+static inline void release_task_buffers(ReplicationSendContext *send_ctx)
+{
+    int i;
+
+    for (i=0; i<send_ctx->task_count; i++) {
+        service_task_release_buffer(send_ctx->tasks[i]);
+    }
+    for (i=0; i<send_ctx->buffer_count; i++) {
+        shared_buffer_release(send_ctx->buffers[i]);
+    }
+}
+
+/* send with writev from the client task buffers directly,
+ * the unsent part is copied to the task buffer to send by the nio thread */
+static int send_rpc_package(FSReplication *replication,
+        ReplicationSendContext *send_ctx)
+{
+    struct fast_task_info *task;
+    struct iovec *iov;
+    struct iovec *end;
+    int bytes;
+    int skip;
+    int len;
+    int result;
+
+    task = replication->task;
+    while ((bytes=writev(task->event.fd, send_ctx->iovs,
+                    send_ctx->iovcnt)) < 0)
+    {
+        result = errno != 0 ? errno : EIO;
+        if (result == EINTR) {
+            continue;
+        }
+
+        if (result == EAGAIN || result == EWOULDBLOCK) {
+            bytes = 0;
+            break;
+        }
+
+        logError("file: "__FILE__", line: %d, "
+                "send data to server %s:%d fail, "
+                "errno: %d, error info: %s", __LINE__,
+                task->client_ip, task->port, result, STRERROR(result));
+        return result;
+    }
+
+    if (bytes < send_ctx->length) {
+        task->length = 0;
+        skip = bytes;
+        end = send_ctx->iovs + send_ctx->iovcnt;
+        for (iov=send_ctx->iovs; iov<end; iov++) {
+            if (skip >= iov->iov_len) {
+                skip -= iov->iov_len;
+                continue;
+            }
+
+            len = iov->iov_len - skip;
+            //the compressed package is in the task buffer already
+            memmove(task->data + task->length,
+                    (char *)iov->iov_base + skip, len);
+            task->length += len;
+            skip = 0;
+        }
+        sf_send_add_event(task);
+    }
+
+    return 0;
+}
+
+/* the body parts are gathered and compressed to the idle task buffer,
+ * the batch is sent raw from the iovs when the ratio is poor */
+static void compress_rpc_package(FSReplication *replication,
+        ReplicationSendContext *send_ctx)
+{
+    FSReplicaCompressContext *ctx;
+    FSProtoReplicaRPCReqBodyHeader *body_header;
+    struct fast_task_info *task;
+    struct iovec *iov;
+    struct iovec *end;
+    int header_len;
+    int raw_len;
+    int compressed_len;
+
+    ctx = &replication->compress;
+    task = replication->task;
+    header_len = sizeof(send_ctx->header);
+    raw_len = send_ctx->length - header_len;
+    if (raw_len > ctx->buffer.alloc_size) {
+        return;
+    }
+
+    ctx->buffer.length = 0;
+    end = send_ctx->iovs + send_ctx->iovcnt;
+    for (iov=send_ctx->iovs + 1; iov<end; iov++) {
+        memcpy(ctx->buffer.buff + ctx->buffer.length,
+                iov->iov_base, iov->iov_len);
+        ctx->buffer.length += iov->iov_len;
+    }
+
+    if (replica_compress_batch(ctx, task->data + header_len,
+                task->size - header_len, &compressed_len) != 0)
+    {
+        replica_compress_stat_add(&ctx->stat, raw_len, raw_len);
+        replica_compress_stat_add(&REPLICA_COMPRESS_STAT.
+                replication, raw_len, raw_len);
+        return;
+    }
+
+    replica_compress_stat_add(&ctx->stat, raw_len, compressed_len);
+    replica_compress_stat_add(&REPLICA_COMPRESS_STAT.replication,
+            raw_len, compressed_len);
+
+    body_header = (FSProtoReplicaRPCReqBodyHeader *)
+        (send_ctx->header + sizeof(FSProtoHeader));
+    body_header->compress_algorithm = ctx->algorithm;
+    send_ctx->length = header_len + compressed_len;
+    FS_PROTO_SET_HEADER((FSProtoHeader *)send_ctx->header,
+            FS_REPLICA_PROTO_RPC_REQ, send_ctx->length -
+            sizeof(FSProtoHeader));
+    memcpy(task->data, send_ctx->header, header_len);
+    send_ctx->iovs[0].iov_base = task->data;
+    send_ctx->iovs[0].iov_len = send_ctx->length;
+    send_ctx->iovcnt = 1;
+}
+
 static int replication_rpc_from_queue(FSReplication *replication)
 {
     struct fc_queue_info qinfo;
     ReplicationRPCEntry *rb;
     ReplicationRPCEntry *deleted;
-    struct fast_task_info *task;
+    ReplicationSendContext send_ctx;
     FSProtoReplicaRPCReqBodyHeader *body_header;
     FSProtoReplicaRPCReqBodyPart *body_part;
-    uint64_t data_version;
+    FSProtoReplicaRPCReqChain *chain;
+    char *package;
     int result;
-    int count;
-    int body_len;
     int blen;
+    int part_len;
     int pkg_len;
 
     fc_queue_pop_to_queue(&replication->context.caller.rpc_queue, &qinfo);
@@ -512,20 +726,21 @@ static int replication_rpc_from_queue(FSReplication *replication)
     }
 
     rb = qinfo.head;
-    count = 0;
-    task = replication->task;
-    task->length = sizeof(FSProtoHeader) +
-        sizeof(FSProtoReplicaRPCReqBodyHeader);
+    send_ctx.count = 0;
+    send_ctx.task_count = 0;
+    send_ctx.buffer_count = 0;
+    send_ctx.length = sizeof(send_ctx.header);
+    send_ctx.iovs[0].iov_base = send_ctx.header;
+    send_ctx.iovs[0].iov_len = sizeof(send_ctx.header);
+    send_ctx.iovcnt = 1;
+    part_len = sizeof(*body_part) + (replication->chain_rpc ?
+            sizeof(FSProtoReplicaRPCReqChain) : 0);
     do {
-        body_part = (FSProtoReplicaRPCReqBodyPart *)(task->data +
-                task->length);
-
-        blen = rb->task->length - sizeof(FSProtoHeader);
-        pkg_len = task->length + sizeof(*body_part) + blen;
-
-        logInfo("replication rb: %p, blen: %d, pkg_len: %d", rb, blen, pkg_len);
-
-        if (pkg_len > task->size) {
+        blen = rb->body_len;
+        pkg_len = send_ctx.length + part_len + blen;
+        if (pkg_len > replication->task->size || send_ctx.count ==
+                REPLICATION_MAX_RPC_COUNT_PER_SEND)
+        {
             bool notify;
 
             qinfo.head = rb;
@@ -534,30 +749,57 @@ static int replication_rpc_from_queue(FSReplication *replication)
             break;
         }
 
-        body_part->cmd = ((FSProtoHeader *)rb->task->data)->cmd;
-        data_version = ((FSServerTaskArg *)rb->task->arg)->
-            context.slice_op_ctx.info.data_version;
-        memcpy(body_part->body, rb->task->data + sizeof(FSProtoHeader), blen);
-        if (rb->task_version == __sync_add_and_fetch(&((FSServerTaskArg *)
-                        rb->task->arg)->task_version, 0))
-        {
-            ++count;
-            task->length = pkg_len;
-            long2buff(data_version, body_part->data_version);
-            int2buff(blen, body_part->body_len);
+        if (rb->buffer != NULL) {
+            shared_buffer_hold(rb->buffer);
+            package = rb->buffer->buff;
+            send_ctx.buffers[send_ctx.buffer_count++] = rb->buffer;
+        } else if (hold_task_buffer(rb)) {
+            package = rb->task->data;
+            send_ctx.tasks[send_ctx.task_count++] = rb->task;
+            server_trace_add_span(&((FSServerTaskArg *)rb->task->arg)->
+                    context.slice_op_ctx.trace, FS_TRACE_STAGE_REPL_SENT);
+        } else {
+            package = NULL;
+        }
 
-            logInfo("count: %d, task->length: %d", count, task->length);
+        if (package != NULL) {
+            body_part = send_ctx.parts + send_ctx.count;
+            body_part->cmd = ((FSProtoHeader *)package)->cmd;
+            FS_PROTO_SET_TRACE_ID(body_part->trace_id, rb->trace_id);
+            long2buff(rb->data_version, body_part->data_version);
+            int2buff(blen, body_part->body_len);
 
-            if ((result=rpc_result_ring_add(&replication->context.caller.
-                            rpc_result_ctx, data_version, rb->task,
-                            rb->task_version)) != 0)
+            send_ctx.iovs[send_ctx.iovcnt].iov_base = body_part;
+            send_ctx.iovs[send_ctx.iovcnt].iov_len = sizeof(*body_part);
+            send_ctx.iovcnt++;
+            if (replication->chain_rpc) {
+                chain = send_ctx.chains + send_ctx.count;
+                long2buff(rb->chain_members, chain->members);
+                send_ctx.iovs[send_ctx.iovcnt].iov_base = chain;
+                send_ctx.iovs[send_ctx.iovcnt].iov_len = sizeof(*chain);
+                send_ctx.iovcnt++;
+            }
+            send_ctx.count++;
+            send_ctx.iovs[send_ctx.iovcnt].iov_base =
+                package + sizeof(FSProtoHeader);
+            send_ctx.iovs[send_ctx.iovcnt].iov_len = blen;
+            send_ctx.iovcnt++;
+            send_ctx.length = pkg_len;
+
+            if ((result=rpc_result_ring_add_ex(&replication->context.
+                            caller.rpc_result_ctx, rb->data_version,
+                            rb->task, rb->task_version, rb->upstream,
+                            rb->data_group_id, blen)) != 0)
             {
+                release_task_buffers(&send_ctx);
                 SF_G_CONTINUE_FLAG = false;
                 return result;
             }
         } else {
             logWarning("file: "__FILE__", line: %d, "
                     "task %p already cleanup", __LINE__, rb->task);
+            replication_window_release(&replication->context.
+                    caller.window, blen);
             decrease_task_waiting_rpc_count(rb);
         }
         deleted = rb;
@@ -566,20 +808,29 @@ static int replication_rpc_from_queue(FSReplication *replication)
         replication_caller_release_rpc_entry(deleted);
     } while (rb != NULL);
 
-    logInfo("replication count: %d, task->length: %d", count, task->length);
-
-    if (count == 0) {
+    if (send_ctx.count == 0) {
         return 0;
     }
 
     body_header = (FSProtoReplicaRPCReqBodyHeader *)
-        (task->data + sizeof(FSProtoHeader));
-    body_len = task->length - sizeof(FSProtoHeader);
-    int2buff(count, body_header->count);
-
-    FS_PROTO_SET_HEADER((FSProtoHeader *)task->data,
-            FS_REPLICA_PROTO_RPC_REQ, body_len);
-    sf_send_add_event(task);
+        (send_ctx.header + sizeof(FSProtoHeader));
+    int2buff(send_ctx.count, body_header->count);
+    body_header->compress_algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    body_header->flags = replication->chain_rpc ?
+        FS_REPLICA_RPC_FLAGS_CHAIN : 0;
+    memset(body_header->padding, 0, sizeof(body_header->padding));
+    FS_PROTO_SET_HEADER((FSProtoHeader *)send_ctx.header,
+            FS_REPLICA_PROTO_RPC_REQ, send_ctx.length -
+            sizeof(FSProtoHeader));
+    if (replica_compress_need_try(&replication->compress, send_ctx.length)) {
+        compress_rpc_package(replication, &send_ctx);
+    }
+
+    result = send_rpc_package(replication, &send_ctx);
+    release_task_buffers(&send_ctx);
+    if (result != 0) {
+        return result;
+    }
 
     if (replication->last_net_comm_time != g_current_time) {
         replication->last_net_comm_time = g_current_time;
@@ -595,14 +846,36 @@ static inline void send_active_test_package(FSReplication *replication)
     sf_send_add_event(replication->task);
 }
 
+static void update_acked_version(FSReplication *replication,
+        const int data_group_id, const uint64_t data_version)
+{
+    FSClusterDataServerInfo *ds;
+
+    if ((ds=fs_get_data_server(data_group_id, replication->
+                    peer->server->id)) == NULL)
+    {
+        return;
+    }
+
+    //the acks of the channels are out of order
+    version_window_mark(&ds->acked, data_version);
+}
+
 int replication_processors_deal_rpc_response(FSReplication *replication,
-        const uint64_t data_version)
+        const int data_group_id, const uint64_t data_version)
 {
-    if (replication->stage == FS_REPLICATION_STAGE_SYNCING) {
-        return rpc_result_ring_remove(&replication->context.caller.
-                rpc_result_ctx, data_version);
+    int result;
+
+    if (replication->stage != FS_REPLICATION_STAGE_SYNCING) {
+        return 0;
     }
-    return 0;
+
+    if ((result=rpc_result_ring_remove(&replication->context.caller.
+                    rpc_result_ctx, data_group_id, data_version)) == 0)
+    {
+        update_acked_version(replication, data_group_id, data_version);
+    }
+    return result;
 }
 
 static int deal_connected_replication(FSReplication *replication)
@@ -621,6 +894,18 @@ static int deal_connected_replication(FSReplication *replication)
         return 0;
     }
 
+    /* the lagging slave missed some updates, break the connection
+     * as the network fault and discard the in flight rpc */
+    if (__sync_add_and_fetch(&replication->context.caller.lagging, 0)) {
+        logWarning("file: "__FILE__", line: %d, "
+                "slave server id: %d is lagging, in flight rpc "
+                "count: %d, bytes: %"PRId64", break the connection",
+                __LINE__, replication->peer->server->id,
+                replication->context.caller.window.count,
+                replication->context.caller.window.bytes);
+        return EBUSY;
+    }
+
     if (!(replication->task->offset == 0 && replication->task->length == 0)) {
         return 0;
     }
@@ -10,14 +10,34 @@
 
 typedef struct replication_rpc_entry {
     uint64_t task_version;
-    struct fast_task_info *task;
+    uint64_t data_version;
+    int data_group_id;
+    int body_len;  //the request body length for the window
+    int trace_id;  //0 for not traced
+    struct fast_task_info *task;  //NULL when the client not wait the result
+    SharedBuffer *buffer;  //the copy of the request package when the client
+                           //does NOT wait all slaves, NULL for zero copy
+    FSReplication *upstream;  //the previous replica of the chain to ack
+    uint64_t chain_members;   //the replicas of the chain decided by the master
     volatile int reffer_count;
     struct replication_rpc_entry *nexts[0];  //for slave replications
 } ReplicationRPCEntry;
 
+struct replication_apply_thread_context;
+typedef struct replication_apply_entry {
+    FSSliceOpContext op_ctx;
+    SharedBuffer *buffer;  //hold the rpc package
+    unsigned char cmd;
+    FSReplication *replication;  //the replication to ack
+    int64_t task_version;        //the task version of the replication
+    struct replication_apply_thread_context *thread;
+    struct replication_apply_entry *next;
+} ReplicationApplyEntry;
+
 typedef struct replication_rpc_result {
     FSReplication *replication;
     short err_no;
+    int data_group_id;
     uint64_t data_version;
     struct replication_rpc_result *next;
 } ReplicationRPCResult;
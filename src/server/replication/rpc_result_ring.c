@@ -15,29 +15,55 @@
 #include "fastcommon/sched_thread.h"
 #include "sf/sf_nio.h"
 #include "sf/sf_global.h"
+#include "../server_trace.h"
+#include "replication_callee.h"
+#include "replication_caller.h"
 #include "rpc_result_ring.h"
 
+static inline unsigned int calc_capacity(const int count)
+{
+    unsigned int capacity;
+
+    capacity = 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
 int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         const int alloc_size)
 {
     int bytes;
 
-    if (ctx->ring.entries != NULL) {
+    if (ctx->htable.buckets != NULL) {
         return 0;
     }
 
-    bytes = sizeof(FSReplicaRPCResultEntry) * alloc_size;
-    ctx->ring.entries = (FSReplicaRPCResultEntry *)fc_malloc(bytes);
-    if (ctx->ring.entries == NULL) {
+    /* the in flight rpc count is limited by the replication window */
+    ctx->htable.capacity = calc_capacity(FC_MAX(alloc_size,
+                REPLICA_WINDOW_MAX_COUNT));
+    bytes = sizeof(FSReplicaRPCResultEntry *) * ctx->htable.capacity;
+    ctx->htable.buckets = (FSReplicaRPCResultEntry **)fc_malloc(bytes);
+    if (ctx->htable.buckets == NULL) {
         return ENOMEM;
     }
-    memset(ctx->ring.entries, 0, bytes);
+    memset(ctx->htable.buckets, 0, bytes);
+    ctx->htable.count = 0;
 
-    ctx->ring.start = ctx->ring.end = ctx->ring.entries;
-    ctx->ring.size = alloc_size;
+    ctx->wheel.size = 16;
+    while (ctx->wheel.size <= SF_G_NETWORK_TIMEOUT + 1) {
+        ctx->wheel.size *= 2;
+    }
+    bytes = sizeof(FSReplicaRPCResultEntry *) * ctx->wheel.size;
+    ctx->wheel.slots = (FSReplicaRPCResultEntry **)fc_malloc(bytes);
+    if (ctx->wheel.slots == NULL) {
+        return ENOMEM;
+    }
+    memset(ctx->wheel.slots, 0, bytes);
+    ctx->wheel.last_time = g_current_time - 1;
 
-    ctx->queue.head = ctx->queue.tail = NULL;
-    return fast_mblock_init_ex2(&ctx->queue.rentry_allocator,
+    return fast_mblock_init_ex2(&ctx->rentry_allocator,
         "push_result", sizeof(FSReplicaRPCResultEntry), 4096,
         NULL, NULL, false, NULL, NULL, NULL);
 }
@@ -45,145 +71,200 @@ int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
 static inline void desc_task_waiting_rpc_count(
         FSReplicaRPCResultEntry *entry)
 {
-    FSServerTaskArg *task_arg;
+    int count;
+
+    if (entry->upstream != NULL) {
+        replication_callee_ack_upstream(entry->upstream, entry->task_version,
+                entry->data_group_id, entry->data_version, 0);
+        return;
+    }
 
     if (entry->waiting_task == NULL) {
         return;
     }
 
-    task_arg = (FSServerTaskArg *)entry->waiting_task->arg;
-    if (entry->task_version != __sync_add_and_fetch(
-                &task_arg->task_version, 0))
+    if ((count=replication_caller_desc_waiting_rpc_count(entry->
+                    waiting_task, entry->task_version, 1)) < 0)
     {
-        logWarning("file: "__FILE__", line: %d, "
-                "task %p already cleanup",
+        //the late ack when the write ack mode is NOT all
+        logDebug("file: "__FILE__", line: %d, "
+                "task %p already cleanup or responsed",
                 __LINE__, entry->waiting_task);
         return;
     }
 
-    if (__sync_sub_and_fetch(&((FSServerTaskArg *)
-                    entry->waiting_task->arg)->context.
-                service.waiting_rpc_count, 1) == 0)
-    {
+    server_trace_add_span(&((FSServerTaskArg *)entry->waiting_task->arg)->
+            context.slice_op_ctx.trace, FS_TRACE_STAGE_REPL_ACKED);
+    if (count == 0) {
         sf_nio_notify(entry->waiting_task, SF_NIO_STAGE_CONTINUE);
     }
 }
 
-static void rpc_result_ring_clear_queue_all(FSReplicaRPCResultContext *ctx)
+static inline void rpc_result_entry_done(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultEntry *entry)
 {
-    FSReplicaRPCResultEntry *current;
-    FSReplicaRPCResultEntry *deleted;
+    replication_window_release(ctx->window, entry->bytes);
+    desc_task_waiting_rpc_count(entry);
+}
 
-    if (ctx->queue.head == NULL) {
-        return;
-    }
+#define RPC_RESULT_BUCKET(ctx, data_group_id, data_version) \
+    ((ctx)->htable.buckets + (((data_version) + (uint64_t)(data_group_id) * \
+            2654435761U) & ((ctx)->htable.capacity - 1)))
 
-    current = ctx->queue.head;
-    while (current != NULL) {
-        deleted = current;
-        current = current->next;
+#define RPC_RESULT_SLOT(ctx, expires) \
+    ((ctx)->wheel.slots + ((expires) & ((ctx)->wheel.size - 1)))
 
-        desc_task_waiting_rpc_count(deleted);
-        fast_mblock_free_object(&ctx->queue.rentry_allocator, deleted);
-    }
+static inline void wheel_add(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultEntry *entry)
+{
+    FSReplicaRPCResultEntry **slot;
 
-    ctx->queue.head = ctx->queue.tail = NULL;
+    slot = RPC_RESULT_SLOT(ctx, entry->expires);
+    entry->dlink.prev = NULL;
+    entry->dlink.next = *slot;
+    if (*slot != NULL) {
+        (*slot)->dlink.prev = entry;
+    }
+    *slot = entry;
 }
 
-void rpc_result_ring_clear_all(FSReplicaRPCResultContext *ctx)
+static inline void wheel_remove(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultEntry *entry)
 {
-    int index;
-
-    if (ctx->ring.start == ctx->ring.end) {
-        rpc_result_ring_clear_queue_all(ctx);
-        return;
+    if (entry->dlink.prev != NULL) {
+        entry->dlink.prev->dlink.next = entry->dlink.next;
+    } else {
+        *RPC_RESULT_SLOT(ctx, entry->expires) = entry->dlink.next;
     }
 
-    index = ctx->ring.start - ctx->ring.entries;
-    while (ctx->ring.start != ctx->ring.end) {
-        desc_task_waiting_rpc_count(ctx->ring.start);
-        ctx->ring.start->data_version = 0;
-        ctx->ring.start->waiting_task = NULL;
-
-        ctx->ring.start = ctx->ring.entries +
-            (++index % ctx->ring.size);
+    if (entry->dlink.next != NULL) {
+        entry->dlink.next->dlink.prev = entry->dlink.prev;
     }
-
-    rpc_result_ring_clear_queue_all(ctx);
 }
 
-static int  rpc_result_ring_clear_queue_timeouts(
-        FSReplicaRPCResultContext *ctx)
+static inline FSReplicaRPCResultEntry *htable_remove(
+        FSReplicaRPCResultContext *ctx, const int data_group_id,
+        const uint64_t data_version)
 {
-    FSReplicaRPCResultEntry *current;
-    FSReplicaRPCResultEntry *deleted;
-    int count;
+    FSReplicaRPCResultEntry **bucket;
+    FSReplicaRPCResultEntry *previous;
+    FSReplicaRPCResultEntry *entry;
 
-    if (ctx->queue.head == NULL) {
-        return 0;
+    bucket = RPC_RESULT_BUCKET(ctx, data_group_id, data_version);
+    previous = NULL;
+    entry = *bucket;
+    while (entry != NULL && !(entry->data_version == data_version &&
+                entry->data_group_id == data_group_id))
+    {
+        previous = entry;
+        entry = entry->next;
     }
 
-    if (ctx->queue.head->expires >= g_current_time) {
-        return 0;
+    if (entry == NULL) {
+        return NULL;
     }
 
-    count = 0;
-    current = ctx->queue.head;
-    while (current != NULL && current->expires < g_current_time) {
-        deleted = current;
-        current = current->next;
+    if (previous == NULL) {
+        *bucket = entry->next;
+    } else {
+        previous->next = entry->next;
+    }
+    ctx->htable.count--;
+    return entry;
+}
 
-        logWarning("file: "__FILE__", line: %d, "
-                "waiting push response timeout, "
-                "data_version: %"PRId64", task: %p",
-                __LINE__, deleted->data_version,
-                deleted->waiting_task);
-        desc_task_waiting_rpc_count(deleted);
-        fast_mblock_free_object(&ctx->queue.rentry_allocator, deleted);
-        ++count;
+static inline void free_entry(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultEntry *entry)
+{
+    rpc_result_entry_done(ctx, entry);
+    fast_mblock_free_object(&ctx->rentry_allocator, entry);
+}
+
+void rpc_result_ring_clear_all_ex(FSReplicaRPCResultContext *ctx,
+        FSReplication *lagging_replication)
+{
+    FSReplicaRPCResultEntry **bucket;
+    FSReplicaRPCResultEntry **end;
+    FSReplicaRPCResultEntry *entry;
+    FSReplicaRPCResultEntry *deleted;
+
+    if (ctx->htable.count == 0) {
+        return;
     }
 
-    ctx->queue.head = current;
-    if (current == NULL) {
-        ctx->queue.tail = NULL;
+    end = ctx->htable.buckets + ctx->htable.capacity;
+    for (bucket=ctx->htable.buckets; bucket<end; bucket++) {
+        entry = *bucket;
+        while (entry != NULL) {
+            deleted = entry;
+            entry = entry->next;
+            if (lagging_replication != NULL && deleted->upstream == NULL) {
+                replication_caller_offline_lagging_slave(
+                        lagging_replication, deleted->data_group_id);
+            }
+            free_entry(ctx, deleted);
+        }
+        *bucket = NULL;
     }
+    ctx->htable.count = 0;
 
-    return count;
+    memset(ctx->wheel.slots, 0, sizeof(FSReplicaRPCResultEntry *) *
+            ctx->wheel.size);
 }
 
+/* expire the entries which expires < the current time, the slots
+ * from the last expired time to now are visited only once */
 void rpc_result_ring_clear_timeouts(FSReplicaRPCResultContext *ctx)
 {
-    int index;
+    FSReplicaRPCResultEntry **slot;
+    FSReplicaRPCResultEntry *entry;
+    FSReplicaRPCResultEntry *deleted;
+    time_t end_time;
+    time_t t;
     int clear_count;
 
     if (ctx->last_check_timeout_time == g_current_time) {
         return;
     }
-
-    clear_count = 0;
     ctx->last_check_timeout_time = g_current_time;
-    if (ctx->ring.start != ctx->ring.end) {
-        index = ctx->ring.start - ctx->ring.entries;
-        while (ctx->ring.start != ctx->ring.end &&
-                ctx->ring.start->expires < g_current_time)
-        {
-            logWarning("file: "__FILE__", line: %d, "
-                    "waiting push response timeout, "
-                    "data_version: %"PRId64", task: %p",
-                    __LINE__, ctx->ring.start->data_version,
-                    ctx->ring.start->waiting_task);
 
-            desc_task_waiting_rpc_count(ctx->ring.start);
-            ctx->ring.start->data_version = 0;
-            ctx->ring.start->waiting_task = NULL;
+    end_time = g_current_time - 1;
+    if (ctx->htable.count == 0) {
+        ctx->wheel.last_time = end_time;
+        return;
+    }
+
+    if (end_time - ctx->wheel.last_time > ctx->wheel.size) {
+        t = end_time - ctx->wheel.size + 1;
+    } else {
+        t = ctx->wheel.last_time + 1;
+    }
+
+    clear_count = 0;
+    for (; t<=end_time; t++) {
+        slot = RPC_RESULT_SLOT(ctx, t);
+        entry = *slot;
+        while (entry != NULL) {
+            deleted = entry;
+            entry = entry->dlink.next;
+            if (deleted->expires > end_time) {
+                continue;
+            }
 
-            ctx->ring.start = ctx->ring.entries +
-                (++index % ctx->ring.size);
+            logWarning("file: "__FILE__", line: %d, "
+                    "waiting push response timeout, data group id: %d, "
+                    "data_version: %"PRId64", task: %p", __LINE__,
+                    deleted->data_group_id, deleted->data_version,
+                    deleted->waiting_task);
+            wheel_remove(ctx, deleted);
+            htable_remove(ctx, deleted->data_group_id,
+                    deleted->data_version);
+            free_entry(ctx, deleted);
             ++clear_count;
         }
     }
+    ctx->wheel.last_time = end_time;
 
-    clear_count += rpc_result_ring_clear_queue_timeouts(ctx);
     if (clear_count > 0) {
         logWarning("file: "__FILE__", line: %d, "
                 "clear timeout push response waiting entries count: %d",
@@ -193,25 +274,32 @@ void rpc_result_ring_clear_timeouts(FSReplicaRPCResultContext *ctx)
 
 void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx)
 {
-    if (ctx->ring.entries != NULL) {
-        free(ctx->ring.entries);
-        ctx->ring.start = ctx->ring.end = ctx->ring.entries = NULL;
-        ctx->ring.size = 0;
+    if (ctx->htable.buckets != NULL) {
+        free(ctx->htable.buckets);
+        ctx->htable.buckets = NULL;
+        ctx->htable.capacity = 0;
+        ctx->htable.count = 0;
+    }
+
+    if (ctx->wheel.slots != NULL) {
+        free(ctx->wheel.slots);
+        ctx->wheel.slots = NULL;
+        ctx->wheel.size = 0;
     }
 
-    fast_mblock_destroy(&ctx->queue.rentry_allocator);
+    fast_mblock_destroy(&ctx->rentry_allocator);
 }
 
-static int add_to_queue(FSReplicaRPCResultContext *ctx,
-            const uint64_t data_version, struct fast_task_info *waiting_task,
-            const int64_t task_version)
+int rpc_result_ring_add_ex(FSReplicaRPCResultContext *ctx,
+        const uint64_t data_version, struct fast_task_info *waiting_task,
+        const int64_t task_version, FSReplication *upstream,
+        const int data_group_id, const int bytes)
 {
+    FSReplicaRPCResultEntry **bucket;
     FSReplicaRPCResultEntry *entry;
-    FSReplicaRPCResultEntry *previous;
-    FSReplicaRPCResultEntry *current;
 
     entry = (FSReplicaRPCResultEntry *)fast_mblock_alloc_object(
-            &ctx->queue.rentry_allocator);
+            &ctx->rentry_allocator);
     if (entry == NULL) {
         return ENOMEM;
     }
@@ -219,151 +307,30 @@ static int add_to_queue(FSReplicaRPCResultContext *ctx,
     entry->data_version = data_version;
     entry->waiting_task = waiting_task;
     entry->task_version = task_version;
+    entry->upstream = upstream;
+    entry->data_group_id = data_group_id;
+    entry->bytes = bytes;
     entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
 
-    if (ctx->queue.tail == NULL) {  //empty queue
-        entry->next = NULL;
-        ctx->queue.head = ctx->queue.tail = entry;
-        return 0;
-    }
-
-    if (data_version > ctx->queue.tail->data_version) {
-        entry->next = NULL;
-        ctx->queue.tail->next = entry;
-        ctx->queue.tail = entry;
-        return 0;
-    }
-
-    if (data_version < ctx->queue.head->data_version) {
-        entry->next = ctx->queue.head;
-        ctx->queue.head = entry;
-        return 0;
-    }
-
-    previous = ctx->queue.head;
-    current = ctx->queue.head->next;
-    while (current != NULL && data_version > current->data_version) {
-        previous = current;
-        current = current->next;
-    }
+    bucket = RPC_RESULT_BUCKET(ctx, data_group_id, data_version);
+    entry->next = *bucket;
+    *bucket = entry;
+    ctx->htable.count++;
 
-    entry->next = previous->next;
-    previous->next = entry;
+    wheel_add(ctx, entry);
     return 0;
 }
 
-int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
-        const uint64_t data_version, struct fast_task_info *waiting_task,
-        const int64_t task_version)
-{
-    FSReplicaRPCResultEntry *entry;
-    FSReplicaRPCResultEntry *previous;
-    FSReplicaRPCResultEntry *next;
-    int index;
-    bool matched;
-
-    matched = false;
-    index = data_version % ctx->ring.size;
-    entry = ctx->ring.entries + index;
-    if (ctx->ring.end == ctx->ring.start) {  //empty
-        ctx->ring.start = entry;
-        ctx->ring.end = ctx->ring.entries + (index + 1) % ctx->ring.size;
-        matched = true;
-    } else if (entry == ctx->ring.end) {
-        previous = ctx->ring.entries + (index + ctx->ring.size - 1) %
-            ctx->ring.size;
-        next = ctx->ring.entries + (index + 1) % ctx->ring.size;
-        if ((next != ctx->ring.start) &&
-                data_version == previous->data_version + 1)
-        {
-            ctx->ring.end = next;
-            matched = true;
-        }
-    }
-
-    if (matched) {
-        entry->data_version = data_version;
-        entry->waiting_task = waiting_task;
-        entry->task_version = task_version;
-        entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
-        return 0;
-    }
-
-    logWarning("file: "__FILE__", line: %d, "
-            "can't found data version %"PRId64", in the ring",
-            __LINE__, data_version);
-    return add_to_queue(ctx, data_version, waiting_task, task_version);
-}
-
-static int remove_from_queue(FSReplicaRPCResultContext *ctx,
-        const uint64_t data_version)
+int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
+        const int data_group_id, const uint64_t data_version)
 {
     FSReplicaRPCResultEntry *entry;
-    FSReplicaRPCResultEntry *previous;
-    FSReplicaRPCResultEntry *current;
 
-    if (ctx->queue.head == NULL) {  //empty queue
+    if ((entry=htable_remove(ctx, data_group_id, data_version)) == NULL) {
         return ENOENT;
     }
 
-    if (data_version == ctx->queue.head->data_version) {
-        entry = ctx->queue.head;
-        ctx->queue.head = entry->next;
-        if (ctx->queue.head == NULL) {
-            ctx->queue.tail = NULL;
-        }
-    } else {
-        previous = ctx->queue.head;
-        current = ctx->queue.head->next;
-        while (current != NULL && data_version > current->data_version) {
-            previous = current;
-            current = current->next;
-        }
-
-        if (current == NULL || data_version != current->data_version) {
-            return ENOENT;
-        }
-
-        entry = current;
-        previous->next = current->next;
-        if (ctx->queue.tail == current) {
-            ctx->queue.tail = previous;
-        }
-    }
-
-    desc_task_waiting_rpc_count(entry);
-    fast_mblock_free_object(&ctx->queue.rentry_allocator, entry);
+    wheel_remove(ctx, entry);
+    free_entry(ctx, entry);
     return 0;
 }
-
-int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
-        const uint64_t data_version)
-{
-    FSReplicaRPCResultEntry *entry;
-    int index;
-
-    if (ctx->ring.end != ctx->ring.start) {
-        index = data_version % ctx->ring.size;
-        entry = ctx->ring.entries + index;
-
-        if (entry->data_version == data_version) {
-            if (ctx->ring.start == entry) {
-                ctx->ring.start = ctx->ring.entries +
-                    (++index % ctx->ring.size);
-                while (ctx->ring.start != ctx->ring.end &&
-                        ctx->ring.start->data_version == 0)
-                {
-                    ctx->ring.start = ctx->ring.entries +
-                        (++index % ctx->ring.size);
-                }
-            }
-
-            desc_task_waiting_rpc_count(entry);
-            entry->data_version = 0;
-            entry->waiting_task = NULL;
-            return 0;
-        }
-    }
-
-    return remove_from_queue(ctx, data_version);
-}
@@ -3,25 +3,67 @@
 #ifndef _RPC_RESULT_RING_H_
 #define _RPC_RESULT_RING_H_
 
-#include "../server_types.h"
+#include "../server_global.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+static inline void replication_window_acquire(
+        FSReplicationWindow *window, const int bytes)
+{
+    __sync_add_and_fetch(&window->count, 1);
+    __sync_add_and_fetch(&window->bytes, bytes);
+}
+
+static inline void replication_window_release(
+        FSReplicationWindow *window, const int bytes)
+{
+    __sync_sub_and_fetch(&window->count, 1);
+    __sync_sub_and_fetch(&window->bytes, bytes);
+}
+
+static inline bool replication_window_full(FSReplicationWindow *window)
+{
+    return (__sync_add_and_fetch(&window->count, 0) >=
+            REPLICA_WINDOW_MAX_COUNT || __sync_add_and_fetch(
+                &window->bytes, 0) >= REPLICA_WINDOW_MAX_BYTES);
+}
+
+/* the rpc results waiting for the acks of the slave are indexed by
+ * the data group id and data version for O(1) match of the out of order
+ * acks, and linked in a timing wheel by the expire time for O(1) timeout
+ */
 int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         const int alloc_size);
 
 void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx);
 
-int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
+int rpc_result_ring_add_ex(FSReplicaRPCResultContext *ctx,
         const uint64_t data_version, struct fast_task_info *waiting_task,
-        const int64_t task_version);
+        const int64_t task_version, FSReplication *upstream,
+        const int data_group_id, const int bytes);
+
+static inline int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
+        const uint64_t data_version, struct fast_task_info *waiting_task,
+        const int64_t task_version)
+{
+    return rpc_result_ring_add_ex(ctx, data_version, waiting_task,
+            task_version, NULL, 0, 0);
+}
 
 int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
-        const uint64_t data_version);
+        const int data_group_id, const uint64_t data_version);
 
-void rpc_result_ring_clear_all(FSReplicaRPCResultContext *ctx);
+/* discard all the in flight rpc, the slaves of their data groups are
+ * marked offline when the lagging replication is not NULL */
+void rpc_result_ring_clear_all_ex(FSReplicaRPCResultContext *ctx,
+        FSReplication *lagging_replication);
+
+static inline void rpc_result_ring_clear_all(FSReplicaRPCResultContext *ctx)
+{
+    rpc_result_ring_clear_all_ex(ctx, NULL);
+}
 
 void rpc_result_ring_clear_timeouts(FSReplicaRPCResultContext *ctx);
 
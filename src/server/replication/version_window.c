@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "version_window.h"
+
+#define VERSION_WINDOW_BIT_INDEX(window, version) \
+    ((version) & ((window)->size - 1))
+
+#define VERSION_WINDOW_IS_SET(window, version) \
+    ((window)->bits[VERSION_WINDOW_BIT_INDEX(window, version) / 64] & \
+     (1ULL << (VERSION_WINDOW_BIT_INDEX(window, version) % 64)))
+
+#define VERSION_WINDOW_SET(window, version) \
+    (window)->bits[VERSION_WINDOW_BIT_INDEX(window, version) / 64] |= \
+     (1ULL << (VERSION_WINDOW_BIT_INDEX(window, version) % 64))
+
+#define VERSION_WINDOW_CLEAR(window, version) \
+    (window)->bits[VERSION_WINDOW_BIT_INDEX(window, version) / 64] &= \
+     ~(1ULL << (VERSION_WINDOW_BIT_INDEX(window, version) % 64))
+
+int version_window_init(FSVersionWindow *window, const int count)
+{
+    int result;
+    int bytes;
+
+    window->size = 64;
+    while (window->size < count) {
+        window->size *= 2;
+    }
+
+    bytes = sizeof(uint64_t) * (window->size / 64);
+    if ((window->bits=(uint64_t *)fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(window->bits, 0, bytes);
+
+    window->watermark = 0;
+    window->tracking = 0;
+    if ((result=init_pthread_lock(&window->lock)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "init_pthread_lock fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        free(window->bits);
+        window->bits = NULL;
+        return result;
+    }
+
+    return 0;
+}
+
+void version_window_destroy(FSVersionWindow *window)
+{
+    if (window->bits != NULL) {
+        free(window->bits);
+        window->bits = NULL;
+        pthread_mutex_destroy(&window->lock);
+    }
+}
+
+void version_window_reset(FSVersionWindow *window, const uint64_t watermark)
+{
+    PTHREAD_MUTEX_LOCK(&window->lock);
+    memset(window->bits, 0, sizeof(uint64_t) * (window->size / 64));
+    __sync_lock_test_and_set(&window->watermark, watermark);
+    PTHREAD_MUTEX_UNLOCK(&window->lock);
+}
+
+void version_window_mark(FSVersionWindow *window, const uint64_t version)
+{
+    uint64_t watermark;
+    uint64_t skip_to;
+
+    PTHREAD_MUTEX_LOCK(&window->lock);
+    watermark = window->watermark;
+    if (version <= watermark) {
+        PTHREAD_MUTEX_UNLOCK(&window->lock);
+        return;
+    }
+
+    /* the missing versions before the window never be done,
+     * skip them to keep the watermark moving */
+    if (version - watermark > window->size) {
+        skip_to = version - window->size;
+        logWarning("file: "__FILE__", line: %d, "
+                "version: %"PRIu64" exceeds the window size: %d, "
+                "skip the watermark from %"PRIu64" to %"PRIu64,
+                __LINE__, version, window->size, watermark, skip_to);
+        if (skip_to - watermark >= window->size) {
+            memset(window->bits, 0, sizeof(uint64_t) * (window->size / 64));
+            watermark = skip_to;
+        } else {
+            while (watermark < skip_to) {
+                ++watermark;
+                VERSION_WINDOW_CLEAR(window, watermark);
+            }
+        }
+    }
+
+    VERSION_WINDOW_SET(window, version);
+    while (VERSION_WINDOW_IS_SET(window, watermark + 1)) {
+        ++watermark;
+        VERSION_WINDOW_CLEAR(window, watermark);
+    }
+
+    if (watermark != window->watermark) {
+        __sync_lock_test_and_set(&window->watermark, watermark);
+    }
+    PTHREAD_MUTEX_UNLOCK(&window->lock);
+}
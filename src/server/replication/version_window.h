@@ -0,0 +1,50 @@
+//version_window.h
+
+#ifndef _VERSION_WINDOW_H_
+#define _VERSION_WINDOW_H_
+
+#include "../server_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* track the contiguous watermark of the data versions which are done
+ * out of order, such as the acks of the slave and the applied versions
+ * from the replication threads. the versions beyond the watermark are
+ * flagged in a bitmap of the window size, and a version exceeds the window
+ * skips the missing ones before it, e.g. the versions of the failed writes
+ */
+int version_window_init(FSVersionWindow *window, const int count);
+
+void version_window_destroy(FSVersionWindow *window);
+
+void version_window_reset(FSVersionWindow *window, const uint64_t watermark);
+
+void version_window_mark(FSVersionWindow *window, const uint64_t version);
+
+static inline uint64_t version_window_get(FSVersionWindow *window)
+{
+    return __sync_add_and_fetch(&window->watermark, 0);
+}
+
+/* reset the watermark before the first version of the new round, the
+ * caller skips the versions between the rounds by version_window_untrack */
+static inline void version_window_track(FSVersionWindow *window,
+        const uint64_t version)
+{
+    if (__sync_bool_compare_and_swap(&window->tracking, 0, 1)) {
+        version_window_reset(window, version - 1);
+    }
+}
+
+static inline void version_window_untrack(FSVersionWindow *window)
+{
+    __sync_bool_compare_and_swap(&window->tracking, 1, 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,6 +13,7 @@
 #include "common/fs_proto.h"
 #include "server_global.h"
 #include "server_group_info.h"
+#include "replication/replica_compress.h"
 #include "server_func.h"
 
 static int get_bytes_item_config(IniContext *ini_context,
@@ -207,7 +208,7 @@ static int load_data_path_config(IniContext *ini_context, const char *filename)
 
 static void server_log_configs()
 {
-    char sz_server_config[512];
+    char sz_server_config[1024];
     char sz_global_config[512];
     char sz_service_config[128];
     char sz_cluster_config[128];
@@ -224,11 +225,34 @@ static void server_log_configs()
     snprintf(sz_server_config, sizeof(sz_server_config),
             "my server id = %d, data_path = %s, "
             "replica_channels_between_two_servers = %d, "
+            "replica_apply_threads = %d, "
+            "replica_window_max_count = %d, "
+            "replica_window_max_bytes = %d MB, "
+            "replica_compress_algorithm = %s, "
+            "replica_compress_min_bytes = %d, "
+            "replica_compress_max_ratio = %d%%, "
+            "recovery_threads_per_data_group = %d, "
+            "recovery_max_version_gap = %d, "
+            "recovery_fetch_binlog_window = %d, "
+            "recovery_write_bytes_per_second = %d MB, "
+            "recovery_source_read_bytes_per_second = %d MB, "
             "binlog_buffer_size = %d KB, "
+            "metrics: {enabled = %d, bind_addr = %s, port = %d}, "
+            "trace: {sample_ratio = %d, slow_threshold = %d ms}, "
             "cluster server count = %d",
             CLUSTER_MY_SERVER_ID,
             DATA_PATH_STR, REPLICA_CHANNELS_BETWEEN_TWO_SERVERS,
-            BINLOG_BUFFER_SIZE / 1024,
+            REPLICA_APPLY_THREADS, REPLICA_WINDOW_MAX_COUNT,
+            (int)(REPLICA_WINDOW_MAX_BYTES / (1024 * 1024)),
+            replica_compress_get_caption(REPLICA_COMPRESS_ALGORITHM),
+            REPLICA_COMPRESS_MIN_BYTES, REPLICA_COMPRESS_MAX_RATIO,
+            RECOVERY_THREADS_PER_DATA_GROUP, RECOVERY_MAX_VERSION_GAP,
+            RECOVERY_FETCH_BINLOG_WINDOW,
+            (int)(RECOVERY_WRITE_BYTES_PER_SECOND / (1024 * 1024)),
+            (int)(RECOVERY_SOURCE_READ_BYTES_PER_SECOND / (1024 * 1024)),
+            BINLOG_BUFFER_SIZE / 1024, METRICS_ENABLED,
+            METRICS_BIND_ADDR, METRICS_PORT,
+            TRACE_SAMPLE_RATIO, TRACE_SLOW_THRESHOLD_MS,
             FC_SID_SERVER_COUNT(SERVER_CONFIG_CTX));
 
     logInfo("%s, service: {%s}, cluster: {%s}, replica: {%s}, %s",
@@ -263,6 +287,171 @@ static int load_binlog_buffer_size(IniContext *ini_context,
     return 0;
 }
 
+static int load_replica_window_config(IniContext *ini_context,
+        const char *filename)
+{
+    int result;
+
+    REPLICA_WINDOW_MAX_COUNT = iniGetIntValue(NULL,
+            "replica_window_max_count", ini_context,
+            FS_DEFAULT_REPLICA_WINDOW_MAX_COUNT);
+    if (REPLICA_WINDOW_MAX_COUNT <= 0) {
+        REPLICA_WINDOW_MAX_COUNT = FS_DEFAULT_REPLICA_WINDOW_MAX_COUNT;
+    }
+
+    if ((result=get_bytes_item_config(ini_context, filename,
+                    "replica_window_max_bytes",
+                    FS_DEFAULT_REPLICA_WINDOW_MAX_BYTES,
+                    &REPLICA_WINDOW_MAX_BYTES)) != 0)
+    {
+        return result;
+    }
+    if (REPLICA_WINDOW_MAX_BYTES < g_sf_global_vars.max_buff_size) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s , replica_window_max_bytes: %"PRId64" "
+                "< max_buff_size: %d, set it to max_buff_size",
+                __LINE__, filename, REPLICA_WINDOW_MAX_BYTES,
+                g_sf_global_vars.max_buff_size);
+        REPLICA_WINDOW_MAX_BYTES = g_sf_global_vars.max_buff_size;
+    }
+
+    return 0;
+}
+
+static void load_metrics_config(IniContext *ini_context)
+{
+    const char *section_name = "metrics";
+    char *bind_addr;
+
+    METRICS_ENABLED = iniGetBoolValue(section_name,
+            "enabled", ini_context, false);
+    bind_addr = iniGetStrValue(section_name, "bind_addr", ini_context);
+    if (bind_addr == NULL) {
+        bind_addr = FS_DEFAULT_METRICS_BIND_ADDR;
+    }
+    snprintf(METRICS_BIND_ADDR, sizeof(METRICS_BIND_ADDR), "%s", bind_addr);
+
+    METRICS_PORT = iniGetIntValue(section_name, "port",
+            ini_context, FS_DEFAULT_METRICS_PORT);
+    if (METRICS_PORT <= 0) {
+        METRICS_PORT = FS_DEFAULT_METRICS_PORT;
+    }
+}
+
+static void load_trace_config(IniContext *ini_context)
+{
+    const char *section_name = "trace";
+
+    TRACE_SAMPLE_RATIO = iniGetIntValue(section_name, "sample_ratio",
+            ini_context, FS_DEFAULT_TRACE_SAMPLE_RATIO);
+    if (TRACE_SAMPLE_RATIO < 0) {
+        TRACE_SAMPLE_RATIO = 0;
+    }
+
+    TRACE_SLOW_THRESHOLD_MS = iniGetIntValue(section_name,
+            "slow_threshold", ini_context,
+            FS_DEFAULT_TRACE_SLOW_THRESHOLD_MS);
+    if (TRACE_SLOW_THRESHOLD_MS < 0) {
+        TRACE_SLOW_THRESHOLD_MS = 0;
+    }
+}
+
+static int load_replica_compress_config(IniContext *ini_context,
+        const char *filename)
+{
+    char *value;
+    char *endptr;
+    int algorithm;
+    int result;
+    int64_t min_bytes;
+
+    value = iniGetStrValue(NULL, "replica_compress_algorithm", ini_context);
+    if (value == NULL || *value == '\0') {
+        algorithm = FS_COMPRESS_ALGORITHM_NONE;
+    } else if ((algorithm=replica_compress_get_algorithm(value)) < 0) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s , replica_compress_algorithm: %s "
+                "is invalid, expect: none, lz4 or zstd",
+                __LINE__, filename, value);
+        return EINVAL;
+    } else if (!replica_compress_is_supported(algorithm)) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s , replica_compress_algorithm: %s "
+                "is NOT supported, please install the library "
+                "and rebuild with make.sh", __LINE__, filename, value);
+        return EOPNOTSUPP;
+    }
+    REPLICA_COMPRESS_ALGORITHM = algorithm;
+
+    if ((result=get_bytes_item_config(ini_context, filename,
+                    "replica_compress_min_bytes",
+                    FS_DEFAULT_REPLICA_COMPRESS_MIN_BYTES,
+                    &min_bytes)) != 0)
+    {
+        return result;
+    }
+    REPLICA_COMPRESS_MIN_BYTES = min_bytes;
+
+    value = iniGetStrValue(NULL, "replica_compress_max_ratio", ini_context);
+    if (value == NULL || *value == '\0') {
+        REPLICA_COMPRESS_MAX_RATIO = FS_DEFAULT_REPLICA_COMPRESS_MAX_RATIO;
+    } else {
+        REPLICA_COMPRESS_MAX_RATIO = strtol(value, &endptr, 10);
+        if (*endptr != '%' || *(endptr + 1) != '\0' ||
+                REPLICA_COMPRESS_MAX_RATIO <= 0 ||
+                REPLICA_COMPRESS_MAX_RATIO > 100)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s , replica_compress_max_ratio: %s "
+                    "is NOT a valid ratio, expect 1%% to 100%%",
+                    __LINE__, filename, value);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static int load_recovery_config(IniContext *ini_context,
+        const char *filename)
+{
+    int result;
+
+    RECOVERY_THREADS_PER_DATA_GROUP = iniGetIntValue(NULL,
+            "recovery_threads_per_data_group", ini_context,
+            FS_DEFAULT_RECOVERY_THREADS_PER_DATA_GROUP);
+    if (RECOVERY_THREADS_PER_DATA_GROUP <= 0) {
+        RECOVERY_THREADS_PER_DATA_GROUP =
+            FS_DEFAULT_RECOVERY_THREADS_PER_DATA_GROUP;
+    }
+
+    RECOVERY_MAX_VERSION_GAP = iniGetIntValue(NULL,
+            "recovery_max_version_gap", ini_context,
+            FS_DEFAULT_RECOVERY_MAX_VERSION_GAP);
+    if (RECOVERY_MAX_VERSION_GAP <= 0) {
+        RECOVERY_MAX_VERSION_GAP = FS_DEFAULT_RECOVERY_MAX_VERSION_GAP;
+    }
+
+    RECOVERY_FETCH_BINLOG_WINDOW = iniGetIntValue(NULL,
+            "recovery_fetch_binlog_window", ini_context,
+            FS_DEFAULT_RECOVERY_FETCH_BINLOG_WINDOW);
+    if (RECOVERY_FETCH_BINLOG_WINDOW <= 0) {
+        RECOVERY_FETCH_BINLOG_WINDOW = 1;
+    }
+
+    if ((result=get_bytes_item_config(ini_context, filename,
+                    "recovery_write_bytes_per_second", 0,
+                    &RECOVERY_WRITE_BYTES_PER_SECOND)) != 0)
+    {
+        return result;
+    }
+
+    return get_bytes_item_config(ini_context, filename,
+            "recovery_source_read_bytes_per_second",
+            FS_DEFAULT_RECOVERY_SOURCE_READ_BYTES_PER_SECOND,
+            &RECOVERY_SOURCE_READ_BYTES_PER_SECOND);
+}
+
 static int load_storage_cfg(IniContext *ini_context, const char *filename)
 {
     char *storage_config_filename;
@@ -329,10 +518,31 @@ int server_load_config(const char *filename)
             FS_DEFAULT_REPLICA_CHANNELS_BETWEEN_TWO_SERVERS;
     }
 
+    REPLICA_APPLY_THREADS = iniGetIntValue(NULL, "replica_apply_threads",
+            &ini_context, FS_DEFAULT_REPLICA_APPLY_THREADS);
+    if (REPLICA_APPLY_THREADS < 0) {
+        REPLICA_APPLY_THREADS = FS_DEFAULT_REPLICA_APPLY_THREADS;
+    }
+
+    if ((result=load_replica_window_config(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    if ((result=load_replica_compress_config(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    if ((result=load_recovery_config(&ini_context, filename)) != 0) {
+        return result;
+    }
+
     if ((result=load_binlog_buffer_size(&ini_context, filename)) != 0) {
         return result;
     }
 
+    load_metrics_config(&ini_context);
+    load_trace_config(&ini_context);
+
     if ((result=load_cluster_config(&ini_context, filename)) != 0) {
         return result;
     }
@@ -39,10 +39,41 @@ typedef struct server_global_vars {
 
     struct {
         int channels_between_two_servers;
+        int apply_threads;          //0 for apply in the nio threads
+        struct {
+            int max_count;          //max in flight rpc count
+            int64_t max_bytes;      //max in flight rpc bytes
+        } window;                   //per replication
+        struct {
+            unsigned char algorithm;  //FS_COMPRESS_ALGORITHM_NONE to disable
+            int min_bytes;            //the smaller batches are sent raw
+            int max_ratio;            //percent, sent raw when exceeds
+            FSReplicaCompressStat replication;  //sent by the master
+            FSReplicaCompressStat fetch_binlog; //sent for data recovery
+        } compress;
         int active_test_interval;   //round(nework_timeout / 2)
         SFContext sf_context;       //for replica communication
     } replica;
 
+    struct {
+        int threads_per_data_group; //the concurrent reads from the sources
+        int max_version_gap;        //switch to ONLINE within the gap
+        int64_t write_bytes_per_second;  //0 for no limit
+        int64_t source_read_bytes_per_second;  //per source, 0 for no limit
+        int fetch_binlog_window;    //the pipelined binlog fetch requests
+    } recovery;
+
+    struct {
+        bool enabled;
+        char bind_addr[IP_ADDRESS_SIZE];
+        int port;
+    } metrics;   //the OpenMetrics exporter
+
+    struct {
+        int sample_ratio;       //sample one of the update requests
+        int slow_threshold_ms;  //log the timeline of the slow requests
+    } trace;
+
 } FSServerGlobalVars;
 
 #define CLUSTER_CONFIG_CTX    g_server_global_vars.cluster.config.ctx
@@ -76,6 +107,32 @@ typedef struct server_global_vars {
 #define REPLICA_CHANNELS_BETWEEN_TWO_SERVERS  \
     g_server_global_vars.replica.channels_between_two_servers
 
+#define REPLICA_APPLY_THREADS  g_server_global_vars.replica.apply_threads
+#define REPLICA_WINDOW_MAX_COUNT g_server_global_vars.replica.window.max_count
+#define REPLICA_WINDOW_MAX_BYTES g_server_global_vars.replica.window.max_bytes
+
+#define REPLICA_COMPRESS_ALGORITHM g_server_global_vars.replica.compress.algorithm
+#define REPLICA_COMPRESS_MIN_BYTES g_server_global_vars.replica.compress.min_bytes
+#define REPLICA_COMPRESS_MAX_RATIO g_server_global_vars.replica.compress.max_ratio
+#define REPLICA_COMPRESS_STAT      g_server_global_vars.replica.compress
+
+#define RECOVERY_THREADS_PER_DATA_GROUP  \
+    g_server_global_vars.recovery.threads_per_data_group
+#define RECOVERY_MAX_VERSION_GAP  g_server_global_vars.recovery.max_version_gap
+#define RECOVERY_WRITE_BYTES_PER_SECOND  \
+    g_server_global_vars.recovery.write_bytes_per_second
+#define RECOVERY_SOURCE_READ_BYTES_PER_SECOND  \
+    g_server_global_vars.recovery.source_read_bytes_per_second
+#define RECOVERY_FETCH_BINLOG_WINDOW  \
+    g_server_global_vars.recovery.fetch_binlog_window
+
+#define METRICS_ENABLED    g_server_global_vars.metrics.enabled
+#define METRICS_BIND_ADDR  g_server_global_vars.metrics.bind_addr
+#define METRICS_PORT       g_server_global_vars.metrics.port
+
+#define TRACE_SAMPLE_RATIO       g_server_global_vars.trace.sample_ratio
+#define TRACE_SLOW_THRESHOLD_MS  g_server_global_vars.trace.slow_threshold_ms
+
 #define CLUSTER_GROUP_INDEX  g_server_global_vars.cluster.config.ctx.cluster_group_index
 #define REPLICA_GROUP_INDEX  g_server_global_vars.cluster.config.ctx.replica_group_index
 #define SERVICE_GROUP_INDEX  g_server_global_vars.cluster.config.ctx.service_group_index
@@ -189,6 +189,7 @@ static int init_cluster_data_group_array(const char *filename,
         const int server_id, FSIdArray *assoc_gid_array)
 {
     FSIdArray *id_array;
+    FSServerGroup *server_group;
     FSClusterDataGroupInfo *group;
     int result;
     int bytes;
@@ -228,9 +229,23 @@ static int init_cluster_data_group_array(const char *filename,
         group->index = data_group_index;
         group->hash_code = fs_cluster_cfg_get_dg_hash_code(
                 &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        server_group = fs_cluster_cfg_get_server_group(
+                &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        group->write_ack_mode = server_group->write_ack_mode;
+        group->replication_topology = server_group->replication_topology;
         if ((result=init_cluster_data_server_array(group)) != 0) {
             return result;
         }
+        if (group->replication_topology == FS_REPLICATION_TOPOLOGY_CHAIN &&
+                group->data_server_array.count > FS_REPLICA_CHAIN_MAX_SERVERS)
+        {
+            logWarning("file: "__FILE__", line: %d, "
+                    "data group id: %d, server count: %d exceeds %d, "
+                    "the replication topology changed from chain to star",
+                    __LINE__, data_group_id, group->data_server_array.count,
+                    FS_REPLICA_CHAIN_MAX_SERVERS);
+            group->replication_topology = FS_REPLICATION_TOPOLOGY_STAR;
+        }
 
         if ((result=init_ds_ptr_array(group)) != 0) {
             return result;
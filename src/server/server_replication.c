@@ -30,6 +30,10 @@ int server_replication_init()
         return result;
     }
 
+    if ((result=replication_apply_init()) != 0) {
+        return result;
+    }
+
 	return 0;
 }
 
@@ -38,8 +42,10 @@ void server_replication_destroy()
     replication_common_destroy();
     replication_caller_destroy();
     replication_callee_destroy();
+    replication_apply_destroy();
 }
  
 void server_replication_terminate()
 {
+    replication_apply_terminate();
 }
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "server_stat.h"
+
+static FSCommandStat command_stats[FS_STAT_COMMAND_COUNT];
+
+static inline int64_t histogram_bucket_upper(const int index)
+{
+    int shift;
+    int sub;
+
+    if (index < FS_HISTOGRAM_SUB_COUNT) {
+        return index;
+    }
+
+    shift = index / FS_HISTOGRAM_SUB_COUNT - 1;
+    sub = index % FS_HISTOGRAM_SUB_COUNT;
+    return (((int64_t)(FS_HISTOGRAM_SUB_COUNT + sub + 1)) << shift) - 1;
+}
+
+void fs_histogram_stat(FSLatencyHistogram *histogram, FSHistogramStat *stat)
+{
+    int64_t buckets[FS_HISTOGRAM_BUCKET_COUNT];
+    int64_t p50_rank;
+    int64_t p99_rank;
+    int64_t p999_rank;
+    int64_t sum;
+    int i;
+
+    //the snapshot may be a little inconsistent with the concurrent adds
+    stat->count = 0;
+    for (i=0; i<FS_HISTOGRAM_BUCKET_COUNT; i++) {
+        buckets[i] = __sync_add_and_fetch(histogram->buckets + i, 0);
+        stat->count += buckets[i];
+    }
+    stat->sum = __sync_add_and_fetch(&histogram->sum, 0);
+
+    stat->p50 = stat->p99 = stat->p999 = stat->max = 0;
+    if (stat->count == 0) {
+        return;
+    }
+
+    p50_rank = (stat->count * 500 + 999) / 1000;
+    p99_rank = (stat->count * 990 + 999) / 1000;
+    p999_rank = (stat->count * 999 + 999) / 1000;
+    sum = 0;
+    for (i=0; i<FS_HISTOGRAM_BUCKET_COUNT; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+
+        if (sum < p50_rank && sum + buckets[i] >= p50_rank) {
+            stat->p50 = histogram_bucket_upper(i);
+        }
+        if (sum < p99_rank && sum + buckets[i] >= p99_rank) {
+            stat->p99 = histogram_bucket_upper(i);
+        }
+        if (sum < p999_rank && sum + buckets[i] >= p999_rank) {
+            stat->p999 = histogram_bucket_upper(i);
+        }
+        sum += buckets[i];
+        stat->max = histogram_bucket_upper(i);
+    }
+}
+
+void server_stat_add_command(const int cmd, const int bytes_in,
+        const int bytes_out, const int64_t time_used_us, const bool error)
+{
+    FSCommandStat *stat;
+
+    stat = command_stats + (cmd & (FS_STAT_COMMAND_COUNT - 1));
+    __sync_add_and_fetch(&stat->count, 1);
+    if (error) {
+        __sync_add_and_fetch(&stat->errors, 1);
+    }
+    __sync_add_and_fetch(&stat->bytes_in, bytes_in);
+    __sync_add_and_fetch(&stat->bytes_out, bytes_out);
+    fs_histogram_add(&stat->latency, time_used_us);
+}
+
+FSCommandStat *server_stat_get_command(const int cmd)
+{
+    if (cmd < 0 || cmd >= FS_STAT_COMMAND_COUNT) {
+        return NULL;
+    }
+    return command_stats + cmd;
+}
@@ -0,0 +1,95 @@
+//server_stat.h
+
+#ifndef _SERVER_STAT_H_
+#define _SERVER_STAT_H_
+
+#include "fastcommon/common_define.h"
+
+/* the log-linear histogram: the values < 8 have their own buckets,
+ * and each power of 2 range above is split into 8 linear buckets,
+ * so the error of the percentile is within 12.5% */
+#define FS_HISTOGRAM_SUB_BITS      3
+#define FS_HISTOGRAM_SUB_COUNT     (1 << FS_HISTOGRAM_SUB_BITS)
+#define FS_HISTOGRAM_MAX_BITS      32   //the larger values in the last bucket
+#define FS_HISTOGRAM_BUCKET_COUNT  ((FS_HISTOGRAM_MAX_BITS - \
+            FS_HISTOGRAM_SUB_BITS + 1) * FS_HISTOGRAM_SUB_COUNT)
+
+#define FS_STAT_COMMAND_COUNT  256  //indexed by the protocol cmd
+
+typedef struct fs_latency_histogram {
+    volatile int64_t buckets[FS_HISTOGRAM_BUCKET_COUNT];
+    volatile int64_t sum;   //the total of the values
+} FSLatencyHistogram;
+
+typedef struct fs_histogram_stat {
+    int64_t count;
+    int64_t sum;
+    int64_t p50;
+    int64_t p99;
+    int64_t p999;
+    int64_t max;
+} FSHistogramStat;
+
+typedef struct fs_command_stat {
+    volatile int64_t count;
+    volatile int64_t errors;
+    volatile int64_t bytes_in;
+    volatile int64_t bytes_out;
+    FSLatencyHistogram latency;  //in microseconds
+} FSCommandStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline int fs_histogram_index(const int64_t value)
+{
+    int msb;
+    int shift;
+
+    if (value < FS_HISTOGRAM_SUB_COUNT) {
+        return value > 0 ? value : 0;
+    }
+
+    msb = 63 - __builtin_clzll(value);
+    if (msb >= FS_HISTOGRAM_MAX_BITS) {
+        return FS_HISTOGRAM_BUCKET_COUNT - 1;
+    }
+
+    shift = msb - FS_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * FS_HISTOGRAM_SUB_COUNT + (int)((value >> shift) &
+            (FS_HISTOGRAM_SUB_COUNT - 1));
+}
+
+static inline void fs_histogram_add(FSLatencyHistogram *histogram,
+        const int64_t value)
+{
+    __sync_add_and_fetch(histogram->buckets +
+            fs_histogram_index(value), 1);
+    __sync_add_and_fetch(&histogram->sum, value);
+}
+
+static inline void fs_histogram_merge(FSLatencyHistogram *dest,
+        FSLatencyHistogram *src)
+{
+    int i;
+
+    for (i=0; i<FS_HISTOGRAM_BUCKET_COUNT; i++) {
+        dest->buckets[i] += src->buckets[i];
+    }
+    dest->sum += src->sum;
+}
+
+//the percentiles are the upper bounds of the buckets
+void fs_histogram_stat(FSLatencyHistogram *histogram, FSHistogramStat *stat);
+
+void server_stat_add_command(const int cmd, const int bytes_in,
+        const int bytes_out, const int64_t time_used_us, const bool error);
+
+FSCommandStat *server_stat_get_command(const int cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,6 +29,10 @@ int server_storage_init()
         return result;
     }
 
+    if ((result=fs_slice_op_init()) != 0) {
+        return result;
+    }
+
     if ((result=storage_allocator_prealloc_trunk_freelists()) != 0) {
         return result;
     }
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "common/fs_proto.h"
+#include "server_global.h"
+#include "server_trace.h"
+
+static volatile int64_t trace_request_count = 0;
+static volatile int trace_id_seq = 0;
+
+static const char *stage_captions[FS_TRACE_STAGE_COUNT] = {
+    "parse", "alloc", "io_queued", "io_start", "io_done", "index",
+    "binlog", "repl_sent", "repl_acked", "done"
+};
+
+int server_trace_sample(const int client_trace_id)
+{
+    int trace_id;
+
+    if (client_trace_id != 0) {
+        return client_trace_id;
+    }
+
+    if (TRACE_SAMPLE_RATIO <= 0 || __sync_add_and_fetch(
+                &trace_request_count, 1) % TRACE_SAMPLE_RATIO != 0)
+    {
+        return 0;
+    }
+
+    do {
+        trace_id = __sync_add_and_fetch(&trace_id_seq, 1) &
+            FS_PROTO_TRACE_ID_MAX;
+    } while (trace_id == 0);
+    return trace_id;
+}
+
+static void sort_spans(FSTraceSpan *spans, const int count)
+{
+    FSTraceSpan span;
+    int i;
+    int k;
+
+    //the spans are added by the concurrent threads, sort them by time
+    for (i=1; i<count; i++) {
+        span = spans[i];
+        for (k=i; k>0 && spans[k - 1].time_us > span.time_us; k--) {
+            spans[k] = spans[k - 1];
+        }
+        spans[k] = span;
+    }
+}
+
+void server_trace_finish_ex(FSSliceOpContext *op_ctx,
+        const int which_side, const int cmd, const int result)
+{
+    FSTraceContext *trace;
+    FSTraceSpan spans[FS_TRACE_MAX_SPANS];
+    char timeline[48 * FS_TRACE_MAX_SPANS];
+    char time_buff[32];
+    char *p;
+    int64_t done_time;
+    int64_t time_used;
+    int count;
+    int i;
+
+    trace = &op_ctx->trace;
+    done_time = get_current_time_us();
+    server_trace_add_span_ex(trace, FS_TRACE_STAGE_DONE, done_time);
+    count = __sync_add_and_fetch(&trace->span_count, 0);
+    if (count > FS_TRACE_MAX_SPANS) {
+        count = FS_TRACE_MAX_SPANS;
+    }
+    time_used = done_time - trace->start_time_us;
+    if (time_used >= (int64_t)TRACE_SLOW_THRESHOLD_MS * 1000) {
+        memcpy(spans, trace->spans, sizeof(FSTraceSpan) * count);
+        sort_spans(spans, count);
+
+        p = timeline;
+        for (i=0; i<count; i++) {
+            p += sprintf(p, "%s%s +%"PRId64, (i > 0 ? ", " : ""),
+                    (spans[i].stage >= 0 && spans[i].stage <
+                     FS_TRACE_STAGE_COUNT) ? stage_captions[spans[i].
+                    stage] : "unkown", spans[i].time_us -
+                    trace->start_time_us);
+        }
+        *p = '\0';
+
+        logWarning("file: "__FILE__", line: %d, "
+                "slow request, trace id: %d, which_side: %c, "
+                "cmd: %d (%s), data_group_id: %d, data_version: %"PRId64", "
+                "block {oid: %"PRId64", offset: %"PRId64"}, "
+                "slice {offset: %d, length: %d}, result: %d, "
+                "time used: %s us, timeline in us: {%s}%s", __LINE__,
+                trace->trace_id, which_side, cmd, fs_get_cmd_caption(cmd),
+                op_ctx->info.data_group_id, op_ctx->info.data_version,
+                op_ctx->info.bs_key.block.oid,
+                op_ctx->info.bs_key.block.offset,
+                op_ctx->info.bs_key.slice.offset,
+                op_ctx->info.bs_key.slice.length, result,
+                long_to_comma_str(time_used, time_buff), timeline,
+                (trace->span_count > FS_TRACE_MAX_SPANS ?
+                 ", some spans dropped" : ""));
+    }
+
+    trace->trace_id = 0;
+}
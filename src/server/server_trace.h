@@ -0,0 +1,68 @@
+//server_trace.h
+
+#ifndef _SERVER_TRACE_H_
+#define _SERVER_TRACE_H_
+
+#include "fastcommon/common_define.h"
+#include "fastcommon/shared_func.h"
+#include "storage/storage_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* return the trace id of the update request, the id set by the client
+ * is honored, otherwise one of every trace_sample_ratio requests is
+ * sampled by the master. return 0 for not traced */
+int server_trace_sample(const int client_trace_id);
+
+static inline void server_trace_begin(FSTraceContext *trace,
+        const int trace_id, const int64_t start_time_us)
+{
+    trace->trace_id = trace_id;
+    trace->span_count = 0;
+    trace->start_time_us = start_time_us;
+}
+
+static inline void server_trace_add_span_ex(FSTraceContext *trace,
+        const int stage, const int64_t time_us)
+{
+    int index;
+
+    if (trace->trace_id == 0) {
+        return;
+    }
+
+    index = __sync_fetch_and_add(&trace->span_count, 1);
+    if (index < FS_TRACE_MAX_SPANS) {
+        trace->spans[index].stage = stage;
+        trace->spans[index].time_us = time_us;
+    }
+}
+
+static inline void server_trace_add_span(FSTraceContext *trace,
+        const int stage)
+{
+    if (trace->trace_id != 0) {
+        server_trace_add_span_ex(trace, stage, get_current_time_us());
+    }
+}
+
+void server_trace_finish_ex(FSSliceOpContext *op_ctx,
+        const int which_side, const int cmd, const int result);
+
+/* log the timeline of the spans when the request is slower than
+ * trace_slow_threshold, then stop tracing */
+static inline void server_trace_finish(FSSliceOpContext *op_ctx,
+        const int which_side, const int cmd, const int result)
+{
+    if (op_ctx->trace.trace_id != 0) {
+        server_trace_finish_ex(op_ctx, which_side, cmd, result);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,7 @@
 #include <pthread.h>
 #include "fastcommon/common_define.h"
 #include "fastcommon/fc_queue.h"
+#include "fastcommon/fc_list.h"
 #include "fastcommon/fast_task_queue.h"
 #include "fastcommon/fast_mblock.h"
 #include "fastcommon/fast_allocator.h"
@@ -42,6 +43,20 @@
 #define FS_CLUSTER_DELAY_DECISION_SELECT_MASTER 2
 
 #define FS_DEFAULT_REPLICA_CHANNELS_BETWEEN_TWO_SERVERS  2
+#define FS_DEFAULT_REPLICA_APPLY_THREADS                 4
+#define FS_DEFAULT_REPLICA_WINDOW_MAX_COUNT           4096
+#define FS_DEFAULT_REPLICA_WINDOW_MAX_BYTES  (64 * 1024 * 1024)
+#define FS_DEFAULT_RECOVERY_THREADS_PER_DATA_GROUP       4
+#define FS_DEFAULT_RECOVERY_MAX_VERSION_GAP           1024
+#define FS_DEFAULT_RECOVERY_SOURCE_READ_BYTES_PER_SECOND  (64 * 1024 * 1024)
+#define FS_DEFAULT_RECOVERY_FETCH_BINLOG_WINDOW          8
+#define FS_DEFAULT_REPLICA_COMPRESS_MIN_BYTES         4096
+#define FS_DEFAULT_REPLICA_COMPRESS_MAX_RATIO           80  //percent
+
+#define FS_DEFAULT_METRICS_BIND_ADDR            "127.0.0.1"
+#define FS_DEFAULT_METRICS_PORT                       21018
+#define FS_DEFAULT_TRACE_SAMPLE_RATIO                  1000
+#define FS_DEFAULT_TRACE_SLOW_THRESHOLD_MS              100
 #define FS_DEFAULT_TRUNK_FILE_SIZE  (  1 * 1024 * 1024 * 1024LL)
 #define FS_TRUNK_FILE_MIN_SIZE      (256 * 1024 * 1024LL)
 #define FS_TRUNK_FILE_MAX_SIZE      ( 16 * 1024 * 1024 * 1024LL)
@@ -50,6 +65,13 @@
 #define FS_DISCARD_REMAIN_SPACE_MIN_SIZE       256
 #define FS_DISCARD_REMAIN_SPACE_MAX_SIZE      (256 * 1024)
 
+#define FS_DEFAULT_SPACE_LEASE_SIZE  (16 * 1024 * 1024)
+#define FS_SPACE_LEASE_MIN_SIZE      ( 4 * 1024 * 1024)
+#define FS_SPACE_LEASE_MAX_SIZE      (64 * 1024 * 1024)
+
+#define FS_DEFAULT_PREALLOC_TRUNK_AHEAD_SECONDS   60
+#define FS_DEFAULT_MAX_PREALLOC_TRUNKS_PER_WRITER  8
+
 #define TASK_STATUS_CONTINUE   12345
 
 #define FS_WHICH_SIDE_MASTER    'M'
@@ -66,6 +88,7 @@
 #define CLUSTER_PEER      TASK_CTX.cluster.peer
 #define REPLICA_REPLICATION  TASK_CTX.replica.replication
 #define REPLICA_READER       TASK_CTX.replica.reader
+#define REPLICA_FETCH_COMPRESS_ALGORITHM  TASK_CTX.replica.compress_algorithm
 #define SERVER_TASK_TYPE  TASK_CTX.task_type
 #define SLICE_OP_CTX      TASK_CTX.slice_op_ctx
 #define OP_CTX_INFO       TASK_CTX.slice_op_ctx.info
@@ -122,6 +145,13 @@ typedef struct fs_cluster_topology_notify_context {
     FSDataServerChangeEvent *events; //event array
 } FSClusterTopologyNotifyContext;
 
+//the client subscribes the data server changes by the service port
+typedef struct fs_topology_subscriber {
+    FSClusterTopologyNotifyContext notify_ctx;
+    struct fc_list_head dlink;  //for the nio thread
+    struct fc_list_head glink;  //for the global subscribers
+} FSTopologySubscriber;
+
 typedef struct fs_cluster_notify_context_ptr_array {
     FSClusterTopologyNotifyContext **contexts;
     int count;
@@ -156,15 +186,28 @@ typedef struct fs_cluster_server_ptr_array {
     int count;
 } FSClusterServerPtrArray;
 
+/* the versions after the watermark are done out of order, the watermark
+ * only advances when all the versions before it are done */
+typedef struct fs_version_window {
+    volatile uint64_t watermark;  //all the versions <= it are done
+    volatile int tracking;        //for the lazy reset of the caller
+    int size;         //the version count of the bitmap, power of 2
+    uint64_t *bits;   //the done flags of the versions after the watermark
+    pthread_mutex_t lock;
+} FSVersionWindow;
+
 struct fs_cluster_data_group_info;
+struct replication_apply_entry;
 typedef struct fs_cluster_data_server_info {
     struct fs_cluster_data_group_info *dg;
     FSClusterServerInfo *cs;
     bool is_preseted;
     volatile char is_master;
     volatile char status;   //the data server status
+    volatile char offline_reporting; //the lagging slave to report offline
     uint64_t data_version;  //for replication
     int64_t last_report_version; //for report last data version to the leader
+    FSVersionWindow acked;  //the data versions acked by the slave
 } FSClusterDataServerInfo;
 
 typedef struct fs_cluster_data_server_array {
@@ -176,6 +219,8 @@ typedef struct fs_cluster_data_group_info {
     int id;
     int index;
     uint32_t hash_code;  //for master election
+    int write_ack_mode;  //from the server group of cluster config
+    int replication_topology;  //from the server group of cluster config
     struct {
         volatile int action;
         int expire_time;
@@ -185,6 +230,12 @@ typedef struct fs_cluster_data_group_info {
     FSClusterDataServerPtrArray slave_ds_array;
     FSClusterDataServerInfo *myself;
     volatile FSClusterDataServerInfo *master;
+    struct {
+        volatile char catching_up;  //hold the replicated updates
+        struct replication_apply_entry *head;  //the held updates
+        struct replication_apply_entry *tail;
+    } recovery;  //for data recovery, protected by the lock
+    FSVersionWindow applied;  //the replicated versions done as slave
     pthread_mutex_t lock;
 } FSClusterDataGroupInfo;
 
@@ -200,30 +251,58 @@ typedef struct fs_rpc_result_entry {
     int64_t task_version;
     time_t expires;
     struct fast_task_info *waiting_task;
-    struct fs_rpc_result_entry *next;
+    struct fs_replication *upstream;  //ack to it for chain replication
+    int data_group_id;
+    int bytes;   //the rpc body bytes for the window
+    struct fs_rpc_result_entry *next;  //for hashtable bucket
+    struct {
+        struct fs_rpc_result_entry *prev;
+        struct fs_rpc_result_entry *next;
+    } dlink;  //for timing wheel slot
 } FSReplicaRPCResultEntry;
 
+typedef struct fs_replication_window {
+    volatile int count;      //the rpc count in queue and waiting for the result
+    volatile int64_t bytes;  //the body bytes of these rpc
+} FSReplicationWindow;
+
 typedef struct fs_rpc_result_context {
     struct {
-        FSReplicaRPCResultEntry *entries;
-        FSReplicaRPCResultEntry *start; //for consumer
-        FSReplicaRPCResultEntry *end;   //for producer
-        int size;
-    } ring;
+        FSReplicaRPCResultEntry **buckets;
+        unsigned int capacity;   //power of 2
+        int count;
+    } htable;  //indexed by data group id and data version
 
     struct {
-        FSReplicaRPCResultEntry *head;
-        FSReplicaRPCResultEntry *tail;
-        struct fast_mblock_man rentry_allocator;
-    } queue;   //for overflow exceptions
+        FSReplicaRPCResultEntry **slots;  //indexed by expire time
+        int size;                //power of 2
+        time_t last_time;        //the entries expired to this time
+    } wheel;   //for the timeout of the entries
 
+    struct fast_mblock_man rentry_allocator;
     time_t last_check_timeout_time;
+    FSReplicationWindow *window;  //release the rpc when result done
 } FSReplicaRPCResultContext;
 
+typedef struct fs_replica_compress_stat {
+    volatile int64_t bytes_before;  //the raw bytes
+    volatile int64_t bytes_after;   //the bytes on the wire
+} FSReplicaCompressStat;
+
+typedef struct fs_replica_compress_context {
+    unsigned char algorithm;  //negotiated per connection
+    int skip_batches;    //the next batches sent raw after a poor ratio
+    int bypass_batches;  //doubled for each poor ratio
+    BufferInfo buffer;   //the raw batch to compress
+    FSReplicaCompressStat stat;
+} FSReplicaCompressContext;
+
 typedef struct fs_replication_context {
     struct {
         struct fc_queue rpc_queue;
         FSReplicaRPCResultContext rpc_result_ctx;   //push result recv from peer
+        FSReplicationWindow window;  //for flow control
+        volatile char lagging;       //the window is full
     } caller;  //master side
 
     struct {
@@ -237,6 +316,7 @@ typedef struct fs_replication {
     FSClusterServerInfo *peer;
     short stage;
     bool is_client;
+    bool chain_rpc;   //the rpc parts carry the chain members
     int thread_index; //for nio thread
     int conn_index;
     int last_net_comm_time;  //last network communication time
@@ -249,6 +329,7 @@ typedef struct fs_replication {
     } connection_info;  //for client to make connection
 
     FSReplicationContext context;
+    FSReplicaCompressContext compress;
 } FSReplication;
 
 typedef struct {
@@ -262,7 +343,9 @@ typedef struct {
 
     union {
         struct {
-            volatile int waiting_rpc_count;
+            //packed with the task version, see replication_caller.h
+            volatile int64_t waiting_rpc_count;
+            FSTopologySubscriber *subscriber;
         } service;
 
         struct {
@@ -274,6 +357,7 @@ typedef struct {
                 FSReplication *replication;
                 struct server_binlog_reader *reader;  //for fetch binlog
             };
+            unsigned char compress_algorithm;  //for fetch binlog
         } replica;
     };
 
@@ -283,6 +367,8 @@ typedef struct {
 
 typedef struct server_task_arg {
     volatile int64_t task_version;
+    volatile int buffer_reffer_count;  //hold by replications to send the body
+    volatile int cleanup_deferred;     //the cleanup waits for the buffer holders
     int64_t req_start_time;
 
     FSServerTaskContext context;
@@ -294,6 +380,7 @@ typedef struct fs_server_context {
     union {
         struct {
             struct ob_slice_ptr_array *slice_ptr_array;
+            struct fc_list_head subscribers;  //the topology subscribers
         } service;
 
         struct {
@@ -305,6 +392,7 @@ typedef struct fs_server_context {
             FSReplicationPtrArray connected;
             struct fast_mblock_man op_ctx_allocator; //for slice op buffer context
             SharedBufferContext shared_buffer_ctx;
+            BufferInfo compress_buffer;  //the raw binlog to compress
         } replica;
     };
 
@@ -25,10 +25,16 @@
 #include "common/fs_func.h"
 #include "binlog/replica_binlog.h"
 #include "replication/replication_common.h"
+#include "replication/replication_caller.h"
+#include "replication/version_window.h"
 #include "server_global.h"
 #include "server_func.h"
 #include "server_group_info.h"
 #include "server_storage.h"
+#include "server_stat.h"
+#include "server_trace.h"
+#include "cluster_topology.h"
+#include "dio/trunk_io_thread.h"
 #include "common_handler.h"
 #include "data_update_handler.h"
 #include "service_handler.h"
@@ -60,10 +66,42 @@ int service_handler_destroy()
     return 0;
 }
 
+static inline void try_finish_deferred_cleanup(struct fast_task_info *task)
+{
+    FSServerTaskArg *task_arg;
+
+    task_arg = (FSServerTaskArg *)task->arg;
+    if (__sync_add_and_fetch(&task_arg->buffer_reffer_count, 0) == 0 &&
+            __sync_bool_compare_and_swap(&task_arg->cleanup_deferred, 1, 0))
+    {
+        sf_task_finish_clean_up(task);
+    }
+}
+
+void service_task_release_buffer(struct fast_task_info *task)
+{
+    if (__sync_sub_and_fetch(&((FSServerTaskArg *)task->arg)->
+                buffer_reffer_count, 1) == 0)
+    {
+        try_finish_deferred_cleanup(task);
+    }
+}
+
 void service_task_finish_cleanup(struct fast_task_info *task)
 {
     __sync_add_and_fetch(&((FSServerTaskArg *)task->arg)->task_version, 1);
-    sf_task_finish_clean_up(task);
+    //no request is waiting, the acks in flight are ignored
+    __sync_lock_test_and_set(&WAITING_RPC_COUNT, 0);
+
+    if (TASK_CTX.service.subscriber != NULL) {
+        cluster_topology_unsubscribe(task);
+    }
+
+    /* the replication threads send the request body from the task buffer
+     * directly, the last buffer holder finishes the cleanup instead */
+    __sync_lock_test_and_set(&((FSServerTaskArg *)task->arg)->
+            cleanup_deferred, 1);
+    try_finish_deferred_cleanup(task);
 }
 
 static int service_deal_client_join(struct fast_task_info *task)
@@ -99,32 +137,174 @@ static int service_deal_client_join(struct fast_task_info *task)
     return 0;
 }
 
+static char *service_stat_output_data_groups(struct fast_task_info *task,
+        char *buff, const char *end, int *count)
+{
+    FSProtoServiceStatRespDataGroup *body_part;
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo *myself;
+
+    *count = 0;
+    body_part = (FSProtoServiceStatRespDataGroup *)buff;
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        if ((myself=group->myself) == NULL) {
+            continue;
+        }
+        if ((char *)(body_part + 1) > end) {
+            break;
+        }
+
+        int2buff(group->id, body_part->data_group_id);
+        body_part->is_master = myself->is_master;
+        body_part->status = myself->status;
+        memset(body_part->padding, 0, sizeof(body_part->padding));
+        long2buff(myself->data_version, body_part->data_version);
+        body_part++;
+        (*count)++;
+    }
+
+    return (char *)body_part;
+}
+
+static void service_stat_output_disk_io(TrunkIORoleStat *role_stat,
+        FSProtoServiceStatRespDiskIO *disk_io)
+{
+    int2buff(role_stat->thread_count, disk_io->thread_count);
+    int2buff(role_stat->queue_depth, disk_io->queue_depth);
+    long2buff(role_stat->wait.p99, disk_io->wait_p99);
+    long2buff(role_stat->service.p50, disk_io->service_p50);
+    long2buff(role_stat->service.p99, disk_io->service_p99);
+    long2buff(role_stat->service.max, disk_io->service_max);
+}
+
+static char *service_stat_output_disks(struct fast_task_info *task,
+        char *buff, const char *end, int *count)
+{
+    FSProtoServiceStatRespDisk *body_part;
+    FSProtoServiceStatRespDiskType *type_part;
+    TrunkIOPathStat stat;
+    int path_count;
+    int path_index;
+    int i;
+
+    *count = 0;
+    body_part = (FSProtoServiceStatRespDisk *)buff;
+    path_count = trunk_io_thread_get_path_count();
+    for (path_index=0; path_index<path_count; path_index++) {
+        if (trunk_io_thread_get_path_stat(path_index, &stat) != 0) {
+            continue;
+        }
+        if ((char *)(body_part + 1) > end) {
+            break;
+        }
+
+        int2buff(path_index, body_part->path_index);
+        memset(body_part->padding, 0, sizeof(body_part->padding));
+        service_stat_output_disk_io(&stat.reads, &body_part->reads);
+        service_stat_output_disk_io(&stat.writes, &body_part->writes);
+        for (i=0; i<FS_IO_TYPE_COUNT; i++) {
+            type_part = body_part->types + i;
+            type_part->type = stat.types[i].type;
+            memset(type_part->padding, 0, sizeof(type_part->padding));
+            long2buff(stat.types[i].ops, type_part->ops);
+            long2buff(stat.types[i].bytes, type_part->bytes);
+            long2buff(stat.types[i].errors, type_part->errors);
+        }
+        body_part++;
+        (*count)++;
+    }
+
+    return (char *)body_part;
+}
+
+static char *service_stat_output_commands(struct fast_task_info *task,
+        char *buff, const char *end, int *count)
+{
+    FSProtoServiceStatRespCommand *body_part;
+    FSCommandStat *cmd_stat;
+    FSHistogramStat latency;
+    int cmd;
+
+    *count = 0;
+    body_part = (FSProtoServiceStatRespCommand *)buff;
+    for (cmd=0; cmd<FS_STAT_COMMAND_COUNT; cmd++) {
+        cmd_stat = server_stat_get_command(cmd);
+        if (cmd_stat->count == 0) {
+            continue;
+        }
+        if ((char *)(body_part + 1) > end) {
+            break;
+        }
+
+        fs_histogram_stat(&cmd_stat->latency, &latency);
+        body_part->cmd = cmd;
+        memset(body_part->padding, 0, sizeof(body_part->padding));
+        long2buff(cmd_stat->count, body_part->count);
+        long2buff(cmd_stat->errors, body_part->errors);
+        long2buff(cmd_stat->bytes_in, body_part->bytes_in);
+        long2buff(cmd_stat->bytes_out, body_part->bytes_out);
+        long2buff(latency.p50, body_part->latency.p50);
+        long2buff(latency.p99, body_part->latency.p99);
+        long2buff(latency.p999, body_part->latency.p999);
+        long2buff(latency.max, body_part->latency.max);
+        body_part++;
+        (*count)++;
+    }
+
+    return (char *)body_part;
+}
+
 static int service_deal_service_stat(struct fast_task_info *task)
 {
     int result;
-    FSProtoServiceStatResp *stat_resp;
+    int read_depth;
+    int write_depth;
+    int data_group_count;
+    int disk_count;
+    int command_count;
+    FSProtoServiceStatRespBodyHeader *body_header;
+    char *p;
+    char *end;
 
     if ((result=server_expect_body_length(task, 0)) != 0) {
         return result;
     }
 
-    stat_resp = (FSProtoServiceStatResp *)REQUEST.body;
-
-    /*
-    stat_resp->is_master = CLUSTER_MYSELF_PTR == CLUSTER_MASTER_PTR ? 1 : 0;
-    stat_resp->status = CLUSTER_MYSELF_PTR->status;
-    int2buff(CLUSTER_MYSELF_PTR->server->id, stat_resp->server_id);
-
-    int2buff(SF_G_CONN_CURRENT_COUNT, stat_resp->connection.current_count);
-    int2buff(SF_G_CONN_MAX_COUNT, stat_resp->connection.max_count);
-    long2buff(CLUSTER_CURRENT_VERSION, stat_resp->dentry.current_data_version);
-    long2buff(CURRENT_INODE_SN, stat_resp->dentry.current_oid_sn);
-    long2buff(counters.ns, stat_resp->dentry.counters.ns);
-    long2buff(counters.dir, stat_resp->dentry.counters.dir);
-    long2buff(counters.file, stat_resp->dentry.counters.file);
-    */
-
-    RESPONSE.header.body_len = sizeof(FSProtoServiceStatResp);
+    body_header = (FSProtoServiceStatRespBodyHeader *)REQUEST.body;
+    int2buff(CLUSTER_MY_SERVER_ID, body_header->server_id);
+    body_header->is_leader = MYSELF_IS_LEADER ? 1 : 0;
+    memset(body_header->padding, 0, sizeof(body_header->padding));
+    memset(body_header->padding2, 0, sizeof(body_header->padding2));
+
+    int2buff(SF_G_CONN_CURRENT_COUNT, body_header->connection.current_count);
+    int2buff(SF_G_CONN_MAX_COUNT, body_header->connection.max_count);
+
+    trunk_io_thread_get_queue_depths(&read_depth, &write_depth);
+    int2buff(read_depth, body_header->trunk_io.read_queue_depth);
+    int2buff(write_depth, body_header->trunk_io.write_queue_depth);
+
+    long2buff(REPLICA_COMPRESS_STAT.replication.bytes_before,
+            body_header->compress.replication_before);
+    long2buff(REPLICA_COMPRESS_STAT.replication.bytes_after,
+            body_header->compress.replication_after);
+    long2buff(REPLICA_COMPRESS_STAT.fetch_binlog.bytes_before,
+            body_header->compress.fetch_binlog_before);
+    long2buff(REPLICA_COMPRESS_STAT.fetch_binlog.bytes_after,
+            body_header->compress.fetch_binlog_after);
+
+    //the entries which exceed the task buffer are omitted
+    end = task->data + task->size;
+    p = service_stat_output_data_groups(task, (char *)(body_header + 1),
+            end, &data_group_count);
+    p = service_stat_output_disks(task, p, end, &disk_count);
+    p = service_stat_output_commands(task, p, end, &command_count);
+    int2buff(data_group_count, body_header->data_group_count);
+    int2buff(disk_count, body_header->disk_count);
+    int2buff(command_count, body_header->command_count);
+
+    RESPONSE.header.body_len = p - REQUEST.body;
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SERVICE_STAT_RESP;
     TASK_ARG->context.response_done = true;
 
@@ -165,11 +345,14 @@ static int service_deal_slice_read(struct fast_task_info *task)
 {
     int result;
     FSProtoSliceReadReqHeader *req_header;
+    uint64_t min_data_version;
+    uint64_t applied_version;
     char *buff;
 
     RESPONSE.header.cmd = FS_SERVICE_PROTO_SLICE_READ_RESP;
-    if ((result=server_expect_body_length(task,
-                    sizeof(FSProtoSliceReadReqHeader))) != 0)
+    if (REQUEST.header.body_len != FS_PROTO_SLICE_READ_REQ_MIN_SIZE &&
+            (result=server_expect_body_length(task,
+                sizeof(FSProtoSliceReadReqHeader))) != 0)
     {
         return result;
     }
@@ -189,6 +372,28 @@ static int service_deal_slice_read(struct fast_task_info *task)
         return EOVERFLOW;
     }
 
+    /* the slave may not apply the writes of the client yet, the client
+     * reads from the master for EAGAIN. the data version of myself is the
+     * max applied one, the updates are applied out of order by the
+     * replication threads, so check the contiguous watermark instead */
+    if (REQUEST.header.body_len == sizeof(FSProtoSliceReadReqHeader)) {
+        min_data_version = buff2long(req_header->min_data_version);
+    } else {
+        min_data_version = 0;
+    }
+    if (min_data_version > 0 && !OP_CTX_INFO.myself->is_master) {
+        applied_version = version_window_get(
+                &OP_CTX_INFO.myself->dg->applied);
+        if (applied_version < min_data_version) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "data group id: %d, my applied version: %"PRId64" < "
+                    "the min data version: %"PRId64, OP_CTX_INFO.
+                    data_group_id, applied_version, min_data_version);
+            TASK_ARG->context.log_error = false;
+            return EAGAIN;
+        }
+    }
+
     buff = REQUEST.body;
     OP_CTX_NOTIFY.func = slice_read_done_notify;
     OP_CTX_NOTIFY.args = task;
@@ -275,6 +480,33 @@ static FSClusterDataServerInfo *get_readable_server(
     return NULL;
 }
 
+static int service_deal_subscribe_topology(struct fast_task_info *task)
+{
+    int result;
+
+    if ((result=server_expect_body_length(task, 0)) != 0) {
+        return result;
+    }
+
+    if (TASK_CTX.service.subscriber != NULL) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "already subscribed");
+        return EEXIST;
+    }
+
+    if ((result=cluster_topology_subscribe(task,
+                    &SERVER_CTX->service.subscribers)) != 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "subscribe fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+        return result;
+    }
+
+    RESPONSE.header.cmd = FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_RESP;
+    return 0;
+}
+
 static int service_deal_get_readable_server(struct fast_task_info *task)
 {
     int result;
@@ -322,13 +554,19 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
     int result;
     int data_group_id;
     FSProtoClusterStatRespBodyHeader *body_header;
-    FSProtoClusterStatRespBodyPart *part_start;
     FSProtoClusterStatRespBodyPart *body_part;
+    char *part_start;
+    char *p;
+    int part_size;
+    int count;
     FSClusterDataGroupInfo *group;
     FSClusterDataGroupInfo *gend;
     FSClusterDataServerInfo *ds;
     FSClusterDataServerInfo *dend;
     const FCAddressInfo *addr;
+    int64_t replica_lag;
+    int inflight_count;
+    bool lagging;
 
     if ((result=server_check_max_body_length(task, 4)) != 0) {
         return result;
@@ -351,17 +589,25 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
         return EINVAL;
     }
 
+    //the old client accepts the parts without the replication stat
+    if ((REQUEST.header.flags & FS_PROTO_FLAGS_REPLICA_STAT) != 0) {
+        part_size = sizeof(FSProtoClusterStatRespBodyPart);
+    } else {
+        part_size = FS_PROTO_CLUSTER_STAT_RESP_PART_MIN_SIZE;
+    }
+
     body_header = (FSProtoClusterStatRespBodyHeader *)REQUEST.body;
-    part_start = (FSProtoClusterStatRespBodyPart *)(REQUEST.body +
-            sizeof(FSProtoClusterStatRespBodyHeader));
-    body_part = part_start;
+    part_start = REQUEST.body + sizeof(FSProtoClusterStatRespBodyHeader);
+    p = part_start;
+    count = 0;
 
     for (; group<gend; group++) {
         dend = group->data_server_array.servers +
             group->data_server_array.count;
         for (ds=group->data_server_array.servers; ds<dend;
-                ds++, body_part++)
+                ds++, p+=part_size, count++)
         {
+            body_part = (FSProtoClusterStatRespBodyPart *)p;
 
             addr = fc_server_get_address_by_peer(&SERVICE_GROUP_ADDRESS_ARRAY(
                         ds->cs->server), task->client_ip);
@@ -374,11 +620,18 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
             body_part->is_master = ds->is_master;
             body_part->status = ds->status;
             long2buff(ds->data_version, body_part->data_version);
+            if (part_size == sizeof(FSProtoClusterStatRespBodyPart)) {
+                replication_caller_get_slave_stat(ds, &replica_lag,
+                        &inflight_count, &lagging);
+                long2buff(replica_lag, body_part->replica_lag);
+                int2buff(inflight_count, body_part->inflight_count);
+                body_part->lagging = lagging;
+            }
         }
     }
 
-    int2buff(body_part - part_start, body_header->count);
-    RESPONSE.header.body_len = (char *)body_part - REQUEST.body;
+    int2buff(count, body_header->count);
+    RESPONSE.header.body_len = p - REQUEST.body;
     RESPONSE.header.cmd = FS_SERVICE_PROTO_CLUSTER_STAT_RESP;
     TASK_ARG->context.response_done = true;
     return 0;
@@ -389,6 +642,8 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
         TASK_CTX.which_side = FS_WHICH_SIDE_MASTER; \
         OP_CTX_INFO.data_version = 0;     \
         OP_CTX_INFO.body = REQUEST.body;  \
+        server_trace_begin(&SLICE_OP_CTX.trace, server_trace_sample( \
+                    REQUEST.header.trace_id), TASK_ARG->req_start_time); \
     } while (0)
 
 static inline int service_deal_slice_write(struct fast_task_info *task)
@@ -472,6 +727,9 @@ int service_deal_task(struct fast_task_info *task)
             case FS_SERVICE_PROTO_GET_READABLE_SERVER_REQ:
                 result = service_deal_get_readable_server(task);
                 break;
+            case FS_SERVICE_PROTO_SUBSCRIBE_TOPOLOGY_REQ:
+                result = service_deal_subscribe_topology(task);
+                break;
             case FS_SERVICE_PROTO_CLUSTER_STAT_REQ:
                 result = service_deal_cluster_stat(task);
                 break;
@@ -506,5 +764,18 @@ void *service_alloc_thread_extra_data(const int thread_index)
 
     server_context->service.slice_ptr_array = (struct ob_slice_ptr_array *)
         (server_context + 1);
+    FC_INIT_LIST_HEAD(&server_context->service.subscribers);
     return server_context;
 }
+
+int service_thread_loop_callback(struct nio_thread_data *thread_data)
+{
+    FSServerContext *server_ctx;
+
+    server_ctx = (FSServerContext *)thread_data->arg;
+    if (!fc_list_empty(&server_ctx->service.subscribers)) {
+        cluster_topology_process_subscriber_events(
+                &server_ctx->service.subscribers);
+    }
+    return 0;
+}
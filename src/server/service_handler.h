@@ -17,8 +17,12 @@ int service_handler_init();
 int service_handler_destroy();
 int service_deal_task(struct fast_task_info *task);
 void service_task_finish_cleanup(struct fast_task_info *task);
+
+/* release the task buffer held by the replication thread, the last holder
+ * finishes the cleanup deferred by service_task_finish_cleanup */
+void service_task_release_buffer(struct fast_task_info *task);
 void *service_alloc_thread_extra_data(const int thread_index);
-//int service_thread_loop(struct nio_thread_data *thread_data);
+int service_thread_loop_callback(struct nio_thread_data *thread_data);
 
 #ifdef __cplusplus
 }
@@ -6,6 +6,7 @@
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "../binlog/slice_binlog.h"
+#include "../dio/trunk_io_thread.h"
 #include "storage_allocator.h"
 #include "object_block_index.h"
 
@@ -13,6 +14,9 @@
 #define SLICE_ARRAY_FIXED_COUNT     4
 //#define SLICE_ARRAY_FIXED_COUNT  64
 
+//the file system block size for punching hole
+#define PUNCH_HOLE_ALIGN_SIZE    4096
+
 typedef struct {
     int count;
     OBSharedContext *contexts;
@@ -124,6 +128,7 @@ static OBEntry *get_ob_entry_ex(OBSharedContext *ctx, OBEntry **bucket,
     }
 
     ob->bkey = *bkey;
+    ob->path_index = -1;
     if (*pprev == NULL) {
         ob->next = *bucket;
         *bucket = ob;
@@ -153,6 +158,7 @@ OBSliceEntry *ob_index_alloc_slice(const FSBlockKey *bkey)
         if (slice != NULL) {
             slice->ob = ob;
             slice->ref_count = 1;
+            slice->dead.length = 0;
         }
     }
     PTHREAD_MUTEX_UNLOCK(&ctx->lock);
@@ -160,6 +166,67 @@ OBSliceEntry *ob_index_alloc_slice(const FSBlockKey *bkey)
     return slice;
 }
 
+int ob_index_pin_write_path(const FSBlockKey *bkey,
+        const int old_path, const int new_path)
+{
+    OBEntry *ob;
+    OBSliceEntry *first;
+    UniqSkiplistIterator it;
+    int path_index;
+
+    OB_INDEX_SET_BUCKET_AND_CTX(*bkey);
+    PTHREAD_MUTEX_LOCK(&ctx->lock);
+    ob = get_ob_entry(ctx, bucket, bkey, true);
+    if (ob == NULL) {
+        path_index = -1;
+    } else {
+        if (ob->path_index < 0) {
+            uniq_skiplist_iterator(ob->slices, &it);
+            if ((first=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+                ob->path_index = first->space.store->index;
+            } else {
+                ob->path_index = new_path;
+            }
+        } else if (ob->path_index == old_path) {
+            ob->path_index = new_path;
+        }
+        path_index = ob->path_index;
+    }
+    PTHREAD_MUTEX_UNLOCK(&ctx->lock);
+
+    return path_index;
+}
+
+static void punch_slice_hole(OBSliceEntry *slice)
+{
+    FSTrunkSpaceInfo space;
+    int64_t start;
+    int64_t end;
+
+    start = slice->space.offset + slice->read_offset + slice->dead.offset;
+    end = start + slice->dead.length;
+
+    //the partial blocks may be shared with the neighbour slices
+    start = (start + PUNCH_HOLE_ALIGN_SIZE - 1) /
+        PUNCH_HOLE_ALIGN_SIZE * PUNCH_HOLE_ALIGN_SIZE;
+    end = end / PUNCH_HOLE_ALIGN_SIZE * PUNCH_HOLE_ALIGN_SIZE;
+    if (end <= start) {
+        return;
+    }
+
+    space = slice->space;
+    space.offset = start;
+    space.size = end - start;
+    io_thread_push_punch_hole(&space);
+}
+
+#define PUNCH_SLICE_HOLE_IF_DEAD(slice) \
+    do { \
+        if (slice->dead.length > 0 && slice->type == OB_SLICE_TYPE_FILE) { \
+            punch_slice_hole(slice); \
+        } \
+    } while (0)
+
 void ob_index_free_slice(OBSliceEntry *slice)
 {
     logInfo("free slice1: %p, ref_count: %d",
@@ -171,6 +238,7 @@ void ob_index_free_slice(OBSliceEntry *slice)
                 slice, __sync_add_and_fetch(&slice->ref_count, 0),
                 slice->ob->bkey.oid, slice->ob->bkey.offset, ctx);
 
+        PUNCH_SLICE_HOLE_IF_DEAD(slice);
         PTHREAD_MUTEX_LOCK(&ctx->lock);
         fast_mblock_free_object(&ctx->slice_allocator, slice);
         PTHREAD_MUTEX_UNLOCK(&ctx->lock);
@@ -197,6 +265,7 @@ static void slice_free_func(void *ptr, const int delay_seconds)
                 slice->ob->bkey.oid, slice->ob->bkey.offset, ctx);
                 */
 
+        PUNCH_SLICE_HOLE_IF_DEAD(slice);
         fast_mblock_free_object(&ctx->slice_allocator, slice);
     }
 }
@@ -289,6 +358,24 @@ void ob_index_destroy()
 {
 }
 
+void ob_index_get_stat(OBIndexStat *stat)
+{
+    OBSharedContext *ctx;
+    OBSharedContext *end;
+
+    stat->block_count = stat->slice_count = 0;
+    stat->memory_bytes = sizeof(OBEntry *) * ob_hashtable.capacity;
+    end = ob_shared_ctx_array.contexts + ob_shared_ctx_array.count;
+    for (ctx=ob_shared_ctx_array.contexts; ctx<end; ctx++) {
+        stat->block_count += ctx->ob_allocator.info.element_used_count;
+        stat->slice_count += ctx->slice_allocator.info.element_used_count;
+        stat->memory_bytes += ctx->ob_allocator.info.element_total_count *
+            ctx->ob_allocator.info.element_size +
+            ctx->slice_allocator.info.element_total_count *
+            ctx->slice_allocator.info.element_size;
+    }
+}
+
 static inline int do_delete_slice(OBEntry *ob, OBSliceEntry *slice)
 {
     int result;
@@ -325,6 +412,7 @@ static inline OBSliceEntry *splice_dup(OBSharedContext *ctx,
         slice->ssize.offset = offset;
     }
     slice->ssize.length = length;
+    slice->dead.length = 0;
     slice->ref_count = 1;
     return slice;
 }
@@ -530,8 +618,22 @@ int ob_index_add_slice_by_binlog(OBSliceEntry *slice)
     return result;
 }
 
+static inline void set_slice_dead_range(OBSliceEntry *slice,
+        const FSSliceSize *deleted)
+{
+    int start;
+    int end;
+
+    start = FC_MAX(slice->ssize.offset, deleted->offset);
+    end = FC_MIN(slice->ssize.offset + slice->ssize.length,
+            deleted->offset + deleted->length);
+    slice->dead.offset = start - slice->ssize.offset;
+    slice->dead.length = end - start;
+}
+
 static int delete_slices(OBSharedContext *ctx, OBEntry *ob,
-        const FSBlockSliceKeyInfo *bs_key, int *count, int *dec_alloc)
+        const FSBlockSliceKeyInfo *bs_key, int *count,
+        int *dec_alloc, const bool punch_hole)
 {
     OBSliceEntry target;
     UniqSkiplistNode *node;
@@ -626,6 +728,9 @@ static int delete_slices(OBSharedContext *ctx, OBEntry *ob,
 
     *count = del_slice_array.count;
     for (i=0; i<del_slice_array.count; i++) {
+        if (punch_hole) {
+            set_slice_dead_range(del_slice_array.slices[i], &bs_key->slice);
+        }
         do_delete_slice(ob, del_slice_array.slices[i]);
     }
     FREE_SLICE_PTR_ARRAY(del_slice_array);
@@ -639,7 +744,7 @@ static int delete_slices(OBSharedContext *ctx, OBEntry *ob,
 }
 
 int ob_index_delete_slices(const FSBlockSliceKeyInfo *bs_key,
-        uint64_t *sn, int *dec_alloc)
+        uint64_t *sn, int *dec_alloc, const bool punch_hole)
 {
     OBEntry *ob;
     int result;
@@ -651,7 +756,8 @@ int ob_index_delete_slices(const FSBlockSliceKeyInfo *bs_key,
     if (ob == NULL) {
         result = ENOENT;
     } else {
-        result = delete_slices(ctx, ob, bs_key, &count, dec_alloc);
+        result = delete_slices(ctx, ob, bs_key, &count,
+                dec_alloc, punch_hole);
         if (result == 0 && sn != NULL) {
             *sn = __sync_add_and_fetch(&SLICE_BINLOG_SN, 1);
         }
@@ -661,7 +767,8 @@ int ob_index_delete_slices(const FSBlockSliceKeyInfo *bs_key,
     return result;
 }
 
-int ob_index_delete_block(const FSBlockKey *bkey, uint64_t *sn, int *dec_alloc)
+int ob_index_delete_block(const FSBlockKey *bkey, uint64_t *sn,
+        int *dec_alloc, const bool punch_hole)
 {
     OBEntry *ob;
     OBEntry *previous;
@@ -678,6 +785,10 @@ int ob_index_delete_block(const FSBlockKey *bkey, uint64_t *sn, int *dec_alloc)
         uniq_skiplist_iterator(ob->slices, &it);
         while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
             *dec_alloc += slice->ssize.length;
+            if (punch_hole) {
+                slice->dead.offset = 0;
+                slice->dead.length = slice->ssize.length;
+            }
             storage_allocator_delete_slice(slice);
         }
 
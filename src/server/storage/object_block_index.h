@@ -21,6 +21,7 @@ typedef struct {
 typedef struct ob_entry {
     FSBlockKey bkey;
     UniqSkiplist *slices;  //the element is OBSliceEntry
+    int path_index;        //the store path to write, -1 for not pinned
     struct ob_entry *next; //for hashtable
 } OBEntry;
 
@@ -30,10 +31,17 @@ typedef struct ob_slice_entry {
     int read_offset;     //offset of the space start offset
     volatile int ref_count;
     FSSliceSize ssize;
+    FSSliceSize dead;    //the deleted range relative to ssize.offset
     FSTrunkSpaceInfo space;
     struct fc_list_head dlink;  //used in trunk entry for trunk reclaiming
 } OBSliceEntry;
 
+typedef struct ob_index_stat {
+    int64_t block_count;
+    int64_t slice_count;
+    int64_t memory_bytes;  //the hashtable and the allocated entries
+} OBIndexStat;
+
 typedef struct ob_slice_ptr_array {
     int alloc;
     int count;
@@ -49,19 +57,33 @@ extern "C" {
 
     int ob_index_add_slice(OBSliceEntry *slice, uint64_t *sn, int *inc_alloc);
 
+    /* punch_hole: if release the disk space of the deleted slices
+     * when they are freed */
     int ob_index_delete_slices(const FSBlockSliceKeyInfo *bs_key,
-            uint64_t *sn, int *dec_alloc);
+            uint64_t *sn, int *dec_alloc, const bool punch_hole);
 
     int ob_index_delete_block(const FSBlockKey *bkey,
-            uint64_t *sn, int *dec_alloc);
+            uint64_t *sn, int *dec_alloc, const bool punch_hole);
 
     OBSliceEntry *ob_index_alloc_slice(const FSBlockKey *bkey);
 
+    /* pin the store path to write the block, so that all slices of a block
+     * go to the same path (and IO thread) and overlapping writes never be
+     * reordered. the path of the existing slices is pinned when not pinned,
+     * or new_path when the block is empty. the pinned path is replaced by
+     * new_path when it equals to old_path (the path is unavailable).
+     * return the pinned path index, or -1 for out of memory */
+    int ob_index_pin_write_path(const FSBlockKey *bkey,
+            const int old_path, const int new_path);
+
     void ob_index_free_slice(OBSliceEntry *slice);
 
     int ob_index_get_slices(const FSBlockSliceKeyInfo *bs_key,
             OBSlicePtrArray *sarray);
 
+    //lock free, the counters may be a little stale
+    void ob_index_get_stat(OBIndexStat *stat);
+
     static inline void ob_index_init_slice_ptr_array(OBSlicePtrArray *sarray)
     {
         sarray->slices = NULL;
@@ -83,14 +105,14 @@ extern "C" {
             const FSBlockSliceKeyInfo *bs_key)
     {
         int dec_alloc;
-        return ob_index_delete_slices(bs_key, NULL, &dec_alloc);
+        return ob_index_delete_slices(bs_key, NULL, &dec_alloc, false);
     }
 
     static inline int ob_index_delete_block_by_binlog(
             const FSBlockKey *bkey)
     {
         int dec_alloc;
-        return ob_index_delete_block(bkey, NULL, &dec_alloc);
+        return ob_index_delete_block(bkey, NULL, &dec_alloc, false);
     }
 
 #ifdef __cplusplus
@@ -2,14 +2,31 @@
 #include <sys/stat.h>
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
+#include "fastcommon/fast_mblock.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "../dio/trunk_io_thread.h"
 #include "../binlog/slice_binlog.h"
 #include "../binlog/replica_binlog.h"
+#include "../server_trace.h"
 #include "storage_allocator.h"
 #include "slice_op.h"
 
+typedef struct fs_slice_read_run {
+    FSSliceOpContext *op_ctx;
+    int count;
+    OBSliceEntry *slices[FS_MAX_SLICE_COUNT_PER_READ_RUN];
+    struct iovec iovs[FS_MAX_SLICE_COUNT_PER_READ_RUN];
+} FSSliceReadRun;
+
+static struct fast_mblock_man read_run_allocator;
+
+int fs_slice_op_init()
+{
+    return fast_mblock_init_ex1(&read_run_allocator, "slice_read_run",
+            sizeof(FSSliceReadRun), 1024, NULL, NULL, true);
+}
+
 static void set_data_version(FSSliceOpContext *op_ctx)
 {
     uint64_t old_version;
@@ -50,6 +67,7 @@ static void slice_write_finish(FSSliceOpContext *op_ctx)
             }
             op_ctx->write.inc_alloc += inc_alloc;
         }
+        server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_INDEX);
 
         set_data_version(op_ctx);
         for (i=0; i<op_ctx->write.sarray.count; i++) {
@@ -70,6 +88,7 @@ static void slice_write_finish(FSSliceOpContext *op_ctx)
                 return;
             }
         }
+        server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_BINLOG);
     }
 
     for (i=0; i<op_ctx->write.sarray.count; i++) {
@@ -82,6 +101,13 @@ static void slice_write_done(struct trunk_io_buffer *record, const int result)
     FSSliceOpContext *op_ctx;
 
     op_ctx = (FSSliceOpContext *)record->notify.args;
+    if (op_ctx->trace.trace_id != 0) {
+        server_trace_add_span_ex(&op_ctx->trace, FS_TRACE_STAGE_IO_QUEUED,
+                record->push_time_us);
+        server_trace_add_span_ex(&op_ctx->trace, FS_TRACE_STAGE_IO_START,
+                record->start_time_us);
+        server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_IO_DONE);
+    }
     if (result == 0) {
         op_ctx->done_bytes += record->slice->ssize.length;
     } else {
@@ -127,12 +153,10 @@ static int fs_slice_alloc(const FSBlockSliceKeyInfo *bs_key,
     FSTrunkSpaceInfo spaces[FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC];
 
     if (reclaim_alloc) {
-        result = storage_allocator_reclaim_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
+        result = storage_allocator_reclaim_alloc(&bs_key->block,
                 bs_key->slice.length, spaces, &*slice_count);
     } else {
-        result = storage_allocator_normal_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
+        result = storage_allocator_normal_alloc(&bs_key->block,
                 bs_key->slice.length, spaces, &*slice_count);
     }
 
@@ -192,6 +216,7 @@ int fs_slice_write_ex(FSSliceOpContext *op_ctx, char *buff,
     {
         return result;
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_ALLOC);
 
     op_ctx->result = 0;
     op_ctx->done_bytes = 0;
@@ -324,6 +349,7 @@ int fs_slice_allocate_ex(FSSliceOpContext *op_ctx,
         }
         *inc_alloc += inc;
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_INDEX);
 
     set_data_version(op_ctx);
     for (i=0; i<slice_count; i++) {
@@ -344,6 +370,7 @@ int fs_slice_allocate_ex(FSSliceOpContext *op_ctx,
             return r;
         }
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_BINLOG);
 
     logInfo("file: "__FILE__", line: %d, "
             "slice hole count: %d, inc_alloc: %d",
@@ -380,12 +407,117 @@ static void slice_read_done(struct trunk_io_buffer *record, const int result)
     do_read_done(record->slice, (FSSliceOpContext *)record->notify.args, result);
 }
 
+static void slice_read_run_done(struct trunk_io_buffer *record,
+        const int result)
+{
+    FSSliceReadRun *run;
+    FSSliceOpContext *op_ctx;
+    int i;
+
+    run = (FSSliceReadRun *)record->notify.args;
+    op_ctx = run->op_ctx;
+    if (result == 0) {
+        op_ctx->done_bytes += record->data.len;
+    } else {
+        op_ctx->result = result;
+    }
+
+    for (i=0; i<run->count; i++) {
+        ob_index_free_slice(run->slices[i]);
+    }
+    fast_mblock_free_object(&read_run_allocator, run);
+
+    if (__sync_sub_and_fetch(&op_ctx->counter, 1) == 0) {
+        if (op_ctx->notify.func != NULL) {
+            op_ctx->notify.func(op_ctx);
+        }
+    }
+}
+
+static inline bool slice_physically_adjacent(const OBSliceEntry *prev,
+        const OBSliceEntry *curr)
+{
+    return (curr->type == OB_SLICE_TYPE_FILE) &&
+        (curr->space.store->index == prev->space.store->index) &&
+        (curr->space.id_info.id == prev->space.id_info.id) &&
+        (curr->space.offset + curr->read_offset == prev->space.offset +
+         prev->read_offset + prev->ssize.length);
+}
+
+/* return the slice count of the physically contiguous run
+ * which starts from the slice pointer: start */
+static int get_read_run_count(OBSliceEntry **start, OBSliceEntry **end)
+{
+    OBSliceEntry **pp;
+
+    if ((*start)->type != OB_SLICE_TYPE_FILE) {
+        return 1;
+    }
+
+    for (pp=start + 1; pp<end && pp - start <
+            FS_MAX_SLICE_COUNT_PER_READ_RUN; pp++)
+    {
+        if (!slice_physically_adjacent(*(pp - 1), *pp)) {
+            break;
+        }
+    }
+
+    return pp - start;
+}
+
+static inline void fill_read_hole(FSSliceOpContext *op_ctx,
+        const OBSliceEntry *slice, char **ps, int *offset)
+{
+    int hole_len;
+
+    hole_len = slice->ssize.offset - *offset;
+    if (hole_len > 0) {
+        memset(*ps, 0, hole_len);
+        *ps += hole_len;
+        op_ctx->done_bytes += hole_len;
+    }
+}
+
+static int push_read_run(FSSliceOpContext *op_ctx, OBSliceEntry **slices,
+        const int count, char **ps, int *offset)
+{
+    FSSliceReadRun *run;
+    int result;
+    int i;
+
+    run = (FSSliceReadRun *)fast_mblock_alloc_object(&read_run_allocator);
+    if (run == NULL) {
+        return ENOMEM;
+    }
+
+    run->op_ctx = op_ctx;
+    run->count = count;
+    for (i=0; i<count; i++) {
+        fill_read_hole(op_ctx, slices[i], ps, offset);
+
+        run->slices[i] = slices[i];
+        run->iovs[i].iov_base = *ps;
+        run->iovs[i].iov_len = slices[i]->ssize.length;
+
+        *ps += slices[i]->ssize.length;
+        *offset = slices[i]->ssize.offset + slices[i]->ssize.length;
+    }
+
+    if ((result=io_thread_push_slices_readv(run->slices[0], run->iovs,
+                    count, slice_read_run_done, run)) != 0)
+    {
+        fast_mblock_free_object(&read_run_allocator, run);
+    }
+    return result;
+}
+
 int fs_slice_read_ex(FSSliceOpContext *op_ctx, char *buff,
         OBSlicePtrArray *sarray)
 {
     int result;
     int offset;
-    int hole_len;
+    int run_count;
+    int io_count;
     FSSliceSize ssize;
     char *ps;
     OBSliceEntry **pp;
@@ -399,23 +531,30 @@ int fs_slice_read_ex(FSSliceOpContext *op_ctx, char *buff,
             sarray->count, op_ctx->info.bs_key.slice.offset,
             op_ctx->info.bs_key.slice.length);
 
+    //one notify per physically contiguous run
+    io_count = 0;
+    end = sarray->slices + sarray->count;
+    for (pp=sarray->slices; pp<end; pp+=get_read_run_count(pp, end)) {
+        io_count++;
+    }
+
+    op_ctx->result = 0;
     op_ctx->done_bytes = 0;
-    op_ctx->counter = sarray->count;
+    op_ctx->counter = io_count;
     ps = buff;
     offset = op_ctx->info.bs_key.slice.offset;
-    end = sarray->slices + sarray->count;
-    for (pp=sarray->slices; pp<end; pp++) {
-        hole_len = (*pp)->ssize.offset - offset;
-        if (hole_len > 0) {
-            memset(ps, 0, hole_len);
-            ps += hole_len;
-            op_ctx->done_bytes += hole_len;
+    for (pp=sarray->slices; pp<end; pp+=run_count) {
+        run_count = get_read_run_count(pp, end);
+        if (run_count > 1) {
+            if ((result=push_read_run(op_ctx, pp, run_count,
+                            &ps, &offset)) != 0)
+            {
+                break;
+            }
+            continue;
         }
 
-        logInfo("slice %d. type: %c (0x%02x), offset: %d, length: %d, "
-                "hole_len: %d", (int)(pp - sarray->slices), (*pp)->type,
-                (*pp)->type, (*pp)->ssize.offset, (*pp)->ssize.length, hole_len);
-
+        fill_read_hole(op_ctx, *pp, &ps, &offset);
         ssize = (*pp)->ssize;
         if ((*pp)->type == OB_SLICE_TYPE_ALLOC) {
             memset(ps, 0, (*pp)->ssize.length);
@@ -423,7 +562,6 @@ int fs_slice_read_ex(FSSliceOpContext *op_ctx, char *buff,
         } else if ((result=io_thread_push_slice_op(FS_IO_TYPE_READ_SLICE,
                         *pp, ps, slice_read_done, op_ctx)) != 0)
         {
-            ob_index_free_slice(*pp);
             break;
         }
 
@@ -431,6 +569,11 @@ int fs_slice_read_ex(FSSliceOpContext *op_ctx, char *buff,
         offset = ssize.offset + ssize.length;
     }
 
+    if (result != 0) {
+        for (; pp<end; pp++) {
+            ob_index_free_slice(*pp);
+        }
+    }
     return result;
 }
 
@@ -439,11 +582,12 @@ int fs_delete_slices(FSSliceOpContext *op_ctx, int *dec_alloc)
     uint64_t sn;
     int result;
 
-    if ((result=ob_index_delete_slices(&op_ctx->info.bs_key,
-                    &sn, dec_alloc)) != 0)
+    if ((result=ob_index_delete_slices(&op_ctx->info.bs_key, &sn,
+                    dec_alloc, STORAGE_CFG.punch_hole_on_delete)) != 0)
     {
         return result;
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_INDEX);
 
     set_data_version(op_ctx);
     if ((result=slice_binlog_log_del_slice(&op_ctx->info.bs_key,
@@ -453,9 +597,14 @@ int fs_delete_slices(FSSliceOpContext *op_ctx, int *dec_alloc)
     }
 
     if (op_ctx->info.write_data_binlog) {
-        return replica_binlog_log_del_slice(op_ctx->info.data_group_id,
-                op_ctx->info.data_version, &op_ctx->info.bs_key);
+        if ((result=replica_binlog_log_del_slice(op_ctx->info.data_group_id,
+                        op_ctx->info.data_version,
+                        &op_ctx->info.bs_key)) != 0)
+        {
+            return result;
+        }
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_BINLOG);
     return 0;
 }
 
@@ -464,11 +613,12 @@ int fs_delete_block(FSSliceOpContext *op_ctx, int *dec_alloc)
     uint64_t sn;
     int result;
 
-    if ((result=ob_index_delete_block(&op_ctx->info.bs_key.block,
-                    &sn, dec_alloc)) != 0)
+    if ((result=ob_index_delete_block(&op_ctx->info.bs_key.block, &sn,
+                    dec_alloc, STORAGE_CFG.punch_hole_on_delete)) != 0)
     {
         return result;
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_INDEX);
 
     set_data_version(op_ctx);
     if ((result=slice_binlog_log_del_block(&op_ctx->info.bs_key.block,
@@ -478,8 +628,13 @@ int fs_delete_block(FSSliceOpContext *op_ctx, int *dec_alloc)
     }
 
     if (op_ctx->info.write_data_binlog) {
-        return replica_binlog_log_del_block(op_ctx->info.data_group_id,
-                op_ctx->info.data_version, &op_ctx->info.bs_key.block);
+        if ((result=replica_binlog_log_del_block(op_ctx->info.data_group_id,
+                        op_ctx->info.data_version,
+                        &op_ctx->info.bs_key.block)) != 0)
+        {
+            return result;
+        }
     }
+    server_trace_add_span(&op_ctx->trace, FS_TRACE_STAGE_BINLOG);
     return 0;
 }
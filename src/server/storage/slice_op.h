@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+    int fs_slice_op_init();
+
     int fs_slice_write_ex(FSSliceOpContext *op_ctx, char *buff,
             const bool reclaim_alloc);
 
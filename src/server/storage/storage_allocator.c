@@ -3,14 +3,23 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
 #include "fastcommon/fc_memory.h"
+#include "fastcommon/sched_thread.h"
 #include "sf/sf_global.h"
 #include "../server_types.h"
 #include "../server_global.h"
+#include "../dio/trunk_io_thread.h"
+#include "object_block_index.h"
 #include "storage_allocator.h"
 
 static FSStorageAllocatorManager allocator_mgr;
 FSStorageAllocatorManager *g_allocator_mgr = &allocator_mgr;
 
+//check the idle freelists by this interval
+#define STORAGE_PREALLOC_DECAY_INTERVAL  10
+
+//the PRNG of the allocating thread, rand() takes a global lock
+static __thread uint64_t path_select_seed = 0;
+
 static int init_allocator_context(FSStorageAllocatorContext *allocator_ctx,
         FSStoragePathArray *parray)
 {
@@ -55,6 +64,36 @@ static int init_allocator_context(FSStorageAllocatorContext *allocator_ctx,
     return 0;
 }
 
+//shrink the prealloc targets of the idle store paths
+static int decay_prealloc_target_func(void *args)
+{
+    FSTrunkAllocator **pp;
+    FSTrunkAllocator **end;
+
+    end = g_allocator_mgr->allocator_ptr_array.allocators +
+        g_allocator_mgr->allocator_ptr_array.count;
+    for (pp=g_allocator_mgr->allocator_ptr_array.allocators; pp<end; pp++) {
+        if (*pp != NULL) {
+            trunk_allocator_decay_prealloc_target(*pp);
+        }
+    }
+    return 0;
+}
+
+static int setup_decay_prealloc_task()
+{
+    ScheduleEntry schedule_entry;
+    ScheduleArray schedule_array;
+
+    INIT_SCHEDULE_ENTRY(schedule_entry, sched_generate_next_id(),
+            0, 0, 0, STORAGE_PREALLOC_DECAY_INTERVAL,
+            decay_prealloc_target_func, NULL);
+
+    schedule_array.count = 1;
+    schedule_array.entries = &schedule_entry;
+    return sched_add_entries(&schedule_array);
+}
+
 int storage_allocator_init()
 {
     int result;
@@ -86,6 +125,12 @@ int storage_allocator_init()
         g_allocator_mgr->current = &g_allocator_mgr->store_path;
     }
 
+    if (STORAGE_CFG.prealloc_trunk_ahead_seconds > 0) {
+        if ((result=setup_decay_prealloc_task()) != 0) {
+            return result;
+        }
+    }
+
     return trunk_id_info_init();
 }
 
@@ -122,3 +167,192 @@ int storage_allocator_prealloc_trunk_freelists()
     }
     return 0;
 }
+
+//xorshift64
+static inline uint64_t path_select_rand()
+{
+    uint64_t x;
+
+    if ((x=path_select_seed) == 0) {
+        x = ((uint64_t)get_current_time_us() << 16) ^
+            (uint64_t)(long)pthread_self();
+        if (x == 0) {
+            x = 88172645463325252ULL;
+        }
+    }
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    path_select_seed = x;
+    return x;
+}
+
+/* the avail_space of the file system is refreshed by the trunk
+ * preallocating only, so add the live free space of the trunks */
+static inline int64_t get_path_free_space(FSTrunkAllocator *allocator)
+{
+    FSStoragePathInfo *path_info;
+    int64_t disk_free;
+    int64_t trunk_free;
+
+    path_info = allocator->path_info;
+    disk_free = path_info->avail_space - path_info->reserved_space.value;
+    trunk_free = __sync_add_and_fetch(&path_info->trunk_stat.total_bytes, 0) -
+        __sync_add_and_fetch(&path_info->trunk_stat.used_bytes, 0);
+    return (disk_free > 0 ? disk_free : 0) +
+        (trunk_free > 0 ? trunk_free : 0);
+}
+
+static FSTrunkAllocator **select_by_free_space(
+        FSStorageAllocatorContext *ctx, const uint32_t blk_hc)
+{
+    FSTrunkAllocator **pp;
+    FSTrunkAllocator **end;
+    int64_t total;
+    int64_t target;
+
+    total = 0;
+    end = ctx->avail.allocators + ctx->avail.count;
+    for (pp=ctx->avail.allocators; pp<end; pp++) {
+        total += get_path_free_space(*pp);
+    }
+    if (total == 0) {
+        return ctx->avail.allocators + blk_hc % ctx->avail.count;
+    }
+
+    target = (int64_t)(path_select_rand() % (uint64_t)total);
+    for (pp=ctx->avail.allocators; pp<end; pp++) {
+        target -= get_path_free_space(*pp);
+        if (target < 0) {
+            return pp;
+        }
+    }
+    return end - 1;
+}
+
+static FSTrunkAllocator **select_by_io_queue(
+        FSStorageAllocatorContext *ctx, const uint32_t blk_hc)
+{
+    FSTrunkAllocator **selected;
+    int start;
+    int index;
+    int i;
+    int depth;
+    int min_depth;
+
+    /* scan from the hash position so that the ties are spread */
+    start = blk_hc % ctx->avail.count;
+    selected = ctx->avail.allocators + start;
+    min_depth = trunk_io_thread_get_write_queue_depth(
+            (*selected)->path_info->store.index);
+    for (i=1; i<ctx->avail.count && min_depth > 0; i++) {
+        index = (start + i) % ctx->avail.count;
+        depth = trunk_io_thread_get_write_queue_depth(
+                ctx->avail.allocators[index]->path_info->store.index);
+        if (depth < min_depth) {
+            min_depth = depth;
+            selected = ctx->avail.allocators + index;
+        }
+    }
+
+    return selected;
+}
+
+static FSTrunkAllocator **select_by_write_latency(
+        FSStorageAllocatorContext *ctx)
+{
+    FSTrunkAllocator **first;
+    FSTrunkAllocator **second;
+    int64_t latency1;
+    int64_t latency2;
+    int index;
+
+    if (ctx->avail.count == 1) {
+        return ctx->avail.allocators;
+    }
+
+    /* power of two random choices */
+    index = path_select_rand() % ctx->avail.count;
+    first = ctx->avail.allocators + index;
+    second = ctx->avail.allocators + (index + 1 + path_select_rand() %
+            (ctx->avail.count - 1)) % ctx->avail.count;
+
+    latency1 = trunk_io_thread_get_write_latency(
+            (*first)->path_info->store.index);
+    latency2 = trunk_io_thread_get_write_latency(
+            (*second)->path_info->store.index);
+    if (latency1 != latency2) {
+        return (latency1 < latency2) ? first : second;
+    }
+
+    return (trunk_io_thread_get_write_queue_depth((*first)->path_info->
+                store.index) <= trunk_io_thread_get_write_queue_depth(
+                    (*second)->path_info->store.index)) ? first : second;
+}
+
+static FSTrunkAllocator **get_avail_allocator(
+        FSStorageAllocatorContext *ctx, const int path_index)
+{
+    FSTrunkAllocator **pp;
+    FSTrunkAllocator **end;
+
+    end = ctx->avail.allocators + ctx->avail.count;
+    for (pp=ctx->avail.allocators; pp<end; pp++) {
+        if ((*pp)->path_info->store.index == path_index) {
+            return pp;
+        }
+    }
+    return NULL;
+}
+
+FSTrunkAllocator **storage_allocator_select_path(
+        const FSBlockKey *bkey, const uint32_t blk_hc)
+{
+    FSStorageAllocatorContext *ctx;
+    FSTrunkAllocator **selected;
+    FSTrunkAllocator **pinned;
+    int new_path;
+    int path_index;
+
+    ctx = g_allocator_mgr->current;
+    if (ctx->avail.count == 0) {
+        return NULL;
+    }
+
+    switch (STORAGE_CFG.path_select_policy) {
+        case FS_PATH_SELECT_POLICY_FREE_SPACE:
+            selected = select_by_free_space(ctx, blk_hc);
+            break;
+        case FS_PATH_SELECT_POLICY_IO_QUEUE:
+            selected = select_by_io_queue(ctx, blk_hc);
+            break;
+        case FS_PATH_SELECT_POLICY_WRITE_LATENCY:
+            selected = select_by_write_latency(ctx);
+            break;
+        default:
+            return ctx->avail.allocators + blk_hc % ctx->avail.count;
+    }
+
+    /* the slave applies the writes without waiting, so the slices of
+     * a block must be written by the same path (IO thread) in order */
+    new_path = (*selected)->path_info->store.index;
+    if ((path_index=ob_index_pin_write_path(bkey, -1, new_path)) < 0) {
+        return selected;
+    }
+    if (path_index == new_path) {
+        return selected;
+    }
+    if ((pinned=get_avail_allocator(ctx, path_index)) != NULL) {
+        return pinned;
+    }
+
+    //the pinned path is unavailable, repin to the selected one
+    path_index = ob_index_pin_write_path(bkey, path_index, new_path);
+    if (path_index >= 0 && path_index != new_path &&
+            (pinned=get_avail_allocator(ctx, path_index)) != NULL)
+    {
+        return pinned;
+    }
+    return selected;
+}
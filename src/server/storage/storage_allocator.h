@@ -39,6 +39,12 @@ extern "C" {
 
     int storage_allocator_prealloc_trunk_freelists();
 
+    /* select the allocator (store path) to write by path_select_policy,
+       the block keeps the path of its slices except for the hash policy,
+       return NULL when no available store path */
+    FSTrunkAllocator **storage_allocator_select_path(
+            const FSBlockKey *bkey, const uint32_t blk_hc);
+
     static inline int storage_allocator_add_trunk_ex(const int path_index,
             const FSTrunkIdInfo *id_info, const int64_t size,
             FSTrunkFileInfo **pp_trunk)
@@ -68,32 +74,32 @@ extern "C" {
                 allocators[path_index], id_info->id);
     }
 
-    static inline int storage_allocator_normal_alloc(const uint32_t blk_hc,
+    static inline int storage_allocator_normal_alloc(const FSBlockKey *bkey,
             const int size, FSTrunkSpaceInfo *space_info, int *count)
     {
         FSTrunkAllocator **allocator;
+        uint32_t blk_hc;
 
-        if (g_allocator_mgr->current->avail.count == 0) {
+        blk_hc = FS_BLOCK_HASH_CODE(*bkey);
+        if ((allocator=storage_allocator_select_path(bkey, blk_hc)) == NULL) {
             return ENOENT;
         }
 
-        allocator = g_allocator_mgr->current->avail.allocators +
-            blk_hc % g_allocator_mgr->current->avail.count;
         return trunk_allocator_normal_alloc(*allocator, blk_hc,
                 size, space_info, count);
     }
 
-    static inline int storage_allocator_reclaim_alloc(const uint32_t blk_hc,
+    static inline int storage_allocator_reclaim_alloc(const FSBlockKey *bkey,
             const int size, FSTrunkSpaceInfo *space_info, int *count)
     {
         FSTrunkAllocator **allocator;
+        uint32_t blk_hc;
 
-        if (g_allocator_mgr->current->avail.count == 0) {
+        blk_hc = FS_BLOCK_HASH_CODE(*bkey);
+        if ((allocator=storage_allocator_select_path(bkey, blk_hc)) == NULL) {
             return ENOENT;
         }
 
-        allocator = g_allocator_mgr->current->avail.allocators +
-            blk_hc % g_allocator_mgr->current->avail.count;
         return trunk_allocator_reclaim_alloc(*allocator, blk_hc,
                 size, space_info, count);
     }
@@ -202,14 +202,99 @@ static int load_paths(FSStorageConfig *storage_cfg,
     return 0;
 }
 
+static int load_path_select_policy(FSStorageConfig *storage_cfg,
+        const char *storage_filename, IniContext *ini_context)
+{
+    char *policy;
+
+    policy = iniGetStrValue(NULL, "path_select_policy", ini_context);
+    if (policy == NULL || *policy == '\0' ||
+            strcasecmp(policy, "hash") == 0)
+    {
+        storage_cfg->path_select_policy = FS_PATH_SELECT_POLICY_HASH;
+    } else if (strcasecmp(policy, "free_space") == 0) {
+        storage_cfg->path_select_policy = FS_PATH_SELECT_POLICY_FREE_SPACE;
+    } else if (strcasecmp(policy, "io_queue") == 0) {
+        storage_cfg->path_select_policy = FS_PATH_SELECT_POLICY_IO_QUEUE;
+    } else if (strcasecmp(policy, "write_latency") == 0) {
+        storage_cfg->path_select_policy =
+            FS_PATH_SELECT_POLICY_WRITE_LATENCY;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, item \"path_select_policy\": %s "
+                "is invalid, expect: hash, free_space, io_queue "
+                "or write_latency", __LINE__, storage_filename, policy);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static const char *get_path_select_policy_caption(const int policy)
+{
+    switch (policy) {
+        case FS_PATH_SELECT_POLICY_HASH:
+            return "hash";
+        case FS_PATH_SELECT_POLICY_FREE_SPACE:
+            return "free_space";
+        case FS_PATH_SELECT_POLICY_IO_QUEUE:
+            return "io_queue";
+        case FS_PATH_SELECT_POLICY_WRITE_LATENCY:
+            return "write_latency";
+        default:
+            return "unkown";
+    }
+}
+
+static int load_trunk_file_prealloc(FSStorageConfig *storage_cfg,
+        const char *storage_filename, IniContext *ini_context)
+{
+    char *prealloc;
+
+    prealloc = iniGetStrValue(NULL, "trunk_file_prealloc", ini_context);
+    if (prealloc == NULL || *prealloc == '\0' ||
+            strcasecmp(prealloc, "fallocate") == 0)
+    {
+        storage_cfg->trunk_file_prealloc = FS_TRUNK_FILE_PREALLOC_FALLOCATE;
+    } else if (strcasecmp(prealloc, "none") == 0) {
+        storage_cfg->trunk_file_prealloc = FS_TRUNK_FILE_PREALLOC_NONE;
+    } else if (strcasecmp(prealloc, "zero") == 0) {
+        storage_cfg->trunk_file_prealloc = FS_TRUNK_FILE_PREALLOC_ZERO;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, item \"trunk_file_prealloc\": %s "
+                "is invalid, expect: none, fallocate or zero",
+                __LINE__, storage_filename, prealloc);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static const char *get_trunk_file_prealloc_caption(const int prealloc)
+{
+    switch (prealloc) {
+        case FS_TRUNK_FILE_PREALLOC_NONE:
+            return "none";
+        case FS_TRUNK_FILE_PREALLOC_FALLOCATE:
+            return "fallocate";
+        case FS_TRUNK_FILE_PREALLOC_ZERO:
+            return "zero";
+        default:
+            return "unkown";
+    }
+}
+
 static int load_global_items(FSStorageConfig *storage_cfg,
         const char *storage_filename, IniContext *ini_context)
 {
     int result;
     char *tf_size;
     char *discard_size;
+    char *lease_size;
     int64_t trunk_file_size;
     int64_t discard_remain_space_size;
+    int64_t space_lease_size;
 
     storage_cfg->fd_cache_capacity_per_read_thread = iniGetIntValue(NULL,
             "fd_cache_capacity_per_read_thread", ini_context, 256);
@@ -217,6 +302,12 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->fd_cache_capacity_per_read_thread = 256;
     }
 
+    storage_cfg->io_stat_log_interval = iniGetIntValue(NULL,
+            "io_stat_log_interval", ini_context, 300);
+    if (storage_cfg->io_stat_log_interval < 0) {
+        storage_cfg->io_stat_log_interval = 0;
+    }
+
     storage_cfg->object_block.hashtable_capacity = iniGetInt64Value(NULL,
             "object_block_hashtable_capacity", ini_context, 1403641);
     if (storage_cfg->object_block.hashtable_capacity <= 0) {
@@ -239,6 +330,12 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->object_block.shared_locks_count = 163;
     }
 
+    if ((result=load_path_select_policy(storage_cfg,
+                    storage_filename, ini_context)) != 0)
+    {
+        return result;
+    }
+
     storage_cfg->write_threads_per_disk = iniGetIntValue(NULL,
             "write_threads_per_disk", ini_context, 1);
     if (storage_cfg->write_threads_per_disk <= 0) {
@@ -257,6 +354,23 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->prealloc_trunks_per_writer = 2;
     }
 
+    storage_cfg->max_prealloc_trunks_per_writer = iniGetIntValue(NULL,
+            "max_prealloc_trunks_per_writer", ini_context,
+            FS_DEFAULT_MAX_PREALLOC_TRUNKS_PER_WRITER);
+    if (storage_cfg->max_prealloc_trunks_per_writer <
+            storage_cfg->prealloc_trunks_per_writer)
+    {
+        storage_cfg->max_prealloc_trunks_per_writer =
+            storage_cfg->prealloc_trunks_per_writer;
+    }
+
+    storage_cfg->prealloc_trunk_ahead_seconds = iniGetIntValue(NULL,
+            "prealloc_trunk_ahead_seconds", ini_context,
+            FS_DEFAULT_PREALLOC_TRUNK_AHEAD_SECONDS);
+    if (storage_cfg->prealloc_trunk_ahead_seconds < 0) {
+        storage_cfg->prealloc_trunk_ahead_seconds = 0;
+    }
+
     storage_cfg->prealloc_trunk_threads = iniGetIntValue(NULL,
             "prealloc_trunk_threads", ini_context, 1);
     if (storage_cfg->prealloc_trunk_threads <= 0) {
@@ -291,6 +405,15 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->trunk_file_size = FS_TRUNK_FILE_MAX_SIZE;
     }
 
+    if ((result=load_trunk_file_prealloc(storage_cfg,
+                    storage_filename, ini_context)) != 0)
+    {
+        return result;
+    }
+
+    storage_cfg->punch_hole_on_delete = iniGetBoolValue(NULL,
+            "punch_hole_on_delete", ini_context, true);
+
     discard_size = iniGetStrValue(NULL, "discard_remain_space_size",
             ini_context);
     if (discard_size == NULL || *discard_size == '\0') {
@@ -322,6 +445,28 @@ static int load_global_items(FSStorageConfig *storage_cfg,
             FS_DISCARD_REMAIN_SPACE_MAX_SIZE;
     }
 
+    lease_size = iniGetStrValue(NULL, "space_lease_size", ini_context);
+    if (lease_size == NULL || *lease_size == '\0') {
+        space_lease_size = FS_DEFAULT_SPACE_LEASE_SIZE;
+    } else if ((result=parse_bytes(lease_size, 1,
+                    &space_lease_size)) != 0) {
+        return result;
+    }
+    if (space_lease_size <= 0) {
+        space_lease_size = 0;  //disabled
+    } else if (space_lease_size < FS_SPACE_LEASE_MIN_SIZE) {
+        logWarning("file: "__FILE__", line: %d, "
+                "space_lease_size: %"PRId64" is too small, set to %d",
+                __LINE__, space_lease_size, FS_SPACE_LEASE_MIN_SIZE);
+        space_lease_size = FS_SPACE_LEASE_MIN_SIZE;
+    } else if (space_lease_size > FS_SPACE_LEASE_MAX_SIZE) {
+        logWarning("file: "__FILE__", line: %d, "
+                "space_lease_size: %"PRId64" is too large, set to %d",
+                __LINE__, space_lease_size, FS_SPACE_LEASE_MAX_SIZE);
+        space_lease_size = FS_SPACE_LEASE_MAX_SIZE;
+    }
+    storage_cfg->space_lease_size = space_lease_size;
+
     if ((result=ini_get_ratio_value(storage_filename, ini_context,
                     NULL, "reserved_space_per_disk", &storage_cfg->
                     reserved_space_per_disk, 0.10)) != 0)
@@ -525,30 +670,44 @@ static void log_paths(FSStoragePathArray *parray, const char *caption)
 
 void storage_config_to_log(FSStorageConfig *storage_cfg)
 {
-    logInfo("storage config, write_threads_per_disk: %d, "
+    logInfo("storage config, path_select_policy: %s, "
+            "write_threads_per_disk: %d, "
             "read_threads_per_disk: %d, "
             "fd_cache_capacity_per_read_thread: %d, "
+            "io_stat_log_interval: %d s, "
             "object_block_hashtable_capacity: %"PRId64", "
             "object_block_shared_locks_count: %d, "
             "prealloc_trunks_per_writer: %d, "
+            "max_prealloc_trunks_per_writer: %d, "
+            "prealloc_trunk_ahead_seconds: %d, "
             "prealloc_trunk_threads: %d, "
             "reserved_space_per_disk: %.2f%%, "
             "trunk_file_size: %d MB, "
+            "trunk_file_prealloc: %s, "
+            "punch_hole_on_delete: %d, "
             "max_trunk_files_per_subdir: %d, "
             "discard_remain_space_size: %d, "
+            "space_lease_size: %d KB, "
             "write_cache_to_hd: { on_usage: %.2f%%, start_time: %02d:%02d, "
             "end_time: %02d:%02d }, reclaim_trunks_on_usage: %.2f%%",
+            get_path_select_policy_caption(storage_cfg->path_select_policy),
             storage_cfg->write_threads_per_disk,
             storage_cfg->read_threads_per_disk,
             storage_cfg->fd_cache_capacity_per_read_thread,
+            storage_cfg->io_stat_log_interval,
             storage_cfg->object_block.hashtable_capacity,
             storage_cfg->object_block.shared_locks_count,
             storage_cfg->prealloc_trunks_per_writer,
+            storage_cfg->max_prealloc_trunks_per_writer,
+            storage_cfg->prealloc_trunk_ahead_seconds,
             storage_cfg->prealloc_trunk_threads,
             storage_cfg->reserved_space_per_disk * 100.00,
             (int)(storage_cfg->trunk_file_size / (1024 * 1024)),
+            get_trunk_file_prealloc_caption(storage_cfg->trunk_file_prealloc),
+            storage_cfg->punch_hole_on_delete,
             storage_cfg->max_trunk_files_per_subdir,
             storage_cfg->discard_remain_space_size,
+            storage_cfg->space_lease_size / 1024,
             storage_cfg->write_cache_to_hd.on_usage * 100.00,
             storage_cfg->write_cache_to_hd.start_time.hour,
             storage_cfg->write_cache_to_hd.start_time.minute,
@@ -5,6 +5,15 @@
 #include "../../common/fs_types.h"
 #include "../server_types.h"
 
+#define FS_PATH_SELECT_POLICY_HASH          'H'  //by block hash code
+#define FS_PATH_SELECT_POLICY_FREE_SPACE    'F'  //weighted by free space
+#define FS_PATH_SELECT_POLICY_IO_QUEUE      'Q'  //least write queue depth
+#define FS_PATH_SELECT_POLICY_WRITE_LATENCY 'L'  //power of two choices
+
+#define FS_TRUNK_FILE_PREALLOC_NONE       'N'  //ftruncate, sparse file
+#define FS_TRUNK_FILE_PREALLOC_FALLOCATE  'F'  //fallocate unwritten extents
+#define FS_TRUNK_FILE_PREALLOC_ZERO       'Z'  //fallocate and fill zeros
+
 typedef struct {
     FSStorePath store;
     int write_thread_count;
@@ -18,6 +27,7 @@ typedef struct {
     struct {
         volatile int64_t total_bytes;
         volatile int64_t used_bytes;
+        volatile int trunk_count;
     } trunk_stat;
 } FSStoragePathInfo;
 
@@ -43,15 +53,22 @@ typedef struct {
         TimeInfo end_time;
     } write_cache_to_hd;
 
+    int path_select_policy;
     int write_threads_per_disk;
     int read_threads_per_disk;
     double reserved_space_per_disk;
     int max_trunk_files_per_subdir;
     int64_t trunk_file_size;
+    int trunk_file_prealloc;
+    bool punch_hole_on_delete;
     int discard_remain_space_size;
+    int space_lease_size;  //the space lease size per allocating thread
     int prealloc_trunks_per_writer;
+    int max_prealloc_trunks_per_writer;
+    int prealloc_trunk_ahead_seconds;  //0 for fixed prealloc count
     int prealloc_trunk_threads;
     int fd_cache_capacity_per_read_thread;
+    int io_stat_log_interval;  //in seconds, 0 for never
     struct {
         int shared_locks_count;
         int64_t hashtable_capacity;
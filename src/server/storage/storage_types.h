@@ -7,6 +7,9 @@
 
 #define FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC  2
 
+//max slices of a physically contiguous run merged into one read IO
+#define FS_MAX_SLICE_COUNT_PER_READ_RUN    16
+
 struct fs_slice_op_context;
 
 typedef void (*fs_slice_op_notify_func)(struct fs_slice_op_context *ctx);
@@ -17,6 +20,35 @@ typedef struct {
     struct ob_slice_entry *slices[FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC];
 } FSSliceFixedArray;
 
+//the spans of the sampled update request
+#define FS_TRACE_MAX_SPANS  16
+
+typedef enum fs_trace_stage {
+    FS_TRACE_STAGE_PARSE = 0,
+    FS_TRACE_STAGE_ALLOC,
+    FS_TRACE_STAGE_IO_QUEUED,
+    FS_TRACE_STAGE_IO_START,
+    FS_TRACE_STAGE_IO_DONE,
+    FS_TRACE_STAGE_INDEX,
+    FS_TRACE_STAGE_BINLOG,
+    FS_TRACE_STAGE_REPL_SENT,
+    FS_TRACE_STAGE_REPL_ACKED,
+    FS_TRACE_STAGE_DONE,
+    FS_TRACE_STAGE_COUNT
+} FSTraceStage;
+
+typedef struct fs_trace_span {
+    int stage;
+    int64_t time_us;
+} FSTraceSpan;
+
+typedef struct fs_trace_context {
+    int trace_id;            //0 for not sampled
+    volatile int span_count; //the spans are added by the IO and RPC threads
+    int64_t start_time_us;
+    FSTraceSpan spans[FS_TRACE_MAX_SPANS];
+} FSTraceContext;
+
 struct fs_cluster_data_server_info;
 typedef struct fs_slice_op_context {
     struct {
@@ -35,6 +67,8 @@ typedef struct fs_slice_op_context {
         FSBlockSliceKeyInfo bs_key;
         struct fs_cluster_data_server_info *myself;
         char *body;
+        int body_len;  //for forwarding of chain replication
+        uint64_t chain_members;  //the replicas after me in the chain
     } info;
 
     struct {
@@ -42,6 +76,7 @@ typedef struct fs_slice_op_context {
         FSSliceFixedArray sarray;
     } write;  //for slice write
 
+    FSTraceContext trace;
 } FSSliceOpContext;
 
 typedef struct fs_slice_op_buffer_context {
@@ -10,14 +10,51 @@
 #include "trunk_prealloc.h"
 #include "trunk_allocator.h"
 
+//the used bytes delta of the thread to merge into the store path
+#define TRUNK_USED_BYTES_MERGE_THRESHOLD  (4 * 1024 * 1024)
+
+//merge the used bytes deltas and return the idle leases by this interval
+#define TRUNK_THREAD_FLUSH_INTERVAL   10
+
+//the lease not allocated from in this seconds is returned
+#define TRUNK_LEASE_IDLE_SECONDS      30
+
+#define TRUNK_LEASE_STATE_IDLE     0
+#define TRUNK_LEASE_STATE_BUSY     1  //the owner or the flush is using it
+
 typedef struct {
     bool allocator_inited;
+    int lease_count;  //the space lease count of each thread
     struct fast_mblock_man trunk_allocator;
     struct fast_mblock_man free_node_allocator;
     UniqSkiplistFactory skiplist_factory;
+    struct {
+        pthread_mutex_t lock;
+        struct fc_list_head head;  //the alloc contexts of the threads
+    } thread_ctxs;
 } TrunkAllocatorGlobalVars;
 
-static TrunkAllocatorGlobalVars g_trunk_allocator_vars = {false};
+/* the space leased from the trunk of the normal freelist,
+ * the owner thread allocates from it without lock */
+typedef struct {
+    FSTrunkAllocator *allocator;
+    FSTrunkFileInfo *trunk_info;
+    int64_t offset;  //current alloc offset
+    int64_t end;     //the end offset of the leased space
+    volatile int state;
+    volatile time_t alloc_time;  //the last alloc time of the owner
+} TrunkSpaceLease;
+
+typedef struct {
+    TrunkSpaceLease *leases;  //index by allocator->lease_base + freelist
+    volatile int64_t *used_deltas;  //index by store path
+    struct fc_list_head dlink;
+} TrunkThreadAllocContext;
+
+static TrunkAllocatorGlobalVars g_trunk_allocator_vars = {false, 0};
+
+//alloced once and never freed, the flush task accesses it
+static __thread TrunkThreadAllocContext *thread_alloc_ctx = NULL;
 
 #define G_TRUNK_ALLOCATOR     g_trunk_allocator_vars.trunk_allocator
 #define G_FREE_NODE_ALLOCATOR g_trunk_allocator_vars.free_node_allocator
@@ -50,6 +87,136 @@ static void trunk_free_func(void *ptr, const int delay_seconds)
     }
 }
 
+static TrunkThreadAllocContext *get_thread_alloc_ctx()
+{
+    TrunkThreadAllocContext *ctx;
+
+    if (thread_alloc_ctx != NULL) {
+        return thread_alloc_ctx;
+    }
+
+    ctx = (TrunkThreadAllocContext *)fc_calloc(1,
+            sizeof(TrunkThreadAllocContext));
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    ctx->leases = (TrunkSpaceLease *)fc_calloc(g_trunk_allocator_vars.
+            lease_count, sizeof(TrunkSpaceLease));
+    ctx->used_deltas = (volatile int64_t *)fc_calloc(STORAGE_CFG.
+            max_store_path_index + 1, sizeof(int64_t));
+    if (ctx->leases == NULL || ctx->used_deltas == NULL) {
+        if (ctx->leases != NULL) {
+            free(ctx->leases);
+        }
+        if (ctx->used_deltas != NULL) {
+            free((void *)ctx->used_deltas);
+        }
+        free(ctx);
+        return NULL;
+    }
+
+    PTHREAD_MUTEX_LOCK(&g_trunk_allocator_vars.thread_ctxs.lock);
+    fc_list_add_tail(&ctx->dlink, &g_trunk_allocator_vars.thread_ctxs.head);
+    PTHREAD_MUTEX_UNLOCK(&g_trunk_allocator_vars.thread_ctxs.lock);
+
+    thread_alloc_ctx = ctx;
+    return ctx;
+}
+
+//give the unused tail back to the trunk when nobody allocated after it
+static inline void return_lease_tail(TrunkSpaceLease *lease)
+{
+    if (lease->trunk_info == NULL) {
+        return;
+    }
+
+    if (lease->trunk_info->status == FS_TRUNK_STATUS_ALLOCING &&
+            lease->trunk_info->free_start == lease->end)
+    {
+        lease->trunk_info->free_start = lease->offset;
+    }
+    lease->trunk_info = NULL;
+}
+
+static void flush_thread_alloc_ctx(TrunkThreadAllocContext *ctx,
+        const time_t current_time)
+{
+    TrunkSpaceLease *lease;
+    TrunkSpaceLease *end;
+    int64_t delta;
+    int i;
+
+    for (i=0; i<=STORAGE_CFG.max_store_path_index; i++) {
+        if (ctx->used_deltas[i] == 0 || i >= STORAGE_CFG.
+                paths_by_index.count || PATHS_BY_INDEX_PPTR[i] == NULL)
+        {
+            continue;
+        }
+
+        if ((delta=__sync_lock_test_and_set(ctx->used_deltas + i, 0)) != 0) {
+            __sync_add_and_fetch(&PATHS_BY_INDEX_PPTR[i]->
+                    trunk_stat.used_bytes, delta);
+        }
+    }
+
+    end = ctx->leases + g_trunk_allocator_vars.lease_count;
+    for (lease=ctx->leases; lease<end; lease++) {
+        if (lease->trunk_info == NULL || current_time - lease->
+                alloc_time < TRUNK_LEASE_IDLE_SECONDS)
+        {
+            continue;
+        }
+
+        //skip the lease in using by the owner
+        if (!__sync_bool_compare_and_swap(&lease->state,
+                    TRUNK_LEASE_STATE_IDLE, TRUNK_LEASE_STATE_BUSY))
+        {
+            continue;
+        }
+
+        if (lease->trunk_info != NULL) {
+            PTHREAD_MUTEX_LOCK(&lease->allocator->lock);
+            return_lease_tail(lease);
+            PTHREAD_MUTEX_UNLOCK(&lease->allocator->lock);
+        }
+        __sync_bool_compare_and_swap(&lease->state,
+                TRUNK_LEASE_STATE_BUSY, TRUNK_LEASE_STATE_IDLE);
+    }
+}
+
+/* merge the used bytes of the idle threads into the store paths,
+ * and return the leases held by the idle threads */
+static int flush_thread_alloc_ctxs_func(void *args)
+{
+    TrunkThreadAllocContext *ctx;
+    time_t current_time;
+
+    current_time = get_current_time();
+    PTHREAD_MUTEX_LOCK(&g_trunk_allocator_vars.thread_ctxs.lock);
+    fc_list_for_each_entry(ctx, &g_trunk_allocator_vars.
+            thread_ctxs.head, dlink)
+    {
+        flush_thread_alloc_ctx(ctx, current_time);
+    }
+    PTHREAD_MUTEX_UNLOCK(&g_trunk_allocator_vars.thread_ctxs.lock);
+    return 0;
+}
+
+static int setup_flush_task()
+{
+    ScheduleEntry schedule_entry;
+    ScheduleArray schedule_array;
+
+    INIT_SCHEDULE_ENTRY(schedule_entry, sched_generate_next_id(),
+            0, 0, 0, TRUNK_THREAD_FLUSH_INTERVAL,
+            flush_thread_alloc_ctxs_func, NULL);
+
+    schedule_array.count = 1;
+    schedule_array.entries = &schedule_entry;
+    return sched_add_entries(&schedule_array);
+}
+
 static void init_freelists(FSTrunkAllocator *allocator)
 {
     FSTrunkFreelistPair *pair;
@@ -58,8 +225,16 @@ static void init_freelists(FSTrunkAllocator *allocator)
     end = allocator->freelists + allocator->path_info->write_thread_count;
     for (pair=allocator->freelists; pair<end; pair++) {
         pair->normal.prealloc_trunks = allocator->path_info->prealloc_trunks;
+        pair->normal.max_prealloc_trunks = FC_MAX(allocator->path_info->
+                prealloc_trunks, STORAGE_CFG.max_prealloc_trunks_per_writer);
+        pair->reclaim.for_reclaim = true;
         pair->reclaim.prealloc_trunks = 2;
+        pair->reclaim.max_prealloc_trunks = 2;
     }
+
+    allocator->stat.blocked_count = 0;
+    allocator->stat.prealloc_trunks = allocator->path_info->
+        prealloc_trunks * allocator->path_info->write_thread_count;
 }
 
 int trunk_allocator_init(FSTrunkAllocator *allocator,
@@ -96,6 +271,17 @@ int trunk_allocator_init(FSTrunkAllocator *allocator,
         {
             return result;
         }
+
+        if ((result=init_pthread_lock(&g_trunk_allocator_vars.
+                        thread_ctxs.lock)) != 0)
+        {
+            return result;
+        }
+        FC_INIT_LIST_HEAD(&g_trunk_allocator_vars.thread_ctxs.head);
+
+        if ((result=setup_flush_task()) != 0) {
+            return result;
+        }
     }
 
     if ((result=init_pthread_lock(&allocator->lock)) != 0) {
@@ -128,6 +314,8 @@ int trunk_allocator_init(FSTrunkAllocator *allocator,
     allocator->priority_array.alloc = allocator->priority_array.count = 0;
     allocator->priority_array.trunks = NULL;
     allocator->path_info = path_info;
+    allocator->lease_base = g_trunk_allocator_vars.lease_count;
+    g_trunk_allocator_vars.lease_count += path_info->write_thread_count;
 
     init_freelists(allocator);
     return 0;
@@ -161,7 +349,12 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
     result = uniq_skiplist_insert(allocator->sl_trunks, trunk_info);
     PTHREAD_MUTEX_UNLOCK(&allocator->lock);
 
-    if (result != 0) {
+    if (result == 0) {
+        __sync_add_and_fetch(&allocator->path_info->
+                trunk_stat.total_bytes, size);
+        __sync_add_and_fetch(&allocator->path_info->
+                trunk_stat.trunk_count, 1);
+    } else {
         logError("file: "__FILE__", line: %d, "
                 "add trunk fail, trunk id: %"PRId64", "
                 "errno: %d, error info: %s", __LINE__,
@@ -178,13 +371,28 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
 int trunk_allocator_delete(FSTrunkAllocator *allocator, const int64_t id)
 {
     FSTrunkFileInfo target;
+    FSTrunkFileInfo *trunk_info;
+    int64_t size;
     int result;
 
     target.id_info.id = id;
     PTHREAD_MUTEX_LOCK(&allocator->lock);
+    if ((trunk_info=(FSTrunkFileInfo *)uniq_skiplist_find(
+                    allocator->sl_trunks, &target)) != NULL)
+    {
+        size = trunk_info->size;
+    } else {
+        size = 0;
+    }
     result = uniq_skiplist_delete(allocator->sl_trunks, &target);
     PTHREAD_MUTEX_UNLOCK(&allocator->lock);
 
+    if (result == 0) {
+        __sync_sub_and_fetch(&allocator->path_info->
+                trunk_stat.total_bytes, size);
+        __sync_sub_and_fetch(&allocator->path_info->
+                trunk_stat.trunk_count, 1);
+    }
     return result;
 }
 
@@ -197,6 +405,111 @@ int trunk_allocator_delete(FSTrunkAllocator *allocator, const int64_t id)
         trunk_info->free_start += alloc_size;  \
     } while (0)
 
+static void prealloc_trunks(FSTrunkAllocator *allocator,
+        FSTrunkFreelist *freelist)
+{
+    int count;
+    int i;
+
+    count = freelist->prealloc_trunks - (freelist->count +
+            __sync_add_and_fetch(&freelist->creating, 0));
+    for (i=0; i<count; i++) {
+        trunk_prealloc_push(allocator, freelist, freelist->prealloc_trunks);
+    }
+}
+
+/* adjust the prealloc target by the trunk consuming rate,
+ * the caller should hold the lock of the allocator */
+static void adjust_prealloc_target(FSTrunkAllocator *allocator,
+        FSTrunkFreelist *freelist)
+{
+    int target;
+
+    if (STORAGE_CFG.prealloc_trunk_ahead_seconds == 0 ||
+            freelist->consume.avg_interval_ms == 0)
+    {
+        return;
+    }
+
+    /* keep the trunks for prealloc_trunk_ahead_seconds at least */
+    target = (STORAGE_CFG.prealloc_trunk_ahead_seconds * 1000LL +
+            freelist->consume.avg_interval_ms - 1) /
+        FC_MAX(freelist->consume.avg_interval_ms, 1);
+    if (target < 1) {
+        target = 1;
+    } else if (target > freelist->max_prealloc_trunks) {
+        target = freelist->max_prealloc_trunks;
+    }
+
+    if (target != freelist->prealloc_trunks) {
+        logDebug("file: "__FILE__", line: %d, "
+                "store path: %s, trunk consuming interval: %"PRId64" ms, "
+                "change prealloc trunks from %d to %d", __LINE__,
+                allocator->path_info->store.path.str,
+                freelist->consume.avg_interval_ms,
+                freelist->prealloc_trunks, target);
+        if (!freelist->for_reclaim) {
+            __sync_add_and_fetch(&allocator->stat.prealloc_trunks,
+                    target - freelist->prealloc_trunks);
+        }
+        freelist->prealloc_trunks = target;
+    }
+}
+
+static inline void add_consume_interval(FSTrunkFreelist *freelist,
+        const int64_t interval)
+{
+    if (freelist->consume.avg_interval_ms == 0) {
+        freelist->consume.avg_interval_ms = interval;
+    } else {  //EWMA with weight 1/4
+        freelist->consume.avg_interval_ms +=
+            (interval - freelist->consume.avg_interval_ms) / 4;
+    }
+}
+
+static void update_prealloc_target(FSTrunkAllocator *allocator,
+        FSTrunkFreelist *freelist)
+{
+    int64_t current_time_ms;
+
+    current_time_ms = get_current_time_ms();
+    if (freelist->consume.last_time_ms > 0) {
+        add_consume_interval(freelist, current_time_ms -
+                freelist->consume.last_time_ms);
+    }
+    freelist->consume.last_time_ms = current_time_ms;
+    adjust_prealloc_target(allocator, freelist);
+}
+
+void trunk_allocator_decay_prealloc_target(FSTrunkAllocator *allocator)
+{
+    FSTrunkFreelistPair *pair;
+    FSTrunkFreelistPair *end;
+    FSTrunkFreelist *freelist;
+    int64_t current_time_ms;
+    int64_t idle_time;
+
+    current_time_ms = get_current_time_ms();
+    PTHREAD_MUTEX_LOCK(&allocator->lock);
+    end = allocator->freelists + allocator->path_info->write_thread_count;
+    for (pair=allocator->freelists; pair<end; pair++) {
+        freelist = &pair->normal;
+        if (freelist->consume.last_time_ms == 0) {
+            continue;
+        }
+
+        /* no trunk consumed for longer than the average interval,
+         * take the idle time as a sample so the target shrinks */
+        idle_time = current_time_ms - freelist->consume.last_time_ms;
+        if (idle_time > freelist->consume.avg_interval_ms) {
+            add_consume_interval(freelist, idle_time);
+            freelist->consume.last_time_ms = current_time_ms;
+            adjust_prealloc_target(allocator, freelist);
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&allocator->lock);
+}
+
 static void remove_trunk_from_freelist(FSTrunkAllocator *allocator,
         FSTrunkFreelist *freelist)
 {
@@ -211,20 +524,8 @@ static void remove_trunk_from_freelist(FSTrunkAllocator *allocator,
     freelist->count--;
 
     fast_mblock_free_object(&G_FREE_NODE_ALLOCATOR, node);
-    trunk_prealloc_push(allocator, freelist, freelist->prealloc_trunks);
-}
-
-static void prealloc_trunks(FSTrunkAllocator *allocator,
-        FSTrunkFreelist *freelist)
-{
-    int count;
-    int i;
-
-    count = freelist->prealloc_trunks - freelist->count;
-    logInfo("%s prealloc count: %d", allocator->path_info->store.path.str, count);
-    for (i=0; i<count; i++) {
-        trunk_prealloc_push(allocator, freelist, freelist->prealloc_trunks);
-    }
+    update_prealloc_target(allocator, freelist);
+    prealloc_trunks(allocator, freelist);
 }
 
 void trunk_allocator_prealloc_trunks(FSTrunkAllocator *allocator)
@@ -305,9 +606,72 @@ void trunk_allocator_array_to_freelists(FSTrunkAllocator *allocator,
     }
 }
 
+static TrunkSpaceLease *get_thread_lease(FSTrunkAllocator *allocator,
+        const int freelist_index)
+{
+    TrunkThreadAllocContext *ctx;
+    TrunkSpaceLease *lease;
+
+    if (STORAGE_CFG.space_lease_size <= 0) {
+        return NULL;
+    }
+
+    if ((ctx=get_thread_alloc_ctx()) == NULL) {
+        return NULL;
+    }
+
+    lease = ctx->leases + allocator->lease_base + freelist_index;
+    //the flush task is returning it
+    if (!__sync_bool_compare_and_swap(&lease->state,
+                TRUNK_LEASE_STATE_IDLE, TRUNK_LEASE_STATE_BUSY))
+    {
+        return NULL;
+    }
+    return lease;
+}
+
+static inline void release_thread_lease(TrunkSpaceLease *lease)
+{
+    lease->alloc_time = get_current_time();
+    __sync_bool_compare_and_swap(&lease->state,
+            TRUNK_LEASE_STATE_BUSY, TRUNK_LEASE_STATE_IDLE);
+}
+
+//lease the space from the head trunk of the freelist
+static void renew_lease(FSTrunkAllocator *allocator,
+        FSTrunkFreelist *freelist, TrunkSpaceLease *lease)
+{
+    FSTrunkFileInfo *trunk_info;
+    int64_t lease_size;
+
+    if (freelist->head == NULL) {
+        return;
+    }
+
+    trunk_info = freelist->head->trunk_info;
+    lease_size = trunk_info->size - trunk_info->free_start;
+    if (lease_size > STORAGE_CFG.space_lease_size) {
+        lease_size = STORAGE_CFG.space_lease_size;
+    }
+    if (lease_size <= 0) {
+        return;
+    }
+
+    lease->allocator = allocator;
+    lease->trunk_info = trunk_info;
+    lease->offset = trunk_info->free_start;
+    lease->end = trunk_info->free_start + lease_size;
+    trunk_info->free_start += lease_size;
+    if (trunk_info->size - trunk_info->free_start <
+            STORAGE_CFG.discard_remain_space_size)
+    {
+        remove_trunk_from_freelist(allocator, freelist);
+    }
+}
+
 static int alloc_space(FSTrunkAllocator *allocator, FSTrunkFreelist *freelist,
-        const uint32_t blk_hc, const int size, FSTrunkSpaceInfo *spaces,
-        int *count, const bool blocked)
+        TrunkSpaceLease *lease, const uint32_t blk_hc, const int size,
+        FSTrunkSpaceInfo *spaces, int *count, const bool blocked)
 {
     int aligned_size;
     int result;
@@ -318,7 +682,30 @@ static int alloc_space(FSTrunkAllocator *allocator, FSTrunkFreelist *freelist,
     aligned_size = MEM_ALIGN(size);
     space_info = spaces;
 
+    //fast path: bump allocate from the thread lease without lock
+    if (lease != NULL && lease->trunk_info != NULL &&
+            lease->end - lease->offset >= aligned_size)
+    {
+        space_info->store = &allocator->path_info->store;
+        space_info->id_info = lease->trunk_info->id_info;
+        space_info->offset = lease->offset;
+        space_info->size = aligned_size;
+        lease->offset += aligned_size;
+        if (lease->end - lease->offset < STORAGE_CFG.
+                discard_remain_space_size)
+        {
+            lease->trunk_info = NULL;
+        }
+
+        *count = 1;
+        return 0;
+    }
+
     PTHREAD_MUTEX_LOCK(&allocator->lock);
+    if (lease != NULL) {
+        return_lease_tail(lease);
+    }
+
     do {
         if (freelist->head != NULL) {
             trunk_info = freelist->head->trunk_info;
@@ -343,6 +730,9 @@ static int alloc_space(FSTrunkAllocator *allocator, FSTrunkFreelist *freelist,
                 result = EAGAIN;
                 break;
             }
+
+            __sync_add_and_fetch(&allocator->stat.blocked_count, 1);
+            prealloc_trunks(allocator, freelist);
             pthread_cond_wait(&allocator->cond, &allocator->lock);
         }
 
@@ -361,6 +751,10 @@ static int alloc_space(FSTrunkAllocator *allocator, FSTrunkFreelist *freelist,
         }
         result = 0;
     } while (0);
+
+    if (result == 0 && lease != NULL) {
+        renew_lease(allocator, freelist, lease);
+    }
     PTHREAD_MUTEX_UNLOCK(&allocator->lock);
 
     *count = space_info - spaces;
@@ -372,11 +766,19 @@ int trunk_allocator_normal_alloc(FSTrunkAllocator *allocator,
         FSTrunkSpaceInfo *spaces, int *count)
 {
     FSTrunkFreelist *freelist;
+    TrunkSpaceLease *lease;
+    int index;
+    int result;
 
-    freelist = &allocator->freelists[blk_hc % allocator->
-        path_info->write_thread_count].normal;
-    return alloc_space(allocator, freelist, blk_hc, size, spaces,
-            count, true);
+    index = blk_hc % allocator->path_info->write_thread_count;
+    freelist = &allocator->freelists[index].normal;
+    lease = get_thread_lease(allocator, index);
+    result = alloc_space(allocator, freelist, lease,
+            blk_hc, size, spaces, count, true);
+    if (lease != NULL) {
+        release_thread_lease(lease);
+    }
+    return result;
 }
 
 int trunk_allocator_reclaim_alloc(FSTrunkAllocator *allocator,
@@ -388,16 +790,16 @@ int trunk_allocator_reclaim_alloc(FSTrunkAllocator *allocator,
 
     freelist = &allocator->freelists[blk_hc % allocator->
         path_info->write_thread_count].normal;
-    if ((result=alloc_space(allocator, freelist, blk_hc, size, spaces,
-                    count, false)) == 0)
+    if ((result=alloc_space(allocator, freelist, NULL, blk_hc, size,
+                    spaces, count, false)) == 0)
     {
         return 0;
     }
 
     freelist = &allocator->freelists[blk_hc % allocator->
         path_info->write_thread_count].reclaim;
-    return alloc_space(allocator, freelist, blk_hc, size, spaces,
-            count, false);
+    return alloc_space(allocator, freelist, NULL, blk_hc, size,
+            spaces, count, false);
 }
 
 static int check_alloc_trunk_ptr_array(FSTrunkInfoPtrArray *parray,
@@ -484,6 +886,35 @@ const FSTrunkInfoPtrArray *trunk_allocator_free_size_top_n(
     return &allocator->priority_array;
 }
 
+/* accumulate the used bytes in the thread counter,
+ * and merge it into the store path stat in batches */
+static void inc_path_used_bytes(FSTrunkAllocator *allocator,
+        const int64_t bytes)
+{
+    TrunkThreadAllocContext *ctx;
+    volatile int64_t *delta;
+    int64_t value;
+
+    if ((ctx=get_thread_alloc_ctx()) == NULL) {
+        __sync_add_and_fetch(&allocator->path_info->
+                trunk_stat.used_bytes, bytes);
+        return;
+    }
+
+    /* the atomic ops on the thread counter are not contended,
+     * the flush task takes the delta of the idle thread */
+    delta = ctx->used_deltas + allocator->path_info->store.index;
+    value = __sync_add_and_fetch(delta, bytes);
+    if (value >= TRUNK_USED_BYTES_MERGE_THRESHOLD ||
+            value <= -TRUNK_USED_BYTES_MERGE_THRESHOLD)
+    {
+        if ((value=__sync_lock_test_and_set(delta, 0)) != 0) {
+            __sync_add_and_fetch(&allocator->path_info->
+                    trunk_stat.used_bytes, value);
+        }
+    }
+}
+
 int trunk_allocator_add_slice(FSTrunkAllocator *allocator, OBSliceEntry *slice)
 {
     int result;
@@ -507,6 +938,10 @@ int trunk_allocator_add_slice(FSTrunkAllocator *allocator, OBSliceEntry *slice)
     }
     PTHREAD_MUTEX_UNLOCK(&allocator->lock);
 
+    if (result == 0) {
+        inc_path_used_bytes(allocator, slice->space.size);
+    }
+
     return result;
 }
 
@@ -534,5 +969,9 @@ int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
     }
     PTHREAD_MUTEX_UNLOCK(&allocator->lock);
 
+    if (result == 0) {
+        inc_path_used_bytes(allocator, -1 * slice->space.size);
+    }
+
     return result;
 }
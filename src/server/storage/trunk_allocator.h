@@ -35,7 +35,14 @@ typedef struct fs_trunk_free_node {
 
 typedef struct {
     int count;
-    int prealloc_trunks;
+    bool for_reclaim;
+    int prealloc_trunks;      //the current target count, dynamic
+    int max_prealloc_trunks;
+    volatile int creating;    //the trunk count in creating
+    struct {
+        int64_t last_time_ms;     //the time of the last trunk consumed
+        int64_t avg_interval_ms;  //EWMA of the trunk consuming interval
+    } consume;
     FSTrunkFreeNode *head;  //allocate from head
     FSTrunkFreeNode *tail;  //push to tail
 } FSTrunkFreelist;
@@ -56,6 +63,14 @@ typedef struct {
     UniqSkiplist *sl_trunks;   //all trunks order by id
     FSTrunkFreelistPair *freelists; //current allocator map to disk write threads
     FSTrunkInfoPtrArray priority_array;  //for trunk reclaim
+    int lease_base;  //the base index of the thread space leases
+    struct {
+        //the times of the writers blocked on the empty freelists
+        volatile int64_t blocked_count;
+
+        //the sum of the prealloc targets of the normal freelists
+        volatile int prealloc_trunks;
+    } stat;  //updated under the lock, read lock free
     pthread_mutex_t lock;
     pthread_cond_t cond;
 } FSTrunkAllocator;
@@ -98,6 +113,21 @@ extern "C" {
 
     void trunk_allocator_prealloc_trunks(FSTrunkAllocator *allocator);
 
+    static inline int64_t trunk_allocator_get_blocked_count(
+            FSTrunkAllocator *allocator)
+    {
+        return __sync_add_and_fetch(&allocator->stat.blocked_count, 0);
+    }
+
+    static inline int trunk_allocator_get_prealloc_trunks(
+            FSTrunkAllocator *allocator)
+    {
+        return __sync_add_and_fetch(&allocator->stat.prealloc_trunks, 0);
+    }
+
+    //shrink the prealloc target of the idle freelists
+    void trunk_allocator_decay_prealloc_target(FSTrunkAllocator *allocator);
+
     //to find freelist when startup 
     const FSTrunkInfoPtrArray *trunk_allocator_free_size_top_n(
             FSTrunkAllocator *allocator, const int count);
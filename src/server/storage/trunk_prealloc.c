@@ -58,6 +58,7 @@ int trunk_prealloc_push(FSTrunkAllocator *allocator,
             notify = false;
         }
         ctx->tail = task;
+        __sync_add_and_fetch(&freelist->creating, 1);
     } else {
         result = ENOMEM;
         notify = false;
@@ -70,6 +71,17 @@ int trunk_prealloc_push(FSTrunkAllocator *allocator,
     return result;
 }
 
+static void trunk_prealloc_task_finish(TrunkPreallocTask *task)
+{
+    TrunkPreallocThreadContext *ctx;
+
+    ctx = task->ctx;
+    __sync_sub_and_fetch(&task->freelist->creating, 1);
+    PTHREAD_MUTEX_LOCK(&ctx->lock);
+    fast_mblock_free_object(&ctx->mblock, task);
+    PTHREAD_MUTEX_UNLOCK(&ctx->lock);
+}
+
 static void create_trunk_done(struct trunk_io_buffer *record,
         const int result)
 {
@@ -86,7 +98,7 @@ static void create_trunk_done(struct trunk_io_buffer *record,
                     task->freelist, trunk_info);
         }
     }
-    fast_mblock_free_object(&task->ctx->mblock, task);
+    trunk_prealloc_task_finish(task);
 }
 
 static int trunk_prealloc_deal_task(TrunkPreallocTask *task)
@@ -96,6 +108,7 @@ static int trunk_prealloc_deal_task(TrunkPreallocTask *task)
     string_t data;
 
     if (task->freelist->count >= task->target_count) {
+        trunk_prealloc_task_finish(task);
         return 0;
     }
 
@@ -158,6 +171,7 @@ static void *trunk_prealloc_thread_func(void *arg)
         if (trunk_prealloc_deal_task(task) != 0) {
             logError("file: "__FILE__", line: %d, "
                     "trunk_prealloc_deal_task fail", __LINE__);
+            trunk_prealloc_task_finish(task);
         }
     }
 
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/sched_thread.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "../replication/rpc_result_ring.h"
+
+#define BENCH_ORDER_SEQUENTIAL  0
+#define BENCH_ORDER_SHUFFLED    1
+#define BENCH_ORDER_ONE_SLOW    2
+
+static int acked_count = 0;
+
+/* no upstream in this benchmark, the ack is counted only */
+int replication_callee_push_to_rpc_result_queue(FSReplication *replication,
+        const int data_group_id, const uint64_t data_version,
+        const int err_no)
+{
+    ++acked_count;
+    return 0;
+}
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-n total_count=1000000] "
+            "[-w window_size=4096] [-g data_group_count=64]\n", argv[0]);
+}
+
+static void shuffle(uint64_t *versions, const int count)
+{
+    uint64_t tmp;
+    int i;
+    int j;
+
+    for (i=count-1; i>0; i--) {
+        j = rand() % (i + 1);
+        tmp = versions[i];
+        versions[i] = versions[j];
+        versions[j] = tmp;
+    }
+}
+
+/* the acks of the slow replica arrive after the window is full,
+ * the others in order */
+static void delay_one_in_eight(uint64_t *versions, const int count)
+{
+    uint64_t *tmp;
+    int i;
+    int k;
+
+    tmp = (uint64_t *)fc_malloc(sizeof(uint64_t) * count);
+    k = 0;
+    for (i=0; i<count; i++) {
+        if (i % 8 != 0) {
+            tmp[k++] = versions[i];
+        }
+    }
+    for (i=0; i<count; i+=8) {
+        tmp[k++] = versions[i];
+    }
+    memcpy(versions, tmp, sizeof(uint64_t) * count);
+    free(tmp);
+}
+
+static int bench(FSReplicaRPCResultContext *ctx, const int order,
+        const int total_count, const int window_size,
+        const int group_count, const char *caption)
+{
+    uint64_t *versions;
+    uint64_t data_version;
+    int64_t start_time;
+    int64_t time_used;
+    int result;
+    int done;
+    int count;
+    int i;
+
+    versions = (uint64_t *)fc_malloc(sizeof(uint64_t) * window_size);
+    if (versions == NULL) {
+        return ENOMEM;
+    }
+
+    data_version = 0;
+    start_time = get_current_time_us();
+    for (done=0; done<total_count; done+=count) {
+        count = FC_MIN(window_size, total_count - done);
+        for (i=0; i<count; i++) {
+            versions[i] = ++data_version;
+            if ((result=rpc_result_ring_add_ex(ctx, data_version, NULL, 0,
+                            NULL, data_version % group_count + 1, 0)) != 0)
+            {
+                return result;
+            }
+        }
+
+        if (order == BENCH_ORDER_SHUFFLED) {
+            shuffle(versions, count);
+        } else if (order == BENCH_ORDER_ONE_SLOW) {
+            delay_one_in_eight(versions, count);
+        }
+
+        for (i=0; i<count; i++) {
+            if ((result=rpc_result_ring_remove(ctx, versions[i] %
+                            group_count + 1, versions[i])) != 0)
+            {
+                fprintf(stderr, "remove data version %"PRId64" fail, "
+                        "errno: %d\n", versions[i], result);
+                return result;
+            }
+        }
+    }
+    time_used = get_current_time_us() - start_time;
+
+    printf("%-10s total: %d, time used: %"PRId64" ms, "
+            "add + remove: %.1f ns per rpc\n", caption, total_count,
+            time_used / 1000, (double)time_used * 1000 / total_count);
+    free(versions);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    FSReplicaRPCResultContext ctx;
+    FSReplicationWindow window;
+    int total_count;
+    int window_size;
+    int group_count;
+    int result;
+    int ch;
+
+    total_count = 1000000;
+    window_size = 4096;
+    group_count = 64;
+    while ((ch=getopt(argc, argv, "hn:w:g:")) != -1) {
+        switch (ch) {
+            case 'n':
+                total_count = atoi(optarg);
+                break;
+            case 'w':
+                window_size = atoi(optarg);
+                break;
+            case 'g':
+                group_count = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+    if (total_count <= 0 || window_size <= 0 || group_count <= 0) {
+        usage(argv);
+        return 1;
+    }
+
+    log_init();
+    srand(time(NULL));
+    g_current_time = time(NULL);
+    g_sf_global_vars.network_timeout = 10;
+    REPLICA_WINDOW_MAX_COUNT = window_size;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&window, 0, sizeof(window));
+    if ((result=rpc_result_ring_check_init(&ctx, window_size)) != 0) {
+        return result;
+    }
+    ctx.window = &window;
+
+    if ((result=bench(&ctx, BENCH_ORDER_SEQUENTIAL, total_count,
+                    window_size, group_count, "in order")) != 0)
+    {
+        return result;
+    }
+    if ((result=bench(&ctx, BENCH_ORDER_SHUFFLED, total_count,
+                    window_size, group_count, "shuffled")) != 0)
+    {
+        return result;
+    }
+    if ((result=bench(&ctx, BENCH_ORDER_ONE_SLOW, total_count,
+                    window_size, group_count, "one slow")) != 0)
+    {
+        return result;
+    }
+
+    rpc_result_ring_destroy(&ctx);
+    return 0;
+}